@@ -25,6 +25,15 @@ void common_init();
  */
 uint32_t millis();
 
+/**
+ * @brief Gets the time with microsecond resolution.
+ * 
+ * Derived from the millisecond counter and the SysTick counter value.
+ * 
+ * @return number of microseconds since a fixed time in the past
+ */
+uint32_t micros();
+
 /**
  * @brief Delays execution (busy wait)
  * @param ms delay length, in milliseconds
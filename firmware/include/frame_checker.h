@@ -0,0 +1,89 @@
+/*
+ * USB Serial
+ * 
+ * Copyright (c) 2026 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Checker for COBS and SLIP frames received via UART
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/**
+ * @brief Frame encodings
+ */
+enum class frame_encoding : uint8_t
+{
+    /// Consistent Overhead Byte Stuffing (delimiter 0x00)
+    cobs = 1,
+    /// Serial Line Internet Protocol, RFC 1055 (delimiter 0xc0)
+    slip = 2
+};
+
+
+/**
+ * @brief Decodes a frame and checks its CRC.
+ *
+ * The encoded bytes of the frame (excluding the delimiter) are passed
+ * one by one. The decoded frame consists of the payload followed by a
+ * CRC-16/CCITT-FALSE checksum of the payload (polynomial 0x1021, initial
+ * value 0xffff, most significant byte first). The frame is valid if it is
+ * correctly encoded and the CRC over the entire decoded frame is 0.
+ */
+class frame_checker
+{
+public:
+    /**
+     * @brief Resets the checker for a new frame.
+     *
+     * @param encoding frame encoding
+     */
+    void reset(frame_encoding encoding);
+
+    /**
+     * @brief Adds the next encoded byte of the frame.
+     *
+     * @param b encoded byte (not the delimiter)
+     */
+    void add(uint8_t b);
+
+    /**
+     * @brief Indicates if the frame is valid.
+     *
+     * Called after all encoded bytes of the frame have been added.
+     *
+     * @return `true` if the frame is correctly encoded, contains at least the CRC and the CRC matches
+     */
+    bool is_valid();
+
+    /// Delimiter of the specified encoding
+    static uint8_t delimiter(frame_encoding encoding) { return encoding == frame_encoding::cobs ? 0x00 : 0xc0; }
+
+    /**
+     * @brief Updates a CRC-16/CCITT-FALSE checksum.
+     *
+     * @param crc CRC of the previous data (0xffff initially)
+     * @param b next byte
+     * @return updated CRC
+     */
+    static uint16_t update_crc(uint16_t crc, uint8_t b);
+
+private:
+    void add_decoded(uint8_t b);
+
+    frame_encoding encoding;
+    uint16_t crc;
+    uint32_t decoded_len;
+    bool is_malformed;
+
+    // COBS: remaining bytes of the current block and its code
+    uint8_t block_remaining;
+    uint8_t block_code;
+    // SLIP: previous byte was the escape character
+    bool is_escaped;
+};
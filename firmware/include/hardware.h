@@ -1,168 +1,316 @@
 /*
  * USB Serial
- * 
+ *
  * Copyright (c) 2020 Manuel Bleichenbacher
  * Licensed under MIT License
  * https://opensource.org/licenses/MIT
- * 
+ *
  * Hardware defintions
  */
 
 #pragma once
 
-// --- USB pins and clocks
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
 
-#if defined(STM32F0)
-
-#define USB_DP_PORT GPIOA
-#define USB_DP_PIN GPIO12
-#define USB_PORT_RCC RCC_GPIOA
-
-#elif defined(STM32F1)
-
-#define USB_DP_PORT GPIOA
-#define USB_DP_PIN GPIO12
-#define USB_PORT_RCC RCC_GPIOA
+/**
+ * @brief GPIO pin configuration
+ *
+ * The configurations are mapped to the MCU family specific modes
+ * by `board_gpio_configure()`.
+ */
+enum class pin_mode {
+    /// Push-pull output, high speed
+    output,
+    /// Push-pull output, medium speed
+    output_medium_speed,
+    /// Push-pull output, low speed
+    output_low_speed,
+    /// Input with pull-down resistor
+    input_pulldown,
+    /// Alternate function output (e.g. USART TX)
+    alt_output,
+    /// Alternate function input (e.g. USART RX)
+    alt_input,
+    /// Alternate function input with pull-down resistor
+    alt_input_pulldown,
+};
+
+/**
+ * @brief Configures the mode of GPIO pins.
+ *
+ * @param port GPIO port
+ * @param pins GPIO pins (bit mask)
+ * @param mode pin configuration
+ */
+void board_gpio_configure(uint32_t port, uint16_t pins, pin_mode mode);
 
+#if defined(STM32F1)
+// GPIO registers can be accessed through the bit-band alias region (Cortex-M3)
+constexpr bool GPIO_HAS_BITBAND = true;
+constexpr uint32_t GPIO_IDR_OFFSET = 0x08;
+constexpr uint32_t GPIO_ODR_OFFSET = 0x0c;
 #else
-
-#error "This code doesn't support this target!"
-
+constexpr bool GPIO_HAS_BITBAND = false;
+constexpr uint32_t GPIO_IDR_OFFSET = 0;
+constexpr uint32_t GPIO_ODR_OFFSET = 0;
 #endif
 
-// --- USART pins and clocks
+/**
+ * @brief GPIO pin descriptor.
+ *
+ * The pin is accessed with inlined register writes (BSRR, or the bit-band
+ * alias of ODR if available) and reads (IDR) instead of calls of the
+ * libopencm3 functions. Each access is a single load or store.
+ *
+ * @tparam Port GPIO port
+ * @tparam Pin GPIO pin (bit mask)
+ * @tparam Rcc clock of GPIO port
+ * @tparam Mode pin configuration
+ * @tparam ActiveLow `true` if the signal is asserted when the pin is low
+ */
+template <uint32_t Port, uint16_t Pin, enum rcc_periph_clken Rcc, pin_mode Mode, bool ActiveLow = false>
+struct gpio_pin
+{
+    static constexpr uint32_t port = Port;
+    static constexpr uint16_t pin = Pin;
+    static constexpr int bit = __builtin_ctz(Pin);
+
+    /// Enables the clock of the GPIO port
+    static void enable_clock() { rcc_periph_clock_enable(Rcc); }
+
+    /// Configures the pin mode
+    static void configure() { board_gpio_configure(Port, Pin, Mode); }
+
+    /// Sets the pin to high
+    static inline void set() { GPIO_BSRR(Port) = Pin; }
+
+    /// Sets the pin to low
+    static inline void clear() { GPIO_BSRR(Port) = (uint32_t)Pin << 16; }
+
+    /// Sets the pin to the specified level
+    static inline void write(bool high)
+    {
+        if (GPIO_HAS_BITBAND)
+            BBIO_PERIPH(Port + GPIO_ODR_OFFSET, bit) = high;
+        else
+            GPIO_BSRR(Port) = (uint32_t)Pin << (high ? 0 : 16);
+    }
+
+    /// Toggles the pin
+    static inline void toggle() { GPIO_BSRR(Port) = (GPIO_ODR(Port) & Pin) != 0 ? (uint32_t)Pin << 16 : Pin; }
+
+    /// Returns if the input pin is high
+    static inline bool get()
+    {
+        if (GPIO_HAS_BITBAND)
+            return BBIO_PERIPH(Port + GPIO_IDR_OFFSET, bit) != 0;
+        else
+            return (GPIO_IDR(Port) & Pin) != 0;
+    }
+
+    /// Asserts or deasserts the signal (taking into account if it is active low)
+    static inline void set_active(bool active) { write(active != ActiveLow); }
+
+    /// Returns if the input signal is asserted (taking into account if it is active low)
+    static inline bool is_active() { return get() != ActiveLow; }
+};
+
+/**
+ * @brief Output signal with cached state.
+ *
+ * The pin is only written if the state changes. Intended for outputs
+ * that are updated in the main loop (LEDs, RTS).
+ *
+ * @tparam Pin GPIO pin descriptor (`gpio_pin`)
+ */
+template <class Pin>
+class cached_output
+{
+public:
+    /**
+     * @brief Sets the initial state.
+     *
+     * @param active `true` if the signal is asserted
+     */
+    void init(bool active)
+    {
+        state = active;
+        Pin::set_active(active);
+    }
+
+    /**
+     * @brief Asserts or deasserts the signal if the state has changed.
+     *
+     * @param active `true` if the signal is asserted
+     */
+    inline void set_active(bool active)
+    {
+        if (active == state)
+            return;
+        state = active;
+        Pin::set_active(active);
+    }
+
+    /// Returns if the signal is asserted
+    bool is_active() const { return state; }
+
+private:
+    bool state;
+};
+
 
 #if defined(STM32F0)
 
-#define USART USART2
-#define USART_RX_DATA_REG USART2_RDR
-#define USART_TX_DATA_REG USART2_TDR
-#define USART_PORT GPIOA
-#define USART_TX_GPIO GPIO2
-#if defined(STM32F042F6)
-#define USART_RX_GPIO GPIO3
-#else
-#define USART_RX_GPIO GPIO15
-#endif
-#define USART_RCC RCC_USART2
+/// Peripherals and pins common to all STM32F042 boards
+struct board_stm32f042
+{
+    // --- USB pins and clocks
 
-#elif defined(STM32F1)
+    typedef gpio_pin<GPIOA, GPIO12, RCC_GPIOA, pin_mode::output_medium_speed> usb_dp;
 
-#define USART USART2
-#define USART_RX_DATA_REG USART2_DR
-#define USART_TX_DATA_REG USART2_DR
-#define USART_PORT GPIOA
-#define USART_TX_GPIO GPIO2
-#define USART_RX_GPIO GPIO3
-#define USART_RCC RCC_USART2
+    // --- USART and clocks
 
-#endif
+    static constexpr uint32_t usart = USART2;
+    static constexpr enum rcc_periph_clken usart_rcc = RCC_USART2;
+    static volatile uint32_t* usart_rx_data_reg() { return &USART2_RDR; }
+    static volatile uint32_t* usart_tx_data_reg() { return &USART2_TDR; }
 
-// --- USART DMA channels and clocks
+    // Alternate function of all USART pins
+    static constexpr uint8_t usart_gpio_af = GPIO_AF1;
 
-#if defined(STM32F0)
+    typedef gpio_pin<GPIOA, GPIO2, RCC_GPIOA, pin_mode::alt_output> usart_tx;
 
-#define USART_DMA DMA1
-#define USART_DMA_TX_CHAN 4
-#define USART_DMA_RX_CHAN 5
-#define USART_DMA_RCC RCC_DMA
+    // --- USART DMA channels and clocks
 
-#elif defined(STM32F1)
+    static constexpr uint32_t usart_dma = DMA1;
+    static constexpr uint8_t usart_dma_tx_chan = 4;
+    static constexpr uint8_t usart_dma_rx_chan = 5;
+    static constexpr enum rcc_periph_clken usart_dma_rcc = RCC_DMA;
 
-#define USART_DMA DMA1
-#define USART_DMA_TX_CHAN 7
-#define USART_DMA_RX_CHAN 6
-#define USART_DMA_RCC RCC_DMA1
+    // --- Additional RS-232 pins
 
-#endif
+    typedef gpio_pin<GPIOA, GPIO5, RCC_GPIOA, pin_mode::output, true> dtr;
+    typedef gpio_pin<GPIOB, GPIO1, RCC_GPIOB, pin_mode::input_pulldown, true> dsr;
+    typedef gpio_pin<GPIOA, GPIO4, RCC_GPIOA, pin_mode::input_pulldown, true> dcd;
+    typedef gpio_pin<GPIOA, GPIO1, RCC_GPIOA, pin_mode::output, true> rts;
+    typedef gpio_pin<GPIOA, GPIO0, RCC_GPIOA, pin_mode::alt_input_pulldown> cts;
 
-// --- Additional RS-232 pins
+    // --- LED pins and clocks
 
-#if defined(STM32F0)
+    typedef gpio_pin<GPIOA, GPIO6, RCC_GPIOA, pin_mode::output_low_speed> led_rx;
+    typedef gpio_pin<GPIOA, GPIO7, RCC_GPIOA, pin_mode::output_low_speed> led_tx;
+};
 
-#define DTR_PORT_RCC RCC_GPIOA
-#define DTR_PORT GPIOA
-#define DTR_PIN GPIO5
+/// Board with STM32F042F6 (TSSOP20)
+struct board_stm32f042f6 : board_stm32f042
+{
+    // PA11/PA12 must be remapped to the USB pins
+    static constexpr bool usb_pin_remap = true;
 
-#define DSR_PORT_RCC RCC_GPIOB
-#define DSR_PORT GPIOB
-#define DSR_PIN GPIO1
+    typedef gpio_pin<GPIOA, GPIO3, RCC_GPIOA, pin_mode::alt_input> usart_rx;
+    typedef gpio_pin<GPIOF, GPIO0, RCC_GPIOF, pin_mode::output_low_speed> led_power;
+};
 
-#define DCD_PORT_RCC RCC_GPIOA
-#define DCD_PORT GPIOA
-#define DCD_PIN GPIO4
+/// Nucleo board with STM32F042K6
+struct board_nucleo_f042k6 : board_stm32f042
+{
+    static constexpr bool usb_pin_remap = false;
 
-#define RTS_PORT_RCC RCC_GPIOA
-#define RTS_PORT GPIOA
-#define RTS_PIN GPIO1
+    typedef gpio_pin<GPIOA, GPIO15, RCC_GPIOA, pin_mode::alt_input> usart_rx;
+    typedef gpio_pin<GPIOB, GPIO3, RCC_GPIOB, pin_mode::output_low_speed> led_power;
+};
 
-#define CTS_PORT_RCC RCC_GPIOA
-#define CTS_PORT GPIOA
-#define CTS_PIN GPIO0
+#if defined(STM32F042F6)
+typedef board_stm32f042f6 board;
+#else
+typedef board_nucleo_f042k6 board;
+#endif
 
 #elif defined(STM32F1)
 
-#define DTR_PORT_RCC RCC_GPIOA
-#define DTR_PORT GPIOA
-#define DTR_PIN GPIO4
-
-#define DSR_PORT_RCC RCC_GPIOA
-#define DSR_PORT GPIOA
-#define DSR_PIN GPIO5
+/// Board with STM32F103C8 ("blue pill")
+struct board_stm32f103c8
+{
+    // --- USB pins and clocks
 
-#define DCD_PORT_RCC RCC_GPIOB
-#define DCD_PORT GPIOB
-#define DCD_PIN GPIO1
+    typedef gpio_pin<GPIOA, GPIO12, RCC_GPIOA, pin_mode::output_medium_speed> usb_dp;
 
-#define RTS_PORT_RCC RCC_GPIOA
-#define RTS_PORT GPIOA
-#define RTS_PIN GPIO1
+    // --- USART and clocks
 
-#define CTS_PORT_RCC RCC_GPIOA
-#define CTS_PORT GPIOA
-#define CTS_PIN GPIO0
+    static constexpr uint32_t usart = USART2;
+    static constexpr enum rcc_periph_clken usart_rcc = RCC_USART2;
+    static volatile uint32_t* usart_rx_data_reg() { return &USART2_DR; }
+    static volatile uint32_t* usart_tx_data_reg() { return &USART2_DR; }
 
-#endif
+    typedef gpio_pin<GPIOA, GPIO2, RCC_GPIOA, pin_mode::alt_output> usart_tx;
+    typedef gpio_pin<GPIOA, GPIO3, RCC_GPIOA, pin_mode::alt_input> usart_rx;
 
-// --- LED pins and clocks
+    // --- USART DMA channels and clocks
 
-#if defined(STM32F0)
+    static constexpr uint32_t usart_dma = DMA1;
+    static constexpr uint8_t usart_dma_tx_chan = 7;
+    static constexpr uint8_t usart_dma_rx_chan = 6;
+    static constexpr enum rcc_periph_clken usart_dma_rcc = RCC_DMA1;
 
-#if defined(STM32F042F6)
+    // --- Additional RS-232 pins
 
-#define LED_POWER_PORT_RCC RCC_GPIOF
-#define LED_POWER_PORT GPIOF
-#define LED_POWER_PIN GPIO0
-
-#else
+    typedef gpio_pin<GPIOA, GPIO4, RCC_GPIOA, pin_mode::output, true> dtr;
+    typedef gpio_pin<GPIOA, GPIO5, RCC_GPIOA, pin_mode::input_pulldown, true> dsr;
+    typedef gpio_pin<GPIOB, GPIO1, RCC_GPIOB, pin_mode::input_pulldown, true> dcd;
+    typedef gpio_pin<GPIOA, GPIO1, RCC_GPIOA, pin_mode::output, true> rts;
+    typedef gpio_pin<GPIOA, GPIO0, RCC_GPIOA, pin_mode::alt_input_pulldown> cts;
 
-#define LED_POWER_PORT_RCC RCC_GPIOB
-#define LED_POWER_PORT GPIOB
-#define LED_POWER_PIN GPIO3
+    // --- LED pins and clocks
 
-#endif
+    typedef gpio_pin<GPIOC, GPIO13, RCC_GPIOC, pin_mode::output_low_speed, true> led_power;
+    typedef gpio_pin<GPIOA, GPIO6, RCC_GPIOA, pin_mode::output_low_speed> led_rx;
+    typedef gpio_pin<GPIOA, GPIO7, RCC_GPIOA, pin_mode::output_low_speed> led_tx;
+};
 
-#define LED_RX_PORT_RCC RCC_GPIOA
-#define LED_RX_PORT GPIOA
-#define LED_RX_PIN GPIO6
+typedef board_stm32f103c8 board;
 
-#define LED_TX_PORT_RCC RCC_GPIOA
-#define LED_TX_PORT GPIOA
-#define LED_TX_PIN GPIO7
+#else
 
-#elif defined(STM32F1)
+#error "This code doesn't support this target!"
 
-#define LED_POWER_PORT_RCC RCC_GPIOC
-#define LED_POWER_PORT GPIOC
-#define LED_POWER_PIN GPIO13
-#define LED_POWER_REVERSED
+#endif
 
-#define LED_RX_PORT_RCC RCC_GPIOA
-#define LED_RX_PORT GPIOA
-#define LED_RX_PIN GPIO6
 
-#define LED_TX_PORT_RCC RCC_GPIOA
-#define LED_TX_PORT GPIOA
-#define LED_TX_PIN GPIO7
+/**
+ * @brief Initializes the system clock and configures SysTick for 1ms interrupts.
+ */
+void board_init_clock();
 
-#endif
+/**
+ * @brief Enables and configures the USB peripheral clock (and pin remapping if needed).
+ */
+void board_init_usb_clock();
+
+/**
+ * @brief Sets the baud rate register of the USART.
+ *
+ * Uses the highest oversampling mode applicable to the baud rate.
+ * Limits the baud rate if set too high or too low.
+ *
+ * @param baud baud rate (in bps)
+ * @return effective baud rate (in bps)
+ */
+int board_usart_set_baudrate(int baud);
+
+/// Parity error flag (see `board_usart_take_rx_errors()`)
+constexpr uint32_t USART_RX_ERROR_PARITY = 1;
+/// Framing error flag (see `board_usart_take_rx_errors()`)
+constexpr uint32_t USART_RX_ERROR_FRAMING = 2;
+
+/**
+ * @brief Gets and clears the receive error flags of the USART.
+ *
+ * The flags are set when a character with a parity or framing error is
+ * received. They are cleared without interfering with the RX DMA.
+ *
+ * @return error flags (bit mask of `USART_RX_ERROR_PARITY` and `USART_RX_ERROR_FRAMING`)
+ */
+uint32_t board_usart_take_rx_errors();
@@ -0,0 +1,121 @@
+/*
+ * USB Serial
+ * 
+ * Copyright (c) 2026 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Verifier for data received via UART
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/**
+ * @brief Verifies received data against a pseudo random stream.
+ *
+ * The stream is the same as generated by the loopback test
+ * (see `test/loopback-linux/prng.hpp`): the 32-bit word with index `i`
+ * is a hash of `i` and the seed, and byte `n` of the stream is byte `n % 4`
+ * (little endian) of word `n / 4`.
+ *
+ * Mismatching bytes are counted in total and per bit position. After several
+ * consecutive mismatches or after data has been discarded, the verifier
+ * searches the received data in the stream ahead of the current position and
+ * at the start of the stream (new test run) to resynchronize. Bytes received
+ * while not synchronized are not checked.
+ */
+class rx_verifier
+{
+public:
+    /**
+     * @brief Resets the verifier to the start of the stream.
+     *
+     * @param seed initial value of the pseudo random number generator
+     */
+    void reset(uint32_t seed);
+
+    /**
+     * @brief Checks the received data against the stream.
+     *
+     * @param data pointer to byte array
+     * @param len length of byte array
+     * @param mask mask applied to each expected byte (0x7f for 7 data bits)
+     */
+    void verify(const uint8_t *data, size_t len, uint8_t mask);
+
+    /**
+     * @brief Called when received data has been discarded (e.g. overrun).
+     *
+     * The verifier will resynchronize with the next received data.
+     */
+    void on_data_lost();
+
+    /// Number of bytes checked against the stream
+    uint32_t num_bytes() { return _num_bytes; }
+
+    /// Number of checked bytes not matching the stream
+    uint32_t num_errors() { return _num_errors; }
+
+    /// Stream position of the first mismatching byte (0xffffffff if none)
+    uint32_t first_error_pos() { return _first_error_pos; }
+
+    /// Number of times the synchronization with the stream has been lost
+    uint32_t num_sync_losses() { return _num_sync_losses; }
+
+    /**
+     * @brief Gets the number of mismatches of the specified bit.
+     *
+     * @param bit bit position (0 to 7)
+     * @return number of received bytes with a wrong value of the bit
+     */
+    uint32_t num_bit_errors(int bit) { return _num_bit_errors[bit]; }
+
+private:
+    /// Advances the stream position by the specified number of bytes
+    void advance(size_t n);
+
+    /**
+     * @brief Searches the stream for the specified data to resynchronize.
+     *
+     * If found, the stream position is set to the start of the data.
+     *
+     * @param data 4 received bytes
+     * @param mask mask applied to each expected byte
+     * @return `true` if the data has been found
+     */
+    bool resync(const uint8_t *data, uint8_t mask);
+
+    /**
+     * @brief Searches a window of the stream for the specified data.
+     *
+     * If found, the stream position is set to the start of the data.
+     *
+     * @param data 4 received bytes
+     * @param mask mask applied to each expected byte
+     * @param index word index of the start of the window
+     * @param offset byte offset within the word of the start of the window
+     * @return `true` if the data has been found
+     */
+    bool search(const uint8_t *data, uint8_t mask, uint32_t index, int offset);
+
+    uint32_t seed;
+
+    // Stream position: word index and byte offset within word
+    uint32_t word_index;
+    int byte_offset;
+    // Word with index `word_index`
+    uint32_t word;
+
+    bool is_synced;
+    int consecutive_errors;
+
+    uint32_t _num_bytes;
+    uint32_t _num_errors;
+    uint32_t _first_error_pos;
+    uint32_t _num_sync_losses;
+    uint32_t _num_bit_errors[8];
+};
@@ -0,0 +1,44 @@
+/*
+ * USB Serial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Flow control and buffering parameters
+ */
+
+#pragma once
+
+/**
+ * @brief List of tuning parameters (type, name, default value).
+ *
+ * On the target, the parameters are compile-time constants. If `FW_TUNABLE`
+ * is defined (host-side simulation), they are variables defined by the
+ * simulator so parameter sweeps can be run without recompiling.
+ */
+#define FW_TUNING_PARAMS(PARAM) \
+    /* Time worth of data that still fits into the UART RX buffer when RTS is deasserted (in ms) */ \
+    PARAM(int, RX_HIGH_WATER_MARGIN_MS, 5) \
+    /* Free space in UART TX buffer below which USB OUT packets are NAKed (in bytes) */ \
+    PARAM(int, TX_NAK_HIGH_WATER, 128) \
+    /* Time worth of data transmitted in a single TX DMA chunk (in ms) */ \
+    PARAM(int, TX_CHUNK_TIME_MS, 1) \
+    /* Minimum size of TX DMA chunk (in bytes) */ \
+    PARAM(int, TX_CHUNK_MIN_SIZE, 16) \
+    /* Maximum size of TX DMA chunk (in bytes) */ \
+    PARAM(int, TX_CHUNK_MAX_SIZE, 256) \
+    /* Maximum time to hold back data for transmission over USB (in ms) */ \
+    PARAM(int, TX_HOLDBACK_MAX_TIME, 3) \
+    /* Maximum number of bytes to hold back for transmission over USB */ \
+    PARAM(int, TX_HOLDBACK_MAX_LEN, 16)
+
+#if defined(FW_TUNABLE)
+#define FW_TUNING_DECLARE(type, name, value) extern type name;
+#else
+#define FW_TUNING_DECLARE(type, name, value) constexpr type name = value;
+#endif
+
+FW_TUNING_PARAMS(FW_TUNING_DECLARE)
+
+#undef FW_TUNING_DECLARE
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include "hardware.h"
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -71,6 +72,25 @@ public:
      */
     size_t copy_rx_data(uint8_t *data, size_t len);
 
+    /**
+     * @brief Copies data from the receive buffer and marks bytes with errors.
+     * 
+     * Like `copy_rx_data()`, but the data is escaped similar to `PARMRK` of
+     * POSIX terminals: a byte received with a parity or framing error is
+     * copied as the sequence 0xff 0x00 byte, a valid byte 0xff as 0xff 0xff.
+     * Escape sequences are not split.
+     * 
+     * Errors are detected when polling, and only data received before the
+     * last poll is copied. All bytes received since the previous poll and
+     * the next byte are marked, i.e. a marked range usually contains more
+     * than the bad byte.
+     * 
+     * @param data pointer to byte array
+     * @param len length of the byte array
+     * @return number of bytes copied to the byte array (incl. escape bytes)
+     */
+    size_t copy_rx_data_marked(uint8_t *data, size_t len);
+
     /**
      * @brief Returns the length of received data in the receive buffer
      * 
@@ -78,6 +98,31 @@ public:
      */
     size_t rx_data_len();
 
+    /**
+     * @brief Returns a byte of the receive buffer without removing it.
+     * 
+     * @param offset offset from the oldest received byte (must be less than `rx_data_len()`)
+     * @return byte value (all 8 bits)
+     */
+    uint8_t rx_byte(size_t offset) { return rx_buf[(rx_buf_tail + offset) % UART_RX_BUF_LEN]; }
+
+    /**
+     * @brief Removes data from the receive buffer without copying it.
+     * 
+     * @param len number of bytes to remove (at most `rx_data_len()`)
+     */
+    void discard_rx_data(size_t len);
+
+    /**
+     * @brief Indicates if the receive buffer is filled up to the high water mark.
+     * 
+     * If so, RTS is deasserted and no further data can be expected
+     * until data is removed from the buffer.
+     * 
+     * @return `true` if the high water mark has been reached
+     */
+    bool is_rx_high_water();
+
     /**
      * Indicates of an RX buffer overrun has occurred.
      * 
@@ -88,6 +133,26 @@ public:
      */
     bool has_rx_overrun_occurred();
 
+    /**
+     * Indicates if a parity error has occurred.
+     * 
+     * This function will return `true` once for
+     * each poll detecting parity errors.
+     * 
+     * @return `true` if a parity error occurred.
+     */
+    bool has_parity_error_occurred();
+
+    /**
+     * Indicates if a framing error has occurred.
+     * 
+     * This function will return `true` once for
+     * each poll detecting framing errors.
+     * 
+     * @return `true` if a framing error occurred.
+     */
+    bool has_framing_error_occurred();
+
     /**
      * @brief Returns the available space in the transmit buffer
      * 
@@ -154,6 +219,18 @@ public:
      */
     uart_parity parity() { return _parity; }
 
+    /**
+     * @brief Enables or disables the internal loopback.
+     * 
+     * The loopback uses the half-duplex mode of the USART: the receiver is
+     * internally connected to the TX line. CTS flow control is disabled while
+     * the loopback is enabled. Pending data in the transmit and receive buffer
+     * is discarded.
+     * 
+     * @param enabled `true` to enable the loopback, `false` to disable it
+     */
+    void set_loopback(bool enabled);
+
 private:
     /// Check if a chunk of data has been transmitted
     void poll_tx_complete();
@@ -161,6 +238,12 @@ private:
     /// Try to transmit more data
     void start_transmission();
 
+    /// Returns the RX buffer head (derived from the DMA counter)
+    int rx_buf_head();
+
+    /// Returns the length of the received data for the specified RX buffer head
+    size_t rx_data_len(int buf_head);
+
     /**
      * @brief Checks if RX buffer has been overrun.
      * 
@@ -168,19 +251,41 @@ private:
      * 
      * This functions must be called frequently in order to reliably detect an overrun
      * (more often than: RX buffer size * 10 bit/byte / maximum bit rate / 2)
+     * 
+     * @param buf_head current RX buffer head
      */
-    void check_rx_overrun();
+    void check_rx_overrun(int buf_head);
 
-    /// Update (turn on/off) the RX/TX LEDs if needed
-    void update_leds();
+    /**
+     * @brief Marks the bytes received since the last check if an error has occurred.
+     * 
+     * @param errors error flags (see `board_usart_take_rx_errors()`)
+     * @param buf_head current RX buffer head (read before the error flags)
+     */
+    void check_rx_errors(uint32_t errors, int buf_head);
+
+    /// Returns if the byte at the specified RX buffer position has been marked as bad
+    bool is_rx_error(int pos) { return (rx_error_bits[pos / 8] & (1 << (pos % 8))) != 0; }
+
+    /// Clears the error marks of the specified RX buffer range (with wrap around)
+    void clear_rx_errors(int start, int end);
+
+    /**
+     * @brief Update (turn on/off) the RX/TX LEDs if needed
+     * 
+     * @param buf_head current RX buffer head
+     */
+    void update_leds(int buf_head);
 
     /**
      * @brief Updates RTS (output signal)
      * 
      * The output signal is asserted if the receive buffer has room for more data
      * (is below the high-water mark).
+     * 
+     * @param buf_head current RX buffer head
      */
-    void update_rts();
+    void update_rts(int buf_head);
 
     /**
      * @brief Sets the baudrate
@@ -229,6 +334,13 @@ private:
     // Last measured RX buffer size (to detect overrun)
     size_t last_rx_size;
 
+    // Bytes received with parity or framing error (one bit per RX buffer position)
+    uint8_t rx_error_bits[UART_RX_BUF_LEN / 8];
+    // Number of marked bytes in the RX buffer
+    int rx_error_count;
+    // RX buffer head at the last error check
+    int rx_error_check_head;
+
     int _baudrate;
     int _databits;
     uart_stopbits _stopbits;
@@ -239,12 +351,23 @@ private:
     uint32_t rx_led_off_timeout;
     uint32_t tx_led_off_timeout;
     int rx_led_head;
+
+    // RX buffer head and tail at the last RTS update (to skip updates if unchanged)
+    int rts_rx_head;
+    int rts_rx_tail;
+
+    // Output signals updated in the main loop (written on change only)
+    cached_output<board::rts> rts_out;
+    cached_output<board::led_rx> led_rx_out;
+    cached_output<board::led_tx> led_tx_out;
     int rx_high_water_mark;
     int tx_max_chunk_size;
 
     bool is_transmitting;
     bool is_enabled;
     bool rx_overrun_occurred;
+    bool parity_error_occurred;
+    bool framing_error_occurred;
 };
 
 /// Global UART instance
@@ -12,6 +12,8 @@
 
 #include "qsb_device.h"
 #include "qsb_cdc.h"
+#include "frame_checker.h"
+#include "rx_verifier.h"
 
 
 /**
@@ -22,7 +24,118 @@ enum class usb_serial_interrupt : uint16_t
     /// Data overrun (received data has been discarded)
     data_overrun = 64,
     /// Parity error
-    parity_error = 32
+    parity_error = 32,
+    /// Framing error
+    framing_error = 16
+};
+
+
+/**
+ * @brief Vendor requests (request type: vendor, recipient: device)
+ */
+enum class usb_serial_request : uint8_t
+{
+    /// Sets the test mode (wValue: test mode, wIndex: parameter, no data stage)
+    set_test_mode = 0x01,
+    /// Gets the statistics (data stage: `usb_serial_stats`)
+    get_stats = 0x02,
+    /// Enables or disables the marking of bytes received with errors (wValue: 0 or 1, no data stage)
+    set_error_marking = 0x03,
+    /// Sets the framing mode (wValue: `usb_serial_framing`, wIndex: flags, no data stage)
+    set_framing = 0x04
+};
+
+
+/**
+ * @brief Framing modes for data received via UART
+ */
+enum class usb_serial_framing : uint16_t
+{
+    /// Byte stream (data is held back for a short time to fill packets)
+    none = 0,
+    /// COBS frames terminated by 0x00
+    cobs = 1,
+    /// SLIP frames terminated by 0xc0
+    slip = 2
+};
+
+
+/// Flag for the `set_framing` vendor request: decode the frames, check the
+/// CRC-16 at the end of each frame (see `frame_checker`) and drop invalid frames
+constexpr uint16_t USB_SERIAL_FRAMING_CHECK_CRC = 1;
+
+
+/**
+ * @brief Test modes
+ */
+enum class usb_serial_test_mode : uint16_t
+{
+    /// Regular operation as USB serial adapter
+    none = 0,
+    /// USB throughput test: test pattern is sent to the host as fast as the
+    /// host polls, data received from the host is checked against the test
+    /// pattern. The UART is not used.
+    usb_throughput = 1,
+    /// UART loopback test: the USART is put into half-duplex mode (receiver
+    /// internally connected to the TX line). The test pattern is transmitted
+    /// as fast as possible and the received data is checked against it.
+    /// USB OUT data is discarded, no data is sent to the host.
+    uart_loopback = 2,
+    /// Regular operation with verification of the data received via UART:
+    /// before it is forwarded to the host, the data is checked against the
+    /// pseudo random stream of the loopback test (parameter: seed).
+    uart_verify = 3
+};
+
+
+/**
+ * @brief Statistics (returned by `get_stats` vendor request)
+ * 
+ * All values are little endian. The counters are reset when the test
+ * mode is set. New fields are only ever appended.
+ */
+struct usb_serial_stats
+{
+    /// Length of the structure (in bytes)
+    uint32_t length;
+    /// Current test mode
+    uint32_t test_mode;
+    /// Time since the test mode has been set (in ms)
+    uint32_t duration_ms;
+    /// Number of bytes submitted for transmission to the host (USB IN)
+    uint32_t usb_in_bytes;
+    /// Number of bytes received from the host (USB OUT)
+    uint32_t usb_out_bytes;
+    /// Number of received bytes not matching the test pattern
+    uint32_t usb_out_errors;
+    /// Number of bytes submitted for transmission via UART
+    uint32_t uart_tx_bytes;
+    /// Number of bytes received via UART
+    uint32_t uart_rx_bytes;
+    /// Number of bytes received via UART not matching the test pattern
+    uint32_t uart_rx_errors;
+    /// Achieved baud rate, derived from the received bytes and the frame format (in bps)
+    uint32_t uart_effective_baudrate;
+    /// Number of gaps between received bytes (idle time longer than two characters)
+    uint32_t uart_gap_count;
+    /// Longest gap (in µs)
+    uint32_t uart_gap_max_us;
+    /// Total idle time of all gaps (in µs)
+    uint32_t uart_gap_total_us;
+    /// Number of bytes received via UART and checked against the pseudo random stream
+    uint32_t uart_verify_bytes;
+    /// Number of checked bytes not matching the pseudo random stream
+    uint32_t uart_verify_errors;
+    /// Stream position of the first mismatching byte (0xffffffff if none)
+    uint32_t uart_verify_first_error_pos;
+    /// Number of times the synchronization with the stream has been lost (overrun or consecutive mismatches)
+    uint32_t uart_verify_sync_losses;
+    /// Number of mismatches per bit position (bit 0 to 7)
+    uint32_t uart_verify_bit_errors[8];
+    /// Number of frames received via UART and forwarded to the host (framing mode)
+    uint32_t uart_frames;
+    /// Number of frames received via UART and dropped (CRC error, invalid encoding or too long)
+    uint32_t uart_frame_errors;
 };
 
 
@@ -133,6 +246,62 @@ public:
      */
     void on_usb_ctrl_completed();
 
+    /**
+     * @brief Sets the test mode.
+     * 
+     * This member function is called to process a `set_test_mode` vendor request.
+     * Setting the test mode resets the statistics.
+     * 
+     * The UART verification test mode cannot be combined with error marking.
+     * 
+     * @param mode test mode
+     * @param param test mode parameter (seed for `uart_verify`)
+     * @return `true` if successful, `false` if the test mode is not supported
+     */
+    bool set_test_mode(usb_serial_test_mode mode, uint16_t param = 0);
+
+    /**
+     * @brief Enables or disables the marking of bytes received with errors.
+     * 
+     * This member function is called to process a `set_error_marking` vendor request.
+     * If enabled, bytes received via UART with a parity or framing error are
+     * sent to the host as the sequence 0xff 0x00 byte, and the byte 0xff
+     * as 0xff 0xff (similar to `PARMRK` of POSIX terminals).
+     * Marking is disabled when the USB interface is configured. It cannot be
+     * enabled in the UART verification test mode or in framing mode.
+     * 
+     * @param enabled `true` to enable marking, `false` to disable it
+     * @return `true` if successful, `false` if marking is not supported in the current mode
+     */
+    bool set_error_marking(bool enabled);
+
+    /**
+     * @brief Sets the framing mode for data received via UART.
+     * 
+     * This member function is called to process a `set_framing` vendor request.
+     * In framing mode, USB transfers are aligned to frame boundaries: each frame
+     * (incl. its delimiter) ends a transfer, and a transfer never contains more
+     * than one frame. Data isn't held back. Without CRC check, a long frame
+     * is forwarded in full packets before its end has been received. If the
+     * RX buffer reaches the high water mark, incomplete frames are forwarded
+     * (or dropped with CRC check). Framing is disabled when the USB interface
+     * is configured. Framing cannot be enabled while error marking is enabled.
+     * 
+     * @param framing framing mode
+     * @param flags framing flags (`USB_SERIAL_FRAMING_CHECK_CRC`)
+     * @return `true` if successful, `false` if the framing mode or a flag is not supported
+     */
+    bool set_framing(usb_serial_framing framing, uint16_t flags);
+
+    /**
+     * @brief Gets the statistics.
+     * 
+     * This member function is called to process a `get_stats` vendor request.
+     * 
+     * @param stats statistics to fill in
+     */
+    void get_stats(usb_serial_stats *stats);
+
     /**
      * Indicates if the USB CDC connection if configured.
      * 
@@ -142,6 +311,12 @@ public:
 
 private:
     void notify_serial_state(uint16_t state);
+    void transmit_test_data();
+    void check_test_data(const uint8_t *data, int len);
+    void run_uart_loopback_test();
+    void transmit_frames();
+    bool find_frame();
+    void reset_frame_scan();
 
     // indicates if zero-length packet is needed as previously transmitted packet was equal to maximum packet size
     bool needs_zlp;
@@ -158,6 +333,52 @@ private:
 
     // Interrupt the host needs to be notified about
     uint16_t pending_interrupt;
+
+    // Indicates if bytes received with errors are marked in the data sent to the host
+    bool is_error_marking;
+
+    // Framing mode and flags
+    usb_serial_framing framing;
+    bool is_frame_crc_checked;
+    // Remaining length of the complete frame at the start of the RX buffer (0 if not yet found)
+    size_t frame_len;
+    // Number of bytes of the RX buffer scanned for the end of the frame
+    size_t frame_scan_len;
+    // Indicates if the frame being scanned contains data other than delimiters
+    bool frame_has_data;
+    // Indicates if the frame being scanned is dropped (overrun or too long)
+    bool is_frame_dropped;
+    // Decoder and CRC checker of the frame being scanned
+    frame_checker checker;
+    uint32_t uart_frames;
+    uint32_t uart_frame_errors;
+
+    // Current test mode
+    usb_serial_test_mode test_mode;
+
+    // Timestamp when the test mode was set (in milliseconds)
+    uint32_t test_start_time;
+
+    // Next byte of test pattern to transmit and to expect
+    uint8_t test_tx_seq;
+    uint8_t test_rx_seq;
+
+    // Statistics
+    uint32_t usb_in_bytes;
+    uint32_t usb_out_bytes;
+    uint32_t usb_out_errors;
+    uint32_t uart_tx_bytes;
+    uint32_t uart_rx_bytes;
+    uint32_t uart_rx_errors;
+    uint32_t uart_gap_count;
+    uint32_t uart_gap_max_us;
+    uint32_t uart_gap_total_us;
+
+    // Time of last UART loopback data check with newly received data (in µs)
+    uint32_t uart_last_rx_time;
+
+    // Verifier of data received via UART (`uart_verify` test mode)
+    rx_verifier verifier;
 };
 
 /// Global USB Serial instance
@@ -9,6 +9,8 @@
  */
 
 #include "common.h"
+#include "hardware.h"
+#include <libopencm3/cm3/systick.h>
 #include <libopencm3/stm32/rcc.h>
 
 static volatile uint32_t millis_count;
@@ -18,6 +20,21 @@ uint32_t millis()
 	return millis_count;
 }
 
+uint32_t micros()
+{
+	// read again if the SysTick interrupt has occurred in between
+	uint32_t ms;
+	uint32_t value;
+	do {
+		ms = millis_count;
+		value = systick_get_value();
+	} while (ms != millis_count);
+
+	// SysTick counts down from the reload value
+	uint32_t reload = systick_get_reload();
+	return ms * 1000 + (reload - value) * 1000 / (reload + 1);
+}
+
 void delay(uint32_t ms)
 {
 	int32_t target_time = millis_count + ms;
@@ -34,23 +51,7 @@ void common_init()
 {
 	// Initialize SysTick
 
-#if defined(STM32F0)
-
-	rcc_clock_setup_in_hsi_out_48mhz();
-
-	// Interrupt every 1ms
-	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
-	systick_set_reload(rcc_ahb_frequency / 1000 - 1);
-
-#elif defined(STM32F1)
-
-	rcc_clock_setup_in_hse_8mhz_out_72mhz();
-
-	// Interrupt every 1ms
-	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB_DIV8);
-	systick_set_reload(rcc_ahb_frequency / 8 / 1000 - 1);
-	
-#endif
+	board_init_clock();
 
 	// Enable and start
 	systick_interrupt_enable();
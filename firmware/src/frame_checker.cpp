@@ -0,0 +1,87 @@
+/*
+ * USB Serial
+ * 
+ * Copyright (c) 2026 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Checker for COBS and SLIP frames received via UART
+ */
+
+#include "frame_checker.h"
+
+// SLIP escape characters (RFC 1055)
+static constexpr uint8_t SLIP_ESC = 0xdb;
+static constexpr uint8_t SLIP_ESC_END = 0xdc;
+static constexpr uint8_t SLIP_ESC_ESC = 0xdd;
+
+// CRC-16/CCITT-FALSE, processed in 4-bit steps
+static const uint16_t crc_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+uint16_t frame_checker::update_crc(uint16_t crc, uint8_t b)
+{
+    crc = (uint16_t)((crc << 4) ^ crc_table[(crc >> 12) ^ (b >> 4)]);
+    crc = (uint16_t)((crc << 4) ^ crc_table[(crc >> 12) ^ (b & 0x0f)]);
+    return crc;
+}
+
+void frame_checker::reset(frame_encoding encoding)
+{
+    this->encoding = encoding;
+    crc = 0xffff;
+    decoded_len = 0;
+    is_malformed = false;
+    block_remaining = 0;
+    block_code = 0;
+    is_escaped = false;
+}
+
+void frame_checker::add(uint8_t b)
+{
+    if (encoding == frame_encoding::cobs) {
+        if (block_remaining > 0) {
+            add_decoded(b);
+            block_remaining--;
+            return;
+        }
+
+        // start of block: the previous block (unless it is a full block) ends with a zero
+        if (block_code != 0 && block_code != 0xff)
+            add_decoded(0);
+        block_code = b;
+        block_remaining = b - 1;
+
+    } else {
+        if (is_escaped) {
+            is_escaped = false;
+            if (b == SLIP_ESC_END)
+                add_decoded(0xc0);
+            else if (b == SLIP_ESC_ESC)
+                add_decoded(SLIP_ESC);
+            else
+                is_malformed = true;
+        } else if (b == SLIP_ESC) {
+            is_escaped = true;
+        } else {
+            add_decoded(b);
+        }
+    }
+}
+
+bool frame_checker::is_valid()
+{
+    if (is_malformed || decoded_len < 2 || crc != 0)
+        return false;
+    if (encoding == frame_encoding::cobs)
+        return block_remaining == 0;
+    return !is_escaped;
+}
+
+void frame_checker::add_decoded(uint8_t b)
+{
+    crc = update_crc(crc, b);
+    decoded_len++;
+}
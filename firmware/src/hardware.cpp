@@ -0,0 +1,190 @@
+/*
+ * USB Serial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * MCU family specific hardware functions
+ */
+
+#include "hardware.h"
+#include <libopencm3/cm3/systick.h>
+#if defined(STM32F0)
+#include <libopencm3/stm32/crs.h>
+#include <libopencm3/stm32/syscfg.h>
+#endif
+
+#if defined(STM32F0)
+
+void board_gpio_configure(uint32_t port, uint16_t pins, pin_mode mode)
+{
+    switch (mode) {
+    case pin_mode::output:
+    case pin_mode::output_medium_speed:
+    case pin_mode::output_low_speed:
+        gpio_mode_setup(port, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, pins);
+        break;
+    case pin_mode::input_pulldown:
+        gpio_mode_setup(port, GPIO_MODE_INPUT, GPIO_PUPD_PULLDOWN, pins);
+        break;
+    case pin_mode::alt_output:
+    case pin_mode::alt_input:
+        gpio_mode_setup(port, GPIO_MODE_AF, GPIO_PUPD_PULLUP, pins);
+        gpio_set_af(port, board::usart_gpio_af, pins);
+        break;
+    case pin_mode::alt_input_pulldown:
+        gpio_mode_setup(port, GPIO_MODE_AF, GPIO_PUPD_PULLDOWN, pins);
+        gpio_set_af(port, board::usart_gpio_af, pins);
+        break;
+    }
+}
+
+void board_init_clock()
+{
+    rcc_clock_setup_in_hsi_out_48mhz();
+
+    // Interrupt every 1ms
+    systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+    systick_set_reload(rcc_ahb_frequency / 1000 - 1);
+}
+
+void board_init_usb_clock()
+{
+    rcc_periph_clock_enable(RCC_USB);
+    crs_autotrim_usb_enable();
+    rcc_set_usbclk_source(RCC_HSI48);
+
+    if (board::usb_pin_remap) {
+        // Remap pins PA11/PA12
+        rcc_periph_clock_enable(RCC_SYSCFG_COMP);
+        SYSCFG_CFGR1 |= SYSCFG_CFGR1_PA11_PA12_RMP;
+    }
+}
+
+int board_usart_set_baudrate(int baud)
+{
+    uint32_t clock = rcc_apb1_frequency;
+    if ((board::usart == USART1) || (board::usart == USART6))
+        clock = rcc_apb2_frequency;
+
+    uint32_t brr = (clock + baud / 2) / baud;
+
+    if (brr > 0xffff) {
+        // increase too low bitrate
+        brr = 0xffff;
+        baud = (clock + 0x8fff) / 0xffff;
+    }
+
+    if (brr >= 0x10) {
+        // oversampling by 16
+        USART_CR1(board::usart) &= ~USART_CR1_OVER8;
+    } else {
+        // oversampling by 8
+        USART_CR1(board::usart) |= USART_CR1_OVER8;
+        if (brr >= 0x08) {
+            brr = 0x10 | (brr & 0x07);
+        } else {
+            // select fastest bitrate possible
+            brr = 0x10;
+            baud = clock / 8;
+        }
+    }
+
+    USART_BRR(board::usart) = brr;
+    return baud;
+}
+
+uint32_t board_usart_take_rx_errors()
+{
+    uint32_t isr = USART_ISR(board::usart);
+    if ((isr & (USART_ISR_PE | USART_ISR_FE)) == 0)
+        return 0;
+
+    USART_ICR(board::usart) = isr & (USART_ICR_PECF | USART_ICR_FECF);
+    return ((isr & USART_ISR_PE) != 0 ? USART_RX_ERROR_PARITY : 0)
+        | ((isr & USART_ISR_FE) != 0 ? USART_RX_ERROR_FRAMING : 0);
+}
+
+#elif defined(STM32F1)
+
+void board_gpio_configure(uint32_t port, uint16_t pins, pin_mode mode)
+{
+    switch (mode) {
+    case pin_mode::output:
+        gpio_set_mode(port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, pins);
+        break;
+    case pin_mode::output_medium_speed:
+        gpio_set_mode(port, GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, pins);
+        break;
+    case pin_mode::output_low_speed:
+        gpio_set_mode(port, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, pins);
+        break;
+    case pin_mode::input_pulldown:
+    case pin_mode::alt_input_pulldown:
+        gpio_set_mode(port, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, pins);
+        gpio_clear(port, pins); // pull down
+        break;
+    case pin_mode::alt_output:
+        gpio_set_mode(port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, pins);
+        break;
+    case pin_mode::alt_input:
+        gpio_set_mode(port, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, pins);
+        break;
+    }
+}
+
+void board_init_clock()
+{
+    rcc_clock_setup_in_hse_8mhz_out_72mhz();
+
+    // Interrupt every 1ms
+    systick_set_clocksource(STK_CSR_CLKSOURCE_AHB_DIV8);
+    systick_set_reload(rcc_ahb_frequency / 8 / 1000 - 1);
+}
+
+void board_init_usb_clock()
+{
+    rcc_periph_clock_enable(RCC_USB);
+}
+
+int board_usart_set_baudrate(int baud)
+{
+    uint32_t clock = rcc_apb1_frequency;
+    if (board::usart == USART1)
+        clock = rcc_apb2_frequency;
+
+    uint32_t brr = (clock + baud / 2) / baud;
+
+    if (brr > 0xffff) {
+        // increase too low bitrate
+        brr = 0xffff;
+        baud = (clock + 0x8fff) / 0xffff;
+    }
+
+    if (brr < 16) {
+        // select fastest bitrate possible
+        brr = 16;
+        baud = clock / 16;
+    }
+
+    USART_BRR(board::usart) = brr;
+    return baud;
+}
+
+uint32_t board_usart_take_rx_errors()
+{
+    uint32_t sr = USART_SR(board::usart);
+    if ((sr & (USART_SR_PE | USART_SR_FE)) == 0)
+        return 0;
+
+    // The flags are cleared by reading SR followed by DR. If a character is
+    // pending, DR must be left to the DMA controller (its read clears the flags).
+    if ((sr & USART_SR_RXNE) == 0)
+        (void)USART_DR(board::usart);
+
+    return ((sr & USART_SR_PE) != 0 ? USART_RX_ERROR_PARITY : 0)
+        | ((sr & USART_SR_FE) != 0 ? USART_RX_ERROR_FRAMING : 0);
+}
+
+#endif
@@ -20,19 +20,9 @@
 static void gpio_setup()
 {
 	// configure power LED
-	rcc_periph_clock_enable(LED_POWER_PORT_RCC);
-
-#if defined(STM32F0)
-	gpio_mode_setup(LED_POWER_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LED_POWER_PIN);
-#elif defined(STM32F1)
-	gpio_set_mode(LED_POWER_PORT, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, LED_POWER_PIN);
-#endif
-
-#if defined(LED_POWER_REVERSED)
-	gpio_clear(LED_POWER_PORT, LED_POWER_PIN);
-#else
-	gpio_set(LED_POWER_PORT, LED_POWER_PIN);
-#endif
+	board::led_power::enable_clock();
+	board::led_power::configure();
+	board::led_power::set_active(true);
 }
 
 int main()
@@ -54,17 +44,13 @@ int main()
 			if (usb_serial.is_connected())
 			{
 				// USB has just been connected: turn on power LED for good
-#if defined(LED_POWER_REVERSED)
-				gpio_clear(LED_POWER_PORT, LED_POWER_PIN);
-#else
-				gpio_set(LED_POWER_PORT, LED_POWER_PIN);
-#endif
+				board::led_power::set_active(true);
 				connected = true;
 			}
 			else if (has_expired(next_led_toggle))
 			{
 				// USB not yet connected: blink power LED quickly
-				gpio_toggle(LED_POWER_PORT, LED_POWER_PIN);
+				board::led_power::toggle();
 				next_led_toggle = millis() + 150;
 			}
 		}
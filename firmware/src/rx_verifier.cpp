@@ -0,0 +1,143 @@
+/*
+ * USB Serial
+ * 
+ * Copyright (c) 2026 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Verifier for data received via UART
+ */
+
+#include "rx_verifier.h"
+#include <string.h>
+
+// Number of consecutive mismatches after which the synchronization is considered lost
+static constexpr int RESYNC_THRESHOLD = 8;
+// Number of bytes ahead of the current position searched when resynchronizing
+// (several times the UART RX buffer size)
+static constexpr uint32_t RESYNC_WINDOW = 4096;
+
+// Same constants as in test/loopback-linux/prng.cpp
+static constexpr uint32_t WEYL_INCREMENT = 0x9e3779b9;
+static constexpr uint32_t HASH_MUL1 = 0x7feb352d;
+static constexpr uint32_t HASH_MUL2 = 0x846ca68b;
+
+// Word with the specified index of the pseudo random stream
+static uint32_t hash_word(uint32_t seed, uint32_t index)
+{
+    // Weyl sequence followed by an integer hash (lowbias32)
+    uint32_t x = seed + index * WEYL_INCREMENT;
+    x ^= x >> 16;
+    x *= HASH_MUL1;
+    x ^= x >> 15;
+    x *= HASH_MUL2;
+    x ^= x >> 16;
+    return x;
+}
+
+void rx_verifier::reset(uint32_t seed)
+{
+    this->seed = seed;
+    word_index = 0;
+    byte_offset = 0;
+    word = hash_word(seed, 0);
+    is_synced = true;
+    consecutive_errors = 0;
+
+    _num_bytes = 0;
+    _num_errors = 0;
+    _first_error_pos = 0xffffffff;
+    _num_sync_losses = 0;
+    memset(_num_bit_errors, 0, sizeof(_num_bit_errors));
+}
+
+void rx_verifier::verify(const uint8_t *data, size_t len, uint8_t mask)
+{
+    size_t i = 0;
+    while (i < len) {
+        if (!is_synced) {
+            // a single search per call (to limit the time spent)
+            if (len - i < 4 || !resync(data + i, mask)) {
+                advance(len - i); // not checked
+                return;
+            }
+            is_synced = true;
+            consecutive_errors = 0;
+        }
+
+        uint8_t expected = (uint8_t)(word >> (8 * byte_offset)) & mask;
+        uint8_t diff = data[i] ^ expected;
+        if (diff != 0) {
+            if (_num_errors == 0)
+                _first_error_pos = word_index * 4 + byte_offset;
+            _num_errors++;
+            for (int bit = 0; bit < 8; bit++)
+                if ((diff & (1 << bit)) != 0)
+                    _num_bit_errors[bit]++;
+
+            consecutive_errors++;
+            if (consecutive_errors >= RESYNC_THRESHOLD) {
+                is_synced = false;
+                _num_sync_losses++;
+            }
+        } else {
+            consecutive_errors = 0;
+        }
+
+        _num_bytes++;
+        advance(1);
+        i++;
+    }
+}
+
+void rx_verifier::on_data_lost()
+{
+    if (!is_synced)
+        return;
+
+    is_synced = false;
+    _num_sync_losses++;
+}
+
+void rx_verifier::advance(size_t n)
+{
+    n += byte_offset;
+    byte_offset = n % 4;
+    if (n >= 4) {
+        word_index += n / 4;
+        word = hash_word(seed, word_index);
+    }
+}
+
+bool rx_verifier::resync(const uint8_t *data, uint8_t mask)
+{
+    // ahead of the current position (lost data) or at the start (restarted stream)
+    return search(data, mask, word_index, byte_offset)
+        || (word_index >= RESYNC_WINDOW / 4 && search(data, mask, 0, 0));
+}
+
+bool rx_verifier::search(const uint8_t *data, uint8_t mask, uint32_t index, int offset)
+{
+    uint32_t m = mask * 0x01010101U;
+    uint32_t received = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+    // two consecutive words to check all byte offsets
+    uint64_t words = hash_word(seed, index) | (uint64_t)hash_word(seed, index + 1) << 32;
+
+    for (uint32_t n = 0; n < RESYNC_WINDOW / 4; n++) {
+        for (; offset < 4; offset++) {
+            if (((uint32_t)(words >> (8 * offset)) & m) == received) {
+                word_index = index;
+                byte_offset = offset;
+                word = (uint32_t)words;
+                return true;
+            }
+        }
+
+        index++;
+        offset = 0;
+        words = (words >> 32) | (uint64_t)hash_word(seed, index + 1) << 32;
+    }
+
+    return false;
+}
@@ -10,6 +10,7 @@
 
 #include "common.h"
 #include "hardware.h"
+#include "tuning.h"
 #include "uart.h"
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/gpio.h>
@@ -22,70 +23,46 @@ uart_impl uart;
 void uart_impl::init()
 {
     // Enable USART interface clock
-    rcc_periph_clock_enable(USART_RCC);
+    rcc_periph_clock_enable(board::usart_rcc);
 
     // Enable TX, RX pin clock
-    rcc_periph_clock_enable(RCC_GPIOA);
+    board::usart_tx::enable_clock();
+    board::usart_rx::enable_clock();
 
     // Configure RX/TXpins
-    gpio_set(USART_PORT, USART_TX_GPIO);
-#if defined(STM32F0)
-    gpio_mode_setup(USART_PORT, GPIO_MODE_AF, GPIO_PUPD_PULLUP, USART_TX_GPIO | USART_RX_GPIO);
-    gpio_set_af(USART_PORT, GPIO_AF1, USART_TX_GPIO | USART_RX_GPIO);
-#elif defined(STM32F1)
-    gpio_set_mode(USART_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, USART_TX_GPIO);
-    gpio_set_mode(USART_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, USART_RX_GPIO);
-#endif
+    board::usart_tx::set();
+    board::usart_tx::configure();
+    board::usart_rx::configure();
 
     // configure RTS/CTS
-    rcc_periph_clock_enable(RTS_PORT_RCC);
-    rcc_periph_clock_enable(CTS_PORT_RCC);
+    board::rts::enable_clock();
+    board::cts::enable_clock();
 
-    gpio_set(RTS_PORT, RTS_PIN); // initial state: not asserted
+    rts_out.init(false); // initial state: not asserted
 
-#if defined(STM32F0)
-    gpio_mode_setup(RTS_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, RTS_PIN);
-    gpio_mode_setup(CTS_PORT, GPIO_MODE_AF, GPIO_PUPD_PULLDOWN, CTS_PIN);
-    gpio_set_af(CTS_PORT, GPIO_AF1, CTS_PIN);
-#elif defined(STM32F1)
-    gpio_set_mode(RTS_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, RTS_PIN);
-    gpio_set_mode(CTS_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, CTS_PIN);
-	gpio_clear(CTS_PORT, CTS_PIN); // pull down
-#endif
+    board::rts::configure();
+    board::cts::configure();
 
     // configure RX/TX LEDs
-    rcc_periph_clock_enable(LED_RX_PORT_RCC);
-    rcc_periph_clock_enable(LED_TX_PORT_RCC);
+    board::led_rx::enable_clock();
+    board::led_tx::enable_clock();
 
-    gpio_clear(LED_RX_PORT, LED_RX_PIN);
-    gpio_clear(LED_TX_PORT, LED_TX_PIN);
+    led_rx_out.init(false);
+    led_tx_out.init(false);
 
-#if defined(STM32F0)
-    gpio_mode_setup(LED_RX_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LED_RX_PIN);
-    gpio_mode_setup(LED_TX_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LED_TX_PIN);
-#elif defined(STM32F1)
-    gpio_set_mode(LED_RX_PORT, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, LED_RX_PIN);
-    gpio_set_mode(LED_TX_PORT, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, LED_TX_PIN);
-#endif
+    board::led_rx::configure();
+    board::led_tx::configure();
 
     // configure DTR/DSR/DCD
-    rcc_periph_clock_enable(DTR_PORT_RCC);
-    rcc_periph_clock_enable(DSR_PORT_RCC);
-    rcc_periph_clock_enable(DCD_PORT_RCC);
-
-    gpio_set(DTR_PORT, DTR_PIN); // initial state: not asserted
-
-#if defined(STM32F0)
-    gpio_mode_setup(DTR_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, DTR_PIN);
-    gpio_mode_setup(DSR_PORT, GPIO_MODE_INPUT, GPIO_PUPD_PULLDOWN, DSR_PIN);
-    gpio_mode_setup(DCD_PORT, GPIO_MODE_INPUT, GPIO_PUPD_PULLDOWN, DCD_PIN);
-#elif defined(STM32F1)
-    gpio_set_mode(DTR_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, DTR_PIN);
-    gpio_set_mode(DSR_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, DSR_PIN);
-	gpio_clear(DSR_PORT, DSR_PIN); // pull down
-    gpio_set_mode(DCD_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, DCD_PIN);
-	gpio_clear(DCD_PORT, DCD_PIN); // pull down
-#endif
+    board::dtr::enable_clock();
+    board::dsr::enable_clock();
+    board::dcd::enable_clock();
+
+    board::dtr::set_active(false); // initial state: not asserted
+
+    board::dtr::configure();
+    board::dsr::configure();
+    board::dcd::configure();
 }
 
 void uart_impl::enable()
@@ -94,45 +71,49 @@ void uart_impl::enable()
     tx_buf_head = tx_buf_tail = 0;
     tx_size = 0;
     rx_buf_tail = 0;
+    memset(rx_error_bits, 0, sizeof(rx_error_bits));
+    rx_error_count = 0;
+    rx_error_check_head = 0;
+    parity_error_occurred = framing_error_occurred = false;
     rx_led_timeout_active = tx_led_timeout_active = false;
     rx_led_head = 0;
 
-    gpio_set(RTS_PORT, RTS_PIN); // initial state: not asserted
-    gpio_set(DTR_PORT, DTR_PIN); // initial state: not asserted
+    rts_out.set_active(false); // initial state: not asserted
+    board::dtr::set_active(false); // initial state: not asserted
 
     // configure TX DMA
-    rcc_periph_clock_enable(USART_DMA_RCC);
-    dma_channel_reset(USART_DMA, USART_DMA_TX_CHAN);
-    dma_set_peripheral_address(USART_DMA, USART_DMA_TX_CHAN, (uint32_t)&USART_TX_DATA_REG);
-    dma_set_read_from_memory(USART_DMA, USART_DMA_TX_CHAN);
-    dma_enable_memory_increment_mode(USART_DMA, USART_DMA_TX_CHAN);
-    dma_set_memory_size(USART_DMA, USART_DMA_TX_CHAN, DMA_CCR_MSIZE_8BIT);
-    dma_set_peripheral_size(USART_DMA, USART_DMA_TX_CHAN, DMA_CCR_MSIZE_8BIT);
-    dma_set_priority(USART_DMA, USART_DMA_TX_CHAN, DMA_CCR_PL_MEDIUM);
-    dma_enable_transfer_complete_interrupt(USART_DMA, USART_DMA_TX_CHAN);
+    rcc_periph_clock_enable(board::usart_dma_rcc);
+    dma_channel_reset(board::usart_dma, board::usart_dma_tx_chan);
+    dma_set_peripheral_address(board::usart_dma, board::usart_dma_tx_chan, (uint32_t)(uintptr_t)board::usart_tx_data_reg());
+    dma_set_read_from_memory(board::usart_dma, board::usart_dma_tx_chan);
+    dma_enable_memory_increment_mode(board::usart_dma, board::usart_dma_tx_chan);
+    dma_set_memory_size(board::usart_dma, board::usart_dma_tx_chan, DMA_CCR_MSIZE_8BIT);
+    dma_set_peripheral_size(board::usart_dma, board::usart_dma_tx_chan, DMA_CCR_MSIZE_8BIT);
+    dma_set_priority(board::usart_dma, board::usart_dma_tx_chan, DMA_CCR_PL_MEDIUM);
+    dma_enable_transfer_complete_interrupt(board::usart_dma, board::usart_dma_tx_chan);
 
     // configure RX DMA (as circular buffer)
-    dma_channel_reset(USART_DMA, USART_DMA_RX_CHAN);
-    dma_set_peripheral_address(USART_DMA, USART_DMA_RX_CHAN, (uint32_t)&USART_RX_DATA_REG);
-    dma_set_read_from_peripheral(USART_DMA, USART_DMA_RX_CHAN);
-    dma_enable_memory_increment_mode(USART_DMA, USART_DMA_RX_CHAN);
-    dma_enable_circular_mode(USART_DMA, USART_DMA_RX_CHAN);
-    dma_set_memory_size(USART_DMA, USART_DMA_RX_CHAN, DMA_CCR_MSIZE_8BIT);
-    dma_set_peripheral_size(USART_DMA, USART_DMA_RX_CHAN, DMA_CCR_MSIZE_8BIT);
-    dma_set_priority(USART_DMA, USART_DMA_RX_CHAN, DMA_CCR_PL_MEDIUM);
-    dma_set_memory_address(USART_DMA, USART_DMA_RX_CHAN, (uint32_t)rx_buf);
-    dma_set_number_of_data(USART_DMA, USART_DMA_RX_CHAN, UART_RX_BUF_LEN);
-
-    dma_enable_channel(USART_DMA, USART_DMA_RX_CHAN);
+    dma_channel_reset(board::usart_dma, board::usart_dma_rx_chan);
+    dma_set_peripheral_address(board::usart_dma, board::usart_dma_rx_chan, (uint32_t)(uintptr_t)board::usart_rx_data_reg());
+    dma_set_read_from_peripheral(board::usart_dma, board::usart_dma_rx_chan);
+    dma_enable_memory_increment_mode(board::usart_dma, board::usart_dma_rx_chan);
+    dma_enable_circular_mode(board::usart_dma, board::usart_dma_rx_chan);
+    dma_set_memory_size(board::usart_dma, board::usart_dma_rx_chan, DMA_CCR_MSIZE_8BIT);
+    dma_set_peripheral_size(board::usart_dma, board::usart_dma_rx_chan, DMA_CCR_MSIZE_8BIT);
+    dma_set_priority(board::usart_dma, board::usart_dma_rx_chan, DMA_CCR_PL_MEDIUM);
+    dma_set_memory_address(board::usart_dma, board::usart_dma_rx_chan, (uint32_t)(uintptr_t)rx_buf);
+    dma_set_number_of_data(board::usart_dma, board::usart_dma_rx_chan, UART_RX_BUF_LEN);
+
+    dma_enable_channel(board::usart_dma, board::usart_dma_rx_chan);
 
     // configure baud rate etc.
     set_coding(9600, 8, uart_stopbits::_1_0, uart_parity::none);
-    usart_set_mode(USART, USART_MODE_TX_RX);
-    usart_set_flow_control(USART, USART_FLOWCONTROL_CTS);
+    usart_set_mode(board::usart, USART_MODE_TX_RX);
+    usart_set_flow_control(board::usart, USART_FLOWCONTROL_CTS);
 
-    usart_enable_rx_dma(USART);
-    usart_enable_tx_dma(USART);
-    usart_enable(USART);
+    usart_enable_rx_dma(board::usart);
+    usart_enable_tx_dma(board::usart);
+    usart_enable(board::usart);
 
     is_enabled = true;
 }
@@ -146,12 +127,16 @@ void uart_impl::poll()
     poll_tx_complete();
     start_transmission();
 
-    // RX side
-    update_rts();
-    check_rx_overrun();
+    // RX side (DMA counter is read once, before the error flags)
+    int buf_head = rx_buf_head();
+    check_rx_errors(board_usart_take_rx_errors(), buf_head);
+    if (buf_head != rts_rx_head || rx_buf_tail != rts_rx_tail) {
+        check_rx_overrun(buf_head);
+        update_rts(buf_head);
+    }
 
     // other stuff
-    update_leds();
+    update_leds(buf_head);
 }
 
 void uart_impl::transmit(const uint8_t *data, size_t len)
@@ -205,23 +190,23 @@ void uart_impl::start_transmission()
     is_transmitting = true;
 
     // set transmit chunk
-    dma_set_memory_address(USART_DMA, USART_DMA_TX_CHAN, (uint32_t)(tx_buf + start_pos));
-    dma_set_number_of_data(USART_DMA, USART_DMA_TX_CHAN, tx_size);
+    dma_set_memory_address(board::usart_dma, board::usart_dma_tx_chan, (uint32_t)(uintptr_t)(tx_buf + start_pos));
+    dma_set_number_of_data(board::usart_dma, board::usart_dma_tx_chan, tx_size);
 
     // start transmission
-    dma_enable_channel(USART_DMA, USART_DMA_TX_CHAN);
+    dma_enable_channel(board::usart_dma, board::usart_dma_tx_chan);
 
     // turn on TX LED
     tx_led_timeout_active = false;
-    gpio_set(LED_TX_PORT, LED_TX_PIN);
+    led_tx_out.set_active(true);
 }
 
 void uart_impl::poll_tx_complete()
 {
-    if (!dma_get_interrupt_flag(USART_DMA, USART_DMA_TX_CHAN, DMA_TCIF | DMA_TEIF))
+    if (!dma_get_interrupt_flag(board::usart_dma, board::usart_dma_tx_chan, DMA_TCIF | DMA_TEIF))
         return;
 
-    dma_clear_interrupt_flags(USART_DMA, USART_DMA_TX_CHAN, DMA_TCIF | DMA_TEIF);
+    dma_clear_interrupt_flags(board::usart_dma, board::usart_dma_tx_chan, DMA_TCIF | DMA_TEIF);
 
     // Update TX buffer
     int buf_tail = tx_buf_tail + tx_size;
@@ -232,21 +217,31 @@ void uart_impl::poll_tx_complete()
     is_transmitting = false;
 
     // Disable DMA    
-    dma_disable_channel(USART_DMA, USART_DMA_TX_CHAN);
+    dma_disable_channel(board::usart_dma, board::usart_dma_tx_chan);
 
     // Turn off LED in 100ms
     tx_led_timeout_active = true;
     tx_led_off_timeout = millis() + 100;
 }
 
-size_t uart_impl::copy_rx_data(uint8_t *data, size_t len)
+int uart_impl::rx_buf_head()
 {
-    int buf_head = UART_RX_BUF_LEN - dma_get_number_of_data(USART_DMA, USART_DMA_RX_CHAN);
+    int buf_head = UART_RX_BUF_LEN - dma_get_number_of_data(board::usart_dma, board::usart_dma_rx_chan);
     if (buf_head == UART_RX_BUF_LEN)
         buf_head = 0;
+    return buf_head;
+}
+
+size_t uart_impl::copy_rx_data(uint8_t *data, size_t len)
+{
+    int buf_head = rx_buf_head();
     if (buf_head == rx_buf_tail)
         return 0; // no new data
 
+    // error marks of copied data are discarded
+    if (rx_error_count > 0)
+        clear_rx_errors(rx_buf_tail, (rx_buf_tail + std::min(len, rx_data_len(buf_head))) % UART_RX_BUF_LEN);
+
     int n1 = 0;
     int n2 = 0;
 
@@ -284,29 +279,143 @@ size_t uart_impl::copy_rx_data(uint8_t *data, size_t len)
     return n1 + n2;
 }
 
+size_t uart_impl::copy_rx_data_marked(uint8_t *data, size_t len)
+{
+    // only data checked for errors is copied
+    int buf_head = rx_error_check_head;
+    int buf_tail = rx_buf_tail;
+    size_t n = 0;
+
+    while (buf_tail != buf_head) {
+        uint8_t b = rx_buf[buf_tail];
+        if (_databits == 7)
+            b &= 0x7f;
+
+        bool is_bad = rx_error_count > 0 && is_rx_error(buf_tail);
+        size_t seq_len = is_bad ? 3 : b == 0xff ? 2 : 1;
+        if (n + seq_len > len)
+            break; // don't split escape sequence
+
+        if (is_bad) {
+            data[n++] = 0xff;
+            data[n++] = 0x00;
+            rx_error_bits[buf_tail / 8] &= ~(1 << (buf_tail % 8));
+            rx_error_count--;
+        } else if (b == 0xff) {
+            data[n++] = 0xff;
+        }
+        data[n++] = b;
+
+        buf_tail++;
+        if (buf_tail >= UART_RX_BUF_LEN)
+            buf_tail = 0;
+    }
+
+    rx_buf_tail = buf_tail;
+    last_rx_size = rx_data_len(rx_buf_head());
+    return n;
+}
+
+void uart_impl::discard_rx_data(size_t len)
+{
+    int buf_head = rx_buf_head();
+    int buf_tail = (rx_buf_tail + std::min(len, rx_data_len(buf_head))) % UART_RX_BUF_LEN;
+    if (rx_error_count > 0)
+        clear_rx_errors(rx_buf_tail, buf_tail);
+    rx_buf_tail = buf_tail;
+    last_rx_size = rx_data_len(buf_head);
+}
+
+bool uart_impl::is_rx_high_water()
+{
+    return (int)rx_data_len() >= rx_high_water_mark;
+}
+
 size_t uart_impl::rx_data_len()
 {
-    int buf_head = UART_RX_BUF_LEN - dma_get_number_of_data(USART_DMA, USART_DMA_RX_CHAN);
-    if (buf_head == UART_RX_BUF_LEN)
-        buf_head = 0;
+    return rx_data_len(rx_buf_head());
+}
+
+size_t uart_impl::rx_data_len(int buf_head)
+{
     if (buf_head >= rx_buf_tail)
         return buf_head - rx_buf_tail;
 
     return UART_RX_BUF_LEN - rx_buf_tail + buf_head;
 }
 
-void uart_impl::check_rx_overrun()
+void uart_impl::check_rx_overrun(int buf_head)
 {
-    size_t len = rx_data_len();
+    size_t len = rx_data_len(buf_head);
     if (len < last_rx_size) {
         // overrun detected
         // clear error condition by discarding data
-        rx_buf_tail = UART_RX_BUF_LEN - dma_get_number_of_data(USART_DMA, USART_DMA_RX_CHAN);
+        if (rx_error_count > 0)
+            clear_rx_errors(rx_buf_tail, buf_head);
+        rx_buf_tail = buf_head;
         last_rx_size = 0;
         rx_overrun_occurred = true;
     }
 }
 
+void uart_impl::check_rx_errors(uint32_t errors, int buf_head)
+{
+    int start = rx_error_check_head;
+    rx_error_check_head = buf_head;
+    if (errors == 0)
+        return;
+
+    if ((errors & USART_RX_ERROR_PARITY) != 0)
+        parity_error_occurred = true;
+    if ((errors & USART_RX_ERROR_FRAMING) != 0)
+        framing_error_occurred = true;
+
+    // The bad byte has been received since the last check, or after the
+    // DMA counter has been read (it will be stored at the current head).
+    // Bytes already copied without marking are skipped.
+    if ((rx_buf_tail - start + UART_RX_BUF_LEN) % UART_RX_BUF_LEN <= (buf_head - start + UART_RX_BUF_LEN) % UART_RX_BUF_LEN)
+        start = rx_buf_tail;
+    int end = (buf_head + 1) % UART_RX_BUF_LEN;
+    for (int pos = start; pos != end; pos = (pos + 1) % UART_RX_BUF_LEN) {
+        if (!is_rx_error(pos)) {
+            rx_error_bits[pos / 8] |= 1 << (pos % 8);
+            rx_error_count++;
+        }
+    }
+}
+
+void uart_impl::clear_rx_errors(int start, int end)
+{
+    for (int pos = start; pos != end && rx_error_count > 0; pos = (pos + 1) % UART_RX_BUF_LEN) {
+        if (is_rx_error(pos)) {
+            rx_error_bits[pos / 8] &= ~(1 << (pos % 8));
+            rx_error_count--;
+        }
+    }
+}
+
+bool uart_impl::has_parity_error_occurred()
+{
+    if (parity_error_occurred)
+    {
+        parity_error_occurred = false;
+        return true;
+    }
+
+    return false;
+}
+
+bool uart_impl::has_framing_error_occurred()
+{
+    if (framing_error_occurred)
+    {
+        framing_error_occurred = false;
+        return true;
+    }
+
+    return false;
+}
+
 bool uart_impl::has_rx_overrun_occurred()
 {
     if (rx_overrun_occurred)
@@ -330,54 +439,48 @@ size_t uart_impl::tx_data_avail() {
 
 void uart_impl::set_dtr(bool asserted)
 {
-    if (asserted)
-        gpio_clear(DTR_PORT, DTR_PIN); // active low
-    else
-        gpio_set(DTR_PORT, DTR_PIN);    
+    board::dtr::set_active(asserted);
 }
 
 bool uart_impl::dsr()
 {
-    return gpio_get(DSR_PORT, DSR_PIN) == 0;
+    return board::dsr::is_active();
 }
 
 bool uart_impl::dcd()
 {
-    return gpio_get(DCD_PORT, DCD_PIN) == 0;
+    return board::dcd::is_active();
 }
 
-void uart_impl::update_leds()
+void uart_impl::update_leds(int buf_head)
 {
     // check for TX LED timeout
     if (tx_led_timeout_active && has_expired(tx_led_off_timeout)) {
-        gpio_clear(LED_TX_PORT, LED_TX_PIN);
+        led_tx_out.set_active(false);
         tx_led_timeout_active = false;
     }
 
     // check for RX LED timeout
     if (rx_led_timeout_active && has_expired(rx_led_off_timeout)) {
-        gpio_clear(LED_RX_PORT, LED_RX_PIN);
+        led_rx_out.set_active(false);
         rx_led_timeout_active = false;
     }
 
     // check for new received data (relevant for LED only)
-    int buf_head = UART_RX_BUF_LEN - dma_get_number_of_data(USART_DMA, USART_DMA_RX_CHAN);
     if (buf_head != rx_led_head) {
         // turn on RX LED and set timeout of 100ms
-        gpio_set(LED_RX_PORT, LED_RX_PIN);
+        led_rx_out.set_active(true);
         rx_led_timeout_active = true;
         rx_led_off_timeout = millis() + 100;
         rx_led_head = buf_head;
     }
 }
 
-void uart_impl::update_rts()
+void uart_impl::update_rts(int buf_head)
 {
-    bool asserted = (int)rx_data_len() < rx_high_water_mark;
-    if (asserted)
-        gpio_clear(RTS_PORT, RTS_PIN);
-    else
-        gpio_set(RTS_PORT, RTS_PIN);
+    rts_out.set_active((int)rx_data_len(buf_head) < rx_high_water_mark);
+    rts_rx_head = buf_head;
+    rts_rx_tail = rx_buf_tail;
 }
 
 static const uint32_t stopbits_enum_to_uint32[] = {
@@ -399,80 +502,60 @@ void uart_impl::set_coding(int baudrate, int databits, uart_stopbits stopbits, u
     _parity = parity;
     int p = parity == uart_parity::none ? 0 : 1;
 
-    usart_disable(USART);
+    usart_disable(board::usart);
     set_baudrate(baudrate);
-    usart_set_databits(USART, _databits + p);
-    usart_set_stopbits(USART, stopbits_enum_to_uint32[(int)_stopbits]);
-    usart_set_parity(USART, parity_enum_to_uint32[(int)_parity]);
-    usart_enable(USART);
-
-    // High water mark is buffer size - 5ms worth of data
-    rx_high_water_mark = std::max(UART_RX_BUF_LEN - baudrate / 2000, 0);
+    usart_set_databits(board::usart, _databits + p);
+    usart_set_stopbits(board::usart, stopbits_enum_to_uint32[(int)_stopbits]);
+    usart_set_parity(board::usart, parity_enum_to_uint32[(int)_parity]);
+    usart_enable(board::usart);
+
+    // High water mark is buffer size - 5ms worth of data (10 bits per byte)
+    rx_high_water_mark = std::max(UART_RX_BUF_LEN - baudrate * RX_HIGH_WATER_MARGIN_MS / 10000, 0);
+    rts_rx_head = -1; // force RTS update
 }
 
-void uart_impl::set_baudrate(int baud)
+void uart_impl::set_loopback(bool enabled)
 {
-    _baudrate = baud;
-
-#if defined(STM32F0)
-
-	uint32_t clock = rcc_apb1_frequency;
-	if ((USART == USART1) || (USART == USART6)) {
-		clock = rcc_apb2_frequency;
-	}
-
-    uint32_t brr = (clock + baud / 2) / baud;
+    // abort transmission and discard pending data
+    dma_disable_channel(board::usart_dma, board::usart_dma_tx_chan);
+    dma_clear_interrupt_flags(board::usart_dma, board::usart_dma_tx_chan, DMA_TCIF | DMA_TEIF);
+    is_transmitting = false;
+    tx_buf_head = tx_buf_tail = 0;
+    tx_size = 0;
 
-    if (brr > 0xffff) {
-        // increase too low bitrate
-        brr = 0xffff;
-        _baudrate = (clock + 0x8fff) / 0xffff;
-    }
-    
-    if (brr >= 0x10) {
-        // oversampling by 16
-        USART_CR1(USART) &= ~USART_CR1_OVER8;
+    usart_disable(board::usart);
+    if (enabled) {
+        USART_CR3(board::usart) |= USART_CR3_HDSEL;
+        usart_set_flow_control(board::usart, USART_FLOWCONTROL_NONE);
     } else {
-        // oversampling by 8
-        USART_CR1(USART) |= USART_CR1_OVER8;
-        if (brr >= 0x08) {
-            brr = 0x10 | (brr & 0x07);
-        } else {
-            // select fastest bitrate possible
-            brr = 0x10;
-            _baudrate = clock / 8;
-        }
-    }
-
-    USART_BRR(USART) = brr;
-
-#else
-	uint32_t clock = rcc_apb1_frequency;
-	if (USART == USART1)
-		clock = rcc_apb2_frequency;
-
-    uint32_t brr = (clock + baud / 2) / baud;
-
-    if (brr > 0xffff) {
-        // increase too low bitrate
-        brr = 0xffff;
-        _baudrate = (clock + 0x8fff) / 0xffff;
-    }
-
-    if (brr < 16) {
-        // select fastest bitrate possible
-        brr = 16;
-        _baudrate = clock / 16;
+        USART_CR3(board::usart) &= ~USART_CR3_HDSEL;
+        usart_set_flow_control(board::usart, USART_FLOWCONTROL_CTS);
     }
+    usart_enable(board::usart);
+
+    rx_buf_tail = rx_buf_head();
+    last_rx_size = 0;
+    memset(rx_error_bits, 0, sizeof(rx_error_bits));
+    rx_error_count = 0;
+    rx_error_check_head = rx_buf_tail;
+    rts_rx_head = -1; // force RTS update
+
+    // errors of the previous mode are not reported in the new mode
+    (void)board_usart_take_rx_errors();
+    rx_overrun_occurred = false;
+    parity_error_occurred = framing_error_occurred = false;
+}
 
-	USART_BRR(USART) = brr;
-#endif
-
-    tx_max_chunk_size = _baudrate / 10000;
-    if (tx_max_chunk_size < 16)
-        tx_max_chunk_size = 16;
-    if (tx_max_chunk_size > 256)
-        tx_max_chunk_size = 256;
+void uart_impl::set_baudrate(int baud)
+{
+    _baudrate = board_usart_set_baudrate(baud);
+
+    // 1ms worth of data (10 bits per byte)
+    tx_max_chunk_size = _baudrate * TX_CHUNK_TIME_MS / 10000;
+    if (tx_max_chunk_size < TX_CHUNK_MIN_SIZE)
+        tx_max_chunk_size = TX_CHUNK_MIN_SIZE;
+    if (tx_max_chunk_size > TX_CHUNK_MAX_SIZE)
+        tx_max_chunk_size = TX_CHUNK_MAX_SIZE;
 }
 
 
@@ -13,10 +13,6 @@
 #include "usb_cdc.h"
 #include "usb_conf.h"
 #include "usb_serial.h"
-#if defined(STM32F0)
-#include <libopencm3/stm32/crs.h>
-#include <libopencm3/stm32/syscfg.h>
-#endif
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include "qsb_device.h"
@@ -62,6 +58,45 @@ static enum qsb_request_return_code cdc_control_request(
 	return QSB_REQ_NEXT_HANDLER;
 }
 
+// Process vendor requests (test modes and statistics) on control endpoint
+static enum qsb_request_return_code vendor_control_request(
+	__attribute__((unused)) qsb_device *dev,
+	qsb_setup_data *req, uint8_t **buf, uint16_t *len,
+	__attribute__((unused)) qsb_dev_control_completion_callback_fn *complete)
+{
+	usb_serial_request request = (usb_serial_request)req->bRequest;
+
+	// requests changing the device state are host-to-device requests without data stage
+	if ((request == usb_serial_request::set_test_mode || request == usb_serial_request::set_error_marking
+			|| request == usb_serial_request::set_framing)
+			&& ((req->bmRequestType & QSB_REQ_TYPE_IN) != 0 || req->wLength != 0))
+		return QSB_REQ_NOTSUPP;
+
+	switch (request)
+	{
+	case usb_serial_request::set_test_mode:
+		return usb_serial.set_test_mode((usb_serial_test_mode)req->wValue, req->wIndex) ? QSB_REQ_HANDLED : QSB_REQ_NOTSUPP;
+
+	case usb_serial_request::get_stats:
+		if ((req->bmRequestType & QSB_REQ_TYPE_IN) == 0)
+			return QSB_REQ_NOTSUPP;
+
+		usb_serial.get_stats((usb_serial_stats *)*buf);
+		*len = std::min(*len, (uint16_t)sizeof(usb_serial_stats));
+		return QSB_REQ_HANDLED;
+
+	case usb_serial_request::set_error_marking:
+		if (req->wValue > 1)
+			return QSB_REQ_NOTSUPP;
+
+		return usb_serial.set_error_marking(req->wValue != 0) ? QSB_REQ_HANDLED : QSB_REQ_NOTSUPP;
+
+	case usb_serial_request::set_framing:
+		return usb_serial.set_framing((usb_serial_framing)req->wValue, req->wIndex) ? QSB_REQ_HANDLED : QSB_REQ_NOTSUPP;
+	}
+	return QSB_REQ_NEXT_HANDLER;
+}
+
 bool usb_cdc_is_connected()
 {
 	return configured != 0;
@@ -76,6 +111,11 @@ static void cdc_set_config(qsb_device *dev, uint16_t wValue)
 								   QSB_REQ_TYPE_TYPE_MASK | QSB_REQ_TYPE_RECIPIENT_MASK,
 								   cdc_control_request);
 
+	qsb_dev_register_control_callback(dev,
+								   QSB_REQ_TYPE_VENDOR    | QSB_REQ_TYPE_DEVICE,
+								   QSB_REQ_TYPE_TYPE_MASK | QSB_REQ_TYPE_RECIPIENT_MASK,
+								   vendor_control_request);
+
 	// Serial interface
 	usb_serial.on_usb_configured();
 
@@ -86,30 +126,15 @@ static void cdc_set_config(qsb_device *dev, uint16_t wValue)
 
 void usb_cdc_init()
 {
-	rcc_periph_clock_enable(RCC_USB);
-	rcc_periph_clock_enable(USB_PORT_RCC);
-
-#if defined(STM32F0)
-	crs_autotrim_usb_enable();
-	rcc_set_usbclk_source(RCC_HSI48);
-#endif
-
-#if defined(STM32F042F6)
-	// Remap pins PA11/PA12
-	rcc_periph_clock_enable(RCC_SYSCFG_COMP);
-	SYSCFG_CFGR1 |= SYSCFG_CFGR1_PA11_PA12_RMP;
-#endif
+	board_init_usb_clock();
+	board::usb_dp::enable_clock();
 
 	// reset USB peripheral
 	rcc_periph_reset_pulse(RST_USB);
 
 	// Pull USB D+ low for 80ms to trigger device reenumeration
-#if defined(STM32F0)
-	gpio_mode_setup(USB_DP_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, USB_DP_PIN);
-#elif defined(STM32F1)
-	gpio_set_mode(USB_DP_PORT, GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, USB_DP_PIN);
-#endif
-	gpio_clear(USB_DP_PORT, USB_DP_PIN);
+	board::usb_dp::configure();
+	board::usb_dp::clear();
 	delay(80);
 
 	// create USB device
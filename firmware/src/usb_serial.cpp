@@ -10,6 +10,7 @@
 
 #include "common.h"
 #include "hardware.h"
+#include "tuning.h"
 #include "uart.h"
 #include "usb_cdc.h"
 #include "usb_conf.h"
@@ -18,9 +19,6 @@
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/rcc.h>
 
-#define TX_HOLDBACK_MAX_TIME 3  // max time to hold back data for transmission (in milliseconds)
-#define TX_HOLDBACK_MAX_LEN 16  // max number of bytes to hold back data for transmission
-
 constexpr int RX_USB_BUF_SIZE = 2 * CDCACM_PACKET_SIZE;
 constexpr int TX_USB_BUF_SIZE = 2 * CDCACM_PACKET_SIZE;
 
@@ -30,6 +28,14 @@ static void usb_comm_in_cb(qsb_device *dev, uint8_t ep, uint32_t len);
 
 usb_serial_impl usb_serial;
 
+// Length of a UART character incl. start, parity and stop bits (in half bits)
+static uint32_t uart_frame_half_bits()
+{
+    static const uint32_t stop_half_bits[] = { 2, 3, 4 };
+    int parity_bits = uart.parity() == uart_parity::none ? 0 : 1;
+    return 2 * (1 + uart.databits() + parity_bits) + stop_half_bits[(int)uart.stopbits()];
+}
+
 void usb_serial_impl::init()
 {
     uart.init();
@@ -39,11 +45,14 @@ void usb_serial_impl::init()
 // Called when USB is connected
 void usb_serial_impl::on_usb_configured()
 {
+    set_test_mode(usb_serial_test_mode::none);
     needs_zlp = false;
     is_tx_high_water = false;
     last_serial_state = 0;
     tx_timestamp = millis() - 100;
     pending_interrupt = 0;
+    is_error_marking = false;
+    set_framing(usb_serial_framing::none, 0);
 
     // register callbacks
     qsb_dev_ep_setup(usb_device, DATA_OUT_1, QSB_ENDPOINT_ATTR_BULK, RX_USB_BUF_SIZE, usb_data_out_cb);
@@ -64,6 +73,13 @@ void usb_serial_impl::on_usb_data_received(qsb_device *dev)
     if (len == 0)
         return;
 
+    if (test_mode == usb_serial_test_mode::usb_throughput) {
+        check_test_data(packet, len);
+        return;
+    }
+    if (test_mode == usb_serial_test_mode::uart_loopback)
+        return; // discard data
+
     // Start transmission via UART
     uart.transmit(packet, len);
 
@@ -85,7 +101,17 @@ bool usb_serial_impl::is_connected()
 void usb_serial_impl::poll()
 {
     usb_cdc_poll();
-    
+
+    if (test_mode == usb_serial_test_mode::usb_throughput) {
+        if (usb_cdc_is_connected())
+            transmit_test_data();
+        return;
+    }
+    if (test_mode == usb_serial_test_mode::uart_loopback) {
+        run_uart_loopback_test();
+        return;
+    }
+
     uart.poll();
 
     if (!usb_cdc_is_connected())
@@ -95,14 +121,32 @@ void usb_serial_impl::poll()
 
     // Check for RX buffer overrun
     if (uart.has_rx_overrun_occurred()) {
+        if (test_mode == usb_serial_test_mode::uart_verify)
+            verifier.on_data_lost();
+        if (framing != usb_serial_framing::none) {
+            // the frame being received is incomplete
+            reset_frame_scan();
+            is_frame_dropped = true;
+        }
         on_interrupt_occurred(usb_serial_interrupt::data_overrun);
         return;
     }
 
+    // Check for parity and framing errors
+    if (uart.has_parity_error_occurred())
+        on_interrupt_occurred(usb_serial_interrupt::parity_error);
+    if (uart.has_framing_error_occurred())
+        on_interrupt_occurred(usb_serial_interrupt::framing_error);
+
     uint16_t state = serial_state();
     if (state != last_serial_state)
         notify_serial_state(state);
 
+    if (framing != usb_serial_framing::none) {
+        transmit_frames();
+        return;
+    }
+
     // In order to prevent the USB line from being flooded with packets
     // to transmit a single byte, data is held back until a certain time
     // has expired or a certain number of bytes has been accumulated.
@@ -111,7 +155,7 @@ void usb_serial_impl::poll()
     size_t len = uart.rx_data_len();
     if (!needs_zlp && len == 0)
             return; // no data, no ZLP
-    if (!needs_zlp && len < TX_HOLDBACK_MAX_LEN && !has_expired(tx_timestamp + TX_HOLDBACK_MAX_TIME))
+    if (!needs_zlp && (int)len < TX_HOLDBACK_MAX_LEN && !has_expired(tx_timestamp + TX_HOLDBACK_MAX_TIME))
         return; // wait for more data to arrive
 
     uint16_t write_avail = qsb_dev_ep_transmit_avail(usb_device, DATA_IN_1);
@@ -123,7 +167,13 @@ void usb_serial_impl::poll()
     uint8_t packet[TX_USB_BUF_SIZE] __attribute__((aligned(4)));
 
     // Retrieve UART data
-    len = uart.copy_rx_data(packet, write_avail);
+    if (is_error_marking)
+        len = uart.copy_rx_data_marked(packet, write_avail);
+    else
+        len = uart.copy_rx_data(packet, write_avail);
+
+    if (test_mode == usb_serial_test_mode::uart_verify)
+        verifier.verify(packet, len, uart.databits() == 7 ? 0x7f : 0xff);
 
     needs_zlp = len > 0 && len % CDCACM_PACKET_SIZE == 0;
 
@@ -134,7 +184,7 @@ void usb_serial_impl::poll()
 // Updates the NAK status of DATA_OUT_1
 void usb_serial_impl::update_nak()
 {
-    bool is_high_water = uart.tx_data_avail() < TX_USB_BUF_SIZE; // two more packages
+    bool is_high_water = (int)uart.tx_data_avail() < TX_NAK_HIGH_WATER; // default: two more packages
     if (is_high_water && !is_tx_high_water) {
         is_tx_high_water = true;
         qsb_dev_ep_pause(usb_device, DATA_OUT_1);
@@ -147,6 +197,8 @@ void usb_serial_impl::update_nak()
 // Called when transmission over USB has completed
 void usb_serial_impl::on_usb_data_transmitted()
 {
+    if (test_mode == usb_serial_test_mode::usb_throughput)
+        transmit_test_data();
 }
 
 // Called when transmission over USB has completed
@@ -244,3 +296,300 @@ void usb_comm_in_cb(__attribute__((unused)) qsb_device *dev, __attribute__((unus
 {
     usb_serial.on_usb_ctrl_completed();
 }
+
+bool usb_serial_impl::set_test_mode(usb_serial_test_mode mode, uint16_t param)
+{
+    if (mode != usb_serial_test_mode::none && mode != usb_serial_test_mode::usb_throughput
+            && mode != usb_serial_test_mode::uart_loopback && mode != usb_serial_test_mode::uart_verify)
+        return false;
+    // the verifier checks the unmarked data
+    if (mode == usb_serial_test_mode::uart_verify && is_error_marking)
+        return false;
+
+    // terminate a pending transfer with a ZLP if needed
+    if (test_mode == usb_serial_test_mode::usb_throughput)
+        needs_zlp = true;
+
+    // (re)start or end UART loopback (discards pending UART data)
+    if (mode == usb_serial_test_mode::uart_loopback || test_mode == usb_serial_test_mode::uart_loopback)
+        uart.set_loopback(mode == usb_serial_test_mode::uart_loopback);
+
+    test_mode = mode;
+    test_start_time = millis();
+    test_tx_seq = 0;
+    test_rx_seq = 0;
+    usb_in_bytes = 0;
+    usb_out_bytes = 0;
+    usb_out_errors = 0;
+    uart_tx_bytes = 0;
+    uart_rx_bytes = 0;
+    uart_rx_errors = 0;
+    uart_gap_count = 0;
+    uart_gap_max_us = 0;
+    uart_gap_total_us = 0;
+    uart_frames = 0;
+    uart_frame_errors = 0;
+    verifier.reset(param);
+
+    // USB OUT data is no longer subject to UART flow control
+    if ((mode == usb_serial_test_mode::usb_throughput || mode == usb_serial_test_mode::uart_loopback)
+            && is_tx_high_water) {
+        is_tx_high_water = false;
+        qsb_dev_ep_unpause(usb_device, DATA_OUT_1);
+    }
+
+    return true;
+}
+
+bool usb_serial_impl::set_error_marking(bool enabled)
+{
+    // marked data can neither be verified nor aligned to frames
+    if (enabled && (test_mode == usb_serial_test_mode::uart_verify || framing != usb_serial_framing::none))
+        return false;
+
+    is_error_marking = enabled;
+    return true;
+}
+
+bool usb_serial_impl::set_framing(usb_serial_framing framing, uint16_t flags)
+{
+    if (framing != usb_serial_framing::none && framing != usb_serial_framing::cobs
+            && framing != usb_serial_framing::slip)
+        return false;
+    if (framing != usb_serial_framing::none && is_error_marking)
+        return false;
+    if ((flags & ~USB_SERIAL_FRAMING_CHECK_CRC) != 0)
+        return false;
+
+    this->framing = framing;
+    is_frame_crc_checked = (flags & USB_SERIAL_FRAMING_CHECK_CRC) != 0;
+    reset_frame_scan();
+    uart_frames = 0;
+    uart_frame_errors = 0;
+    return true;
+}
+
+// Resets the search for the end of the next frame
+void usb_serial_impl::reset_frame_scan()
+{
+    frame_len = 0;
+    frame_scan_len = 0;
+    frame_has_data = false;
+    is_frame_dropped = false;
+    if (framing != usb_serial_framing::none)
+        checker.reset((frame_encoding)framing);
+}
+
+// Scans the received data for the end of the next frame. Invalid frames are discarded.
+// Returns `true` if a complete frame is at the start of the RX buffer (length in `frame_len`).
+bool usb_serial_impl::find_frame()
+{
+    uint8_t delimiter = frame_checker::delimiter((frame_encoding)framing);
+    size_t len = uart.rx_data_len();
+
+    while (frame_scan_len < len) {
+        uint8_t b = uart.rx_byte(frame_scan_len);
+        frame_scan_len++;
+        if (b != delimiter) {
+            frame_has_data = true;
+            if (is_frame_crc_checked)
+                checker.add(b);
+            continue;
+        }
+
+        if (!frame_has_data)
+            continue; // leading delimiters are forwarded with the frame
+
+        bool is_valid = !is_frame_dropped && (!is_frame_crc_checked || checker.is_valid());
+        size_t scanned_len = frame_scan_len;
+        reset_frame_scan();
+        if (is_valid) {
+            frame_len = scanned_len;
+            uart_frames++;
+            return true;
+        }
+
+        uart_frame_errors++;
+        uart.discard_rx_data(scanned_len);
+        len -= scanned_len;
+    }
+
+    // A frame to be checked must fit into the RX buffer below the high water mark
+    // (RTS is deasserted and the rest of the frame won't arrive).
+    if ((is_frame_crc_checked || is_frame_dropped) && frame_has_data && uart.is_rx_high_water()) {
+        uart.discard_rx_data(frame_scan_len);
+        frame_scan_len = 0;
+        is_frame_dropped = true;
+    }
+
+    return false;
+}
+
+// Submits received data for transmission over USB, aligned to frame boundaries
+void usb_serial_impl::transmit_frames()
+{
+    uint16_t write_avail = qsb_dev_ep_transmit_avail(usb_device, DATA_IN_1);
+    if (write_avail == 0)
+        return; // DATA IN endpoint is busy
+
+    size_t len = 0;
+    bool is_frame_end = false;
+    if (needs_zlp) {
+        // terminate the previous transfer before the next frame is sent
+
+    } else if (frame_len > 0 || find_frame()) {
+        // complete frame: within the frame, only full packets are sent so the transfer doesn't end
+        len = std::min(frame_len, (size_t)write_avail);
+        is_frame_end = len == frame_len;
+        if (!is_frame_end)
+            len -= len % CDCACM_PACKET_SIZE;
+
+    } else if (!is_frame_crc_checked && !is_frame_dropped) {
+        // incomplete frame: forward full packets (or all data if RTS is deasserted)
+        len = std::min(frame_scan_len, (size_t)write_avail);
+        if (!uart.is_rx_high_water())
+            len -= len % CDCACM_PACKET_SIZE;
+    }
+
+    if (len == 0 && !needs_zlp)
+        return;
+
+    uint8_t packet[TX_USB_BUF_SIZE] __attribute__((aligned(4)));
+    len = uart.copy_rx_data(packet, len);
+    if (frame_len > 0)
+        frame_len -= len;
+    else
+        frame_scan_len -= len;
+
+    if (test_mode == usb_serial_test_mode::uart_verify)
+        verifier.verify(packet, len, uart.databits() == 7 ? 0x7f : 0xff);
+
+    // a transfer ending with a full packet is terminated by a ZLP
+    needs_zlp = is_frame_end && len % CDCACM_PACKET_SIZE == 0;
+
+    qsb_dev_ep_transmit_packet(usb_device, DATA_IN_1, packet, len);
+}
+
+void usb_serial_impl::get_stats(usb_serial_stats *stats)
+{
+    stats->length = sizeof(usb_serial_stats);
+    stats->test_mode = (uint32_t)test_mode;
+    stats->duration_ms = millis() - test_start_time;
+    stats->usb_in_bytes = usb_in_bytes;
+    stats->usb_out_bytes = usb_out_bytes;
+    stats->usb_out_errors = usb_out_errors;
+    stats->uart_tx_bytes = uart_tx_bytes;
+    stats->uart_rx_bytes = uart_rx_bytes;
+    stats->uart_rx_errors = uart_rx_errors;
+    stats->uart_effective_baudrate = stats->duration_ms == 0 ? 0
+        : (uint32_t)((uint64_t)uart_rx_bytes * uart_frame_half_bits() * 500 / stats->duration_ms);
+    stats->uart_gap_count = uart_gap_count;
+    stats->uart_gap_max_us = uart_gap_max_us;
+    stats->uart_gap_total_us = uart_gap_total_us;
+    stats->uart_verify_bytes = verifier.num_bytes();
+    stats->uart_verify_errors = verifier.num_errors();
+    stats->uart_verify_first_error_pos = verifier.first_error_pos();
+    stats->uart_verify_sync_losses = verifier.num_sync_losses();
+    for (int bit = 0; bit < 8; bit++)
+        stats->uart_verify_bit_errors[bit] = verifier.num_bit_errors(bit);
+    stats->uart_frames = uart_frames;
+    stats->uart_frame_errors = uart_frame_errors;
+}
+
+// Submits the next test pattern chunk for transmission (if the endpoint is available)
+void usb_serial_impl::transmit_test_data()
+{
+    uint16_t write_avail = qsb_dev_ep_transmit_avail(usb_device, DATA_IN_1);
+    if (write_avail == 0)
+        return; // DATA IN endpoint is busy
+
+    uint8_t packet[TX_USB_BUF_SIZE] __attribute__((aligned(4)));
+    int len = std::min((int)write_avail, TX_USB_BUF_SIZE);
+    uint8_t seq = test_tx_seq;
+    for (int i = 0; i < len; i++)
+        packet[i] = seq++;
+
+    len = qsb_dev_ep_transmit_packet(usb_device, DATA_IN_1, packet, len);
+    if (len <= 0)
+        return;
+
+    test_tx_seq += len;
+    usb_in_bytes += len;
+    needs_zlp = false;
+}
+
+// Checks the data received from the host against the test pattern
+void usb_serial_impl::check_test_data(const uint8_t *data, int len)
+{
+    uint8_t seq = test_rx_seq;
+    for (int i = 0; i < len; i++) {
+        if (data[i] != seq) {
+            // resynchronize
+            usb_out_errors++;
+            seq = data[i];
+        }
+        seq++;
+    }
+
+    test_rx_seq = seq;
+    usb_out_bytes += len;
+}
+
+// Runs the UART loopback test: keeps the UART busy with the test pattern and checks the received data
+void usb_serial_impl::run_uart_loopback_test()
+{
+    uart.poll();
+
+    // keep the transmit buffer filled
+    uint8_t buf[64];
+    size_t avail;
+    while ((avail = uart.tx_data_avail()) > 0) {
+        int len = std::min(avail, sizeof(buf));
+        for (int i = 0; i < len; i++)
+            buf[i] = test_tx_seq++;
+        uart.transmit(buf, len);
+        uart_tx_bytes += len;
+    }
+
+    // sample the amount of received data and the time together
+    size_t rx_len = uart.rx_data_len();
+    if (rx_len == 0)
+        return;
+    uint32_t now = micros();
+
+    // check received data (the high bit is cleared for 7 data bits)
+    uint8_t mask = uart.databits() == 7 ? 0x7f : 0xff;
+    uint8_t seq = test_rx_seq;
+    size_t n = rx_len;
+    while (n > 0) {
+        size_t len = uart.copy_rx_data(buf, std::min(n, sizeof(buf)));
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] != (seq & mask)) {
+                // resynchronize
+                uart_rx_errors++;
+                seq = buf[i];
+            }
+            seq++;
+        }
+        n -= len;
+    }
+    test_rx_seq = seq;
+
+    // Idle time on the line: time since the last check minus the time needed
+    // for the received characters. Less than two characters is attributed to
+    // the measurement granularity.
+    if (uart_rx_bytes > 0) {
+        uint64_t char_ns = (uint64_t)uart_frame_half_bits() * 500000000 / uart.baudrate();
+        uint64_t elapsed_ns = (uint64_t)(now - uart_last_rx_time) * 1000;
+        uint64_t busy_ns = rx_len * char_ns;
+        if (elapsed_ns > busy_ns + 2 * char_ns) {
+            uint32_t gap_us = (uint32_t)((elapsed_ns - busy_ns) / 1000);
+            uart_gap_count++;
+            uart_gap_max_us = std::max(uart_gap_max_us, gap_us);
+            uart_gap_total_us += gap_us;
+        }
+    }
+
+    uart_last_rx_time = now;
+    uart_rx_bytes += rx_len;
+}
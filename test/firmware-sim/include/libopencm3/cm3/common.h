@@ -0,0 +1,56 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencm3/cm3/common.h>.
+//
+// Register access macros are identical to libopencm3. Peripheral registers
+// are mapped at their STM32 addresses by the simulator (see sim/mmio.cpp).
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#define BEGIN_DECLS extern "C" {
+#define END_DECLS }
+#else
+#define BEGIN_DECLS
+#define END_DECLS
+#endif
+
+#define MMIO8(addr) (*(volatile uint8_t *)(uintptr_t)(addr))
+#define MMIO16(addr) (*(volatile uint16_t *)(uintptr_t)(addr))
+#define MMIO32(addr) (*(volatile uint32_t *)(uintptr_t)(addr))
+#define MMIO64(addr) (*(volatile uint64_t *)(uintptr_t)(addr))
+
+#define BBIO_SRAM(addr, bit) \
+	MMIO32((((uint32_t)addr) & 0x0FFFFF) * 32 + 0x22000000 + (bit) * 4)
+
+#define BBIO_PERIPH(addr, bit) \
+	MMIO32((((uint32_t)addr) & 0x0FFFFF) * 32 + 0x42000000 + (bit) * 4)
+
+#define BIT0  (1 << 0)
+#define BIT1  (1 << 1)
+#define BIT2  (1 << 2)
+#define BIT3  (1 << 3)
+#define BIT4  (1 << 4)
+#define BIT5  (1 << 5)
+#define BIT6  (1 << 6)
+#define BIT7  (1 << 7)
+#define BIT8  (1 << 8)
+#define BIT9  (1 << 9)
+#define BIT10 (1 << 10)
+#define BIT11 (1 << 11)
+#define BIT12 (1 << 12)
+#define BIT13 (1 << 13)
+#define BIT14 (1 << 14)
+#define BIT15 (1 << 15)
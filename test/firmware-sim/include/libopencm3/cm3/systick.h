@@ -0,0 +1,49 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencm3/cm3/systick.h>.
+//
+
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define SCS_BASE (0xE000E000U)
+#define SYS_TICK_BASE (SCS_BASE + 0x0010)
+
+#define STK_CSR MMIO32(SYS_TICK_BASE + 0x00)
+#define STK_RVR MMIO32(SYS_TICK_BASE + 0x04)
+#define STK_CVR MMIO32(SYS_TICK_BASE + 0x08)
+#define STK_CALIB MMIO32(SYS_TICK_BASE + 0x0C)
+
+#define STK_CSR_COUNTFLAG (1 << 16)
+#define STK_CSR_CLKSOURCE_LSB 2
+#define STK_CSR_CLKSOURCE (1 << STK_CSR_CLKSOURCE_LSB)
+#define STK_CSR_CLKSOURCE_EXT (0 << STK_CSR_CLKSOURCE_LSB)
+#define STK_CSR_CLKSOURCE_AHB (1 << STK_CSR_CLKSOURCE_LSB)
+#define STK_CSR_CLKSOURCE_AHB_DIV8 (0 << STK_CSR_CLKSOURCE_LSB)
+#define STK_CSR_TICKINT (1 << 1)
+#define STK_CSR_ENABLE (1 << 0)
+
+#define STK_RVR_RELOAD 0x00FFFFFF
+
+BEGIN_DECLS
+
+void systick_set_reload(uint32_t value);
+uint32_t systick_get_reload(void);
+uint32_t systick_get_value(void);
+void systick_set_clocksource(uint8_t clocksource);
+void systick_interrupt_enable(void);
+void systick_interrupt_disable(void);
+void systick_counter_enable(void);
+void systick_counter_disable(void);
+
+void sys_tick_handler(void);
+
+END_DECLS
@@ -0,0 +1,20 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencm3/stm32/desig.h>.
+//
+
+#pragma once
+
+#include <libopencm3/stm32/memorymap.h>
+
+#define DESIG_FLASH_SIZE MMIO16(DESIG_FLASH_SIZE_BASE + 0x00)
+#define DESIG_UNIQUE_ID0 MMIO32(DESIG_UNIQUE_ID_BASE + 0x00)
+#define DESIG_UNIQUE_ID1 MMIO32(DESIG_UNIQUE_ID_BASE + 0x04)
+#define DESIG_UNIQUE_ID2 MMIO32(DESIG_UNIQUE_ID_BASE + 0x08)
@@ -0,0 +1,46 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencm3/stm32/memorymap.h> (STM32F1 memory map).
+//
+
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#if !defined(STM32F1)
+#error "The firmware simulator only implements the STM32F1 peripherals"
+#endif
+
+#define PERIPH_BASE (0x40000000U)
+#define PERIPH_BASE_APB1 (PERIPH_BASE + 0x00000)
+#define PERIPH_BASE_APB2 (PERIPH_BASE + 0x10000)
+#define PERIPH_BASE_AHB (PERIPH_BASE + 0x18000)
+
+// APB1
+#define USART2_BASE (PERIPH_BASE_APB1 + 0x4400)
+#define USART3_BASE (PERIPH_BASE_APB1 + 0x4800)
+#define USB_DEV_FS_BASE (PERIPH_BASE_APB1 + 0x5c00)
+// (pointer-sized as qsb converts PMA addresses to pointers)
+#define USB_PMA_BASE ((uintptr_t)PERIPH_BASE_APB1 + 0x6000)
+
+// APB2
+#define AFIO_BASE (PERIPH_BASE_APB2 + 0x0000)
+#define GPIO_PORT_A_BASE (PERIPH_BASE_APB2 + 0x0800)
+#define GPIO_PORT_B_BASE (PERIPH_BASE_APB2 + 0x0c00)
+#define GPIO_PORT_C_BASE (PERIPH_BASE_APB2 + 0x1000)
+#define USART1_BASE (PERIPH_BASE_APB2 + 0x3800)
+
+// AHB
+#define DMA1_BASE (PERIPH_BASE_AHB + 0x8000)
+#define RCC_BASE (PERIPH_BASE_AHB + 0x9000)
+
+// Device electronic signature
+#define DESIG_FLASH_SIZE_BASE (0x1FFFF7E0U)
+#define DESIG_UNIQUE_ID_BASE (0x1FFFF7E8U)
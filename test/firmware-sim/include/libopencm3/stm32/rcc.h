@@ -0,0 +1,65 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencm3/stm32/rcc.h> (STM32F1 subset).
+//
+
+#pragma once
+
+#include <libopencm3/stm32/memorymap.h>
+
+#define RCC_CR MMIO32(RCC_BASE + 0x00)
+#define RCC_CFGR MMIO32(RCC_BASE + 0x04)
+#define RCC_CIR MMIO32(RCC_BASE + 0x08)
+#define RCC_APB2RSTR MMIO32(RCC_BASE + 0x0c)
+#define RCC_APB1RSTR MMIO32(RCC_BASE + 0x10)
+#define RCC_AHBENR MMIO32(RCC_BASE + 0x14)
+#define RCC_APB2ENR MMIO32(RCC_BASE + 0x18)
+#define RCC_APB1ENR MMIO32(RCC_BASE + 0x1c)
+
+#define RCC_APB1RSTR_USBRST (1 << 23)
+
+// Peripheral clock enable: register offset in upper bits, bit number in lower 5 bits
+#define _REG_BIT(base, bit) (((base) << 5) + (bit))
+
+enum rcc_periph_clken {
+	RCC_DMA1 = _REG_BIT(0x14, 0),
+	RCC_AFIO = _REG_BIT(0x18, 0),
+	RCC_GPIOA = _REG_BIT(0x18, 2),
+	RCC_GPIOB = _REG_BIT(0x18, 3),
+	RCC_GPIOC = _REG_BIT(0x18, 4),
+	RCC_USART1 = _REG_BIT(0x18, 14),
+	RCC_USART2 = _REG_BIT(0x1c, 17),
+	RCC_USART3 = _REG_BIT(0x1c, 18),
+	RCC_USB = _REG_BIT(0x1c, 23),
+};
+
+enum rcc_periph_rst {
+	RST_AFIO = _REG_BIT(0x0c, 0),
+	RST_GPIOA = _REG_BIT(0x0c, 2),
+	RST_GPIOB = _REG_BIT(0x0c, 3),
+	RST_GPIOC = _REG_BIT(0x0c, 4),
+	RST_USART1 = _REG_BIT(0x0c, 14),
+	RST_USART2 = _REG_BIT(0x10, 17),
+	RST_USART3 = _REG_BIT(0x10, 18),
+	RST_USB = _REG_BIT(0x10, 23),
+};
+
+BEGIN_DECLS
+
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+extern uint32_t rcc_apb2_frequency;
+
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void);
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_periph_clock_disable(enum rcc_periph_clken clken);
+void rcc_periph_reset_pulse(enum rcc_periph_rst rst);
+
+END_DECLS
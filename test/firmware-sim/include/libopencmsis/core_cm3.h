@@ -0,0 +1,24 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host replacement for <libopencmsis/core_cm3.h>.
+//
+
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/systick.h>
+
+// Simulated interrupts (SysTick) are delivered between peripheral
+// accesses and cannot be masked.
+static inline void __enable_irq(void) { }
+static inline void __disable_irq(void) { }
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __ISB(void) { __sync_synchronize(); }
+static inline void __NOP(void) { }
@@ -0,0 +1,127 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Runs the firmware on the host against simulated STM32F1 peripherals.
+// The USB side of the adapter appears as a pseudo terminal (like /dev/ttyACM0).
+// The UART side is either connected to a second pseudo terminal or looped
+// back (TX to RX, RTS to CTS).
+//
+// Comand line syntax: firmware-sim [ OPTIONS... ]
+//
+// Example (loopback test against the simulated adapter):
+//
+//     ./firmware-sim --loopback --link /tmp/ttySIM0 &
+//     ../loopback-linux/build/loopback-linux -b 115200 /tmp/ttySIM0
+//
+
+#include "cxxopts.hpp"
+#include "pty.hpp"
+#include "sim/sim.hpp"
+#include <signal.h>
+#include <unistd.h>
+#include <iostream>
+
+static std::string usb_link_path;
+static std::string uart_link_path;
+
+static void remove_links()
+{
+    if (!usb_link_path.empty())
+        unlink(usb_link_path.c_str());
+    if (!uart_link_path.empty())
+        unlink(uart_link_path.c_str());
+}
+
+static void on_terminate(int)
+{
+    remove_links();
+    _exit(0);
+}
+
+static void create_link(const std::string& link_path, const std::string& target)
+{
+    unlink(link_path.c_str());
+    if (symlink(target.c_str(), link_path.c_str()) != 0)
+        throw std::runtime_error("Unable to create symbolic link " + link_path);
+}
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    cxxopts::Options options("firmware-sim", "USB serial firmware running against simulated peripherals");
+
+    options.add_options()
+        ("l,loopback", "Connect UART TX to RX and RTS to CTS (instead of a second terminal)")
+        ("link", "Symbolic link to create for the USB side terminal", cxxopts::value<std::string>())
+        ("uart-link", "Symbolic link to create for the UART side terminal", cxxopts::value<std::string>())
+        ("v,verbose", "Log USB enumeration and control requests")
+        ("h,help", "Show usage");
+
+    sim_options sim_opts;
+    bool is_loopback;
+
+    try {
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") != 0) {
+            std::cout << options.help() << std::endl;
+            return 2;
+        }
+
+        is_loopback = result.count("loopback") > 0;
+        sim_opts.verbose = result.count("verbose") > 0;
+        if (result.count("link") > 0)
+            usb_link_path = result["link"].as<std::string>();
+        if (result.count("uart-link") > 0)
+            uart_link_path = result["uart-link"].as<std::string>();
+
+    } catch (const cxxopts::OptionException& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return 3;
+    }
+
+    try {
+        static pty usb_port;
+        static pty_usb_app usb_app(usb_port);
+        static sim_loopback_peer loopback_peer;
+        static pty* uart_port = nullptr;
+        sim_line_peer* line_peer = &loopback_peer;
+
+        if (!is_loopback) {
+            uart_port = new pty();
+            line_peer = new pty_line_peer(*uart_port);
+        }
+
+        signal(SIGINT, on_terminate);
+        signal(SIGTERM, on_terminate);
+
+        if (!usb_link_path.empty())
+            create_link(usb_link_path, usb_port.path());
+        if (!uart_link_path.empty() && uart_port != nullptr)
+            create_link(uart_link_path, uart_port->path());
+
+        std::cout << "USB side:  " << usb_port.path() << std::endl;
+        if (uart_port != nullptr)
+            std::cout << "UART side: " << uart_port->path() << std::endl;
+        else
+            std::cout << "UART side: loopback" << std::endl;
+
+        sim_init(sim_opts, line_peer, &usb_app);
+        sim_run_firmware();
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        remove_links();
+        return 1;
+    }
+}
@@ -0,0 +1,198 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Pseudo terminals connecting the simulated adapter to host applications.
+//
+// All functions except the constructor are called from the simulator's
+// signal handlers and only use async-signal-safe system calls.
+//
+
+#include "pty.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <asm-generic/termbits.h>
+#include <asm-generic/ioctls.h>
+#include <sys/ioctl.h>
+#include <stdexcept>
+
+// Minimum interval between reads from a terminal that had no data (in ns)
+static constexpr uint64_t IDLE_READ_INTERVAL_NS = 50000;
+
+pty::pty()
+{
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0)
+        throw std::runtime_error(std::string("Unable to create pseudo terminal: ") + strerror(errno));
+
+    _path = ptsname(master_fd);
+
+    // Keep the slave side open so the master doesn't see a hangup
+    // when applications close the terminal.
+    slave_fd = open(_path.c_str(), O_RDWR | O_NOCTTY);
+    if (slave_fd < 0)
+        throw std::runtime_error(std::string("Unable to open pseudo terminal: ") + strerror(errno));
+
+    struct termios2 options;
+    ioctl(slave_fd, TCGETS2, &options);
+    options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    options.c_oflag &= ~OPOST;
+    options.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    options.c_cflag &= ~(CSIZE | PARENB | CBAUD);
+    options.c_cflag |= CS8 | BOTHER;
+    options.c_ispeed = 9600;
+    options.c_ospeed = 9600;
+    ioctl(slave_fd, TCSETS2, &options);
+}
+
+size_t pty::read(uint8_t* buf, size_t len)
+{
+    ssize_t n = ::read(master_fd, buf, len);
+    return n > 0 ? n : 0;
+}
+
+size_t pty::write(const uint8_t* buf, size_t len)
+{
+    ssize_t n = ::write(master_fd, buf, len);
+    return n > 0 ? n : 0;
+}
+
+pty::line_coding pty::get_line_coding() const
+{
+    struct termios2 options;
+    ioctl(slave_fd, TCGETS2, &options);
+
+    line_coding coding;
+    coding.baudrate = options.c_ospeed;
+    coding.databits = (options.c_cflag & CSIZE) == CS7 ? 7 : 8;
+    coding.stopbits = (options.c_cflag & CSTOPB) != 0 ? 2 : 0;
+    coding.parity = (options.c_cflag & PARENB) == 0 ? 0 : (options.c_cflag & PARODD) != 0 ? 1 : 2;
+    return coding;
+}
+
+bool pty::line_coding::operator==(const line_coding& other) const
+{
+    return baudrate == other.baudrate && databits == other.databits && stopbits == other.stopbits
+        && parity == other.parity;
+}
+
+// --- USB side
+
+pty_usb_app::pty_usb_app(pty& port) : port(port) { }
+
+void pty_usb_app::on_configured(uint64_t)
+{
+    // like the Linux CDC ACM driver when the terminal is opened
+    line_coding = port.get_line_coding();
+    sim_usb_set_line_coding(line_coding.baudrate, line_coding.databits, line_coding.stopbits, line_coding.parity);
+    sim_usb_set_control_line_state(true, true);
+}
+
+size_t pty_usb_app::fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns)
+{
+    if (t_ns < next_read_ns)
+        return 0;
+
+    size_t n = port.read(buf, max_len);
+    if (n == 0)
+        next_read_ns = t_ns + IDLE_READ_INTERVAL_NS;
+    return n;
+}
+
+bool pty_usb_app::can_receive_in_data(uint64_t)
+{
+    return in_buf_size - in_buf_len >= 64;
+}
+
+void pty_usb_app::on_in_data(const uint8_t* data, size_t len, uint64_t)
+{
+    memcpy(in_buf + in_buf_len, data, len);
+    in_buf_len += len;
+    flush_in_data();
+}
+
+void pty_usb_app::flush_in_data()
+{
+    if (in_buf_len == 0)
+        return;
+
+    size_t n = port.write(in_buf, in_buf_len);
+    memmove(in_buf, in_buf + n, in_buf_len - n);
+    in_buf_len -= n;
+}
+
+void pty_usb_app::poll(uint64_t)
+{
+    flush_in_data();
+
+    if (!sim_usb_is_configured())
+        return;
+
+    pty::line_coding coding = port.get_line_coding();
+    if (!(coding == line_coding)) {
+        line_coding = coding;
+        sim_usb_set_line_coding(coding.baudrate, coding.databits, coding.stopbits, coding.parity);
+    }
+}
+
+// --- UART side
+
+pty_line_peer::pty_line_peer(pty& port) : port(port) { }
+
+void pty_line_peer::on_char_transmitted(uint16_t data, uint64_t)
+{
+    if (tx_buf_len < buf_size)
+        tx_buf[tx_buf_len++] = (uint8_t)data;
+    flush_tx_data();
+}
+
+bool pty_line_peer::is_ready_to_receive(uint64_t)
+{
+    flush_tx_data();
+    return tx_buf_len < buf_size / 2;
+}
+
+void pty_line_peer::on_rts_changed(bool asserted, uint64_t)
+{
+    is_rts_asserted = asserted;
+}
+
+bool pty_line_peer::fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns)
+{
+    if (!is_rts_asserted)
+        return false;
+
+    if (rx_buf_pos == rx_buf_len) {
+        if (t_ns < next_read_ns)
+            return false;
+        rx_buf_len = port.read(rx_buf, buf_size);
+        rx_buf_pos = 0;
+        if (rx_buf_len == 0) {
+            next_read_ns = t_ns + IDLE_READ_INTERVAL_NS;
+            return false;
+        }
+    }
+
+    *data = rx_buf[rx_buf_pos++];
+    *end_ns = 0;
+    return true;
+}
+
+void pty_line_peer::flush_tx_data()
+{
+    if (tx_buf_len == 0)
+        return;
+
+    size_t n = port.write(tx_buf, tx_buf_len);
+    memmove(tx_buf, tx_buf + n, tx_buf_len - n);
+    tx_buf_len -= n;
+}
@@ -0,0 +1,114 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Pseudo terminals connecting the simulated adapter to host applications.
+//
+
+#pragma once
+
+#include "sim/sim.hpp"
+#include <string>
+
+/**
+ * @brief Pseudo terminal (master side, non-blocking).
+ */
+class pty {
+public:
+    /**
+     * @brief Creates a new pseudo terminal in raw mode.
+     */
+    pty();
+
+    /**
+     * @brief Gets the path of the terminal device (slave side).
+     */
+    const std::string& path() const { return _path; }
+
+    /// Reads available data, returns the number of bytes read (0 if no data is available)
+    size_t read(uint8_t* buf, size_t len);
+    /// Writes as much data as possible, returns the number of bytes written
+    size_t write(const uint8_t* buf, size_t len);
+
+    /// Line coding set by the application using the terminal
+    struct line_coding {
+        uint32_t baudrate;
+        uint8_t databits;
+        uint8_t stopbits;
+        uint8_t parity;
+
+        bool operator==(const line_coding& other) const;
+    };
+
+    /**
+     * @brief Gets the line coding set by the application using the terminal.
+     */
+    line_coding get_line_coding() const;
+
+private:
+    int master_fd;
+    int slave_fd;
+    std::string _path;
+};
+
+/**
+ * @brief USB host application forwarding data between the CDC ACM interface and a pseudo terminal.
+ *
+ * Line coding changes on the terminal are sent as SET_LINE_CODING requests.
+ */
+class pty_usb_app : public sim_usb_app {
+public:
+    pty_usb_app(pty& port);
+
+    void on_configured(uint64_t t_ns) override;
+    size_t fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns) override;
+    bool can_receive_in_data(uint64_t t_ns) override;
+    void on_in_data(const uint8_t* data, size_t len, uint64_t t_ns) override;
+    void poll(uint64_t t_ns) override;
+
+private:
+    static constexpr size_t in_buf_size = 4096;
+
+    pty& port;
+    uint8_t in_buf[in_buf_size];
+    size_t in_buf_len = 0;
+    uint64_t next_read_ns = 0;
+    pty::line_coding line_coding;
+
+    void flush_in_data();
+};
+
+/**
+ * @brief Serial line peer forwarding data between the adapter's UART and a pseudo terminal.
+ *
+ * The peer stops sending when RTS is deasserted and deasserts CTS
+ * if the terminal can't accept more data.
+ */
+class pty_line_peer : public sim_line_peer {
+public:
+    pty_line_peer(pty& port);
+
+    void on_char_transmitted(uint16_t data, uint64_t end_ns) override;
+    bool is_ready_to_receive(uint64_t t_ns) override;
+    void on_rts_changed(bool asserted, uint64_t t_ns) override;
+    bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) override;
+
+private:
+    static constexpr size_t buf_size = 1024;
+
+    pty& port;
+    uint8_t tx_buf[buf_size];
+    size_t tx_buf_len = 0;
+    uint8_t rx_buf[buf_size];
+    size_t rx_buf_len = 0;
+    size_t rx_buf_pos = 0;
+    uint64_t next_read_ns = 0;
+    bool is_rts_asserted = false;
+
+    void flush_tx_data();
+};
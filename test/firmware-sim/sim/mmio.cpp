@@ -0,0 +1,383 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Memory-mapped peripheral registers.
+//
+// The peripheral address ranges are mapped twice from the same memory file:
+// once at the STM32 addresses for the firmware and once at an arbitrary
+// address for the models. The firmware's view is write-protected (the USB
+// and USART register pages are fully protected). A faulting access synchronizes the
+// models and emulates the instruction if it is a simple move (the common
+// case for volatile register accesses). Other instructions are executed by
+// unprotecting the page and single-stepping the instruction; the trap after
+// the single step applies the register's read or write semantics and
+// protects the page again.
+//
+// Only implemented for Linux on x86-64.
+//
+
+#include "model.hpp"
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/stm32/memorymap.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "The firmware simulator requires Linux on x86-64"
+#endif
+
+static constexpr uint32_t PAGE_SIZE = 0x1000;
+static constexpr uint32_t PAGE_MASK = ~(PAGE_SIZE - 1);
+
+// x86 trap flag (single step)
+static constexpr greg_t EFLAGS_TF = 0x100;
+// page fault error code: write access
+static constexpr greg_t PF_WRITE = 0x2;
+// Number of watchdog periods (100 us each) without any register access after
+// which the firmware is considered idle in virtual time
+static constexpr int WATCHDOG_IDLE_PERIODS = 10;
+
+struct mmio_region {
+    uint32_t base;
+    uint32_t size;
+    uint8_t* alias;
+};
+
+// Bit-band alias of the peripheral region (one 32-bit word per bit)
+static constexpr uint32_t PERIPH_BB_BASE = 0x42000000;
+static constexpr uint32_t PERIPH_SIZE = 0x30000;
+
+static mmio_region regions[] = {
+    { PERIPH_BASE, PERIPH_SIZE, nullptr },     // APB1, APB2 and AHB peripherals
+    { PERIPH_BB_BASE, PERIPH_SIZE * 32, nullptr }, // bit-band alias of peripherals
+    { SCS_BASE, PAGE_SIZE, nullptr },          // system control space (SysTick)
+    { DESIG_FLASH_SIZE_BASE & PAGE_MASK, PAGE_SIZE, nullptr }, // device electronic signature
+};
+
+static struct {
+    bool active;
+    bool is_write;
+    uint32_t addr;
+    uint32_t old_value;
+} trap;
+
+static bool is_in_sync;
+static volatile sig_atomic_t has_synced;
+static int idle_alarms;
+
+static mmio_region* find_region(uintptr_t addr)
+{
+    for (auto& region : regions)
+        if (addr >= region.base && addr < (uintptr_t)region.base + region.size)
+            return &region;
+    return nullptr;
+}
+
+volatile uint32_t& sim_reg(uint32_t addr)
+{
+    mmio_region* region = find_region(addr);
+    if (region == nullptr) {
+        fprintf(stderr, "Simulator: access to unmapped register 0x%08x\n", addr);
+        abort();
+    }
+    return *(volatile uint32_t*)(region->alias + (addr & ~3U) - region->base);
+}
+
+static bool is_bitband_alias(uintptr_t addr)
+{
+    return addr >= PERIPH_BB_BASE && addr < PERIPH_BB_BASE + PERIPH_SIZE * 32;
+}
+
+static int page_protection(uint32_t page)
+{
+    if (is_bitband_alias(page))
+        return PROT_NONE; // bit-band alias: always emulated
+    if (page == (USB_DEV_FS_BASE & PAGE_MASK))
+        return PROT_NONE; // USB registers: trap reads as well
+    if (page == (USART2_BASE & PAGE_MASK))
+        return PROT_NONE; // USART registers: reads clear error flags
+    if (page == USB_PMA_BASE)
+        return PROT_READ | PROT_WRITE; // packet memory: plain memory
+    return PROT_READ;
+}
+
+static void protect_region(const mmio_region& region)
+{
+    for (uint32_t page = region.base; page < region.base + region.size; page += PAGE_SIZE)
+        mprotect((void*)(uintptr_t)page, PAGE_SIZE, page_protection(page));
+}
+
+static void sync(bool is_idle)
+{
+    is_in_sync = true;
+    sim_sync(is_idle);
+    is_in_sync = false;
+    has_synced = 1;
+}
+
+// general purpose registers in x86-64 encoding order
+static constexpr int gp_regs[16] = { REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15 };
+
+/**
+ * @brief Emulates a register access by a simple move instruction.
+ *
+ * Supported: MOV r/m,r (89, 88), MOV r,r/m (8B, 8A), MOV r/m,imm (C7, C6),
+ * MOVZX r,r/m (0F B6, 0F B7), with 16-bit operand size prefix and REX prefix.
+ *
+ * @param uc signal context
+ * @param addr accessed address
+ * @return `true` if the instruction has been emulated, `false` if it isn't supported
+ */
+static bool emulate_access(ucontext_t* uc, uintptr_t addr)
+{
+    greg_t* gregs = uc->uc_mcontext.gregs;
+    const uint8_t* p = (const uint8_t*)gregs[REG_RIP];
+
+    // prefixes
+    bool is_16bit = false;
+    while (true) {
+        if (*p == 0x66)
+            is_16bit = true;
+        else if (*p != 0x2e && *p != 0x3e && *p != 0x26 && *p != 0x36 && *p != 0x64 && *p != 0x65)
+            break;
+        p++;
+    }
+    uint8_t rex = 0;
+    if ((*p & 0xf0) == 0x40)
+        rex = *p++;
+    if ((rex & 0x08) != 0)
+        return false; // 64-bit operand
+
+    // opcode
+    enum { load, load_zx, store_reg, store_imm } kind;
+    int width;
+    uint8_t opcode = *p++;
+    switch (opcode) {
+    case 0x89: kind = store_reg; width = is_16bit ? 2 : 4; break;
+    case 0x88: kind = store_reg; width = 1; break;
+    case 0x8b: kind = load; width = is_16bit ? 2 : 4; break;
+    case 0x8a: kind = load; width = 1; break;
+    case 0xc7: kind = store_imm; width = is_16bit ? 2 : 4; break;
+    case 0xc6: kind = store_imm; width = 1; break;
+    case 0x0f:
+        opcode = *p++;
+        if (opcode != 0xb6 && opcode != 0xb7)
+            return false;
+        kind = load_zx;
+        width = opcode == 0xb6 ? 1 : 2;
+        break;
+    default:
+        return false;
+    }
+
+    // ModR/M, SIB and displacement (the address is already known)
+    uint8_t modrm = *p++;
+    int mod = modrm >> 6;
+    int reg = ((modrm >> 3) & 7) | ((rex & 0x04) << 1);
+    int rm = modrm & 7;
+    if (mod == 3)
+        return false;
+    if (rm == 4) {
+        uint8_t sib = *p++;
+        if (mod == 0 && (sib & 7) == 5)
+            p += 4;
+    } else if (mod == 0 && rm == 5) {
+        p += 4; // RIP-relative
+    }
+    if (mod == 1)
+        p += 1;
+    else if (mod == 2)
+        p += 4;
+
+    // 8-bit registers AH, CH, DH, BH
+    if (width == 1 && rex == 0 && reg >= 4 && kind != store_imm)
+        return false;
+    if (kind == store_imm && (reg & 7) != 0)
+        return false;
+
+    uint32_t reg_addr;
+    int shift;
+    uint32_t mask;
+    if (is_bitband_alias(addr)) {
+        // bit-band alias: access single bit of peripheral register
+        uint32_t offset = ((uint32_t)addr - PERIPH_BB_BASE) / 4;
+        reg_addr = PERIPH_BASE + (offset / 8 & ~3U);
+        shift = offset % 32;
+        mask = 1U << shift;
+    } else {
+        reg_addr = (uint32_t)addr & ~3U;
+        shift = (addr & 3) * 8;
+        mask = width == 4 ? 0xffffffff : ((1U << (width * 8)) - 1) << shift;
+    }
+    volatile uint32_t& value = sim_reg(reg_addr);
+
+    if (kind == load || kind == load_zx) {
+        uint64_t data = (value & mask) >> shift;
+        greg_t& r = gregs[gp_regs[reg]];
+        if (kind == load_zx || width == 4)
+            r = data; // zero-extended
+        else
+            r = (r & ~(greg_t)((1ULL << (width * 8)) - 1)) | data;
+        sim_register_read(reg_addr);
+
+    } else {
+        uint32_t data;
+        if (kind == store_imm) {
+            data = 0;
+            for (int i = 0; i < width; i++)
+                data |= (uint32_t)p[i] << (i * 8);
+            p += width;
+        } else {
+            data = (uint32_t)gregs[gp_regs[reg]];
+        }
+        uint32_t old_value = value;
+        uint32_t new_value = (old_value & ~mask) | ((data << shift) & mask);
+        value = new_value;
+        value = sim_register_written(reg_addr, old_value, new_value);
+    }
+
+    gregs[REG_RIP] = (greg_t)p;
+    return true;
+}
+
+static void on_segv(int, siginfo_t* info, void* context)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    if (trap.active || find_region(addr) == nullptr) {
+        // genuine segmentation fault: crash on return
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    ucontext_t* uc = (ucontext_t*)context;
+    sync(false);
+
+    if (emulate_access(uc, addr))
+        return;
+
+    if (is_bitband_alias(addr)) {
+        fprintf(stderr, "Simulator: unsupported instruction for bit-band access at 0x%08x\n", (uint32_t)addr);
+        abort();
+    }
+
+    trap.active = true;
+    trap.is_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+    trap.addr = (uint32_t)addr & ~3U;
+    trap.old_value = sim_reg(trap.addr);
+
+    mprotect((void*)(addr & PAGE_MASK), PAGE_SIZE, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void on_trap(int, siginfo_t*, void* context)
+{
+    if (!trap.active) {
+        signal(SIGTRAP, SIG_DFL);
+        return;
+    }
+
+    ucontext_t* uc = (ucontext_t*)context;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+
+    if (trap.is_write) {
+        volatile uint32_t& reg = sim_reg(trap.addr);
+        reg = sim_register_written(trap.addr, trap.old_value, reg);
+    } else {
+        sim_register_read(trap.addr);
+    }
+
+    uint32_t page = trap.addr & PAGE_MASK;
+    mprotect((void*)(uintptr_t)page, PAGE_SIZE, page_protection(page));
+    trap.active = false;
+}
+
+// Watchdog: keeps the models running while the firmware isn't accessing
+// any peripherals, e.g. during a busy wait for the SysTick counter.
+// In virtual time, the idle sync skips to the next SysTick. So the firmware is
+// only considered idle after several periods; a single period can be missed
+// if the process is preempted or the firmware is busy computing.
+static void on_alarm(int)
+{
+    if (trap.active || is_in_sync)
+        return;
+
+    if (has_synced) {
+        has_synced = 0;
+        idle_alarms = 0;
+        return;
+    }
+
+    idle_alarms++;
+    if (!sim_opts.virtual_time || idle_alarms >= WATCHDOG_IDLE_PERIODS) {
+        idle_alarms = 0;
+        sync(true);
+        has_synced = 0;
+    }
+}
+
+void sim_mmio_init()
+{
+    size_t total_size = 0;
+    for (auto& region : regions)
+        total_size += region.size;
+
+    int fd = memfd_create("stm32-periph", 0);
+    if (fd < 0 || ftruncate(fd, total_size) != 0) {
+        perror("Simulator: cannot create peripheral memory");
+        exit(1);
+    }
+
+    off_t offset = 0;
+    for (auto& region : regions) {
+        void* alias = mmap(nullptr, region.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        void* view = mmap((void*)(uintptr_t)region.base, region.size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_FIXED_NOREPLACE, fd, offset);
+        if (alias == MAP_FAILED || view != (void*)(uintptr_t)region.base) {
+            fprintf(stderr, "Simulator: cannot map peripheral registers at 0x%08x\n", region.base);
+            exit(1);
+        }
+        region.alias = (uint8_t*)alias;
+        offset += region.size;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIGALRM);
+    sa.sa_sigaction = on_segv;
+    sigaction(SIGSEGV, &sa, nullptr);
+    sa.sa_sigaction = on_trap;
+    sigaction(SIGTRAP, &sa, nullptr);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = on_alarm;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, nullptr);
+}
+
+void sim_mmio_start()
+{
+    for (auto& region : regions)
+        protect_region(region);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 100;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_REAL, &timer, nullptr);
+}
@@ -0,0 +1,119 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Internal interfaces between the memory-mapped I/O layer and the peripheral models.
+//
+// All model functions run in signal handler context (on the firmware thread)
+// and access the registers through `sim_reg()`, which bypasses the traps.
+//
+
+#pragma once
+
+#include "sim.hpp"
+
+/// Simulation options (set by `sim_init()`)
+extern sim_options sim_opts;
+/// Peer connected to the serial line
+extern sim_line_peer* sim_line;
+/// Application on the USB host
+extern sim_usb_app* sim_app;
+/// Statistics
+extern sim_stats sim_stat;
+
+// --- Memory-mapped I/O (mmio.cpp)
+
+/**
+ * @brief Maps the peripheral registers and installs the trap handlers.
+ */
+void sim_mmio_init();
+
+/**
+ * @brief Protects the peripheral registers and starts the watchdog timer.
+ */
+void sim_mmio_start();
+
+/**
+ * @brief Gets a register for direct access by the models (no trap).
+ *
+ * @param addr STM32 address of register
+ * @return register reference
+ */
+volatile uint32_t& sim_reg(uint32_t addr);
+
+// --- Core (sim.cpp)
+
+/**
+ * @brief Number of state changes visible to the firmware.
+ *
+ * Incremented by the models and for register writes changing a register.
+ * Used to detect busy waiting in virtual time.
+ */
+extern uint64_t sim_activity;
+
+/**
+ * @brief Advances the simulated time and updates all peripheral models.
+ *
+ * Called before each trapped peripheral access and from the watchdog timer.
+ *
+ * @param is_idle `true` if called by the watchdog timer (firmware is not accessing peripherals)
+ */
+void sim_sync(bool is_idle);
+
+/**
+ * @brief Applies the register write semantics.
+ *
+ * Called after the firmware has written to a peripheral register.
+ *
+ * @param addr STM32 address of register
+ * @param old_value register value before the write
+ * @param value value written by the firmware
+ * @return new register value
+ */
+uint32_t sim_register_written(uint32_t addr, uint32_t old_value, uint32_t value);
+
+/**
+ * @brief Applies the side effects of a register read.
+ *
+ * Called after the firmware has read a peripheral register
+ * on a page trapping reads.
+ *
+ * @param addr STM32 address of register
+ */
+void sim_register_read(uint32_t addr);
+
+// --- GPIO (sim.cpp)
+
+/**
+ * @brief Gets the output level of a GPIO pin.
+ *
+ * @param port GPIO port base address
+ * @param pin pin mask
+ * @return `true` for high level
+ */
+bool sim_gpio_output(uint32_t port, uint16_t pin);
+
+// --- USART and DMA (usart.cpp)
+
+void sim_usart_reset();
+void sim_usart_update(uint64_t t_ns);
+uint32_t sim_dma_register_written(uint32_t addr, uint32_t old_value, uint32_t value);
+void sim_usart_register_read(uint32_t addr);
+void sim_usart_rts_changed(bool asserted, uint64_t t_ns);
+/// Gets the level of the CTS input (`true` = high = not asserted)
+bool sim_usart_cts_level(uint64_t t_ns);
+/// Time of the next USART or DMA event (or `UINT64_MAX` if unknown)
+uint64_t sim_usart_next_event_ns();
+
+// --- USB device and host (usb.cpp)
+
+void sim_usb_reset();
+void sim_usb_update(uint64_t t_ns);
+uint32_t sim_usb_register_written(uint32_t addr, uint32_t old_value, uint32_t value);
+/// Time of the next USB event (or `UINT64_MAX` if unknown)
+uint64_t sim_usb_next_event_ns();
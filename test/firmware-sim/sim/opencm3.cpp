@@ -0,0 +1,366 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Host implementation of the libopencm3 functions used by the firmware.
+// The implementations follow libopencm3 and access the registers through
+// the regular (trapped) register macros.
+//
+
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+
+// --- RCC
+
+uint32_t rcc_ahb_frequency = 8000000;
+uint32_t rcc_apb1_frequency = 8000000;
+uint32_t rcc_apb2_frequency = 8000000;
+
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void)
+{
+    RCC_CFGR = (0x7 << 18) | (1 << 16) | (0x4 << 8) | 0x2; // PLL x9 from HSE, APB1 = HCLK / 2
+    rcc_ahb_frequency = 72000000;
+    rcc_apb1_frequency = 36000000;
+    rcc_apb2_frequency = 72000000;
+}
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+    MMIO32(RCC_BASE + (clken >> 5)) |= 1 << (clken & 0x1f);
+}
+
+void rcc_periph_clock_disable(enum rcc_periph_clken clken)
+{
+    MMIO32(RCC_BASE + (clken >> 5)) &= ~(1 << (clken & 0x1f));
+}
+
+void rcc_periph_reset_pulse(enum rcc_periph_rst rst)
+{
+    MMIO32(RCC_BASE + (rst >> 5)) |= 1 << (rst & 0x1f);
+    MMIO32(RCC_BASE + (rst >> 5)) &= ~(1 << (rst & 0x1f));
+}
+
+// --- SysTick
+
+void systick_set_reload(uint32_t value)
+{
+    STK_RVR = value & STK_RVR_RELOAD;
+}
+
+uint32_t systick_get_reload(void)
+{
+    return STK_RVR & STK_RVR_RELOAD;
+}
+
+uint32_t systick_get_value(void)
+{
+    return STK_CVR;
+}
+
+void systick_set_clocksource(uint8_t clocksource)
+{
+    STK_CSR = (STK_CSR & ~STK_CSR_CLKSOURCE) | (clocksource & STK_CSR_CLKSOURCE);
+}
+
+void systick_interrupt_enable(void)
+{
+    STK_CSR |= STK_CSR_TICKINT;
+}
+
+void systick_interrupt_disable(void)
+{
+    STK_CSR &= ~STK_CSR_TICKINT;
+}
+
+void systick_counter_enable(void)
+{
+    STK_CSR |= STK_CSR_ENABLE;
+}
+
+void systick_counter_disable(void)
+{
+    STK_CSR &= ~STK_CSR_ENABLE;
+}
+
+// --- GPIO
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+    GPIO_BSRR(gpioport) = gpios;
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+    GPIO_BSRR(gpioport) = (uint32_t)gpios << 16;
+}
+
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios)
+{
+    return gpio_port_read(gpioport) & gpios;
+}
+
+void gpio_toggle(uint32_t gpioport, uint16_t gpios)
+{
+    uint32_t port = GPIO_ODR(gpioport);
+    GPIO_BSRR(gpioport) = ((port & gpios) << 16) | (~port & gpios);
+}
+
+uint16_t gpio_port_read(uint32_t gpioport)
+{
+    return (uint16_t)GPIO_IDR(gpioport);
+}
+
+void gpio_port_write(uint32_t gpioport, uint16_t data)
+{
+    GPIO_ODR(gpioport) = data;
+}
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
+{
+    uint32_t crl = GPIO_CRL(gpioport);
+    uint32_t crh = GPIO_CRH(gpioport);
+
+    for (int i = 0; i < 16; i++) {
+        if (((gpios >> i) & 1) == 0)
+            continue;
+
+        uint32_t value = (cnf << 2) | mode;
+        if (i < 8) {
+            crl = (crl & ~(0xf << (i * 4))) | (value << (i * 4));
+        } else {
+            crh = (crh & ~(0xf << ((i - 8) * 4))) | (value << ((i - 8) * 4));
+        }
+    }
+
+    GPIO_CRL(gpioport) = crl;
+    GPIO_CRH(gpioport) = crh;
+}
+
+// --- DMA
+
+void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) = 0;
+    DMA_CNDTR(dma, channel) = 0;
+    DMA_CPAR(dma, channel) = 0;
+    DMA_CMAR(dma, channel) = 0;
+    DMA_IFCR(dma) |= DMA_IFLAGS << DMA_FLAG_OFFSET(channel);
+}
+
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+    DMA_IFCR(dma) = interrupts << DMA_FLAG_OFFSET(channel);
+}
+
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+    return (DMA_ISR(dma) & (interrupts << DMA_FLAG_OFFSET(channel))) != 0;
+}
+
+void dma_enable_mem2mem_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_MEM2MEM;
+    DMA_CCR(dma, channel) &= ~DMA_CCR_CIRC;
+}
+
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_PL_MASK) | prio;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_MSIZE_MASK) | mem_size;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel, uint32_t peripheral_size)
+{
+    DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_PSIZE_MASK) | peripheral_size;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_MINC;
+}
+
+void dma_disable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_MINC;
+}
+
+void dma_enable_peripheral_increment_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_PINC;
+}
+
+void dma_disable_peripheral_increment_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_PINC;
+}
+
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_CIRC;
+    DMA_CCR(dma, channel) &= ~DMA_CCR_MEM2MEM;
+}
+
+void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_DIR;
+}
+
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_DIR;
+}
+
+void dma_enable_transfer_error_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_TEIE;
+}
+
+void dma_disable_transfer_error_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_TEIE;
+}
+
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_HTIE;
+}
+
+void dma_disable_half_transfer_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_HTIE;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_TCIE;
+}
+
+void dma_disable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_TCIE;
+}
+
+void dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) |= DMA_CCR_EN;
+}
+
+void dma_disable_channel(uint32_t dma, uint8_t channel)
+{
+    DMA_CCR(dma, channel) &= ~DMA_CCR_EN;
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+    if ((DMA_CCR(dma, channel) & DMA_CCR_EN) == 0)
+        DMA_CPAR(dma, channel) = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+    if ((DMA_CCR(dma, channel) & DMA_CCR_EN) == 0)
+        DMA_CMAR(dma, channel) = address;
+}
+
+uint16_t dma_get_number_of_data(uint32_t dma, uint8_t channel)
+{
+    return DMA_CNDTR(dma, channel);
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+    DMA_CNDTR(dma, channel) = number;
+}
+
+// --- USART
+
+void usart_set_baudrate(uint32_t usart, uint32_t baud)
+{
+    uint32_t clock = usart == USART1 ? rcc_apb2_frequency : rcc_apb1_frequency;
+    USART_BRR(usart) = (clock + baud / 2) / baud;
+}
+
+void usart_set_databits(uint32_t usart, uint32_t bits)
+{
+    if (bits == 8)
+        USART_CR1(usart) &= ~USART_CR1_M;
+    else
+        USART_CR1(usart) |= USART_CR1_M;
+}
+
+void usart_set_stopbits(uint32_t usart, uint32_t stopbits)
+{
+    USART_CR2(usart) = (USART_CR2(usart) & ~USART_CR2_STOPBITS_MASK) | stopbits;
+}
+
+void usart_set_parity(uint32_t usart, uint32_t parity)
+{
+    USART_CR1(usart) = (USART_CR1(usart) & ~USART_PARITY_MASK) | parity;
+}
+
+void usart_set_mode(uint32_t usart, uint32_t mode)
+{
+    USART_CR1(usart) = (USART_CR1(usart) & ~USART_MODE_MASK) | mode;
+}
+
+void usart_set_flow_control(uint32_t usart, uint32_t flowcontrol)
+{
+    USART_CR3(usart) = (USART_CR3(usart) & ~USART_FLOWCONTROL_MASK) | flowcontrol;
+}
+
+void usart_enable(uint32_t usart)
+{
+    USART_CR1(usart) |= USART_CR1_UE;
+}
+
+void usart_disable(uint32_t usart)
+{
+    USART_CR1(usart) &= ~USART_CR1_UE;
+}
+
+void usart_send(uint32_t usart, uint16_t data)
+{
+    USART_DR(usart) = data & 0x1ff;
+}
+
+uint16_t usart_recv(uint32_t usart)
+{
+    return USART_DR(usart) & 0x1ff;
+}
+
+void usart_enable_rx_dma(uint32_t usart)
+{
+    USART_CR3(usart) |= USART_CR3_DMAR;
+}
+
+void usart_disable_rx_dma(uint32_t usart)
+{
+    USART_CR3(usart) &= ~USART_CR3_DMAR;
+}
+
+void usart_enable_tx_dma(uint32_t usart)
+{
+    USART_CR3(usart) |= USART_CR3_DMAT;
+}
+
+void usart_disable_tx_dma(uint32_t usart)
+{
+    USART_CR3(usart) &= ~USART_CR3_DMAT;
+}
+
+bool usart_get_flag(uint32_t usart, uint32_t flag)
+{
+    return (USART_SR(usart) & flag) != 0;
+}
@@ -0,0 +1,334 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Simulated time, SysTick, GPIO and RCC, and dispatching of register writes.
+//
+
+#include "model.hpp"
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <stdlib.h>
+
+// The firmware's main function (renamed when compiling main.cpp)
+int firmware_main();
+
+sim_options sim_opts;
+sim_line_peer* sim_line;
+sim_usb_app* sim_app;
+sim_stats sim_stat;
+uint64_t sim_activity;
+
+static std::chrono::steady_clock::time_point start_time;
+static uint64_t now_ns;
+static uint64_t time_lag_ns;
+static uint64_t last_activity;
+static uint32_t idle_syncs;
+static uint64_t next_systick_ns;
+static uint64_t next_app_poll_ns;
+static bool is_rts_asserted;
+
+// RTS and CTS pins (see firmware/include/hardware.h)
+static constexpr uint32_t RTS_PORT = GPIOA;
+static constexpr uint16_t RTS_PIN = GPIO1;
+static constexpr uint32_t CTS_PORT = GPIOA;
+static constexpr uint16_t CTS_PIN = GPIO0;
+
+// --- SysTick
+
+static uint64_t systick_period_ns()
+{
+    uint64_t clock = rcc_ahb_frequency;
+    if ((sim_reg(SYS_TICK_BASE) & STK_CSR_CLKSOURCE) == STK_CSR_CLKSOURCE_AHB_DIV8)
+        clock /= 8;
+    return ((sim_reg(SYS_TICK_BASE + 0x04) & STK_RVR_RELOAD) + 1) * (uint64_t)1000000000 / clock;
+}
+
+static bool is_systick_running()
+{
+    return (sim_reg(SYS_TICK_BASE) & STK_CSR_ENABLE) != 0;
+}
+
+static void update_systick(uint64_t t_ns)
+{
+    if (!is_systick_running())
+        return;
+
+    while (next_systick_ns <= t_ns) {
+        next_systick_ns += systick_period_ns();
+        sim_activity++;
+        sim_reg(SYS_TICK_BASE) |= STK_CSR_COUNTFLAG;
+        if ((sim_reg(SYS_TICK_BASE) & STK_CSR_TICKINT) != 0)
+            sys_tick_handler();
+    }
+
+    // current value (counting down to 0 at the next tick)
+    uint64_t period = systick_period_ns();
+    uint32_t reload = sim_reg(SYS_TICK_BASE + 0x04) & STK_RVR_RELOAD;
+    uint64_t value = (next_systick_ns - t_ns) * (reload + 1) / period;
+    sim_reg(SYS_TICK_BASE + 0x08) = (uint32_t)std::min(value, (uint64_t)reload);
+}
+
+// --- GPIO
+
+bool sim_gpio_output(uint32_t port, uint16_t pin)
+{
+    return (sim_reg(port + 0x0c) & pin) != 0;
+}
+
+// Input levels: pins follow the output register (outputs and pull-up/down
+// resistors) except for the inputs driven by the serial line peer.
+static void update_gpio_inputs(uint64_t t_ns)
+{
+    for (uint32_t port : { GPIOA, GPIOB, GPIOC }) {
+        uint32_t idr = sim_reg(port + 0x0c);
+        if (port == CTS_PORT)
+            idr = (idr & ~CTS_PIN) | (sim_usart_cts_level(t_ns) ? CTS_PIN : 0);
+        sim_reg(port + 0x08) = idr;
+    }
+}
+
+static void check_rts(uint64_t t_ns)
+{
+    bool asserted = !sim_gpio_output(RTS_PORT, RTS_PIN); // active low
+    if (asserted != is_rts_asserted) {
+        is_rts_asserted = asserted;
+        sim_usart_rts_changed(asserted, t_ns);
+    }
+}
+
+static uint32_t gpio_register_written(uint32_t port, uint32_t offset, uint32_t old_value, uint32_t value)
+{
+    volatile uint32_t& odr = sim_reg(port + 0x0c);
+    uint32_t old_odr = odr;
+
+    switch (offset) {
+    case 0x08:
+        return old_value; // IDR is read-only
+    case 0x10:
+        // BSRR: set has priority over reset
+        odr = ((odr & ~(value >> 16)) | value) & 0xffff;
+        value = 0;
+        break;
+    case 0x14:
+        odr = odr & ~value & 0xffff;
+        value = 0;
+        break;
+    default:
+        break;
+    }
+
+    if (offset == 0x0c)
+        odr = value & 0xffff;
+    if (odr != old_odr)
+        sim_activity++;
+    update_gpio_inputs(now_ns);
+    check_rts(now_ns);
+    return offset == 0x0c ? odr : value;
+}
+
+// --- Register writes
+
+static uint32_t apply_register_write(uint32_t addr, uint32_t old_value, uint32_t value)
+{
+    if (addr >= GPIO_PORT_A_BASE && addr < GPIO_PORT_C_BASE + 0x400)
+        return gpio_register_written(addr & ~0x3ffU, addr & 0x3ff, old_value, value);
+
+    if (addr >= DMA1_BASE && addr < DMA1_BASE + 0x400)
+        return sim_dma_register_written(addr, old_value, value);
+
+    if (addr >= USB_DEV_FS_BASE && addr < USB_DEV_FS_BASE + 0x400)
+        return sim_usb_register_written(addr, old_value, value);
+
+    if (addr == USART2_BASE) {
+        // SR: RXNE, TC, LBD and CTS are cleared by writing 0
+        uint32_t w0_bits = USART_SR_RXNE | USART_SR_TC | USART_SR_LBD | USART_SR_CTS;
+        return (old_value & ~w0_bits) | (old_value & value & w0_bits);
+    }
+
+    if (addr == RCC_BASE + 0x10) {
+        // APB1RSTR: reset peripherals on rising edge
+        uint32_t rising = value & ~old_value;
+        if ((rising & RCC_APB1RSTR_USBRST) != 0)
+            sim_usb_reset();
+        if ((rising & (1 << 17)) != 0)
+            sim_usart_reset();
+        return value;
+    }
+
+    if (addr == SYS_TICK_BASE) {
+        if ((old_value & STK_CSR_ENABLE) == 0 && (value & STK_CSR_ENABLE) != 0) {
+            sim_reg(addr) = value;
+            next_systick_ns = now_ns + systick_period_ns();
+        }
+        return (value & ~STK_CSR_COUNTFLAG) | (old_value & STK_CSR_COUNTFLAG);
+    }
+
+    return value;
+}
+
+uint32_t sim_register_written(uint32_t addr, uint32_t old_value, uint32_t value)
+{
+    uint32_t new_value = apply_register_write(addr, old_value, value);
+    if (new_value != old_value)
+        sim_activity++;
+    return new_value;
+}
+
+void sim_register_read(uint32_t addr)
+{
+    if (addr >= USART2_BASE && addr < USART2_BASE + 0x400)
+        sim_usart_register_read(addr);
+}
+
+// --- Simulated time
+
+// Number of synchronizations without any activity after which the firmware is considered busy waiting
+static constexpr uint32_t IDLE_SYNC_THRESHOLD = 16;
+
+// Time of the next known event of any model
+static uint64_t next_event_ns()
+{
+    uint64_t next = std::min(sim_usart_next_event_ns(), sim_usb_next_event_ns());
+    next = std::min(next, next_app_poll_ns);
+    if (is_systick_running())
+        next = std::min(next, next_systick_ns);
+    return next;
+}
+
+void sim_sync(bool is_idle)
+{
+    sim_stat.syncs++;
+
+    if (sim_activity != last_activity) {
+        last_activity = sim_activity;
+        idle_syncs = 0;
+    } else {
+        idle_syncs++;
+    }
+
+    if (sim_opts.virtual_time) {
+        now_ns += sim_opts.access_cost_ns;
+        // firmware is busy waiting: skip to next SysTick
+        if (is_idle && is_systick_running() && next_systick_ns > now_ns)
+            now_ns = next_systick_ns;
+        // firmware is polling without any changes: skip to next event
+        if (idle_syncs >= IDLE_SYNC_THRESHOLD) {
+            uint64_t t_ns = std::min(next_event_ns(), now_ns + sim_opts.max_idle_step_ns);
+            if (t_ns > now_ns)
+                now_ns = t_ns;
+        }
+    } else {
+        uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_time).count();
+        uint64_t t_ns = wall_ns - time_lag_ns;
+        if (t_ns > now_ns + sim_opts.max_time_step_ns) {
+            time_lag_ns += t_ns - now_ns - sim_opts.max_time_step_ns;
+            t_ns = now_ns + sim_opts.max_time_step_ns;
+        }
+        now_ns = t_ns;
+    }
+
+    update_systick(now_ns);
+    update_gpio_inputs(now_ns);
+    sim_usart_update(now_ns);
+    sim_usb_update(now_ns);
+
+    if (now_ns >= next_app_poll_ns) {
+        next_app_poll_ns = now_ns + sim_opts.app_poll_interval_ns;
+        sim_app->poll(now_ns);
+    }
+}
+
+uint64_t sim_now_ns()
+{
+    return now_ns;
+}
+
+const sim_stats& sim_get_stats()
+{
+    return sim_stat;
+}
+
+// --- Initialization
+
+static void reset_registers()
+{
+    for (uint32_t port : { GPIOA, GPIOB, GPIOC }) {
+        sim_reg(port + 0x00) = 0x44444444; // CRL: floating inputs
+        sim_reg(port + 0x04) = 0x44444444; // CRH: floating inputs
+    }
+    sim_reg(RCC_BASE + 0x00) = 0x00000083;
+    sim_reg(SYS_TICK_BASE + 0x0c) = 9000; // CALIB: 1 ms at 9 MHz
+
+    sim_reg(DESIG_FLASH_SIZE_BASE) = 64; // 64 KB flash
+    sim_reg(DESIG_UNIQUE_ID_BASE + 0) = 0x0667ff34;
+    sim_reg(DESIG_UNIQUE_ID_BASE + 4) = 0x35314b43;
+    sim_reg(DESIG_UNIQUE_ID_BASE + 8) = 0x43163024;
+
+    sim_usart_reset();
+    sim_usb_reset();
+}
+
+void sim_init(const sim_options& options, sim_line_peer* line, sim_usb_app* app)
+{
+    sim_opts = options;
+    sim_line = line;
+    sim_app = app;
+
+    sim_mmio_init();
+    reset_registers();
+    start_time = std::chrono::steady_clock::now();
+}
+
+void sim_run_firmware()
+{
+    sim_mmio_start();
+    firmware_main();
+    exit(0);
+}
+
+// --- Loopback peer
+
+void sim_loopback_peer::on_char_transmitted(uint16_t data, uint64_t end_ns)
+{
+    int next = (head + 1) % buf_size;
+    if (next == tail)
+        return; // receiver isn't keeping up: character is lost
+
+    chars[head] = data;
+    times[head] = end_ns;
+    head = next;
+}
+
+bool sim_loopback_peer::is_ready_to_receive(uint64_t)
+{
+    return rts;
+}
+
+void sim_loopback_peer::on_rts_changed(bool asserted, uint64_t)
+{
+    rts = asserted;
+}
+
+bool sim_loopback_peer::fetch_char(uint64_t, uint16_t* data, uint64_t* end_ns)
+{
+    if (head == tail)
+        return false;
+
+    *data = chars[tail];
+    *end_ns = times[tail];
+    tail = (tail + 1) % buf_size;
+    return true;
+}
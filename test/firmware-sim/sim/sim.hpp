@@ -0,0 +1,290 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// The firmware is compiled for the host from the same sources and runs against models
+// of the STM32F1 peripherals it uses (RCC, GPIO, USART2, DMA1, USB FS device,
+// SysTick). Peripheral registers are mapped at their STM32 addresses. Register
+// writes (and all accesses to the USB registers) are trapped so the models
+// can apply the hardware semantics and advance simulated time.
+//
+// The serial line is connected to a `sim_line_peer`; the USB host side
+// (enumeration, bulk and interrupt transfers) is simulated and connected
+// to a `sim_usb_app`.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// Flag for `sim_line_peer::fetch_char()`: character is received with a parity error
+constexpr uint16_t SIM_CHAR_PARITY_ERROR = 0x4000;
+/// Flag for `sim_line_peer::fetch_char()`: character is received with a framing error
+constexpr uint16_t SIM_CHAR_FRAMING_ERROR = 0x8000;
+
+/**
+ * @brief Peer connected to the serial line (TX, RX, RTS, CTS) of the adapter.
+ */
+class sim_line_peer {
+public:
+    virtual ~sim_line_peer() { }
+
+    /**
+     * @brief Called for each character transmitted by the adapter.
+     *
+     * @param data character (data bits only)
+     * @param end_ns time when the stop bit ends (in ns)
+     */
+    virtual void on_char_transmitted(uint16_t data, uint64_t end_ns) = 0;
+
+    /**
+     * @brief Indicates if the peer is ready to receive (adapter's CTS input).
+     *
+     * @param t_ns current time (in ns)
+     * @return `true` if CTS is asserted
+     */
+    virtual bool is_ready_to_receive(uint64_t t_ns) = 0;
+
+    /**
+     * @brief Called when the adapter's RTS output changes.
+     *
+     * @param asserted new RTS state
+     * @param t_ns current time (in ns)
+     */
+    virtual void on_rts_changed(bool /* asserted */, uint64_t /* t_ns */) { }
+
+    /**
+     * @brief Fetches the next character to be sent to the adapter.
+     *
+     * @param t_ns earliest time the start bit can begin (in ns)
+     * @param data receives the character (data bits only, optionally combined
+     *    with `SIM_CHAR_PARITY_ERROR` and `SIM_CHAR_FRAMING_ERROR`)
+     * @param end_ns receives the earliest time the character can be complete (in ns), or 0
+     * @return `true` if a character has been fetched
+     */
+    virtual bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) = 0;
+};
+
+/**
+ * @brief Application on the simulated USB host using the CDC ACM interface.
+ */
+class sim_usb_app {
+public:
+    virtual ~sim_usb_app() { }
+
+    /**
+     * @brief Called when the device has been enumerated and configured.
+     *
+     * @param t_ns current time (in ns)
+     */
+    virtual void on_configured(uint64_t /* t_ns */) { }
+
+    /**
+     * @brief Fetches data for the next bulk OUT packet.
+     *
+     * Data is only fetched if the host controller has no pending packet.
+     *
+     * @param buf buffer receiving the data
+     * @param max_len maximum length (in bytes)
+     * @param t_ns current time (in ns)
+     * @return number of bytes, 0 if no data is available
+     */
+    virtual size_t fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns) = 0;
+
+    /**
+     * @brief Indicates if the application can receive a bulk IN packet.
+     *
+     * @param t_ns current time (in ns)
+     * @return `true` if an IN request is outstanding
+     */
+    virtual bool can_receive_in_data(uint64_t t_ns) = 0;
+
+    /**
+     * @brief Called when a bulk IN packet has been received.
+     *
+     * @param data packet data
+     * @param len packet length (in bytes)
+     * @param t_ns time the transaction completed (in ns)
+     */
+    virtual void on_in_data(const uint8_t* data, size_t len, uint64_t t_ns) = 0;
+
+    /**
+     * @brief Called when a CDC notification has been received on the interrupt endpoint.
+     *
+     * @param data notification data
+     * @param len notification length (in bytes)
+     * @param t_ns time the transaction completed (in ns)
+     */
+    virtual void on_notification(const uint8_t* /* data */, size_t /* len */, uint64_t /* t_ns */) { }
+
+    /**
+     * @brief Called when a vendor request (see `sim_usb_vendor_request()`) has completed.
+     *
+     * @param request request code
+     * @param data data received in the data stage (IN requests only)
+     * @param len length of received data (in bytes)
+     * @param is_stalled `true` if the device has stalled the request
+     * @param t_ns time the request completed (in ns)
+     */
+    virtual void on_vendor_request_completed(uint8_t /* request */, const uint8_t* /* data */, size_t /* len */,
+            bool /* is_stalled */, uint64_t /* t_ns */) { }
+
+    /**
+     * @brief Called periodically (in simulated time) to poll external data sources.
+     *
+     * @param t_ns current time (in ns)
+     */
+    virtual void poll(uint64_t /* t_ns */) { }
+};
+
+/**
+ * @brief Simulation options.
+ */
+struct sim_options {
+    /// Use virtual time (deterministic, as fast as possible) instead of wall clock time
+    bool virtual_time = false;
+    /// Virtual time consumed by firmware code between two peripheral accesses (in ns)
+    uint32_t access_cost_ns = 250;
+    /// Virtual time: maximum time skipped per peripheral access while the firmware is polling
+    /// without any changes (in ns). Line peer and USB app are polled at least this often.
+    uint32_t max_idle_step_ns = 20000;
+    /// Wall clock time: maximum time step between two synchronizations (in ns).
+    /// If the simulator falls behind (e.g. when descheduled), simulated time is slowed down instead.
+    uint32_t max_time_step_ns = 500000;
+    /// Minimum interval between calls of `sim_usb_app::poll()` (in ns)
+    uint32_t app_poll_interval_ns = 100000;
+    /// Bus time available per USB frame for control and bulk transfers (in bit times)
+    uint32_t usb_frame_budget_bits = 11700;
+    /// Polling interval of the interrupt IN endpoint (in frames)
+    uint32_t usb_interrupt_interval = 8;
+    /// Log USB enumeration and control requests to stderr
+    bool verbose = false;
+};
+
+/**
+ * @brief Simulation statistics.
+ */
+struct sim_stats {
+    uint64_t uart_tx_chars;
+    uint64_t uart_rx_chars;
+    /// Characters received while RX DMA was not running
+    uint64_t uart_rx_lost;
+    uint64_t usb_frames;
+    uint64_t usb_in_packets;
+    uint64_t usb_in_naks;
+    uint64_t usb_out_packets;
+    uint64_t usb_out_naks;
+    uint64_t usb_setup_packets;
+    /// Number of synchronization points (trapped peripheral accesses and timer ticks)
+    uint64_t syncs;
+};
+
+/**
+ * @brief Initializes the simulation and maps the peripheral registers.
+ *
+ * @param options simulation options
+ * @param line peer connected to the serial line
+ * @param app application on the USB host
+ */
+void sim_init(const sim_options& options, sim_line_peer* line, sim_usb_app* app);
+
+/**
+ * @brief Runs the firmware. Does not return.
+ */
+[[noreturn]] void sim_run_firmware();
+
+/**
+ * @brief Gets the current simulated time.
+ *
+ * @return time since start of simulation (in ns)
+ */
+uint64_t sim_now_ns();
+
+/**
+ * @brief Gets the simulation statistics.
+ */
+const sim_stats& sim_get_stats();
+
+/**
+ * @brief Queues a CDC SET_LINE_CODING request.
+ *
+ * Must be called from a `sim_usb_app` callback.
+ *
+ * @param baudrate bit rate (in bps)
+ * @param databits data bits (7 or 8)
+ * @param stopbits stop bits (as in the CDC specification: 0 = 1, 1 = 1.5, 2 = 2)
+ * @param parity parity (as in the CDC specification: 0 = none, 1 = odd, 2 = even)
+ */
+void sim_usb_set_line_coding(uint32_t baudrate, uint8_t databits, uint8_t stopbits, uint8_t parity);
+
+/**
+ * @brief Queues a CDC SET_CONTROL_LINE_STATE request.
+ *
+ * Must be called from a `sim_usb_app` callback.
+ *
+ * @param dtr DTR state
+ * @param rts RTS state
+ */
+void sim_usb_set_control_line_state(bool dtr, bool rts);
+
+/**
+ * @brief Queues a vendor request (recipient: device).
+ *
+ * Must be called from a `sim_usb_app` callback. On completion,
+ * `sim_usb_app::on_vendor_request_completed()` is called.
+ *
+ * @param request request code (`bRequest`)
+ * @param value request value (`wValue`)
+ * @param index request index (`wIndex`)
+ * @param in_length length of data to receive (0 for a request without data stage)
+ */
+void sim_usb_vendor_request(uint8_t request, uint16_t value, uint16_t index, uint16_t in_length);
+
+/**
+ * @brief Indicates if the USB device has been configured.
+ */
+bool sim_usb_is_configured();
+
+/**
+ * @brief Sets a firmware tuning parameter (see firmware/include/tuning.h).
+ *
+ * Must be called before the firmware is started.
+ *
+ * @param name parameter name, e.g. `TX_NAK_HIGH_WATER`
+ * @param value new value
+ * @return `true` if successful, `false` if there is no such parameter
+ */
+bool sim_set_tuning_param(const char* name, int value);
+
+/**
+ * @brief Gets the current value of a firmware tuning parameter.
+ *
+ * @param name parameter name
+ * @return parameter value, -1 if there is no such parameter
+ */
+int sim_get_tuning_param(const char* name);
+
+/**
+ * @brief Line peer connecting TX to RX and RTS to CTS of the adapter itself.
+ */
+class sim_loopback_peer : public sim_line_peer {
+public:
+    void on_char_transmitted(uint16_t data, uint64_t end_ns) override;
+    bool is_ready_to_receive(uint64_t t_ns) override;
+    void on_rts_changed(bool asserted, uint64_t t_ns) override;
+    bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) override;
+
+private:
+    static constexpr int buf_size = 64;
+    uint16_t chars[buf_size];
+    uint64_t times[buf_size];
+    int head = 0;
+    int tail = 0;
+    bool rts = false;
+};
@@ -0,0 +1,45 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Firmware tuning parameters (variables instead of constants, see firmware/include/tuning.h).
+//
+
+#include "sim.hpp"
+#include "tuning.h"
+#include <string.h>
+
+#define FW_TUNING_DEFINE(type, name, value) type name = value;
+FW_TUNING_PARAMS(FW_TUNING_DEFINE)
+
+struct tuning_param {
+    const char* name;
+    int* value;
+};
+
+#define FW_TUNING_ENTRY(type, name, value) { #name, &name },
+static const tuning_param params[] = { FW_TUNING_PARAMS(FW_TUNING_ENTRY) };
+
+bool sim_set_tuning_param(const char* name, int value)
+{
+    for (auto& param : params) {
+        if (strcmp(param.name, name) == 0) {
+            *param.value = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+int sim_get_tuning_param(const char* name)
+{
+    for (auto& param : params)
+        if (strcmp(param.name, name) == 0)
+            return *param.value;
+    return -1;
+}
@@ -0,0 +1,386 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Model of USART2 with its DMA channels (DMA1 channel 7 for TX, channel 6
+// for RX, as mapped on the STM32F1).
+//
+// Characters are timed according to the configured baud rate and frame format.
+// TX uses a transmit data register and a shift register: DMA refills the data
+// register at the start of each character so consecutive DMA transfers don't
+// leave a gap on the line. Hardware CTS flow control is checked before each
+// character. Received characters are written to memory by the RX DMA channel;
+// characters arriving while it is disabled are lost.
+//
+// Characters can be received with a parity error (inverted parity bit) or
+// a framing error. The error flags in SR are cleared by reading SR followed
+// by reading DR (by the firmware or the RX DMA).
+//
+// In half-duplex mode (HDSEL), the receiver is connected to the TX line:
+// transmitted characters are received at the end of their frame and the
+// characters of the simulated line are ignored.
+//
+
+#include "model.hpp"
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+#include <algorithm>
+
+static constexpr uint32_t USART = USART2;
+static constexpr uint32_t DMA = DMA1;
+static constexpr uint8_t TX_CHAN = 7;
+static constexpr uint8_t RX_CHAN = 6;
+
+static constexpr int NUM_DMA_CHANNELS = 7;
+
+/// Number of data items set when the channel was enabled (for circular mode)
+static uint32_t dma_initial_count[NUM_DMA_CHANNELS + 1];
+
+static uint64_t last_update_ns;
+
+static bool is_tdr_full;
+static uint16_t tdr;
+static uint64_t tx_line_free_ns;
+static bool is_cts_blocked;
+
+static bool is_rx_active;
+static uint16_t rx_char;
+static uint64_t rx_end_ns;
+static uint64_t rx_line_free_ns;
+
+// Characters on the TX line to be received in half-duplex mode
+static constexpr int HD_QUEUE_LEN = 4;
+struct hd_char {
+    uint16_t data;
+    uint64_t end_ns;
+};
+static hd_char hd_queue[HD_QUEUE_LEN];
+static int hd_queue_len;
+
+// Indicates if SR has been read since the error flags have been set
+static bool is_sr_read;
+
+static volatile uint32_t& usart_reg(uint32_t offset)
+{
+    return sim_reg(USART + offset);
+}
+
+static volatile uint32_t& dma_reg(uint8_t channel, uint32_t offset)
+{
+    return sim_reg(DMA + 0x08 + 0x14 * (channel - 1) + offset);
+}
+
+// Duration of a single character (incl. start, parity and stop bits)
+static uint64_t char_duration_ns()
+{
+    uint32_t brr = usart_reg(0x08) & 0xffff;
+    if (brr == 0 || rcc_apb1_frequency == 0)
+        return 0;
+
+    uint32_t cr1 = usart_reg(0x0c);
+    uint32_t half_bits = 2 * (1 + ((cr1 & USART_CR1_M) != 0 ? 9 : 8));
+    static const uint32_t stop_half_bits[] = { 2, 1, 4, 3 };
+    half_bits += stop_half_bits[(usart_reg(0x10) & USART_CR2_STOPBITS_MASK) >> USART_CR2_STOPBITS_SHIFT];
+
+    return (uint64_t)half_bits * brr * 1000000000 / (2 * (uint64_t)rcc_apb1_frequency);
+}
+
+// Mask for the data bits (excl. parity bit)
+static uint16_t data_mask()
+{
+    uint32_t cr1 = usart_reg(0x0c);
+    int bits = 8 + ((cr1 & USART_CR1_M) != 0 ? 1 : 0) - ((cr1 & USART_CR1_PCE) != 0 ? 1 : 0);
+    return (1 << bits) - 1;
+}
+
+// Value read from the data register, incl. the parity bit
+static uint16_t with_parity_bit(uint16_t data)
+{
+    uint32_t cr1 = usart_reg(0x0c);
+    if ((cr1 & USART_CR1_PCE) == 0)
+        return data;
+
+    uint16_t mask = data_mask();
+    bool parity = (__builtin_popcount(data & mask) & 1) != 0;
+    if ((cr1 & USART_CR1_PS) != 0)
+        parity = !parity;
+    return (data & mask) | (parity ? mask + 1 : 0);
+}
+
+static void dma_set_flags(uint8_t channel, uint32_t flags)
+{
+    sim_reg(DMA + 0x00) |= (flags | DMA_GIF) << DMA_FLAG_OFFSET(channel);
+}
+
+// Advances the DMA channel by one data item, returns the index of the transferred item
+static uint32_t dma_advance(uint8_t channel)
+{
+    volatile uint32_t& cndtr = dma_reg(channel, 0x04);
+    uint32_t initial = dma_initial_count[channel];
+    uint32_t index = initial - cndtr;
+
+    sim_activity++;
+    cndtr = cndtr - 1;
+    if (cndtr == initial / 2)
+        dma_set_flags(channel, DMA_HTIF);
+    if (cndtr == 0) {
+        dma_set_flags(channel, DMA_TCIF);
+        if ((dma_reg(channel, 0x00) & DMA_CCR_CIRC) != 0)
+            cndtr = initial;
+    }
+
+    return index;
+}
+
+static bool is_half_duplex()
+{
+    return (usart_reg(0x14) & USART_CR3_HDSEL) != 0;
+}
+
+static bool is_dma_active(uint8_t channel)
+{
+    return (dma_reg(channel, 0x00) & DMA_CCR_EN) != 0 && dma_reg(channel, 0x04) != 0;
+}
+
+static uint8_t* dma_memory(uint8_t channel, uint32_t index)
+{
+    uint32_t ccr = dma_reg(channel, 0x00);
+    uintptr_t addr = dma_reg(channel, 0x0c);
+    if ((ccr & DMA_CCR_MINC) != 0)
+        addr += index;
+    return (uint8_t*)addr;
+}
+
+static void set_error_flags(uint16_t data)
+{
+    uint32_t flags = 0;
+    if ((data & SIM_CHAR_PARITY_ERROR) != 0 && (usart_reg(0x0c) & USART_CR1_PCE) != 0)
+        flags |= USART_SR_PE;
+    if ((data & SIM_CHAR_FRAMING_ERROR) != 0)
+        flags |= USART_SR_FE;
+    if (flags == 0)
+        return;
+
+    usart_reg(0x00) |= flags;
+    is_sr_read = false;
+    sim_activity++;
+}
+
+static void clear_error_flags()
+{
+    usart_reg(0x00) &= ~(USART_SR_PE | USART_SR_FE);
+    is_sr_read = false;
+    sim_activity++;
+}
+
+static void receive_char(uint16_t data)
+{
+    if ((usart_reg(0x14) & USART_CR3_DMAR) == 0 || !is_dma_active(RX_CHAN)) {
+        usart_reg(0x00) |= USART_SR_ORE;
+        sim_stat.uart_rx_lost++;
+        sim_activity++;
+        return;
+    }
+
+    // DMA read of DR completes the clear sequence of the previous error flags
+    if (is_sr_read)
+        clear_error_flags();
+
+    uint16_t value = with_parity_bit(data & ~(SIM_CHAR_PARITY_ERROR | SIM_CHAR_FRAMING_ERROR));
+    if ((data & SIM_CHAR_PARITY_ERROR) != 0 && (usart_reg(0x0c) & USART_CR1_PCE) != 0)
+        value ^= data_mask() + 1; // invert parity bit
+    set_error_flags(data);
+
+    *dma_memory(RX_CHAN, dma_advance(RX_CHAN)) = (uint8_t)value;
+    sim_stat.uart_rx_chars++;
+}
+
+// Receives the characters of the TX line that have ended (half-duplex mode)
+static void receive_hd_chars(uint64_t t_ns)
+{
+    while (hd_queue_len > 0 && hd_queue[0].end_ns <= t_ns) {
+        receive_char(hd_queue[0].data);
+        hd_queue_len--;
+        std::copy(hd_queue + 1, hd_queue + 1 + hd_queue_len, hd_queue);
+    }
+}
+
+static void update_tx(uint64_t t_ns)
+{
+    uint32_t cr1 = usart_reg(0x0c);
+    if ((cr1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE)) {
+        is_tdr_full = false;
+        return;
+    }
+
+    uint64_t duration = char_duration_ns();
+    if (duration == 0)
+        return;
+
+    is_cts_blocked = false;
+    while (true) {
+        // DMA refills the transmit data register as soon as it is empty
+        if (!is_tdr_full && (usart_reg(0x14) & USART_CR3_DMAT) != 0 && is_dma_active(TX_CHAN)) {
+            tdr = *dma_memory(TX_CHAN, dma_advance(TX_CHAN));
+            is_tdr_full = true;
+        }
+        if (!is_tdr_full)
+            break;
+
+        uint64_t start = std::max(tx_line_free_ns, last_update_ns);
+        if (start > t_ns)
+            break;
+
+        if ((usart_reg(0x14) & USART_CR3_CTSE) != 0 && sim_usart_cts_level(start)) {
+            tx_line_free_ns = t_ns; // wait for CTS
+            is_cts_blocked = true;
+            break;
+        }
+
+        is_tdr_full = false;
+        tx_line_free_ns = start + duration;
+        sim_stat.uart_tx_chars++;
+        sim_line->on_char_transmitted(tdr & data_mask(), tx_line_free_ns);
+
+        if (is_half_duplex()) {
+            receive_hd_chars(t_ns);
+            if (hd_queue_len < HD_QUEUE_LEN)
+                hd_queue[hd_queue_len++] = { tdr, tx_line_free_ns };
+        }
+    }
+}
+
+static void update_rx(uint64_t t_ns)
+{
+    uint32_t cr1 = usart_reg(0x0c);
+    if ((cr1 & (USART_CR1_UE | USART_CR1_RE)) != (USART_CR1_UE | USART_CR1_RE)) {
+        is_rx_active = false;
+        return;
+    }
+
+    if (is_half_duplex()) {
+        is_rx_active = false;
+        receive_hd_chars(t_ns);
+        return;
+    }
+
+    uint64_t duration = char_duration_ns();
+    if (duration == 0)
+        return;
+
+    while (true) {
+        if (!is_rx_active) {
+            uint64_t start = std::max(rx_line_free_ns, last_update_ns);
+            if (start > t_ns)
+                break;
+
+            uint16_t data;
+            uint64_t end_ns = 0;
+            if (!sim_line->fetch_char(start, &data, &end_ns))
+                break;
+
+            rx_char = data;
+            rx_end_ns = std::max(start + duration, end_ns);
+            is_rx_active = true;
+        }
+
+        if (rx_end_ns > t_ns)
+            break;
+
+        is_rx_active = false;
+        rx_line_free_ns = rx_end_ns;
+        receive_char(rx_char);
+    }
+}
+
+void sim_usart_update(uint64_t t_ns)
+{
+    update_tx(t_ns);
+    update_rx(t_ns);
+    last_update_ns = t_ns;
+}
+
+uint64_t sim_usart_next_event_ns()
+{
+    uint64_t next = UINT64_MAX;
+    if (is_tdr_full && !is_cts_blocked)
+        next = std::max(tx_line_free_ns, last_update_ns);
+    if (is_rx_active)
+        next = std::min(next, rx_end_ns);
+    if (hd_queue_len > 0)
+        next = std::min(next, hd_queue[0].end_ns);
+    return next;
+}
+
+void sim_usart_reset()
+{
+    usart_reg(0x00) = USART_SR_TXE | USART_SR_TC;
+    for (uint32_t offset = 0x04; offset <= 0x18; offset += 4)
+        usart_reg(offset) = 0;
+    is_tdr_full = false;
+    is_rx_active = false;
+    hd_queue_len = 0;
+    is_sr_read = false;
+}
+
+void sim_usart_register_read(uint32_t addr)
+{
+    uint32_t offset = addr - USART;
+    if (offset == 0x00 && (usart_reg(0x00) & (USART_SR_PE | USART_SR_FE)) != 0)
+        is_sr_read = true;
+    else if (offset == 0x04 && is_sr_read)
+        clear_error_flags();
+}
+
+void sim_usart_rts_changed(bool asserted, uint64_t t_ns)
+{
+    sim_line->on_rts_changed(asserted, t_ns);
+}
+
+bool sim_usart_cts_level(uint64_t t_ns)
+{
+    return !sim_line->is_ready_to_receive(t_ns);
+}
+
+uint32_t sim_dma_register_written(uint32_t addr, uint32_t old_value, uint32_t value)
+{
+    uint32_t offset = addr - DMA;
+    if (offset == 0x00)
+        return old_value; // ISR is read-only
+
+    if (offset == 0x04) {
+        // IFCR: clear flags; clearing GIF clears all flags of the channel
+        uint32_t clear = value;
+        for (int channel = 1; channel <= NUM_DMA_CHANNELS; channel++)
+            if ((value & (DMA_GIF << DMA_FLAG_OFFSET(channel))) != 0)
+                clear |= DMA_IFLAGS << DMA_FLAG_OFFSET(channel);
+        if ((sim_reg(DMA + 0x00) & clear) != 0)
+            sim_activity++;
+        sim_reg(DMA + 0x00) &= ~clear;
+        return 0;
+    }
+
+    uint8_t channel = (offset - 0x08) / 0x14 + 1;
+    uint32_t reg = (offset - 0x08) % 0x14;
+    if (channel > NUM_DMA_CHANNELS)
+        return value;
+
+    bool is_enabled = (old_value & DMA_CCR_EN) != 0;
+    if (reg == 0x00) {
+        if (!is_enabled && (value & DMA_CCR_EN) != 0)
+            dma_initial_count[channel] = dma_reg(channel, 0x04);
+        return value & 0x7fff;
+    }
+
+    // CNDTR, CPAR and CMAR are read-only while the channel is enabled
+    if ((dma_reg(channel, 0x00) & DMA_CCR_EN) != 0)
+        return old_value;
+
+    return reg == 0x04 ? value & 0xffff : value;
+}
@@ -0,0 +1,781 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Model of the USB full-speed device peripheral (endpoint registers,
+// buffer descriptor table, packet memory) and of the USB host: enumeration,
+// CDC class requests and transaction scheduling within 1 ms frames.
+//
+// Bus time is accounted in bit times (12 Mbit/s) with the protocol overhead
+// from the USB 2.0 specification, table 5-9 (13 bytes per bulk transaction).
+// Bit stuffing is ignored. Each endpoint executes at most one transaction per
+// synchronization point so the firmware can react between transactions.
+//
+
+#include "model.hpp"
+#include "qsb_fsdev.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static constexpr uint64_t FRAME_NS = 1000000;
+static constexpr uint64_t MS_NS = 1000000;
+
+// transaction costs (in bit times)
+static constexpr uint32_t SOF_BITS = 6 * 8;
+static constexpr uint32_t HANDSHAKE_ONLY_BITS = 6 * 8;
+static constexpr uint32_t TIMEOUT_BITS = 8 * 8;
+static constexpr uint32_t DATA_OVERHEAD_BYTES = 13;
+
+static constexpr uint32_t LATCHED_ISTR_BITS = USB_ISTR_PMAOVR | USB_ISTR_ERR | USB_ISTR_WKUP
+        | USB_ISTR_SUSP | USB_ISTR_RESET | USB_ISTR_SOF | USB_ISTR_ESOF;
+
+static constexpr int NUM_EP_REGS = 8;
+static constexpr uint8_t DEVICE_ADDRESS = 1;
+static constexpr uint8_t BULK_OUT_EP = 0x01;
+static constexpr uint8_t BULK_IN_EP = 0x02;
+static constexpr uint8_t INTERRUPT_IN_EP = 0x03;
+static constexpr int BULK_PACKET_SIZE = 64;
+
+static uint64_t bits_to_ns(uint32_t bits)
+{
+    return (uint64_t)bits * 1000 / 12;
+}
+
+static uint32_t data_bits(uint32_t len)
+{
+    return (len + DATA_OVERHEAD_BYTES) * 8;
+}
+
+// --- Device: endpoint registers
+
+/// Endpoint state that isn't visible in the endpoint register
+struct ep_state {
+    /// STAT_RX as set by software (may be masked as NAK)
+    uint32_t stat_rx;
+    /// STAT_TX as set by software (may be masked as NAK)
+    uint32_t stat_tx;
+    /// Double-buffered: both buffers in use, STAT_RX reads as NAK
+    bool rx_masked;
+    /// Double-buffered: both buffers in use, STAT_TX reads as NAK
+    bool tx_masked;
+};
+
+static ep_state eps[NUM_EP_REGS];
+
+static volatile uint32_t& ep_reg(int ep)
+{
+    return sim_reg(USB_DEV_FS_BASE + 4 * ep);
+}
+
+static bool is_dbl_buf(uint32_t reg)
+{
+    return (reg & USB_EP_KIND) != 0 && (reg & USB_EP_TYPE) == USB_EP_TYPE_BULK;
+}
+
+static uint32_t with_visible_stat(int ep, uint32_t reg)
+{
+    const ep_state& st = eps[ep];
+    reg &= ~(USB_EP_STAT_RX | USB_EP_STAT_TX);
+    reg |= st.rx_masked ? USB_EP_STAT_RX_NAK : st.stat_rx;
+    reg |= st.tx_masked ? USB_EP_STAT_TX_NAK : st.stat_tx;
+    return reg;
+}
+
+static void update_istr()
+{
+    uint32_t istr = sim_reg(USB_DEV_FS_BASE + 0x44) & ~(USB_ISTR_CTR | USB_ISTR_DIR | USB_ISTR_EP_ID);
+    for (int ep = 0; ep < NUM_EP_REGS; ep++) {
+        uint32_t reg = ep_reg(ep);
+        if ((reg & (USB_EP_CTR_RX | USB_EP_CTR_TX)) != 0) {
+            istr |= USB_ISTR_CTR | ep;
+            if ((reg & USB_EP_CTR_RX) != 0)
+                istr |= USB_ISTR_DIR;
+            break;
+        }
+    }
+    sim_reg(USB_DEV_FS_BASE + 0x44) = istr;
+}
+
+static uint32_t ep_register_written(int ep, uint32_t old_value, uint32_t value)
+{
+    ep_state& st = eps[ep];
+
+    uint32_t reg = old_value;
+    // bits with r/w behavior
+    reg = (reg & ~USB_EP_RW_BITS_MSK) | (value & USB_EP_RW_BITS_MSK);
+    // bits that can only be cleared
+    reg &= (value & USB_EP_W0_BITS_MSK) | ~USB_EP_W0_BITS_MSK;
+    // bits with toggle behavior (STAT bits are toggled on the internal value)
+    uint32_t toggled = value & (USB_EP_DTOG_RX | USB_EP_DTOG_TX);
+    reg ^= toggled;
+    st.stat_rx ^= value & USB_EP_STAT_RX;
+    st.stat_tx ^= value & USB_EP_STAT_TX;
+
+    if (is_dbl_buf(reg)) {
+        // RX: DTOG_RX selects the USB buffer, bit 6 is SW_BUF_RX
+        // TX: DTOG_TX selects the USB buffer, bit 14 is SW_BUF_TX
+        bool bit14 = (reg & USB_EP_DTOG_RX) != 0;
+        bool bit6 = (reg & USB_EP_DTOG_TX) != 0;
+        if (st.stat_rx != USB_EP_STAT_RX_DISABLED) {
+            if ((toggled & USB_EP_SW_BUF_RX) != 0)
+                st.rx_masked = false;
+            else if ((toggled & USB_EP_DTOG_RX) != 0 || (value & USB_EP_STAT_RX) != 0)
+                st.rx_masked = bit14 == bit6;
+        }
+        if (st.stat_tx != USB_EP_STAT_TX_DISABLED) {
+            if ((toggled & USB_EP_SW_BUF_TX) != 0)
+                st.tx_masked = false;
+            else if ((toggled & USB_EP_DTOG_TX) != 0 || (value & USB_EP_STAT_TX) != 0)
+                st.tx_masked = bit14 == bit6;
+        }
+    } else {
+        st.rx_masked = false;
+        st.tx_masked = false;
+    }
+
+    reg = with_visible_stat(ep, reg);
+    ep_reg(ep) = reg;
+    update_istr();
+    return ep_reg(ep);
+}
+
+// --- Device: buffer descriptor table and packet memory
+
+static volatile uint32_t& buf_desc_addr(int ep, int offset)
+{
+    return sim_reg(USB_PMA_BASE + (ep << 4) + (offset << 3));
+}
+
+static volatile uint32_t& buf_desc_count(int ep, int offset)
+{
+    return sim_reg(USB_PMA_BASE + (ep << 4) + (offset << 3) + 4);
+}
+
+static uint32_t rx_buf_capacity(uint32_t count_reg)
+{
+    uint32_t num_block = (count_reg >> 10) & 0x1f;
+    if ((count_reg & 0x8000) != 0)
+        return (num_block + 1) * 32;
+    return num_block * 2;
+}
+
+static void pma_write(uint32_t usb_addr, const uint8_t* data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += 2) {
+        uint32_t half_word = data[i];
+        if (i + 1 < len)
+            half_word |= data[i + 1] << 8;
+        sim_reg(USB_PMA_BASE + (usb_addr + i) * 2) = half_word;
+    }
+}
+
+static void pma_read(uint8_t* data, uint32_t usb_addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += 2) {
+        uint32_t half_word = sim_reg(USB_PMA_BASE + (usb_addr + i) * 2);
+        data[i] = half_word;
+        if (i + 1 < len)
+            data[i + 1] = half_word >> 8;
+    }
+}
+
+static void receive_into_buffer(int ep, int offset, const uint8_t* data, uint32_t len)
+{
+    volatile uint32_t& count = buf_desc_count(ep, offset);
+    len = std::min(len, rx_buf_capacity(count));
+    pma_write(buf_desc_addr(ep, offset) & 0xffff, data, len);
+    count = (count & ~0x3ffU) | len;
+}
+
+// --- Device: transactions
+
+enum class usb_response { ack, nak, stall, none };
+
+static bool is_addressed(uint8_t addr)
+{
+    uint32_t daddr = sim_reg(USB_DEV_FS_BASE + 0x4c);
+    return (daddr & USB_DADDR_EF) != 0 && (daddr & USB_DADDR_ADDR) == addr;
+}
+
+static int find_ep_reg(uint8_t ep_num)
+{
+    for (int ep = 0; ep < NUM_EP_REGS; ep++)
+        if ((ep_reg(ep) & USB_EP_ADDR) == ep_num)
+            return ep;
+    return -1;
+}
+
+static usb_response device_setup(uint8_t addr, const uint8_t* data)
+{
+    int ep = find_ep_reg(0);
+    if (!is_addressed(addr) || ep < 0 || eps[ep].stat_rx == USB_EP_STAT_RX_DISABLED)
+        return usb_response::none;
+
+    // SETUP is always acknowledged; both directions are set to NAK
+    receive_into_buffer(ep, 1, data, 8);
+    eps[ep].stat_rx = USB_EP_STAT_RX_NAK;
+    eps[ep].stat_tx = USB_EP_STAT_TX_NAK;
+    ep_reg(ep) = with_visible_stat(ep, ep_reg(ep) | USB_EP_CTR_RX | USB_EP_SETUP);
+    update_istr();
+    sim_activity++;
+    return usb_response::ack;
+}
+
+static usb_response device_out(uint8_t addr, uint8_t ep_num, const uint8_t* data, uint32_t len)
+{
+    int ep = find_ep_reg(ep_num);
+    if (!is_addressed(addr) || ep < 0)
+        return usb_response::none;
+
+    ep_state& st = eps[ep];
+    uint32_t reg = ep_reg(ep);
+    if (st.stat_rx == USB_EP_STAT_RX_DISABLED)
+        return usb_response::none;
+    if (st.stat_rx == USB_EP_STAT_RX_STALL)
+        return usb_response::stall;
+    if (st.stat_rx == USB_EP_STAT_RX_NAK || st.rx_masked)
+        return usb_response::nak;
+
+    if (is_dbl_buf(reg)) {
+        int offset = (reg & USB_EP_DTOG_RX) != 0 ? 1 : 0;
+        receive_into_buffer(ep, offset, data, len);
+        reg ^= USB_EP_DTOG_RX;
+        st.rx_masked = ((reg & USB_EP_DTOG_RX) != 0) == ((reg & USB_EP_SW_BUF_RX) != 0);
+    } else {
+        receive_into_buffer(ep, 1, data, len);
+        reg ^= USB_EP_DTOG_RX;
+        st.stat_rx = USB_EP_STAT_RX_NAK;
+    }
+
+    reg = (reg & ~USB_EP_SETUP) | USB_EP_CTR_RX;
+    ep_reg(ep) = with_visible_stat(ep, reg);
+    update_istr();
+    sim_activity++;
+    return usb_response::ack;
+}
+
+static usb_response device_in(uint8_t addr, uint8_t ep_num, uint8_t* data, uint32_t* len)
+{
+    int ep = find_ep_reg(ep_num);
+    if (!is_addressed(addr) || ep < 0)
+        return usb_response::none;
+
+    ep_state& st = eps[ep];
+    uint32_t reg = ep_reg(ep);
+    if (st.stat_tx == USB_EP_STAT_TX_DISABLED)
+        return usb_response::none;
+    if (st.stat_tx == USB_EP_STAT_TX_STALL)
+        return usb_response::stall;
+    if (st.stat_tx == USB_EP_STAT_TX_NAK || st.tx_masked)
+        return usb_response::nak;
+
+    int offset = 0;
+    if (is_dbl_buf(reg))
+        offset = (reg & USB_EP_DTOG_TX) != 0 ? 1 : 0;
+
+    *len = std::min(buf_desc_count(ep, offset) & 0x3ffU, (uint32_t)BULK_PACKET_SIZE);
+    pma_read(data, buf_desc_addr(ep, offset) & 0xffff, *len);
+    reg ^= USB_EP_DTOG_TX;
+
+    if (is_dbl_buf(reg))
+        st.tx_masked = ((reg & USB_EP_DTOG_TX) != 0) == ((reg & USB_EP_SW_BUF_TX) != 0);
+    else
+        st.stat_tx = USB_EP_STAT_TX_NAK;
+
+    ep_reg(ep) = with_visible_stat(ep, reg | USB_EP_CTR_TX);
+    update_istr();
+    sim_activity++;
+    return usb_response::ack;
+}
+
+// --- Host: control transfers
+
+enum class ctrl_kind { get_device_desc, set_address, get_config_desc, set_configuration, class_request, vendor_request };
+
+struct control_transfer {
+    ctrl_kind kind;
+    uint8_t setup[8];
+    uint8_t data[256];
+    uint16_t length;
+    uint16_t done;
+    enum { setup_stage, data_stage, status_stage } stage;
+};
+
+static constexpr int CTRL_QUEUE_LEN = 16;
+static control_transfer ctrl_queue[CTRL_QUEUE_LEN];
+static int ctrl_head;
+static int ctrl_tail;
+
+static void queue_control(ctrl_kind kind, uint8_t bm_request_type, uint8_t b_request, uint16_t w_value,
+        uint16_t w_index, const uint8_t* data, uint16_t length)
+{
+    int next = (ctrl_head + 1) % CTRL_QUEUE_LEN;
+    if (next == ctrl_tail) {
+        fprintf(stderr, "Simulator: control request queue overflow\n");
+        return;
+    }
+
+    control_transfer& xfer = ctrl_queue[ctrl_head];
+    xfer.kind = kind;
+    xfer.setup[0] = bm_request_type;
+    xfer.setup[1] = b_request;
+    xfer.setup[2] = w_value;
+    xfer.setup[3] = w_value >> 8;
+    xfer.setup[4] = w_index;
+    xfer.setup[5] = w_index >> 8;
+    xfer.setup[6] = length;
+    xfer.setup[7] = length >> 8;
+    xfer.length = length;
+    xfer.done = 0;
+    xfer.stage = control_transfer::setup_stage;
+    if (data != nullptr)
+        memcpy(xfer.data, data, length);
+    ctrl_head = next;
+}
+
+// --- Host: state
+
+enum class host_state { detached, attached, resetting, recovering, enumerating, configured };
+
+static host_state state;
+static uint64_t state_until_ns;
+static uint8_t host_addr;
+static uint32_t ep0_max_packet;
+static uint64_t ctrl_delay_until_ns;
+
+static uint64_t frame_start_ns;
+static uint64_t bus_time_ns;
+static uint64_t last_bus_update_ns;
+static uint16_t frame_number;
+static uint32_t interrupt_countdown;
+static bool is_interrupt_due;
+
+static uint8_t out_packet[BULK_PACKET_SIZE];
+static uint32_t out_packet_len;
+static int bulk_rr;
+
+static void log(const char* msg, const control_transfer* xfer = nullptr)
+{
+    if (!sim_opts.verbose)
+        return;
+    if (xfer != nullptr)
+        fprintf(stderr, "USB host: %s %02x %02x %02x%02x %02x%02x %02x%02x\n", msg, xfer->setup[0],
+                xfer->setup[1], xfer->setup[3], xfer->setup[2], xfer->setup[5], xfer->setup[4], xfer->setup[7],
+                xfer->setup[6]);
+    else
+        fprintf(stderr, "USB host: %s\n", msg);
+}
+
+static void enter_state(host_state new_state, uint64_t until_ns)
+{
+    sim_activity++;
+    state = new_state;
+    state_until_ns = until_ns;
+}
+
+void sim_usb_reset()
+{
+    for (int ep = 0; ep < NUM_EP_REGS; ep++) {
+        ep_reg(ep) = 0;
+        eps[ep] = ep_state();
+    }
+    sim_reg(USB_DEV_FS_BASE + 0x40) = USB_CNTR_PWDN | USB_CNTR_FRES;
+    sim_reg(USB_DEV_FS_BASE + 0x44) = 0;
+    sim_reg(USB_DEV_FS_BASE + 0x48) = 0;
+    sim_reg(USB_DEV_FS_BASE + 0x4c) = 0;
+    sim_reg(USB_DEV_FS_BASE + 0x50) = 0;
+
+    enter_state(host_state::detached, 0);
+    ctrl_head = ctrl_tail = 0;
+    out_packet_len = 0;
+}
+
+static void bus_reset(uint64_t t_ns)
+{
+    log("bus reset");
+    for (int ep = 0; ep < NUM_EP_REGS; ep++) {
+        ep_reg(ep) = 0;
+        eps[ep] = ep_state();
+    }
+    sim_reg(USB_DEV_FS_BASE + 0x4c) = 0;
+    sim_reg(USB_DEV_FS_BASE + 0x44) = USB_ISTR_RESET;
+
+    host_addr = 0;
+    ep0_max_packet = 8;
+    ctrl_head = ctrl_tail = 0;
+    out_packet_len = 0;
+    enter_state(host_state::resetting, t_ns + 10 * MS_NS);
+}
+
+static void start_enumeration(uint64_t t_ns)
+{
+    log("enumerating");
+    queue_control(ctrl_kind::get_device_desc, 0x80, 6, 0x0100, 0, nullptr, 64);
+    queue_control(ctrl_kind::set_address, 0x00, 5, DEVICE_ADDRESS, 0, nullptr, 0);
+    queue_control(ctrl_kind::get_device_desc, 0x80, 6, 0x0100, 0, nullptr, 18);
+    queue_control(ctrl_kind::get_config_desc, 0x80, 6, 0x0200, 0, nullptr, 255);
+    queue_control(ctrl_kind::set_configuration, 0x00, 9, 1, 0, nullptr, 0);
+
+    frame_start_ns = t_ns;
+    bus_time_ns = t_ns + bits_to_ns(SOF_BITS);
+    interrupt_countdown = 0;
+    enter_state(host_state::enumerating, 0);
+}
+
+static void start_frame(uint64_t start_ns)
+{
+    frame_start_ns = start_ns;
+    bus_time_ns = start_ns + bits_to_ns(SOF_BITS);
+    frame_number = (frame_number + 1) & USB_FNR_FN;
+    sim_reg(USB_DEV_FS_BASE + 0x48) = frame_number;
+    sim_reg(USB_DEV_FS_BASE + 0x44) |= USB_ISTR_SOF;
+    sim_stat.usb_frames++;
+    sim_activity++;
+
+    if (interrupt_countdown == 0) {
+        is_interrupt_due = state == host_state::configured;
+        interrupt_countdown = sim_opts.usb_interrupt_interval;
+    }
+    interrupt_countdown--;
+}
+
+void sim_usb_set_line_coding(uint32_t baudrate, uint8_t databits, uint8_t stopbits, uint8_t parity)
+{
+    uint8_t data[7] = { (uint8_t)baudrate, (uint8_t)(baudrate >> 8), (uint8_t)(baudrate >> 16),
+        (uint8_t)(baudrate >> 24), stopbits, parity, databits };
+    queue_control(ctrl_kind::class_request, 0x21, 0x20, 0, 0, data, sizeof(data));
+}
+
+void sim_usb_set_control_line_state(bool dtr, bool rts)
+{
+    queue_control(ctrl_kind::class_request, 0x21, 0x22, (dtr ? 1 : 0) | (rts ? 2 : 0), 0, nullptr, 0);
+}
+
+void sim_usb_vendor_request(uint8_t request, uint16_t value, uint16_t index, uint16_t in_length)
+{
+    in_length = std::min(in_length, (uint16_t)sizeof(control_transfer::data));
+    queue_control(ctrl_kind::vendor_request, in_length > 0 ? 0xc0 : 0x40, request, value, index, nullptr, in_length);
+}
+
+bool sim_usb_is_configured()
+{
+    return state == host_state::configured;
+}
+
+// --- Host: transactions
+
+static void control_completed(control_transfer& xfer, bool is_stalled, uint64_t t_ns)
+{
+    ctrl_tail = (ctrl_tail + 1) % CTRL_QUEUE_LEN;
+
+    if (xfer.kind == ctrl_kind::vendor_request)
+        sim_app->on_vendor_request_completed(xfer.setup[1], xfer.data, xfer.done, is_stalled, t_ns);
+
+    if (is_stalled) {
+        log("control request stalled:", &xfer);
+        return;
+    }
+
+    log("control request completed:", &xfer);
+
+    switch (xfer.kind) {
+    case ctrl_kind::get_device_desc:
+        if (xfer.done >= 8)
+            ep0_max_packet = xfer.data[7];
+        break;
+    case ctrl_kind::set_address:
+        host_addr = DEVICE_ADDRESS;
+        ctrl_delay_until_ns = t_ns + 2 * MS_NS; // set address recovery interval
+        break;
+    case ctrl_kind::set_configuration:
+        enter_state(host_state::configured, 0);
+        sim_app->on_configured(t_ns);
+        break;
+    default:
+        break;
+    }
+}
+
+/// Executes the next control transaction, returns its duration (in bit times)
+static uint32_t control_transaction(uint64_t t_ns)
+{
+    control_transfer& xfer = ctrl_queue[ctrl_tail];
+    bool is_in = (xfer.setup[0] & 0x80) != 0;
+    usb_response response;
+    uint32_t bits;
+
+    if (xfer.stage == control_transfer::setup_stage) {
+        sim_stat.usb_setup_packets++;
+        response = device_setup(host_addr, xfer.setup);
+        bits = data_bits(8);
+        if (response == usb_response::ack)
+            xfer.stage = xfer.length > 0 ? control_transfer::data_stage : control_transfer::status_stage;
+
+    } else if (xfer.stage == control_transfer::data_stage && is_in) {
+        uint8_t packet[BULK_PACKET_SIZE];
+        uint32_t len = 0;
+        response = device_in(host_addr, 0, packet, &len);
+        bits = response == usb_response::ack ? data_bits(len) : HANDSHAKE_ONLY_BITS;
+        if (response == usb_response::ack) {
+            len = std::min(len, (uint32_t)(xfer.length - xfer.done));
+            memcpy(xfer.data + xfer.done, packet, len);
+            xfer.done += len;
+            if (len < ep0_max_packet || xfer.done >= xfer.length)
+                xfer.stage = control_transfer::status_stage;
+        }
+
+    } else if (xfer.stage == control_transfer::data_stage) {
+        uint32_t len = std::min(ep0_max_packet, (uint32_t)(xfer.length - xfer.done));
+        response = device_out(host_addr, 0, xfer.data + xfer.done, len);
+        bits = data_bits(len);
+        if (response == usb_response::ack) {
+            xfer.done += len;
+            if (xfer.done >= xfer.length)
+                xfer.stage = control_transfer::status_stage;
+        }
+
+    } else if (is_in) {
+        // status stage: zero-length OUT
+        response = device_out(host_addr, 0, nullptr, 0);
+        bits = data_bits(0);
+        if (response == usb_response::ack)
+            control_completed(xfer, false, t_ns + bits_to_ns(bits));
+
+    } else {
+        // status stage: zero-length IN
+        uint8_t packet[BULK_PACKET_SIZE];
+        uint32_t len = 0;
+        response = device_in(host_addr, 0, packet, &len);
+        bits = response == usb_response::ack ? data_bits(len) : HANDSHAKE_ONLY_BITS;
+        if (response == usb_response::ack)
+            control_completed(xfer, false, t_ns + bits_to_ns(bits));
+    }
+
+    if (response == usb_response::stall)
+        control_completed(xfer, true, t_ns);
+    else if (response == usb_response::none)
+        bits += TIMEOUT_BITS;
+
+    return bits;
+}
+
+static uint32_t bulk_out_transaction()
+{
+    uint32_t bits = data_bits(out_packet_len);
+    usb_response response = device_out(host_addr, BULK_OUT_EP, out_packet, out_packet_len);
+    if (response == usb_response::ack) {
+        sim_stat.usb_out_packets++;
+        out_packet_len = 0;
+    } else {
+        sim_stat.usb_out_naks++;
+    }
+
+    return response == usb_response::none ? bits + TIMEOUT_BITS : bits;
+}
+
+static uint32_t in_transaction(uint8_t ep_num, uint64_t t_ns)
+{
+    uint8_t packet[BULK_PACKET_SIZE];
+    uint32_t len = 0;
+    usb_response response = device_in(host_addr, ep_num, packet, &len);
+
+    if (response != usb_response::ack) {
+        if (ep_num == BULK_IN_EP)
+            sim_stat.usb_in_naks++;
+        return response == usb_response::none ? TIMEOUT_BITS : HANDSHAKE_ONLY_BITS;
+    }
+
+    uint32_t bits = data_bits(len);
+    if (ep_num == BULK_IN_EP) {
+        sim_stat.usb_in_packets++;
+        sim_app->on_in_data(packet, len, t_ns + bits_to_ns(bits));
+    } else {
+        sim_app->on_notification(packet, len, t_ns + bits_to_ns(bits));
+    }
+    return bits;
+}
+
+// --- Host: scheduling
+
+enum class pipe { control, interrupt_in, bulk_out, bulk_in, none };
+
+static bool is_pipe_ready(pipe p, uint64_t t_ns)
+{
+    switch (p) {
+    case pipe::control:
+        // the next stage waits until the firmware has processed the previous one
+        // (real firmware reacts within microseconds)
+        return ctrl_head != ctrl_tail && t_ns >= ctrl_delay_until_ns
+            && (ep_reg(0) & (USB_EP_CTR_RX | USB_EP_CTR_TX)) == 0;
+    case pipe::interrupt_in:
+        return is_interrupt_due;
+    case pipe::bulk_out:
+        if (state != host_state::configured)
+            return false;
+        if (out_packet_len == 0)
+            out_packet_len = sim_app->fetch_out_data(out_packet, BULK_PACKET_SIZE, t_ns);
+        return out_packet_len > 0;
+    case pipe::bulk_in:
+        return state == host_state::configured && sim_app->can_receive_in_data(t_ns);
+    default:
+        return false;
+    }
+}
+
+static void run_bus(uint64_t t_ns)
+{
+    bool is_used[4] = { false, false, false, false };
+
+    // While waiting for the firmware, the bus cannot fall behind the previous update:
+    // the firmware's reaction is only visible from then on.
+    bus_time_ns = std::max(bus_time_ns, last_bus_update_ns);
+    last_bus_update_ns = t_ns;
+
+    while (bus_time_ns <= t_ns) {
+        uint64_t frame_end = frame_start_ns + FRAME_NS;
+        if (bus_time_ns >= frame_end) {
+            // skip frames if the simulation has fallen behind
+            uint64_t start = frame_end;
+            if (t_ns - start >= FRAME_NS)
+                start = t_ns - (t_ns - start) % FRAME_NS;
+            start_frame(start);
+            continue;
+        }
+
+        // periodic transfers first, then control, then round robin between bulk pipes
+        pipe candidates[] = { pipe::interrupt_in, pipe::control,
+            bulk_rr == 0 ? pipe::bulk_out : pipe::bulk_in, bulk_rr == 0 ? pipe::bulk_in : pipe::bulk_out };
+        pipe selected = pipe::none;
+        bool is_blocked = false;
+        for (pipe p : candidates) {
+            if (!is_pipe_ready(p, bus_time_ns))
+                continue;
+            if (is_used[(int)p]) {
+                is_blocked = true;
+                continue;
+            }
+            selected = p;
+            break;
+        }
+
+        if (selected == pipe::none) {
+            if (is_blocked)
+                break; // wait for firmware
+            bus_time_ns = std::min(t_ns, frame_end); // bus idle
+            if (bus_time_ns == t_ns)
+                break;
+            continue;
+        }
+
+        uint64_t budget_end = frame_start_ns + bits_to_ns(sim_opts.usb_frame_budget_bits);
+        uint32_t expected_bits = selected == pipe::bulk_out ? data_bits(out_packet_len) : data_bits(BULK_PACKET_SIZE);
+        if (bus_time_ns + bits_to_ns(expected_bits) > budget_end) {
+            bus_time_ns = frame_end; // doesn't fit into this frame
+            continue;
+        }
+
+        uint32_t bits;
+        switch (selected) {
+        case pipe::control:
+            bits = control_transaction(bus_time_ns);
+            break;
+        case pipe::interrupt_in:
+            is_interrupt_due = false;
+            bits = in_transaction(INTERRUPT_IN_EP, bus_time_ns);
+            break;
+        case pipe::bulk_out:
+            bits = bulk_out_transaction();
+            bulk_rr = 1;
+            break;
+        default:
+            bits = in_transaction(BULK_IN_EP, bus_time_ns);
+            bulk_rr = 0;
+            break;
+        }
+
+        is_used[(int)selected] = true;
+        bus_time_ns += bits_to_ns(bits);
+    }
+}
+
+void sim_usb_update(uint64_t t_ns)
+{
+    uint32_t cntr = sim_reg(USB_DEV_FS_BASE + 0x40);
+    bool is_powered = (cntr & (USB_CNTR_PWDN | USB_CNTR_FRES)) == 0;
+
+    switch (state) {
+    case host_state::detached:
+        if (is_powered) {
+            log("device attached");
+            enter_state(host_state::attached, t_ns + 100 * MS_NS); // debounce interval
+        }
+        return;
+    case host_state::attached:
+        if (t_ns >= state_until_ns)
+            bus_reset(t_ns);
+        return;
+    case host_state::resetting:
+        if (t_ns >= state_until_ns)
+            enter_state(host_state::recovering, t_ns + 10 * MS_NS); // reset recovery time
+        return;
+    case host_state::recovering:
+        if (t_ns >= state_until_ns)
+            start_enumeration(t_ns);
+        return;
+    default:
+        break;
+    }
+
+    if (!is_powered) {
+        log("device detached");
+        enter_state(host_state::detached, 0);
+        return;
+    }
+
+    run_bus(t_ns);
+}
+
+uint64_t sim_usb_next_event_ns()
+{
+    switch (state) {
+    case host_state::detached:
+        return UINT64_MAX;
+    case host_state::attached:
+    case host_state::resetting:
+    case host_state::recovering:
+        return state_until_ns;
+    default:
+        break;
+    }
+
+    uint64_t next = frame_start_ns + FRAME_NS;
+    if (bus_time_ns > sim_now_ns())
+        next = std::min(next, bus_time_ns); // transaction in progress
+    return next;
+}
+
+uint32_t sim_usb_register_written(uint32_t addr, uint32_t old_value, uint32_t value)
+{
+    uint32_t offset = addr - USB_DEV_FS_BASE;
+    if (offset < 4 * NUM_EP_REGS)
+        return ep_register_written(offset / 4, old_value, value);
+
+    switch (offset) {
+    case 0x44: {
+        // ISTR: latched bits are cleared by writing 0, CTR, DIR and EP_ID are read-only
+        sim_reg(addr) = (old_value & ~LATCHED_ISTR_BITS) | (old_value & value & LATCHED_ISTR_BITS);
+        update_istr();
+        return sim_reg(addr);
+    }
+    case 0x48:
+        return old_value; // FNR is read-only
+    default:
+        return value;
+    }
+}
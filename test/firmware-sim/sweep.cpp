@@ -0,0 +1,531 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// Parameter sweep: runs the simulated firmware in virtual time for each
+// combination of bit rate and tuning parameters (see firmware/include/tuning.h)
+// and reports throughput and latency in both directions.
+//
+// Both directions run at the same time (full duplex):
+//  - TX: the USB host sends data that the adapter transmits on the UART.
+//    Latency is measured from the first attempt to send the USB packet
+//    to the end of the character's stop bit.
+//  - RX: the serial peer sends data (honoring RTS) that the adapter forwards
+//    to the USB host. Latency is measured from the end of the character's
+//    stop bit to the completion of the USB IN transaction.
+//
+// Each combination runs in a separate process; several processes run in parallel.
+//
+// Comand line syntax: firmware-sweep [ OPTIONS... ]
+//
+// Example:
+//
+//     firmware-sweep -b 115200,921600 --param TX_NAK_HIGH_WATER=64,128,256 --param TX_HOLDBACK_MAX_TIME=1,3
+//
+
+#include "cxxopts.hpp"
+#include "sim/sim.hpp"
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Time after configuration until data is generated (line coding has been set)
+static constexpr uint64_t GEN_DELAY_NS = 5000000;
+// Time after start of data generation until measurement starts
+static constexpr uint64_t WARMUP_NS = 20000000;
+// Time limit for USB enumeration
+static constexpr uint64_t ENUM_TIMEOUT_NS = 2000000000;
+// Size of ring buffer for timestamps (must exceed the number of bytes in transit)
+static constexpr uint32_t TIMESTAMP_RING_SIZE = 1 << 16;
+
+struct tuning_param_values {
+    std::string name;
+    std::vector<int> values;
+};
+
+struct sweep_config {
+    uint32_t bitrate;
+    std::vector<int> param_values;
+};
+
+/// Result of a single run (passed from the child process through a pipe)
+struct sweep_result {
+    bool is_valid;
+    double tx_throughput; // in bytes/s
+    uint32_t tx_p50_ns;
+    uint32_t tx_p99_ns;
+    double rx_throughput; // in bytes/s
+    uint32_t rx_p50_ns;
+    uint32_t rx_p99_ns;
+    uint32_t overruns;
+    uint32_t errors;
+};
+
+/**
+ * @brief Latency samples collected during the measurement window.
+ *
+ * The storage is allocated upfront as samples are added from
+ * the simulator's signal handlers.
+ */
+class latency_samples {
+public:
+    void reserve(size_t n) { samples.reserve(n); }
+
+    void add(uint64_t latency_ns)
+    {
+        if (samples.size() < samples.capacity())
+            samples.push_back((uint32_t)std::min(latency_ns, (uint64_t)UINT32_MAX));
+        count++;
+    }
+
+    uint64_t num_samples() const { return count; }
+
+    uint32_t percentile(int p)
+    {
+        if (samples.empty())
+            return 0;
+        size_t index = (samples.size() - 1) * p / 100;
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+private:
+    std::vector<uint32_t> samples;
+    uint64_t count = 0;
+};
+
+/**
+ * @brief USB host application and serial peer generating and checking the test data.
+ */
+class sweep_bench : public sim_usb_app, public sim_line_peer {
+public:
+    sweep_bench(uint32_t bitrate, int load_percent, uint64_t duration_ns, int result_fd);
+
+    // USB host side
+    void on_configured(uint64_t t_ns) override;
+    size_t fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns) override;
+    bool can_receive_in_data(uint64_t t_ns) override;
+    void on_in_data(const uint8_t* data, size_t len, uint64_t t_ns) override;
+    void on_notification(const uint8_t* data, size_t len, uint64_t t_ns) override;
+    void poll(uint64_t t_ns) override;
+
+    // serial line side
+    void on_char_transmitted(uint16_t data, uint64_t end_ns) override;
+    bool is_ready_to_receive(uint64_t t_ns) override;
+    void on_rts_changed(bool asserted, uint64_t t_ns) override;
+    bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) override;
+
+private:
+    uint32_t bitrate;
+    int load_percent;
+    uint64_t duration_ns;
+    int result_fd;
+
+    uint64_t char_ns; // duration of a character (8N1)
+    uint64_t gen_start_ns = UINT64_MAX;
+    uint64_t measure_start_ns = UINT64_MAX;
+    uint64_t measure_end_ns = UINT64_MAX;
+
+    // TX: USB OUT -> UART TX
+    uint64_t tx_gen_seq = 0;
+    uint64_t tx_check_seq = 0;
+    uint64_t tx_bytes = 0;
+    std::vector<uint64_t> tx_times;
+    latency_samples tx_latency;
+
+    // RX: UART RX -> USB IN
+    uint64_t rx_gen_seq = 0;
+    uint64_t rx_check_seq = 0;
+    uint64_t rx_bytes = 0;
+    std::vector<uint64_t> rx_times;
+    latency_samples rx_latency;
+    bool is_rts_asserted = false;
+
+    uint32_t overruns = 0;
+    uint32_t errors = 0;
+
+    bool is_in_window(uint64_t t_ns) const { return t_ns >= measure_start_ns && t_ns < measure_end_ns; }
+    uint64_t gen_limit(uint64_t t_ns) const;
+    [[noreturn]] void finish(bool is_valid);
+};
+
+sweep_bench::sweep_bench(uint32_t bitrate, int load_percent, uint64_t duration_ns, int result_fd)
+    : bitrate(bitrate), load_percent(load_percent), duration_ns(duration_ns), result_fd(result_fd),
+      tx_times(TIMESTAMP_RING_SIZE), rx_times(TIMESTAMP_RING_SIZE)
+{
+    char_ns = 10000000000ULL / bitrate;
+    size_t max_samples = duration_ns / char_ns + 1000;
+    tx_latency.reserve(max_samples);
+    rx_latency.reserve(max_samples);
+}
+
+void sweep_bench::on_configured(uint64_t t_ns)
+{
+    sim_usb_set_line_coding(bitrate, 8, 0, 0);
+    sim_usb_set_control_line_state(true, true);
+
+    gen_start_ns = t_ns + GEN_DELAY_NS;
+    measure_start_ns = gen_start_ns + WARMUP_NS;
+    measure_end_ns = measure_start_ns + duration_ns;
+}
+
+// number of bytes that may have been generated by the specified time
+uint64_t sweep_bench::gen_limit(uint64_t t_ns) const
+{
+    if (t_ns < gen_start_ns)
+        return 0;
+    if (load_percent >= 100)
+        return UINT64_MAX;
+    return (t_ns - gen_start_ns) * load_percent / 100 / char_ns + 1;
+}
+
+size_t sweep_bench::fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns)
+{
+    size_t n = (size_t)std::min((uint64_t)max_len, gen_limit(t_ns) - tx_gen_seq);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (uint8_t)tx_gen_seq;
+        tx_times[tx_gen_seq % TIMESTAMP_RING_SIZE] = t_ns;
+        tx_gen_seq++;
+    }
+    return n;
+}
+
+void sweep_bench::on_char_transmitted(uint16_t data, uint64_t end_ns)
+{
+    if (data != (uint8_t)tx_check_seq) {
+        // resynchronize
+        errors++;
+        tx_check_seq += (uint8_t)(data - tx_check_seq);
+        tx_check_seq++;
+        return;
+    }
+
+    if (is_in_window(end_ns)) {
+        tx_latency.add(end_ns - tx_times[tx_check_seq % TIMESTAMP_RING_SIZE]);
+        tx_bytes++;
+    }
+    tx_check_seq++;
+}
+
+bool sweep_bench::is_ready_to_receive(uint64_t)
+{
+    return true;
+}
+
+void sweep_bench::on_rts_changed(bool asserted, uint64_t)
+{
+    is_rts_asserted = asserted;
+}
+
+bool sweep_bench::fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns)
+{
+    if (!is_rts_asserted || rx_gen_seq >= gen_limit(t_ns))
+        return false;
+
+    *data = (uint8_t)rx_gen_seq;
+    *end_ns = t_ns + char_ns;
+    rx_times[rx_gen_seq % TIMESTAMP_RING_SIZE] = *end_ns;
+    rx_gen_seq++;
+    return true;
+}
+
+bool sweep_bench::can_receive_in_data(uint64_t)
+{
+    return true;
+}
+
+void sweep_bench::on_in_data(const uint8_t* data, size_t len, uint64_t t_ns)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != (uint8_t)rx_check_seq) {
+            // data has been lost: resynchronize
+            errors++;
+            rx_check_seq += (uint8_t)(data[i] - rx_check_seq);
+            rx_check_seq++;
+            continue;
+        }
+
+        if (is_in_window(t_ns)) {
+            rx_latency.add(t_ns - rx_times[rx_check_seq % TIMESTAMP_RING_SIZE]);
+            rx_bytes++;
+        }
+        rx_check_seq++;
+    }
+}
+
+void sweep_bench::on_notification(const uint8_t* data, size_t len, uint64_t)
+{
+    // SERIAL_STATE notification with overrun bit
+    if (len >= 10 && data[1] == 0x20 && (data[8] & 0x40) != 0)
+        overruns++;
+}
+
+void sweep_bench::poll(uint64_t t_ns)
+{
+    if (t_ns >= measure_end_ns)
+        finish(true);
+    if (!sim_usb_is_configured() && t_ns >= ENUM_TIMEOUT_NS)
+        finish(false);
+}
+
+void sweep_bench::finish(bool is_valid)
+{
+    sweep_result result;
+    memset(&result, 0, sizeof(result));
+    result.is_valid = is_valid;
+    if (is_valid) {
+        double duration_s = duration_ns / 1e9;
+        result.tx_throughput = tx_bytes / duration_s;
+        result.tx_p50_ns = tx_latency.percentile(50);
+        result.tx_p99_ns = tx_latency.percentile(99);
+        result.rx_throughput = rx_bytes / duration_s;
+        result.rx_p50_ns = rx_latency.percentile(50);
+        result.rx_p99_ns = rx_latency.percentile(99);
+        result.overruns = overruns;
+        result.errors = errors;
+    }
+
+    ssize_t n = write(result_fd, &result, sizeof(result));
+    _exit(n == sizeof(result) ? 0 : 1);
+}
+
+// --- Sweep
+
+static std::vector<tuning_param_values> parse_params(const std::vector<std::string>& args)
+{
+    // cxxopts splits the arguments at commas: "NAME=1,2,3" results in "NAME=1", "2", "3"
+    std::vector<tuning_param_values> params;
+    for (auto& arg : args) {
+        size_t eq = arg.find('=');
+        std::string value = arg;
+        if (eq != std::string::npos) {
+            std::string name = arg.substr(0, eq);
+            if (sim_get_tuning_param(name.c_str()) < 0)
+                throw std::invalid_argument("unknown tuning parameter " + name);
+            params.push_back({ name, {} });
+            value = arg.substr(eq + 1);
+        } else if (params.empty()) {
+            throw std::invalid_argument("invalid parameter specification " + arg);
+        }
+        params.back().values.push_back(std::stoi(value));
+    }
+    return params;
+}
+
+static std::vector<sweep_config> build_configs(
+        const std::vector<uint32_t>& bitrates, const std::vector<tuning_param_values>& params)
+{
+    std::vector<sweep_config> configs;
+    for (uint32_t bitrate : bitrates)
+        configs.push_back({ bitrate, {} });
+
+    for (auto& param : params) {
+        std::vector<sweep_config> expanded;
+        for (auto& config : configs) {
+            for (int value : param.values) {
+                sweep_config c = config;
+                c.param_values.push_back(value);
+                expanded.push_back(c);
+            }
+        }
+        configs = expanded;
+    }
+    return configs;
+}
+
+[[noreturn]] static void run_child(const sweep_config& config, const std::vector<tuning_param_values>& params,
+        int load_percent, uint64_t duration_ns, int result_fd)
+{
+    for (size_t i = 0; i < params.size(); i++)
+        sim_set_tuning_param(params[i].name.c_str(), config.param_values[i]);
+
+    static sweep_bench* bench = new sweep_bench(config.bitrate, load_percent, duration_ns, result_fd);
+
+    sim_options options;
+    options.virtual_time = true;
+    sim_init(options, bench, bench);
+    sim_run_firmware();
+}
+
+static std::vector<sweep_result> run_sweep(const std::vector<sweep_config>& configs,
+        const std::vector<tuning_param_values>& params, int load_percent, uint64_t duration_ns, int num_jobs)
+{
+    std::vector<sweep_result> results(configs.size());
+    struct running_job {
+        size_t index;
+        int fd;
+    };
+    std::map<pid_t, running_job> running;
+    size_t next = 0;
+
+    while (next < configs.size() || !running.empty()) {
+        if (next < configs.size() && (int)running.size() < num_jobs) {
+            int fds[2];
+            if (pipe(fds) != 0)
+                throw std::runtime_error("pipe() failed");
+
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0)
+                throw std::runtime_error("fork() failed");
+            if (pid == 0) {
+                close(fds[0]);
+                run_child(configs[next], params, load_percent, duration_ns, fds[1]);
+            }
+
+            close(fds[1]);
+            running[pid] = { next, fds[0] };
+            next++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            throw std::runtime_error("wait() failed");
+        auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+
+        sweep_result& result = results[it->second.index];
+        if (read(it->second.fd, &result, sizeof(result)) != sizeof(result))
+            result.is_valid = false;
+        close(it->second.fd);
+        running.erase(it);
+    }
+
+    return results;
+}
+
+static void print_results(const std::vector<sweep_config>& configs, const std::vector<tuning_param_values>& params,
+        const std::vector<sweep_result>& results, bool is_csv)
+{
+    if (is_csv) {
+        printf("bitrate");
+        for (auto& param : params)
+            printf(",%s", param.name.c_str());
+        printf(",tx_bytes_per_s,tx_p50_us,tx_p99_us,rx_bytes_per_s,rx_p50_us,rx_p99_us,overruns,errors\n");
+    } else {
+        printf("%9s", "bitrate");
+        for (auto& param : params)
+            printf("  %*s", (int)param.name.length(), param.name.c_str());
+        printf("  %10s %9s %9s  %10s %9s %9s  %8s %6s\n", "TX kB/s", "p50 us", "p99 us", "RX kB/s", "p50 us",
+                "p99 us", "overruns", "errors");
+    }
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        const sweep_config& config = configs[i];
+        const sweep_result& result = results[i];
+
+        printf(is_csv ? "%u" : "%9u", config.bitrate);
+        for (size_t j = 0; j < params.size(); j++) {
+            if (is_csv)
+                printf(",%d", config.param_values[j]);
+            else
+                printf("  %*d", (int)params[j].name.length(), config.param_values[j]);
+        }
+
+        if (!result.is_valid) {
+            printf(is_csv ? ",,,,,,,,\n" : "  simulation failed\n");
+            continue;
+        }
+
+        printf(is_csv ? ",%.0f,%.1f,%.1f,%.0f,%.1f,%.1f,%u,%u\n"
+                      : "  %10.1f %9.1f %9.1f  %10.1f %9.1f %9.1f  %8u %6u\n",
+                is_csv ? result.tx_throughput : result.tx_throughput / 1000, result.tx_p50_ns / 1000.0,
+                result.tx_p99_ns / 1000.0, is_csv ? result.rx_throughput : result.rx_throughput / 1000,
+                result.rx_p50_ns / 1000.0, result.rx_p99_ns / 1000.0, result.overruns, result.errors);
+    }
+}
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    cxxopts::Options options("firmware-sweep", "Throughput and latency of the simulated firmware for parameter combinations");
+
+    options.add_options()
+        ("b,bitrate", "Bit rates (comma separated)", cxxopts::value<std::vector<uint32_t>>()->default_value("115200,921600"))
+        ("P,param", "Tuning parameter values, e.g. TX_NAK_HIGH_WATER=64,128 (can be repeated)", cxxopts::value<std::vector<std::string>>())
+        ("l,load", "Offered load (in % of bit rate)", cxxopts::value<int>()->default_value("100"))
+        ("d,duration", "Measurement duration (in ms of simulated time)", cxxopts::value<int>()->default_value("200"))
+        ("j,jobs", "Number of parallel simulations (default: number of CPUs)", cxxopts::value<int>())
+        ("csv", "Output results as CSV")
+        ("h,help", "Show usage");
+
+    std::vector<uint32_t> bitrates;
+    std::vector<tuning_param_values> params;
+    int load_percent;
+    uint64_t duration_ns;
+    int num_jobs = std::max((int)std::thread::hardware_concurrency(), 1);
+    bool is_csv;
+
+    try {
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") != 0) {
+            std::cout << options.help() << std::endl;
+            return 2;
+        }
+
+        bitrates = result["bitrate"].as<std::vector<uint32_t>>();
+        for (uint32_t bitrate : bitrates) {
+            if (bitrate < 1200 || bitrate > 4500000) {
+                std::cerr << "Bit rate " << bitrate << " out of range (1200 .. 4,500,000)" << std::endl;
+                return 3;
+            }
+        }
+
+        if (result.count("param") > 0)
+            params = parse_params(result["param"].as<std::vector<std::string>>());
+
+        load_percent = result["load"].as<int>();
+        if (load_percent < 1 || load_percent > 100) {
+            std::cerr << "Load must be between 1 and 100" << std::endl;
+            return 3;
+        }
+
+        int duration_ms = result["duration"].as<int>();
+        if (duration_ms < 1) {
+            std::cerr << "Invalid duration" << std::endl;
+            return 3;
+        }
+        duration_ns = duration_ms * 1000000ULL;
+
+        if (result.count("jobs") > 0)
+            num_jobs = std::max(result["jobs"].as<int>(), 1);
+        is_csv = result.count("csv") > 0;
+
+    } catch (const cxxopts::OptionException& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return 3;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 3;
+    }
+
+    try {
+        std::vector<sweep_config> configs = build_configs(bitrates, params);
+        std::vector<sweep_result> results = run_sweep(configs, params, load_percent, duration_ns, num_jobs);
+        print_results(configs, params, results, is_csv);
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Minimal test harness shared by the unit tests.
+//
+// Comand line syntax: TEST_PROGRAM [ TEST_NAME... ]
+//
+
+#include "check.hpp"
+#include <exception>
+#include <iostream>
+#include <set>
+
+std::string test_context;
+
+static int num_failures;
+
+void check_failed(const char* file, int line, const char* expr, long actual, long expected)
+{
+    std::cerr << file << ":" << line << ": " << expr << " is " << actual
+        << ", expected " << expected;
+    if (!test_context.empty())
+        std::cerr << " (" << test_context << ")";
+    std::cerr << std::endl;
+    num_failures += 1;
+}
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    std::set<std::string> selected(argv + 1, argv + argc);
+
+    int num_failed_tests = 0;
+    for (auto& test : test_cases) {
+        if (!selected.empty() && selected.count(test.name) == 0)
+            continue;
+
+        int prev_failures = num_failures;
+        try {
+            test.func();
+        } catch (const std::exception& e) {
+            std::cerr << test.name << ": " << e.what() << std::endl;
+            num_failures += 1;
+        }
+        test_context.clear();
+
+        bool passed = num_failures == prev_failures;
+        std::cout << (passed ? "PASSED  " : "FAILED  ") << test.name << std::endl;
+        if (!passed)
+            num_failed_tests += 1;
+    }
+
+    return num_failed_tests == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Minimal test harness shared by the unit tests. Each test program defines
+// its test functions and the table `test_cases`; `main()` is provided by
+// check.cpp and runs all tests or the tests named on the command line.
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Checks that `actual` equals `expected`, otherwise reports the failure and returns from the test function
+#define CHECK_EQ(actual, expected) \
+    do { \
+        auto a = (actual); \
+        auto e = (expected); \
+        if (a != e) { \
+            check_failed(__FILE__, __LINE__, #actual, (long)a, (long)e); \
+            return; \
+        } \
+    } while (false)
+
+/// Checks that the condition is true, otherwise reports the failure and returns from the test function
+#define CHECK(cond) CHECK_EQ((bool)(cond), true)
+
+/**
+ * @brief Test case.
+ */
+struct test_case {
+    /// Name (for selecting the test on the command line)
+    const char* name;
+    /// Test function
+    std::function<void()> func;
+};
+
+/// Test cases of the test program (defined by each test program)
+extern const std::vector<test_case> test_cases;
+
+/// Context reported with failed checks, e.g. the current loop parameters (cleared after each test)
+extern std::string test_context;
+
+/**
+ * @brief Reports a failed check.
+ *
+ * @param file source file name
+ * @param line source line number
+ * @param expr checked expression
+ * @param actual actual value
+ * @param expected expected value
+ */
+void check_failed(const char* file, int line, const char* expr, long actual, long expected);
@@ -0,0 +1,176 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Tests of the decoding and CRC check of COBS and SLIP frames.
+//
+// Comand line syntax: frame-checker-test [ TEST_NAME... ]
+//
+
+#include "check.hpp"
+#include "frame_checker.h"
+#include <string>
+#include <vector>
+
+// Payload with CRC appended (most significant byte first)
+static std::vector<uint8_t> with_crc(const std::vector<uint8_t>& payload)
+{
+    uint16_t crc = 0xffff;
+    for (uint8_t b : payload)
+        crc = frame_checker::update_crc(crc, b);
+    std::vector<uint8_t> frame(payload);
+    frame.push_back((uint8_t)(crc >> 8));
+    frame.push_back((uint8_t)crc);
+    return frame;
+}
+
+// COBS encoding (without delimiter)
+static std::vector<uint8_t> cobs_encode(const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> encoded(1);
+    size_t code_index = 0;
+    for (uint8_t b : data) {
+        if (b != 0)
+            encoded.push_back(b);
+        if (b == 0 || encoded.size() - code_index == 0xff) {
+            encoded[code_index] = (uint8_t)(encoded.size() - code_index);
+            code_index = encoded.size();
+            encoded.push_back(0);
+        }
+    }
+    encoded[code_index] = (uint8_t)(encoded.size() - code_index);
+    return encoded;
+}
+
+// SLIP encoding (without delimiter)
+static std::vector<uint8_t> slip_encode(const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> encoded;
+    for (uint8_t b : data) {
+        if (b == 0xc0) {
+            encoded.push_back(0xdb);
+            encoded.push_back(0xdc);
+        } else if (b == 0xdb) {
+            encoded.push_back(0xdb);
+            encoded.push_back(0xdd);
+        } else {
+            encoded.push_back(b);
+        }
+    }
+    return encoded;
+}
+
+static bool check_frame(frame_encoding encoding, const std::vector<uint8_t>& encoded)
+{
+    frame_checker checker;
+    checker.reset(encoding);
+    for (uint8_t b : encoded)
+        checker.add(b);
+    return checker.is_valid();
+}
+
+// Payloads covering zeros, delimiters, escape characters and COBS block boundaries
+static std::vector<std::vector<uint8_t>> test_payloads()
+{
+    std::vector<std::vector<uint8_t>> payloads = {
+        { },
+        { 0x00 },
+        { 0x00, 0x00 },
+        { 0x11, 0x22, 0x33 },
+        { 0xc0, 0xdb, 0xdc, 0xdd, 0xc0 },
+        { 0x00, 0xc0, 0x00, 0xdb },
+    };
+    for (size_t len : { 252, 253, 254, 255, 256, 508, 600 }) {
+        std::vector<uint8_t> data(len);
+        for (size_t i = 0; i < len; i++)
+            data[i] = (uint8_t)(i * 37 + 1);
+        payloads.push_back(data);
+        // a single zero at different positions
+        data[len / 2] = 0;
+        payloads.push_back(data);
+    }
+    return payloads;
+}
+
+
+static void test_crc()
+{
+    // check value of CRC-16/CCITT-FALSE
+    uint16_t crc = 0xffff;
+    for (char c : std::string("123456789"))
+        crc = frame_checker::update_crc(crc, (uint8_t)c);
+    CHECK_EQ(crc, 0x29b1);
+}
+
+static void test_valid_frames()
+{
+    for (auto& payload : test_payloads()) {
+        test_context = "payload length " + std::to_string(payload.size());
+        auto frame = with_crc(payload);
+        CHECK(check_frame(frame_encoding::cobs, cobs_encode(frame)));
+        CHECK(check_frame(frame_encoding::slip, slip_encode(frame)));
+    }
+    test_context.clear();
+}
+
+static void test_crc_errors()
+{
+    for (auto& payload : test_payloads()) {
+        test_context = "payload length " + std::to_string(payload.size());
+        auto frame = with_crc(payload);
+        for (size_t i = 0; i < frame.size(); i++) {
+            auto corrupted = frame;
+            corrupted[i] ^= 0x10;
+            CHECK(!check_frame(frame_encoding::cobs, cobs_encode(corrupted)));
+            CHECK(!check_frame(frame_encoding::slip, slip_encode(corrupted)));
+        }
+    }
+    test_context.clear();
+}
+
+static void test_malformed_cobs()
+{
+    auto encoded = cobs_encode(with_crc({ 0x11, 0x00, 0x22, 0x33 }));
+    CHECK(check_frame(frame_encoding::cobs, encoded));
+
+    // truncated block
+    CHECK(!check_frame(frame_encoding::cobs, { 0x02, 0x11, 0x05, 0x22, 0x33 }));
+    CHECK(!check_frame(frame_encoding::cobs, std::vector<uint8_t>(encoded.begin(), encoded.end() - 1)));
+
+    // too short for CRC
+    CHECK(!check_frame(frame_encoding::cobs, { }));
+    CHECK(!check_frame(frame_encoding::cobs, { 0x02, 0xff }));
+}
+
+static void test_malformed_slip()
+{
+    auto encoded = slip_encode(with_crc({ 0xc0, 0x11, 0xdb }));
+    CHECK(check_frame(frame_encoding::slip, encoded));
+
+    // invalid escape sequence
+    auto invalid = encoded;
+    invalid[1] = 0x11;
+    CHECK(!check_frame(frame_encoding::slip, invalid));
+
+    // escape character at end of frame
+    auto unterminated = encoded;
+    unterminated.push_back(0xdb);
+    CHECK(!check_frame(frame_encoding::slip, unterminated));
+
+    CHECK(!check_frame(frame_encoding::slip, { }));
+    CHECK(!check_frame(frame_encoding::slip, { 0xff }));
+}
+
+
+const std::vector<test_case> test_cases = {
+    { "crc", test_crc },
+    { "valid_frames", test_valid_frames },
+    { "crc_errors", test_crc_errors },
+    { "malformed_cobs", test_malformed_cobs },
+    { "malformed_slip", test_malformed_slip },
+};
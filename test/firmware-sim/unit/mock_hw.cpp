@@ -0,0 +1,119 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Mocked peripherals for testing firmware classes in isolation.
+//
+
+#include "mock_hw.hpp"
+#include "hardware.h"
+#include "uart.h"
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/usart.h>
+#include <sys/mman.h>
+#include <stdexcept>
+#include <string.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// APB1, APB2 and AHB peripherals up to and including RCC
+static constexpr uintptr_t REGS_BASE = PERIPH_BASE;
+static constexpr size_t REGS_SIZE = RCC_BASE + 0x400 - PERIPH_BASE;
+// Bit-band alias (plain memory as well, not linked to the registers)
+static constexpr uintptr_t REGS_BB_BASE = 0x42000000;
+
+static void map_memory(uintptr_t base, size_t size)
+{
+    void* mem = mmap((void*)base, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (mem != (void*)base)
+        throw std::runtime_error("Cannot map peripheral registers");
+}
+
+void mock_hw_init()
+{
+    static bool is_mapped = false;
+    if (is_mapped)
+        return;
+
+    map_memory(REGS_BASE, REGS_SIZE);
+    map_memory(REGS_BB_BASE, REGS_SIZE * 32);
+    is_mapped = true;
+}
+
+void mock_hw_reset_uart()
+{
+    mock_hw_init();
+    memset((void*)REGS_BASE, 0, REGS_SIZE);
+    uart = uart_impl();
+    uart.init();
+    uart.enable();
+}
+
+void mock_hw_rx(const uint8_t* data, size_t len)
+{
+    uint8_t* buf = (uint8_t*)(uintptr_t)DMA_CMAR(board::usart_dma, board::usart_dma_rx_chan);
+
+    // DMA read of the data register completes the clear sequence of the error flags
+    USART_SR(board::usart) &= ~(USART_SR_PE | USART_SR_FE);
+
+    while (len > 0) {
+        uint32_t count = DMA_CNDTR(board::usart_dma, board::usart_dma_rx_chan);
+        size_t pos = UART_RX_BUF_LEN - count;
+        size_t n = len < count ? len : count;
+        memcpy(buf + pos, data, n);
+        data += n;
+        len -= n;
+        count -= n;
+        // circular mode: reload counter
+        DMA_CNDTR(board::usart_dma, board::usart_dma_rx_chan) = count == 0 ? UART_RX_BUF_LEN : count;
+    }
+}
+
+void mock_hw_rx_error(const uint8_t* data, size_t len, uint32_t flags)
+{
+    mock_hw_rx(data, len);
+    USART_SR(board::usart) |= flags;
+}
+
+size_t mock_hw_tx_active_len()
+{
+    if ((DMA_CCR(board::usart_dma, board::usart_dma_tx_chan) & DMA_CCR_EN) == 0)
+        return 0;
+    return DMA_CNDTR(board::usart_dma, board::usart_dma_tx_chan);
+}
+
+size_t mock_hw_tx_complete(std::vector<uint8_t>& transmitted)
+{
+    size_t n = mock_hw_tx_active_len();
+    if (n > 0) {
+        const uint8_t* buf = (const uint8_t*)(uintptr_t)DMA_CMAR(board::usart_dma, board::usart_dma_tx_chan);
+        transmitted.insert(transmitted.end(), buf, buf + n);
+        DMA_CNDTR(board::usart_dma, board::usart_dma_tx_chan) = 0;
+        DMA_ISR(board::usart_dma) |= DMA_TCIF << DMA_FLAG_OFFSET(board::usart_dma_tx_chan);
+    }
+
+    uart.poll();
+
+    // IFCR is plain memory: clear flags explicitly
+    DMA_ISR(board::usart_dma) = 0;
+    return n;
+}
+
+size_t mock_hw_tx_drain(std::vector<uint8_t>& transmitted)
+{
+    size_t total = 0;
+    while (true) {
+        size_t n = mock_hw_tx_complete(transmitted);
+        if (n == 0)
+            return total;
+        total += n;
+    }
+}
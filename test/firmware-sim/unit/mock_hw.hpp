@@ -0,0 +1,85 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Mocked peripherals for testing firmware classes in isolation.
+// The peripheral registers are plain memory (no trapping, no timing).
+// The functions below play the role of the DMA controller.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief Maps the peripheral register range as plain memory.
+ *
+ * Must be called before any register is accessed. Further calls have no effect.
+ */
+void mock_hw_init();
+
+/**
+ * @brief Resets all registers to 0 and the global UART instance to
+ * its initial state, and then initializes and enables the UART.
+ *
+ * Maps the registers if `mock_hw_init()` hasn't been called yet.
+ */
+void mock_hw_reset_uart();
+
+/**
+ * @brief Simulates the reception of data via the RX DMA channel.
+ *
+ * The data is written to the circular buffer configured in the DMA channel
+ * and the channel's data counter is updated (without any checks for overrun).
+ *
+ * @param data pointer to received data
+ * @param len length of the data, in bytes
+ */
+void mock_hw_rx(const uint8_t* data, size_t len);
+
+/**
+ * @brief Simulates the reception of data with a parity or framing error.
+ *
+ * The data is received as with `mock_hw_rx()`. Additionally, the specified
+ * error flags are set in the USART status register. As the registers are
+ * plain memory, the flags remain set until the next call of `mock_hw_rx()`.
+ *
+ * @param data pointer to received data
+ * @param len length of the data, in bytes
+ * @param flags USART status register flags (`USART_SR_PE`, `USART_SR_FE`)
+ */
+void mock_hw_rx_error(const uint8_t* data, size_t len, uint32_t flags);
+
+/**
+ * @brief Completes the active TX DMA transfer (if any) and polls the UART.
+ *
+ * The transferred data is appended to `transmitted`.
+ *
+ * @param transmitted vector receiving the transmitted data
+ * @return number of bytes transferred
+ */
+size_t mock_hw_tx_complete(std::vector<uint8_t>& transmitted);
+
+/**
+ * @brief Completes TX DMA transfers until the UART TX buffer is empty.
+ *
+ * The transferred data is appended to `transmitted`.
+ *
+ * @param transmitted vector receiving the transmitted data
+ * @return number of bytes transferred
+ */
+size_t mock_hw_tx_drain(std::vector<uint8_t>& transmitted);
+
+/**
+ * @brief Returns the number of bytes of the active TX DMA transfer.
+ *
+ * @return number of bytes, 0 if no transfer is active
+ */
+size_t mock_hw_tx_active_len();
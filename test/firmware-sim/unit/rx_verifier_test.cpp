@@ -0,0 +1,186 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Tests of the verifier for data received via UART. The stream is generated
+// by the pseudo random number generator of the loopback test so both
+// implementations are checked to produce the same stream.
+//
+// Comand line syntax: rx-verifier-test [ TEST_NAME... ]
+//
+
+#include "check.hpp"
+#include "prng.hpp"
+#include "rx_verifier.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Initial value of the pseudo random number generator (as in the loopback test)
+static constexpr uint32_t PRNG_INIT = 0x7b;
+
+static rx_verifier verifier;
+
+// Pseudo random stream of the loopback test
+static std::vector<uint8_t> stream(uint64_t start, size_t len, uint8_t mask = 0xff)
+{
+    prng prandom(PRNG_INIT);
+    prandom.seek(start);
+    std::vector<uint8_t> data(len);
+    prandom.fill(data.data(), len, mask);
+    return data;
+}
+
+// Verifies the data in chunks of the specified size
+static void verify_chunked(const std::vector<uint8_t>& data, size_t chunk_size, uint8_t mask = 0xff)
+{
+    for (size_t i = 0; i < data.size(); i += chunk_size)
+        verifier.verify(data.data() + i, std::min(chunk_size, data.size() - i), mask);
+}
+
+static uint32_t total_bit_errors()
+{
+    uint32_t n = 0;
+    for (int bit = 0; bit < 8; bit++)
+        n += verifier.num_bit_errors(bit);
+    return n;
+}
+
+
+static void test_matching_stream()
+{
+    for (size_t chunk_size : { 1, 3, 4, 64, 1000 }) {
+        verifier.reset(PRNG_INIT);
+        verify_chunked(stream(0, 10000), chunk_size);
+        CHECK_EQ(verifier.num_bytes(), 10000u);
+        CHECK_EQ(verifier.num_errors(), 0u);
+        CHECK_EQ(verifier.first_error_pos(), 0xffffffffu);
+        CHECK_EQ(verifier.num_sync_losses(), 0u);
+    }
+}
+
+static void test_wrong_seed()
+{
+    verifier.reset(PRNG_INIT + 1);
+    verify_chunked(stream(0, 1000), 64);
+    CHECK(verifier.num_errors() > 0);
+    CHECK_EQ(verifier.first_error_pos(), 0u);
+}
+
+static void test_corrupted_bits()
+{
+    auto data = stream(0, 5000);
+    for (int i = 0; i < 16; i++)
+        data[100 + 300 * i] ^= 1 << (i % 8);
+    data[4050] ^= 0x81; // two bits in one byte
+
+    verifier.reset(PRNG_INIT);
+    verify_chunked(data, 64);
+    CHECK_EQ(verifier.num_bytes(), 5000u);
+    CHECK_EQ(verifier.num_errors(), 17u);
+    CHECK_EQ(verifier.first_error_pos(), 100u);
+    CHECK_EQ(verifier.num_sync_losses(), 0u);
+    CHECK_EQ(verifier.num_bit_errors(0), 3u);
+    CHECK_EQ(verifier.num_bit_errors(7), 3u);
+    for (int bit = 1; bit < 7; bit++)
+        CHECK_EQ(verifier.num_bit_errors(bit), 2u);
+}
+
+static void test_lost_bytes()
+{
+    for (size_t lost : { 9, 100, 1023, 3000 }) {
+        // bytes 1000 .. 1000 + lost are missing
+        auto data = stream(0, 1000);
+        auto rest = stream(1000 + lost, 2000);
+        data.insert(data.end(), rest.begin(), rest.end());
+
+        verifier.reset(PRNG_INIT);
+        verify_chunked(data, 64);
+        CHECK_EQ(verifier.num_sync_losses(), 1u);
+        CHECK_EQ(verifier.first_error_pos(), 1000u);
+        // mismatches until the loss is detected (random matches can extend it), followed by a successful resync
+        CHECK(verifier.num_errors() >= 8 && verifier.num_errors() < 32);
+        CHECK(verifier.num_bytes() >= 3000 - 64);
+
+        // continues after resync
+        uint32_t errors = verifier.num_errors();
+        verifier.verify(stream(3000 + lost, 100).data(), 100, 0xff);
+        CHECK_EQ(verifier.num_errors(), errors);
+    }
+}
+
+static void test_data_lost()
+{
+    verifier.reset(PRNG_INIT);
+    verifier.verify(stream(0, 500).data(), 500, 0xff);
+    verifier.on_data_lost();
+    verifier.on_data_lost(); // not synchronized yet
+    CHECK_EQ(verifier.num_sync_losses(), 1u);
+
+    // less than 4 bytes: not checked
+    verifier.verify(stream(1200, 3).data(), 3, 0xff);
+    CHECK_EQ(verifier.num_bytes(), 500u);
+
+    verifier.verify(stream(1203, 200).data(), 200, 0xff);
+    CHECK_EQ(verifier.num_bytes(), 700u);
+    CHECK_EQ(verifier.num_errors(), 0u);
+}
+
+static void test_restarted_stream()
+{
+    verifier.reset(PRNG_INIT);
+    verify_chunked(stream(0, 10000), 64);
+    verify_chunked(stream(0, 1000), 64);
+    CHECK_EQ(verifier.num_sync_losses(), 1u);
+
+    uint32_t errors = verifier.num_errors();
+    verify_chunked(stream(1000, 1000), 64);
+    CHECK_EQ(verifier.num_errors(), errors);
+    CHECK_EQ(verifier.num_sync_losses(), 1u);
+}
+
+static void test_no_resync()
+{
+    // data not part of the stream
+    std::vector<uint8_t> data(1000, 0x55);
+    verifier.reset(PRNG_INIT);
+    verify_chunked(data, 100);
+    CHECK_EQ(verifier.num_sync_losses(), 1u);
+    CHECK(verifier.num_bytes() < 100);
+    CHECK(total_bit_errors() >= verifier.num_errors());
+}
+
+static void test_7_databits()
+{
+    auto data = stream(0, 2000, 0x7f);
+    data[777] ^= 0x40;
+
+    verifier.reset(PRNG_INIT);
+    verify_chunked(data, 64, 0x7f);
+    CHECK_EQ(verifier.num_errors(), 1u);
+    CHECK_EQ(verifier.num_bit_errors(6), 1u);
+
+    // resync with 7 data bits
+    verifier.on_data_lost();
+    auto rest = stream(2500, 500, 0x7f);
+    verifier.verify(rest.data(), rest.size(), 0x7f);
+    CHECK_EQ(verifier.num_errors(), 1u);
+    CHECK_EQ(verifier.num_bytes(), 2500u);
+}
+
+
+const std::vector<test_case> test_cases = {
+    { "matching_stream", test_matching_stream },
+    { "wrong_seed", test_wrong_seed },
+    { "corrupted_bits", test_corrupted_bits },
+    { "lost_bytes", test_lost_bytes },
+    { "data_lost", test_data_lost },
+    { "restarted_stream", test_restarted_stream },
+    { "no_resync", test_no_resync },
+    { "7_databits", test_7_databits },
+};
@@ -0,0 +1,209 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware microbenchmarks
+//
+// Measures the host execution time of the hot UART functions
+// (in the style of Google Benchmark). The absolute numbers are not
+// representative for the Cortex-M target, but relative changes are.
+//
+// Comand line syntax: uart-bench [ BENCHMARK_NAME... ]
+//
+
+#include "mock_hw.hpp"
+#include "uart.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Benchmark state
+ *
+ * The benchmark function runs the measured code in a loop
+ * `for ([[maybe_unused]] auto _ : state)`. The number of iterations is increased
+ * until the measured time is long enough.
+ */
+class bench_state
+{
+public:
+    explicit bench_state(uint64_t iterations) : iterations(iterations) {}
+
+    struct iterator {
+        uint64_t remaining;
+        bool operator!=(const iterator& other) const { return remaining != other.remaining; }
+        void operator++() { remaining -= 1; }
+        int operator*() const { return 0; }
+    };
+
+    iterator begin() { start_time = std::chrono::steady_clock::now(); return iterator{ iterations }; }
+    iterator end() { return iterator{ 0 }; }
+
+    /// Sets the number of bytes processed per iteration (for throughput reporting)
+    void set_bytes_per_iteration(size_t bytes) { bytes_per_iteration = bytes; }
+
+    uint64_t iterations;
+    size_t bytes_per_iteration = 0;
+    std::chrono::steady_clock::time_point start_time;
+};
+
+/// Prevents the compiler from optimizing away a result
+template <class T> static inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+static void bm_tx_data_avail(bench_state& state)
+{
+    mock_hw_reset_uart();
+    uint8_t data[100] = { 0 };
+    uart.transmit(data, sizeof(data));
+
+    for ([[maybe_unused]] auto _ : state)
+        do_not_optimize(uart.tx_data_avail());
+}
+
+static void bm_rx_data_len(bench_state& state)
+{
+    mock_hw_reset_uart();
+    uint8_t data[100] = { 0 };
+    mock_hw_rx(data, sizeof(data));
+
+    for ([[maybe_unused]] auto _ : state)
+        do_not_optimize(uart.rx_data_len());
+}
+
+static void bm_transmit_64(bench_state& state)
+{
+    mock_hw_reset_uart();
+    uart.set_coding(921600, 8, uart_stopbits::_1_0, uart_parity::none);
+    uint8_t data[64] = { 0 };
+    std::vector<uint8_t> transmitted;
+    transmitted.reserve(UART_TX_BUF_LEN);
+    state.set_bytes_per_iteration(sizeof(data));
+
+    // Keeps the TX buffer at a fill level of 64 to 320 bytes
+    for ([[maybe_unused]] auto _ : state) {
+        uart.transmit(data, sizeof(data));
+        if (uart.tx_data_avail() < UART_TX_BUF_LEN - 320) {
+            transmitted.clear();
+            mock_hw_tx_complete(transmitted);
+        }
+    }
+}
+
+static void bm_copy_rx_data_64(bench_state& state)
+{
+    mock_hw_reset_uart();
+    uint8_t data[64] = { 0 };
+    uint8_t buf[64];
+    state.set_bytes_per_iteration(sizeof(data));
+
+    for ([[maybe_unused]] auto _ : state) {
+        mock_hw_rx(data, sizeof(data));
+        do_not_optimize(uart.copy_rx_data(buf, sizeof(buf)));
+    }
+}
+
+static void bm_poll_idle(bench_state& state)
+{
+    mock_hw_reset_uart();
+
+    for ([[maybe_unused]] auto _ : state)
+        uart.poll();
+}
+
+static void bm_poll_rx(bench_state& state)
+{
+    // includes check_rx_overrun() with partially read data
+    mock_hw_reset_uart();
+    uint8_t data[64] = { 0 };
+    uint8_t buf[32];
+
+    for ([[maybe_unused]] auto _ : state) {
+        mock_hw_rx(data, sizeof(data));
+        uart.poll();
+        uart.copy_rx_data(buf, sizeof(buf));
+        uart.copy_rx_data(buf, sizeof(buf));
+    }
+}
+
+
+struct benchmark {
+    const char* name;
+    std::function<void(bench_state&)> func;
+};
+
+static const benchmark benchmarks[] = {
+    { "tx_data_avail", bm_tx_data_avail },
+    { "rx_data_len", bm_rx_data_len },
+    { "transmit_64", bm_transmit_64 },
+    { "copy_rx_data_64", bm_copy_rx_data_64 },
+    { "poll_idle", bm_poll_idle },
+    { "poll_rx", bm_poll_rx },
+};
+
+static constexpr double MIN_TIME_S = 0.2;
+
+static void run_benchmark(const benchmark& bm)
+{
+    uint64_t iterations = 1;
+    while (true) {
+        bench_state state(iterations);
+        bm.func(state);
+        auto end_time = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(end_time - state.start_time).count();
+
+        if (elapsed >= MIN_TIME_S || iterations >= 1000000000) {
+            char line[120];
+            int n = snprintf(line, sizeof(line), "%-20s %10.2f ns %14llu", bm.name,
+                elapsed * 1e9 / iterations, (unsigned long long)iterations);
+            if (state.bytes_per_iteration != 0)
+                snprintf(line + n, sizeof(line) - n, "   %8.1f MB/s",
+                    state.bytes_per_iteration * iterations / elapsed / 1e6);
+            std::cout << line << std::endl;
+            return;
+        }
+
+        // Estimate the required number of iterations
+        double factor = elapsed > 0 ? MIN_TIME_S * 1.4 / elapsed : 10;
+        if (factor > 10)
+            factor = 10;
+        if (factor < 2)
+            factor = 2;
+        iterations = (uint64_t)(iterations * factor);
+    }
+}
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    std::set<std::string> selected(argv + 1, argv + argc);
+
+    try {
+        mock_hw_init();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Benchmark                  Time     Iterations" << std::endl;
+    std::cout << "----------------------------------------------" << std::endl;
+    for (auto& bm : benchmarks) {
+        if (selected.empty() || selected.count(bm.name) != 0)
+            run_benchmark(bm);
+    }
+
+    return 0;
+}
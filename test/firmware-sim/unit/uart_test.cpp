@@ -0,0 +1,417 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware unit tests
+//
+// Tests of the ring buffer arithmetic of the UART implementation
+// (transmit, copy_rx_data, rx_data_len, tx_data_avail, check_rx_overrun)
+// and of the marking of bytes received with errors. All start positions of the buffers are tested with the lengths
+// around the wrap-around, empty and full cases.
+//
+// Comand line syntax: uart-test [ TEST_NAME... ]
+//
+
+#include "check.hpp"
+#include "mock_hw.hpp"
+#include "uart.h"
+#include <libopencm3/stm32/usart.h>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+// Size of USB packets delivering data to transmit
+static constexpr int USB_PACKET_SIZE = 64;
+
+// Test data: sequence of bytes that doesn't repeat at buffer length
+static uint8_t pattern_byte(uint32_t index)
+{
+    return (uint8_t)((index * 7 + (index >> 8)) ^ 0x5a);
+}
+
+static std::vector<uint8_t> pattern(uint32_t start, size_t len)
+{
+    std::vector<uint8_t> data(len);
+    for (size_t i = 0; i < len; i++)
+        data[i] = pattern_byte(start + i);
+    return data;
+}
+
+// Relevant lengths for buffer of length `buf_len` starting at `start`
+static std::set<int> edge_lengths(int start, int buf_len)
+{
+    std::set<int> lengths;
+    for (int len : { 0, 1, 2, buf_len - start - 1, buf_len - start, buf_len - start + 1,
+            buf_len - 2, buf_len - 1, buf_len, buf_len + 1 })
+        if (len >= 0)
+            lengths.insert(len);
+    return lengths;
+}
+
+// Moves TX buffer head and tail to `pos`
+static void advance_tx(int pos)
+{
+    auto data = pattern(0, pos);
+    uart.transmit(data.data(), data.size());
+    std::vector<uint8_t> transmitted;
+    mock_hw_tx_drain(transmitted);
+}
+
+// Moves RX buffer head and tail to `pos`
+static void advance_rx(int pos)
+{
+    auto data = pattern(0, pos);
+    mock_hw_rx(data.data(), data.size());
+    std::vector<uint8_t> received(pos + 1);
+    uart.copy_rx_data(received.data(), received.size());
+}
+
+// Escapes data like `copy_rx_data_marked()` (marked bytes at the specified indexes)
+static std::vector<uint8_t> marked(const std::vector<uint8_t>& data, const std::set<size_t>& bad_indexes)
+{
+    std::vector<uint8_t> result;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (bad_indexes.count(i) != 0) {
+            result.push_back(0xff);
+            result.push_back(0x00);
+        } else if (data[i] == 0xff) {
+            result.push_back(0xff);
+        }
+        result.push_back(data[i]);
+    }
+    return result;
+}
+
+// Simple deterministic random number generator
+static uint32_t rand_state = 1;
+static uint32_t random_int(uint32_t limit)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return (rand_state >> 8) % limit;
+}
+
+
+static void test_initial_state()
+{
+    mock_hw_reset_uart();
+
+    CHECK_EQ(uart.tx_data_avail(), (size_t)UART_TX_BUF_LEN - 1);
+    CHECK_EQ(uart.rx_data_len(), 0u);
+    CHECK_EQ(mock_hw_tx_active_len(), 0u);
+
+    uint8_t buf[16];
+    CHECK_EQ(uart.copy_rx_data(buf, sizeof(buf)), 0u);
+    uart.poll();
+    CHECK(!uart.has_rx_overrun_occurred());
+}
+
+static void test_transmit_edges()
+{
+    for (int start = 0; start < UART_TX_BUF_LEN; start++) {
+        for (int len : edge_lengths(start, UART_TX_BUF_LEN)) {
+            test_context = "start " + std::to_string(start) + ", len " + std::to_string(len);
+            mock_hw_reset_uart();
+            advance_tx(start);
+            CHECK_EQ(uart.tx_data_avail(), (size_t)UART_TX_BUF_LEN - 1);
+
+            // data exceeding the buffer capacity is discarded
+            int accepted = std::min(len, UART_TX_BUF_LEN - 1);
+            auto data = pattern(start, len);
+            uart.transmit(data.data(), data.size());
+            CHECK_EQ(uart.tx_data_avail(), (size_t)(UART_TX_BUF_LEN - 1 - accepted));
+            CHECK_EQ(mock_hw_tx_active_len() > 0, accepted > 0);
+
+            std::vector<uint8_t> transmitted;
+            CHECK_EQ(mock_hw_tx_drain(transmitted), (size_t)accepted);
+            CHECK(std::equal(transmitted.begin(), transmitted.end(), data.begin()));
+            CHECK_EQ(uart.tx_data_avail(), (size_t)UART_TX_BUF_LEN - 1);
+        }
+    }
+    test_context.clear();
+}
+
+static void test_transmit_chunks()
+{
+    // With a full buffer, chunks are completed one by one and
+    // the freed space is filled again.
+    for (int start = 0; start < UART_TX_BUF_LEN; start++) {
+        test_context = "start " + std::to_string(start);
+        mock_hw_reset_uart();
+        advance_tx(start);
+
+        auto data = pattern(start, UART_TX_BUF_LEN - 1);
+        uart.transmit(data.data(), data.size());
+        CHECK_EQ(uart.tx_data_avail(), 0u);
+
+        std::vector<uint8_t> transmitted;
+        size_t n = mock_hw_tx_complete(transmitted);
+        CHECK(n > 0);
+        CHECK_EQ(uart.tx_data_avail(), n);
+
+        auto more = pattern(start + UART_TX_BUF_LEN - 1, n + 1);
+        uart.transmit(more.data(), more.size());
+        CHECK_EQ(uart.tx_data_avail(), 0u);
+
+        data.insert(data.end(), more.begin(), more.end() - 1);
+        mock_hw_tx_drain(transmitted);
+        CHECK(transmitted == data);
+    }
+    test_context.clear();
+}
+
+static void test_transmit_random()
+{
+    mock_hw_reset_uart();
+    std::deque<uint8_t> expected;
+    std::vector<uint8_t> transmitted;
+    uint32_t index = 0;
+
+    for (int i = 0; i < 200000; i++) {
+        test_context = "operation " + std::to_string(i);
+        if (random_int(3) != 0) {
+            auto data = pattern(index, random_int(2 * USB_PACKET_SIZE) + 1);
+            size_t accepted = std::min(data.size(), UART_TX_BUF_LEN - 1 - expected.size());
+            uart.transmit(data.data(), data.size());
+            expected.insert(expected.end(), data.begin(), data.begin() + accepted);
+            index += data.size();
+        } else {
+            transmitted.clear();
+            mock_hw_tx_complete(transmitted);
+            for (uint8_t b : transmitted) {
+                CHECK_EQ(b, expected.front());
+                expected.pop_front();
+            }
+        }
+        CHECK_EQ(uart.tx_data_avail(), UART_TX_BUF_LEN - 1 - expected.size());
+    }
+    test_context.clear();
+}
+
+static void test_receive_edges()
+{
+    for (int start = 0; start < UART_RX_BUF_LEN; start++) {
+        for (int len : edge_lengths(start, UART_RX_BUF_LEN)) {
+            if (len >= UART_RX_BUF_LEN)
+                continue; // indistinguishable from overrun
+            for (int read_size : { 1, 7, USB_PACKET_SIZE, UART_RX_BUF_LEN }) {
+                test_context = "start " + std::to_string(start) + ", len " + std::to_string(len)
+                    + ", read size " + std::to_string(read_size);
+                mock_hw_reset_uart();
+                advance_rx(start);
+                CHECK_EQ(uart.rx_data_len(), 0u);
+
+                auto data = pattern(start, len);
+                mock_hw_rx(data.data(), data.size());
+                CHECK_EQ(uart.rx_data_len(), (size_t)len);
+
+                std::vector<uint8_t> received;
+                std::vector<uint8_t> buf(read_size);
+                while (true) {
+                    size_t n = uart.copy_rx_data(buf.data(), buf.size());
+                    if (n == 0)
+                        break;
+                    CHECK(n <= (size_t)read_size);
+                    received.insert(received.end(), buf.begin(), buf.begin() + n);
+                    CHECK_EQ(uart.rx_data_len(), len - received.size());
+                    uart.poll();
+                    CHECK(!uart.has_rx_overrun_occurred());
+                }
+                CHECK(received == data);
+            }
+        }
+    }
+    test_context.clear();
+}
+
+static void test_receive_random()
+{
+    mock_hw_reset_uart();
+    std::deque<uint8_t> expected;
+    uint32_t index = 0;
+    uint8_t buf[2 * USB_PACKET_SIZE];
+
+    for (int i = 0; i < 200000; i++) {
+        test_context = "operation " + std::to_string(i);
+        if (random_int(2) == 0) {
+            size_t len = std::min((size_t)random_int(100) + 1, UART_RX_BUF_LEN - 1 - expected.size());
+            auto data = pattern(index, len);
+            mock_hw_rx(data.data(), data.size());
+            expected.insert(expected.end(), data.begin(), data.end());
+            index += len;
+        } else {
+            size_t n = uart.copy_rx_data(buf, random_int(sizeof(buf)) + 1);
+            for (size_t j = 0; j < n; j++) {
+                CHECK_EQ(buf[j], expected.front());
+                expected.pop_front();
+            }
+        }
+        CHECK_EQ(uart.rx_data_len(), expected.size());
+        uart.poll();
+        CHECK(!uart.has_rx_overrun_occurred());
+    }
+    test_context.clear();
+}
+
+static void test_rx_overrun()
+{
+    for (int start = 0; start < UART_RX_BUF_LEN; start++) {
+        test_context = "start " + std::to_string(start);
+        mock_hw_reset_uart();
+        advance_rx(start);
+
+        // partially read the data
+        auto data = pattern(start, 100);
+        mock_hw_rx(data.data(), data.size());
+        uint8_t buf[10];
+        CHECK_EQ(uart.copy_rx_data(buf, sizeof(buf)), sizeof(buf));
+        uart.poll();
+        CHECK(!uart.has_rx_overrun_occurred());
+
+        // overwrite the unread data
+        auto more = pattern(start + 100, UART_RX_BUF_LEN - 50);
+        mock_hw_rx(more.data(), more.size());
+        uart.poll();
+        CHECK(uart.has_rx_overrun_occurred());
+        CHECK(!uart.has_rx_overrun_occurred());
+
+        // data has been discarded; reception continues
+        CHECK_EQ(uart.rx_data_len(), 0u);
+        auto next = pattern(0, 5);
+        mock_hw_rx(next.data(), next.size());
+        CHECK_EQ(uart.copy_rx_data(buf, sizeof(buf)), next.size());
+        CHECK(std::equal(next.begin(), next.end(), buf));
+        uart.poll();
+        CHECK(!uart.has_rx_overrun_occurred());
+    }
+    test_context.clear();
+}
+
+static void test_7_databits()
+{
+    mock_hw_reset_uart();
+    uart.set_coding(9600, 7, uart_stopbits::_1_0, uart_parity::even);
+
+    std::vector<uint8_t> data(UART_TX_BUF_LEN - 1, 0xff);
+    uart.transmit(data.data(), data.size());
+    std::vector<uint8_t> transmitted;
+    mock_hw_tx_drain(transmitted);
+    CHECK_EQ(transmitted.size(), data.size());
+    for (uint8_t b : transmitted)
+        CHECK_EQ(b, 0x7f);
+
+    advance_rx(UART_RX_BUF_LEN - 10);
+    mock_hw_rx(data.data(), 20);
+    uint8_t buf[20];
+    CHECK_EQ(uart.copy_rx_data(buf, sizeof(buf)), sizeof(buf));
+    for (uint8_t b : buf)
+        CHECK_EQ(b, 0x7f);
+}
+
+static void test_rx_error_marking()
+{
+    for (int start = 0; start < UART_RX_BUF_LEN; start++) {
+        for (int read_size : { 3, 4, 7, USB_PACKET_SIZE }) {
+            test_context = "start " + std::to_string(start) + ", read size " + std::to_string(read_size);
+            mock_hw_reset_uart();
+            advance_rx(start);
+
+            // byte 5 is received with a parity error, byte 6 is 0xff
+            // (byte 6 will be marked as well as it could have arrived before the error flags were read)
+            auto data = pattern(start, 12);
+            data[6] = 0xff;
+            mock_hw_rx(data.data(), 5);
+            uart.poll();
+            mock_hw_rx_error(data.data() + 5, 1, USART_SR_PE);
+            uart.poll();
+            uart.poll();
+            mock_hw_rx(data.data() + 6, data.size() - 6);
+            uart.poll();
+            CHECK(uart.has_parity_error_occurred());
+            CHECK(!uart.has_parity_error_occurred());
+            CHECK(!uart.has_framing_error_occurred());
+
+            // escape sequences are not split
+            std::vector<uint8_t> received;
+            std::vector<uint8_t> buf(read_size);
+            while (true) {
+                size_t n = uart.copy_rx_data_marked(buf.data(), buf.size());
+                if (n == 0)
+                    break;
+                received.insert(received.end(), buf.begin(), buf.begin() + n);
+            }
+            CHECK_EQ(uart.rx_data_len(), 0u);
+            CHECK(received == marked(data, { 5, 6 }));
+        }
+    }
+    test_context.clear();
+}
+
+static void test_rx_error_consumed()
+{
+    mock_hw_reset_uart();
+
+    auto data = pattern(0, 20);
+    mock_hw_rx_error(data.data(), data.size(), USART_SR_FE);
+    uart.poll();
+    CHECK(uart.has_framing_error_occurred());
+    CHECK(!uart.has_parity_error_occurred());
+
+    // marks are discarded with the data read without marking
+    std::vector<uint8_t> buf(UART_RX_BUF_LEN);
+    CHECK_EQ(uart.copy_rx_data(buf.data(), buf.size()), data.size());
+    mock_hw_rx(nullptr, 0); // clears the error flags
+
+    // same buffer positions after wrap around are not marked
+    auto more = pattern(20, UART_RX_BUF_LEN - 1);
+    mock_hw_rx(more.data(), more.size());
+    uart.poll();
+    size_t n = uart.copy_rx_data_marked(buf.data(), buf.size());
+    buf.resize(n);
+    auto expected = marked(more, { 0 }); // next byte after error check
+    expected.resize(std::min(expected.size(), (size_t)UART_RX_BUF_LEN));
+    CHECK(buf == expected);
+}
+
+static void test_loopback_discards_errors()
+{
+    mock_hw_reset_uart();
+    uart.set_loopback(true);
+
+    // errors and overrun while in loopback mode
+    auto data = pattern(0, 100);
+    mock_hw_rx_error(data.data(), data.size(), USART_SR_PE | USART_SR_FE);
+    uint8_t buf[10];
+    CHECK_EQ(uart.copy_rx_data(buf, sizeof(buf)), sizeof(buf));
+    uart.poll();
+    auto more = pattern(100, UART_RX_BUF_LEN - 50);
+    mock_hw_rx(more.data(), more.size());
+    uart.poll();
+
+    // not reported after loopback mode has ended
+    uart.set_loopback(false);
+    uart.poll();
+    CHECK(!uart.has_rx_overrun_occurred());
+    CHECK(!uart.has_parity_error_occurred());
+    CHECK(!uart.has_framing_error_occurred());
+    CHECK_EQ(uart.rx_data_len(), 0u);
+}
+
+
+const std::vector<test_case> test_cases = {
+    { "initial_state", test_initial_state },
+    { "transmit_edges", test_transmit_edges },
+    { "transmit_chunks", test_transmit_chunks },
+    { "transmit_random", test_transmit_random },
+    { "receive_edges", test_receive_edges },
+    { "receive_random", test_receive_random },
+    { "rx_overrun", test_rx_overrun },
+    { "7_databits", test_7_databits },
+    { "rx_error_marking", test_rx_error_marking },
+    { "rx_error_consumed", test_rx_error_consumed },
+    { "loopback_discards_errors", test_loopback_discards_errors },
+};
@@ -0,0 +1,804 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Firmware simulator
+//
+// USB throughput benchmark: switches the simulated firmware into the USB
+// throughput test mode (vendor request) and measures how fast the test pattern
+// is transferred in both directions without the UART being involved. This is
+// the ceiling of the CDC bulk endpoints. At the end, the device statistics are
+// read and checked against the data seen by the host.
+//
+// With `--mode uart-loopback`, the firmware is switched into the UART loopback
+// test mode instead (USART in half-duplex mode, receiver connected to the TX
+// line). The achieved baud rate and the gap statistics reported by the device
+// are printed and checked.
+//
+// With `--mode uart-verify`, the simulated line sends the pseudo random stream
+// of the loopback test to the adapter, optionally with injected bit errors
+// (`--corrupt`). The device verifies the received data before forwarding it,
+// and the host verifies it again. The device must report exactly the injected
+// errors.
+//
+// With `--mode uart-errors`, the adapter is used in regular operation with even
+// parity and marking of bytes received with errors enabled (vendor request).
+// The simulated line sends the pseudo random stream with a parity or framing
+// error in every n-th byte (`--rx-errors`). The host decodes the marked
+// stream and checks that the data is complete, that all bad bytes are marked
+// and that the errors are reported in SERIAL_STATE notifications.
+//
+// With `--mode uart-frames`, the adapter is used in regular operation with
+// framing enabled (vendor request). The simulated line sends COBS or SLIP
+// frames of random length with a CRC, optionally with a bit error in every
+// n-th frame (`--corrupt`). The host checks that each USB transfer contains
+// exactly one frame and, with `--check-crc`, that the corrupted frames have
+// been dropped by the device.
+//
+// Comand line syntax: firmware-usb-bench [ OPTIONS... ]
+//
+
+#include "cxxopts.hpp"
+#include "frame_checker.h"
+#include "prng.hpp"
+#include "sim/sim.hpp"
+#include "usb_serial.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <iostream>
+#include <set>
+#include <vector>
+
+// Time limit for USB enumeration
+static constexpr uint64_t ENUM_TIMEOUT_NS = 2000000000;
+// Time after the end of the measurement until the statistics are requested
+static constexpr uint64_t DRAIN_NS = 5000000;
+// Minimum achieved baud rate in UART loopback mode (relative to the configured baud rate)
+static constexpr double MIN_UART_UTILIZATION = 0.9;
+
+// Initial value of the pseudo random number generator (as in the loopback test)
+static constexpr uint32_t PRNG_INIT = 0x7b;
+// Maximum number of marked bytes per bad byte (errors are detected per poll,
+// the bytes received since the previous poll and the next byte are marked)
+static constexpr uint64_t MAX_MARKED_PER_ERROR = 4;
+
+// Maximum payload length of frames (uart-frames mode)
+static constexpr int MAX_FRAME_PAYLOAD = 200;
+// Maximum length of encoded frames (all bytes escaped, two delimiters)
+static constexpr int MAX_FRAME_BYTES = 2 * (MAX_FRAME_PAYLOAD + 2) + 2;
+// Maximum USB packet size
+static constexpr size_t PACKET_SIZE = 64;
+
+// CDC SERIAL_STATE notification
+static constexpr uint8_t CDC_NOTIFY_SERIAL_STATE = 0x20;
+static constexpr size_t CDC_SERIAL_STATE_LEN = 10;
+
+/**
+ * @brief Line peer sending the pseudo random stream to the adapter.
+ *
+ * Optionally, a single bit of every n-th byte is flipped (rotating bit position),
+ * and every m-th byte is received with a parity or framing error (alternating).
+ */
+class prng_line_peer : public sim_line_peer {
+public:
+    prng_line_peer(uint32_t corrupt_interval, uint32_t rx_error_interval)
+        : prandom(PRNG_INIT), corrupt_interval(corrupt_interval), rx_error_interval(rx_error_interval) { }
+
+    void on_char_transmitted(uint16_t, uint64_t) override { }
+    bool is_ready_to_receive(uint64_t) override { return true; }
+    void on_rts_changed(bool asserted, uint64_t) override { rts = asserted; }
+    bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) override;
+
+    /// Sets the time range for sending data
+    void set_time_range(uint64_t start, uint64_t end) { start_ns = start; end_ns = end; }
+
+    uint64_t num_bytes = 0;
+    uint64_t num_corrupted = 0;
+    uint64_t first_corrupted_pos = UINT64_MAX;
+    /// Stream positions of bytes with parity or framing error
+    std::set<uint64_t> rx_error_pos;
+    uint64_t num_parity_errors = 0;
+    uint64_t num_framing_errors = 0;
+
+private:
+    prng prandom;
+    uint32_t corrupt_interval;
+    uint32_t rx_error_interval;
+    bool rts = false;
+    uint64_t start_ns = UINT64_MAX;
+    uint64_t end_ns = UINT64_MAX;
+};
+
+bool prng_line_peer::fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns)
+{
+    if (!rts || t_ns < start_ns || t_ns >= this->end_ns)
+        return false;
+
+    uint64_t pos = num_bytes;
+    uint8_t value = prandom.byte_at(pos);
+    if (corrupt_interval != 0 && pos % corrupt_interval == corrupt_interval - 1) {
+        value ^= 1 << (num_corrupted % 8);
+        if (num_corrupted == 0)
+            first_corrupted_pos = pos;
+        num_corrupted++;
+    }
+
+    *data = value;
+    if (rx_error_interval != 0 && pos % rx_error_interval == rx_error_interval - 1) {
+        if (rx_error_pos.size() % 2 == 0) {
+            *data |= SIM_CHAR_PARITY_ERROR;
+            num_parity_errors++;
+        } else {
+            *data |= SIM_CHAR_FRAMING_ERROR;
+            num_framing_errors++;
+        }
+        rx_error_pos.insert(pos);
+    }
+
+    *end_ns = 0;
+    num_bytes++;
+    return true;
+}
+
+/**
+ * @brief Generates the frame with the specified index (uart-frames mode).
+ *
+ * The payload has a pseudo random length and content and is followed by
+ * the CRC. SLIP frames start and end with the delimiter, COBS frames only end with it.
+ *
+ * @param encoding frame encoding
+ * @param index frame index
+ * @param is_corrupted `true` to flip a bit after the CRC has been calculated
+ * @return encoded frame
+ */
+static std::vector<uint8_t> test_frame(frame_encoding encoding, uint64_t index, bool is_corrupted)
+{
+    static const prng prandom(PRNG_INIT);
+    uint64_t pos = index * (MAX_FRAME_PAYLOAD + 1);
+    size_t len = 1 + prandom.byte_at(pos) % MAX_FRAME_PAYLOAD;
+    std::vector<uint8_t> data;
+    uint16_t crc = 0xffff;
+    for (size_t i = 0; i < len; i++) {
+        data.push_back(prandom.byte_at(pos + 1 + i));
+        crc = frame_checker::update_crc(crc, data.back());
+    }
+    data.push_back((uint8_t)(crc >> 8));
+    data.push_back((uint8_t)crc);
+    if (is_corrupted)
+        data[len / 2] ^= 0x10;
+
+    uint8_t delimiter = frame_checker::delimiter(encoding);
+    std::vector<uint8_t> frame;
+    if (encoding == frame_encoding::cobs) {
+        size_t code_index = 0;
+        frame.push_back(0);
+        for (uint8_t b : data) {
+            if (b != 0)
+                frame.push_back(b);
+            if (b == 0 || frame.size() - code_index == 0xff) {
+                frame[code_index] = (uint8_t)(frame.size() - code_index);
+                code_index = frame.size();
+                frame.push_back(0);
+            }
+        }
+        frame[code_index] = (uint8_t)(frame.size() - code_index);
+    } else {
+        frame.push_back(delimiter);
+        for (uint8_t b : data) {
+            if (b == 0xc0 || b == 0xdb) {
+                frame.push_back(0xdb);
+                frame.push_back(b == 0xc0 ? 0xdc : 0xdd);
+            } else {
+                frame.push_back(b);
+            }
+        }
+    }
+    frame.push_back(delimiter);
+    return frame;
+}
+
+/**
+ * @brief Line peer sending frames to the adapter (uart-frames mode).
+ *
+ * Every n-th frame is corrupted. Frames are always sent completely.
+ */
+class frame_line_peer : public sim_line_peer {
+public:
+    frame_line_peer(frame_encoding encoding, uint32_t corrupt_interval)
+        : encoding(encoding), corrupt_interval(corrupt_interval) { }
+
+    void on_char_transmitted(uint16_t, uint64_t) override { }
+    bool is_ready_to_receive(uint64_t) override { return true; }
+    void on_rts_changed(bool asserted, uint64_t) override { rts = asserted; }
+    bool fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns) override;
+
+    /// Sets the time range for starting frames
+    void set_time_range(uint64_t start, uint64_t end) { start_ns = start; end_ns = end; }
+
+    /// Indicates if the frame with the specified index is corrupted
+    bool is_corrupted(uint64_t index) const
+    {
+        return corrupt_interval != 0 && index % corrupt_interval == corrupt_interval - 1;
+    }
+
+    const frame_encoding encoding;
+    uint64_t num_frames = 0;
+    uint64_t num_corrupted = 0;
+
+private:
+    uint32_t corrupt_interval;
+    std::deque<uint8_t> pending;
+    bool rts = false;
+    uint64_t start_ns = UINT64_MAX;
+    uint64_t end_ns = UINT64_MAX;
+};
+
+bool frame_line_peer::fetch_char(uint64_t t_ns, uint16_t* data, uint64_t* end_ns)
+{
+    if (!rts)
+        return false;
+
+    if (pending.empty()) {
+        if (t_ns < start_ns || t_ns >= this->end_ns)
+            return false;
+        bool corrupted = is_corrupted(num_frames);
+        auto frame = test_frame(encoding, num_frames, corrupted);
+        pending.assign(frame.begin(), frame.end());
+        num_frames++;
+        if (corrupted)
+            num_corrupted++;
+    }
+
+    *data = pending.front();
+    pending.pop_front();
+    *end_ns = 0;
+    return true;
+}
+
+/**
+ * @brief USB host application running the throughput test.
+ */
+class usb_bench : public sim_usb_app {
+public:
+    usb_bench(usb_serial_test_mode mode, bool is_marking, bool is_in_enabled, bool is_out_enabled,
+            uint64_t duration_ns, uint32_t bitrate, prng_line_peer* verify_peer);
+
+    /// Enables the framing test
+    void set_frame_peer(frame_line_peer* peer, bool check_crc) { frame_peer = peer; is_frame_crc_checked = check_crc; }
+
+    void on_configured(uint64_t t_ns) override;
+    size_t fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns) override;
+    bool can_receive_in_data(uint64_t t_ns) override;
+    void on_in_data(const uint8_t* data, size_t len, uint64_t t_ns) override;
+    void on_notification(const uint8_t* data, size_t len, uint64_t t_ns) override;
+    void on_vendor_request_completed(uint8_t request, const uint8_t* data, size_t len, bool is_stalled,
+            uint64_t t_ns) override;
+    void poll(uint64_t t_ns) override;
+
+private:
+    usb_serial_test_mode mode;
+    bool is_marking;
+    bool is_in_enabled;
+    bool is_out_enabled;
+    uint64_t duration_ns;
+    uint32_t bitrate;
+    prng_line_peer* verify_peer;
+    frame_line_peer* frame_peer = nullptr;
+    bool is_frame_crc_checked = false;
+    // number of next vendor requests that are malformed (must be stalled)
+    int num_malformed_requests = 0;
+
+    uint64_t start_ns = UINT64_MAX;
+    uint64_t end_ns = UINT64_MAX;
+    bool is_stats_requested = false;
+
+    uint8_t out_seq = 0;
+    uint64_t out_bytes = 0;
+    uint8_t in_seq = 0;
+    uint64_t in_bytes = 0;
+    uint64_t in_errors = 0;
+    prng in_prandom{PRNG_INIT};
+
+    // decoding of marked data (number of pending escape bytes) and marked stream positions
+    int escape_state = 0;
+    uint64_t num_marked = 0;
+    uint64_t num_marked_errors = 0;
+    // bits of all received SERIAL_STATE notifications
+    uint16_t serial_state_bits = 0;
+
+    // framing test: current transfer, index of next expected frame, statistics
+    std::vector<uint8_t> transfer;
+    uint64_t next_frame = 0;
+    uint64_t num_transfers = 0;
+    uint64_t num_transfer_errors = 0;
+    uint64_t num_bad_crc = 0;
+
+    bool is_running(uint64_t t_ns) const { return t_ns >= start_ns && t_ns < end_ns; }
+    void report(const usb_serial_stats& stats);
+    bool report_uart_loopback(const usb_serial_stats& stats);
+    bool report_uart_verify(const usb_serial_stats& stats);
+    bool report_uart_errors();
+    void decode_marked(const uint8_t* data, size_t len);
+    bool report_uart_frames(const usb_serial_stats& stats);
+    void check_transfer();
+    [[noreturn]] void finish(int exit_code);
+};
+
+usb_bench::usb_bench(usb_serial_test_mode mode, bool is_marking, bool is_in_enabled, bool is_out_enabled,
+        uint64_t duration_ns, uint32_t bitrate, prng_line_peer* verify_peer)
+    : mode(mode), is_marking(is_marking), is_in_enabled(is_in_enabled), is_out_enabled(is_out_enabled), duration_ns(duration_ns),
+      bitrate(bitrate), verify_peer(verify_peer)
+{
+}
+
+void usb_bench::on_configured(uint64_t)
+{
+    if (is_marking) {
+        sim_usb_set_line_coding(bitrate, 8, 0, 2); // even parity
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_error_marking, 1, 0, 0);
+        // not supported while marking (must be stalled)
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_framing, (uint16_t)usb_serial_framing::cobs, 0, 0);
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_test_mode,
+                (uint16_t)usb_serial_test_mode::uart_verify, PRNG_INIT, 0);
+        return;
+    }
+    if (frame_peer != nullptr) {
+        sim_usb_set_line_coding(bitrate, 8, 0, 0);
+        // malformed (must be stalled): device-to-host request, unknown framing flag
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_framing, (uint16_t)frame_peer->encoding, 0, 1);
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_framing, (uint16_t)frame_peer->encoding, 0x8000, 0);
+        num_malformed_requests = 2;
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_framing, (uint16_t)frame_peer->encoding,
+                is_frame_crc_checked ? USB_SERIAL_FRAMING_CHECK_CRC : 0, 0);
+        // not supported while framing (must be stalled)
+        sim_usb_vendor_request((uint8_t)usb_serial_request::set_error_marking, 1, 0, 0);
+        return;
+    }
+
+    if (mode != usb_serial_test_mode::usb_throughput)
+        sim_usb_set_line_coding(bitrate, 8, 0, 0);
+    uint16_t param = mode == usb_serial_test_mode::uart_verify ? PRNG_INIT : 0;
+    sim_usb_vendor_request((uint8_t)usb_serial_request::set_test_mode, (uint16_t)mode, param, 0);
+}
+
+size_t usb_bench::fetch_out_data(uint8_t* buf, size_t max_len, uint64_t t_ns)
+{
+    if (!is_out_enabled || !is_running(t_ns))
+        return 0;
+
+    for (size_t i = 0; i < max_len; i++)
+        buf[i] = out_seq++;
+    out_bytes += max_len;
+    return max_len;
+}
+
+bool usb_bench::can_receive_in_data(uint64_t t_ns)
+{
+    // forwarded data is received until the end
+    if (mode == usb_serial_test_mode::uart_verify || is_marking || frame_peer != nullptr)
+        return true;
+    return is_in_enabled && is_running(t_ns);
+}
+
+void usb_bench::on_in_data(const uint8_t* data, size_t len, uint64_t)
+{
+    if (is_marking) {
+        decode_marked(data, len);
+        return;
+    }
+    if (frame_peer != nullptr) {
+        // a short packet ends the transfer
+        transfer.insert(transfer.end(), data, data + len);
+        if (len < PACKET_SIZE)
+            check_transfer();
+        return;
+    }
+
+    if (mode == usb_serial_test_mode::uart_verify) {
+        for (size_t i = 0; i < len; i++)
+            if (data[i] != in_prandom.byte_at(in_bytes + i))
+                in_errors++;
+        in_bytes += len;
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != in_seq) {
+            in_errors++;
+            in_seq = data[i];
+        }
+        in_seq++;
+    }
+    in_bytes += len;
+}
+
+void usb_bench::decode_marked(const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = data[i];
+        if (escape_state == 0 && b == 0xff) {
+            escape_state = 1;
+            continue;
+        }
+        if (escape_state == 1 && b == 0x00) {
+            escape_state = 2; // marked byte follows
+            continue;
+        }
+
+        if (escape_state == 2) {
+            num_marked++;
+            if (verify_peer->rx_error_pos.count(in_bytes) != 0)
+                num_marked_errors++;
+        } else if (escape_state == 1 && b != 0xff) {
+            in_errors++; // invalid escape sequence
+        }
+        escape_state = 0;
+
+        if (b != in_prandom.byte_at(in_bytes))
+            in_errors++;
+        in_bytes++;
+    }
+}
+
+void usb_bench::check_transfer()
+{
+    num_transfers++;
+
+    // skip frames dropped by the device
+    while (is_frame_crc_checked && frame_peer->is_corrupted(next_frame))
+        next_frame++;
+
+    bool is_corrupted = frame_peer->is_corrupted(next_frame);
+    if (transfer != test_frame(frame_peer->encoding, next_frame, is_corrupted))
+        num_transfer_errors++;
+    if (is_corrupted)
+        num_bad_crc++;
+
+    next_frame++;
+    transfer.clear();
+}
+
+void usb_bench::on_notification(const uint8_t* data, size_t len, uint64_t)
+{
+    if (len >= CDC_SERIAL_STATE_LEN && data[1] == CDC_NOTIFY_SERIAL_STATE)
+        serial_state_bits |= data[8] | (data[9] << 8);
+}
+
+void usb_bench::on_vendor_request_completed(uint8_t request, const uint8_t* data, size_t len, bool is_stalled,
+        uint64_t t_ns)
+{
+    // malformed requests and requests conflicting with error marking or framing
+    bool must_stall = num_malformed_requests > 0
+        || (is_marking && request != (uint8_t)usb_serial_request::set_error_marking
+            && request != (uint8_t)usb_serial_request::get_stats)
+        || (frame_peer != nullptr && request == (uint8_t)usb_serial_request::set_error_marking);
+    if (must_stall) {
+        if (num_malformed_requests > 0)
+            num_malformed_requests--;
+        if (!is_stalled) {
+            fprintf(stderr, "Vendor request 0x%02x has not been stalled\n", request);
+            finish(3);
+        }
+        return;
+    }
+
+    if (is_stalled) {
+        fprintf(stderr, "Vendor request 0x%02x has been stalled\n", request);
+        finish(3);
+    }
+
+    if (request == (uint8_t)usb_serial_request::set_test_mode
+            || request == (uint8_t)usb_serial_request::set_error_marking
+            || request == (uint8_t)usb_serial_request::set_framing) {
+        start_ns = t_ns;
+        end_ns = t_ns + duration_ns;
+        if (verify_peer != nullptr)
+            verify_peer->set_time_range(start_ns, end_ns);
+        if (frame_peer != nullptr) {
+            // the last frame must be completely received before the statistics are requested
+            uint64_t max_frame_ns = (uint64_t)MAX_FRAME_BYTES * 10 * 1000000000 / bitrate;
+            frame_peer->set_time_range(start_ns, end_ns > start_ns + max_frame_ns ? end_ns - max_frame_ns : start_ns);
+        }
+
+    } else if (request == (uint8_t)usb_serial_request::get_stats) {
+        usb_serial_stats stats;
+        memset(&stats, 0, sizeof(stats));
+        memcpy(&stats, data, std::min(len, sizeof(stats)));
+        report(stats);
+    }
+}
+
+void usb_bench::poll(uint64_t t_ns)
+{
+    if (!sim_usb_is_configured() && t_ns >= ENUM_TIMEOUT_NS) {
+        fprintf(stderr, "USB enumeration has failed\n");
+        finish(3);
+    }
+
+    if (!is_stats_requested && end_ns != UINT64_MAX && t_ns >= end_ns + DRAIN_NS) {
+        is_stats_requested = true;
+        sim_usb_vendor_request((uint8_t)usb_serial_request::get_stats, 0, 0, sizeof(usb_serial_stats));
+    }
+}
+
+void usb_bench::report(const usb_serial_stats& stats)
+{
+    if (stats.length < sizeof(usb_serial_stats) || stats.test_mode != (uint32_t)mode) {
+        printf("Invalid statistics\n");
+        finish(3);
+    }
+
+    if (mode == usb_serial_test_mode::uart_loopback)
+        finish(report_uart_loopback(stats) ? 0 : 3);
+    if (mode == usb_serial_test_mode::uart_verify)
+        finish(report_uart_verify(stats) ? 0 : 3);
+    if (is_marking)
+        finish(report_uart_errors() ? 0 : 3);
+    if (frame_peer != nullptr)
+        finish(report_uart_frames(stats) ? 0 : 3);
+
+    double duration_s = duration_ns / 1e9;
+    printf("USB throughput test mode (%.0f ms simulated time):\n", duration_ns / 1e6);
+    if (is_in_enabled)
+        printf("  IN  (device to host): %8.0f bytes/s\n", in_bytes / duration_s);
+    if (is_out_enabled)
+        printf("  OUT (host to device): %8.0f bytes/s\n", out_bytes / duration_s);
+    printf("Device statistics: %u bytes IN, %u bytes OUT, %u errors, %u ms\n",
+            stats.usb_in_bytes, stats.usb_out_bytes, stats.usb_out_errors, stats.duration_ms);
+
+    bool is_successful = true;
+    if (in_errors != 0 || stats.usb_out_errors != 0) {
+        printf("Test pattern mismatch: %llu errors IN, %u errors OUT\n", (unsigned long long)in_errors,
+                stats.usb_out_errors);
+        is_successful = false;
+    }
+    if (stats.usb_out_bytes != (uint32_t)out_bytes) {
+        printf("Bytes lost OUT: %llu sent, %u received\n", (unsigned long long)out_bytes, stats.usb_out_bytes);
+        is_successful = false;
+    }
+    // bytes submitted by the device can still be in the endpoint buffers
+    if (stats.usb_in_bytes < (uint32_t)in_bytes || stats.usb_in_bytes > (uint32_t)in_bytes + 256) {
+        printf("Bytes lost IN: %u sent, %llu received\n", stats.usb_in_bytes, (unsigned long long)in_bytes);
+        is_successful = false;
+    }
+    if ((is_in_enabled && in_bytes == 0) || (is_out_enabled && out_bytes == 0)) {
+        printf("No data has been transferred\n");
+        is_successful = false;
+    }
+
+    finish(is_successful ? 0 : 3);
+}
+
+bool usb_bench::report_uart_loopback(const usb_serial_stats& stats)
+{
+    printf("UART loopback test mode (%u bps, %u ms):\n", bitrate, stats.duration_ms);
+    printf("  Transmitted: %10u bytes\n", stats.uart_tx_bytes);
+    printf("  Received:    %10u bytes, %u errors\n", stats.uart_rx_bytes, stats.uart_rx_errors);
+    printf("  Achieved:    %10u bps (%.1f%%)\n", stats.uart_effective_baudrate,
+            100.0 * stats.uart_effective_baudrate / bitrate);
+    printf("  Gaps:        %10u (max %u us, total %u us)\n", stats.uart_gap_count, stats.uart_gap_max_us,
+            stats.uart_gap_total_us);
+
+    bool is_successful = true;
+    if (stats.uart_rx_bytes == 0) {
+        printf("No data has been received\n");
+        is_successful = false;
+    }
+    if (stats.uart_rx_errors != 0) {
+        printf("Test pattern mismatch\n");
+        is_successful = false;
+    }
+    if (stats.uart_effective_baudrate < MIN_UART_UTILIZATION * bitrate) {
+        printf("Achieved baud rate is too low\n");
+        is_successful = false;
+    }
+    return is_successful;
+}
+
+bool usb_bench::report_uart_verify(const usb_serial_stats& stats)
+{
+    printf("UART verification test mode (%u bps, %u ms):\n", bitrate, stats.duration_ms);
+    printf("  Line:   %10llu bytes sent, %llu corrupted\n", (unsigned long long)verify_peer->num_bytes,
+            (unsigned long long)verify_peer->num_corrupted);
+    printf("  Device: %10u bytes checked, %u errors, %u sync losses\n", stats.uart_verify_bytes,
+            stats.uart_verify_errors, stats.uart_verify_sync_losses);
+    printf("  Host:   %10llu bytes received, %llu errors\n", (unsigned long long)in_bytes,
+            (unsigned long long)in_errors);
+    printf("  Errors per bit:");
+    uint32_t bit_errors = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        printf(" %u", stats.uart_verify_bit_errors[bit]);
+        bit_errors += stats.uart_verify_bit_errors[bit];
+    }
+    printf("\n");
+
+    bool is_successful = true;
+    if (verify_peer->num_bytes == 0 || stats.uart_verify_bytes != verify_peer->num_bytes
+            || in_bytes != verify_peer->num_bytes) {
+        printf("Bytes lost\n");
+        is_successful = false;
+    }
+    // each injected error is a single bit error
+    if (stats.uart_verify_errors != verify_peer->num_corrupted || bit_errors != verify_peer->num_corrupted
+            || in_errors != verify_peer->num_corrupted || stats.uart_verify_sync_losses != 0) {
+        printf("Device errors do not match injected errors\n");
+        is_successful = false;
+    }
+    if (verify_peer->num_corrupted > 0 && stats.uart_verify_first_error_pos != verify_peer->first_corrupted_pos) {
+        printf("First error at position %u, expected %llu\n", stats.uart_verify_first_error_pos,
+                (unsigned long long)verify_peer->first_corrupted_pos);
+        is_successful = false;
+    }
+    return is_successful;
+}
+
+bool usb_bench::report_uart_errors()
+{
+    uint64_t num_errors = verify_peer->rx_error_pos.size();
+    printf("UART error marking (%u bps, %.0f ms):\n", bitrate, duration_ns / 1e6);
+    printf("  Line: %10llu bytes sent, %llu parity errors, %llu framing errors\n",
+            (unsigned long long)verify_peer->num_bytes, (unsigned long long)verify_peer->num_parity_errors,
+            (unsigned long long)verify_peer->num_framing_errors);
+    printf("  Host: %10llu bytes received, %llu errors, %llu marked (%llu bad bytes)\n",
+            (unsigned long long)in_bytes, (unsigned long long)in_errors, (unsigned long long)num_marked,
+            (unsigned long long)num_marked_errors);
+    printf("  Serial state notifications: 0x%04x\n", serial_state_bits);
+
+    bool is_successful = true;
+    if (verify_peer->num_bytes == 0 || in_bytes != verify_peer->num_bytes || in_errors != 0) {
+        printf("Data has been lost or corrupted\n");
+        is_successful = false;
+    }
+    if (num_marked_errors != num_errors || num_marked > MAX_MARKED_PER_ERROR * num_errors) {
+        printf("Marked bytes do not match bad bytes\n");
+        is_successful = false;
+    }
+    uint16_t expected_bits = (verify_peer->num_parity_errors > 0 ? (uint16_t)usb_serial_interrupt::parity_error : 0)
+        | (verify_peer->num_framing_errors > 0 ? (uint16_t)usb_serial_interrupt::framing_error : 0);
+    if ((serial_state_bits & expected_bits) != expected_bits) {
+        printf("Errors have not been notified\n");
+        is_successful = false;
+    }
+    return is_successful;
+}
+
+bool usb_bench::report_uart_frames(const usb_serial_stats& stats)
+{
+    printf("UART framing (%s%s, %u bps, %.0f ms):\n", frame_peer->encoding == frame_encoding::cobs ? "COBS" : "SLIP",
+            is_frame_crc_checked ? " with CRC check" : "", bitrate, duration_ns / 1e6);
+    printf("  Line:   %8llu frames sent, %llu corrupted\n", (unsigned long long)frame_peer->num_frames,
+            (unsigned long long)frame_peer->num_corrupted);
+    printf("  Device: %8u frames forwarded, %u dropped\n", stats.uart_frames, stats.uart_frame_errors);
+    printf("  Host:   %8llu transfers, %llu not matching a frame, %llu with bad CRC\n",
+            (unsigned long long)num_transfers, (unsigned long long)num_transfer_errors,
+            (unsigned long long)num_bad_crc);
+
+    uint64_t num_dropped = is_frame_crc_checked ? frame_peer->num_corrupted : 0;
+    bool is_successful = true;
+    if (frame_peer->num_frames == 0 || num_transfers != frame_peer->num_frames - num_dropped
+            || stats.uart_frames != num_transfers || !transfer.empty()) {
+        printf("Frames lost\n");
+        is_successful = false;
+    }
+    if (num_transfer_errors != 0) {
+        printf("Transfers not aligned to frames\n");
+        is_successful = false;
+    }
+    if (stats.uart_frame_errors != num_dropped || num_bad_crc != frame_peer->num_corrupted - num_dropped) {
+        printf("Dropped frames do not match corrupted frames\n");
+        is_successful = false;
+    }
+    return is_successful;
+}
+
+void usb_bench::finish(int exit_code)
+{
+    fflush(stdout);
+    _exit(exit_code);
+}
+
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options("firmware-usb-bench", "Measures the USB throughput (without UART) or the UART loopback performance of the simulated firmware");
+
+    options.add_options()
+        ("m,mode", "Test mode: usb, uart-loopback, uart-verify, uart-errors or uart-frames", cxxopts::value<std::string>()->default_value("usb"))
+        ("b,bitrate", "Bit rate for UART test modes (in bps)", cxxopts::value<int>()->default_value("1000000"))
+        ("corrupt", "Flip a bit in every n-th byte (uart-verify mode) or frame (uart-frames mode) sent to the adapter (0 = none)", cxxopts::value<int>()->default_value("0"))
+        ("framing", "Frame encoding for uart-frames mode: cobs or slip", cxxopts::value<std::string>()->default_value("cobs"))
+        ("check-crc", "Check the CRC of frames on the device (uart-frames mode)")
+        ("rx-errors", "Parity or framing error in every n-th byte sent to the adapter (uart-errors mode)", cxxopts::value<int>()->default_value("101"))
+        ("d,duration", "Measurement duration (in ms of simulated time)", cxxopts::value<int>()->default_value("1000"))
+        ("direction", "Direction: in, out or both", cxxopts::value<std::string>()->default_value("both"))
+        ("v,verbose", "Log USB enumeration and control requests")
+        ("h,help", "Show usage");
+
+    sim_options sim_opts;
+    sim_opts.virtual_time = true;
+    usb_serial_test_mode mode;
+    uint32_t bitrate;
+    uint32_t corrupt_interval;
+    uint32_t rx_error_interval;
+    bool is_marking = false;
+    bool is_framing = false;
+    frame_encoding encoding;
+    bool check_crc;
+    uint64_t duration_ns;
+    bool is_in_enabled;
+    bool is_out_enabled;
+
+    try {
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") != 0) {
+            std::cout << options.help() << std::endl;
+            return 2;
+        }
+
+        std::string mode_name = result["mode"].as<std::string>();
+        if (mode_name == "usb")
+            mode = usb_serial_test_mode::usb_throughput;
+        else if (mode_name == "uart-loopback")
+            mode = usb_serial_test_mode::uart_loopback;
+        else if (mode_name == "uart-verify")
+            mode = usb_serial_test_mode::uart_verify;
+        else if (mode_name == "uart-errors") {
+            mode = usb_serial_test_mode::none;
+            is_marking = true;
+        } else if (mode_name == "uart-frames") {
+            mode = usb_serial_test_mode::none;
+            is_framing = true;
+        } else
+            throw cxxopts::OptionParseException("invalid mode '" + mode_name + "'");
+        bitrate = std::min(std::max(result["bitrate"].as<int>(), 1200), 4500000);
+        corrupt_interval = std::max(result["corrupt"].as<int>(), 0);
+        rx_error_interval = is_marking ? std::max(result["rx-errors"].as<int>(), 0) : 0;
+        std::string framing_name = result["framing"].as<std::string>();
+        if (framing_name == "cobs")
+            encoding = frame_encoding::cobs;
+        else if (framing_name == "slip")
+            encoding = frame_encoding::slip;
+        else
+            throw cxxopts::OptionParseException("invalid framing '" + framing_name + "'");
+        check_crc = result.count("check-crc") > 0;
+        duration_ns = (uint64_t)std::max(result["duration"].as<int>(), 1) * 1000000;
+        sim_opts.verbose = result.count("verbose") > 0;
+        std::string direction = result["direction"].as<std::string>();
+        if (direction != "in" && direction != "out" && direction != "both")
+            throw cxxopts::OptionParseException("invalid direction '" + direction + "'");
+        is_in_enabled = mode == usb_serial_test_mode::usb_throughput && direction != "out";
+        is_out_enabled = mode == usb_serial_test_mode::usb_throughput && direction != "in";
+
+    } catch (const cxxopts::OptionException& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return 3;
+    }
+
+    static sim_loopback_peer loopback_peer;
+    static prng_line_peer verify_peer(corrupt_interval, rx_error_interval);
+    static frame_line_peer frame_peer(encoding, corrupt_interval);
+    bool is_verifying = mode == usb_serial_test_mode::uart_verify || is_marking;
+    static usb_bench bench(mode, is_marking, is_in_enabled, is_out_enabled, duration_ns, bitrate,
+            is_verifying ? &verify_peer : nullptr);
+    sim_line_peer* line = &loopback_peer;
+    if (is_verifying)
+        line = &verify_peer;
+    if (is_framing) {
+        bench.set_frame_peer(&frame_peer, check_crc);
+        line = &frame_peer;
+    }
+    sim_init(sim_opts, line, &bench);
+    sim_run_firmware();
+}
@@ -0,0 +1,282 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback result comparison
+//
+// Compares two sets of loopback test results (CSV or JSON output of
+// `loopback-linux --sweep`) and detects performance regressions.
+//
+// Runs of the same configuration (bit rate, data bits, parity, chunk size,
+// read size, iovecs, outstanding data) are aggregated. A change of a metric is significant if
+// it exceeds both the relative threshold and the noise estimated from the
+// repeated runs (standard error of the difference of the means times the
+// sigma factor).
+//
+// Comand line syntax: loopback-compare [ OPTIONS... ] baseline candidate
+//
+// Exit code: 0 if there is no significant regression, 3 if there is one.
+//
+
+#include "cxxopts.hpp"
+#include "results.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+// parsed command line arguments
+static std::string baseline_path;
+static std::string candidate_path;
+static double throughput_threshold;
+static double latency_threshold;
+static double sigma_factor;
+static bool show_all;
+
+/// Test configuration (key for matching runs)
+typedef std::tuple<int, int, bool, int, int, int, int> config_key;
+
+/// Runs of a configuration
+struct config_runs {
+    std::vector<result_row> baseline;
+    std::vector<result_row> candidate;
+};
+
+/// Metric to compare
+struct metric {
+    const char* name;
+    double result_row::* value;
+    /// `true` if higher values are better
+    bool higher_is_better;
+    /// `true` if metric is a latency (only compared if latency has been measured)
+    bool is_latency;
+};
+
+static const metric METRICS[] = {
+    { "net_bitrate", &result_row::net_bit_rate, true, false },
+    { "rtt_p50_us", &result_row::rtt_p50, false, true },
+    { "rtt_p99_us", &result_row::rtt_p99, false, true },
+};
+
+/// Mean and standard deviation of a metric
+struct sample_stats {
+    int count;
+    double mean;
+    double stddev;
+};
+
+/**
+ * Checks the program arguments
+ * @param argc number of arguments
+ * @param argv argument array
+ * @return 0 on success, other value on error
+ */
+static int check_usage(int argc, char* argv[]);
+
+/**
+ * Loads the results from the specified file
+ * @param path file path
+ * @return result rows
+ */
+static std::vector<result_row> load_results(const std::string& path);
+
+/**
+ * Computes the statistics of a metric over the successful runs
+ * @param runs runs
+ * @param m metric
+ * @return statistics
+ */
+static sample_stats compute_stats(const std::vector<result_row>& runs, const metric& m);
+
+/**
+ * Formats the configuration for display
+ * @param key configuration
+ * @return formatted configuration
+ */
+static std::string format_config(const config_key& key);
+
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    if (check_usage(argc, argv) != 0)
+        exit(1);
+
+    std::map<config_key, config_runs> configs;
+    try {
+        for (auto& row : load_results(baseline_path))
+            configs[config_key(row.bit_rate, row.data_bits, row.with_parity, row.chunk_size, row.read_size, row.num_iovecs, row.max_outstanding_bytes)].baseline.push_back(row);
+        for (auto& row : load_results(candidate_path))
+            configs[config_key(row.bit_rate, row.data_bits, row.with_parity, row.chunk_size, row.read_size, row.num_iovecs, row.max_outstanding_bytes)].candidate.push_back(row);
+    }
+    catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+
+    printf("%-52s %-12s %14s %14s %8s  %s\n", "Configuration", "Metric", "Baseline", "Candidate", "Delta", "Verdict");
+
+    int num_regressions = 0;
+    int num_improvements = 0;
+    for (auto& entry : configs) {
+        std::string config = format_config(entry.first);
+        const config_runs& runs = entry.second;
+
+        if (runs.baseline.empty() || runs.candidate.empty()) {
+            printf("%-52s %-12s %s\n", config.c_str(), "-", runs.baseline.empty() ? "missing in baseline" : "missing in candidate");
+            continue;
+        }
+
+        // failed runs
+        int baseline_errors = 0;
+        int candidate_errors = 0;
+        for (auto& row : runs.baseline)
+            baseline_errors += row.errors > 0 ? 1 : 0;
+        for (auto& row : runs.candidate)
+            candidate_errors += row.errors > 0 ? 1 : 0;
+        double baseline_error_rate = (double)baseline_errors / runs.baseline.size();
+        double candidate_error_rate = (double)candidate_errors / runs.candidate.size();
+        if (candidate_error_rate > baseline_error_rate) {
+            printf("%-52s %-12s %13.0f%% %13.0f%% %8s  REGRESSION\n", config.c_str(), "failed_runs",
+                baseline_error_rate * 100, candidate_error_rate * 100, "");
+            num_regressions += 1;
+        }
+
+        for (auto& m : METRICS) {
+            sample_stats base = compute_stats(runs.baseline, m);
+            sample_stats cand = compute_stats(runs.candidate, m);
+            if (base.count == 0 || cand.count == 0 || base.mean == 0)
+                continue;
+
+            double delta = cand.mean - base.mean;
+            double relative_delta = delta / base.mean;
+            double noise = sqrt(base.stddev * base.stddev / base.count + cand.stddev * cand.stddev / cand.count);
+            double threshold = std::max((m.is_latency ? latency_threshold : throughput_threshold) / 100.0 * base.mean,
+                sigma_factor * noise);
+
+            const char* verdict = "ok";
+            if (fabs(delta) > threshold) {
+                bool is_worse = m.higher_is_better ? delta < 0 : delta > 0;
+                if (is_worse) {
+                    verdict = "REGRESSION";
+                    num_regressions += 1;
+                } else {
+                    verdict = "improvement";
+                    num_improvements += 1;
+                }
+            } else if (!show_all) {
+                continue;
+            }
+
+            printf("%-52s %-12s %14.1f %14.1f %+7.1f%%  %s\n", config.c_str(), m.name,
+                base.mean, cand.mean, relative_delta * 100, verdict);
+        }
+    }
+
+    printf("\n%d configurations, %d regressions, %d improvements\n", (int)configs.size(), num_regressions, num_improvements);
+    return num_regressions > 0 ? 3 : 0;
+}
+
+
+int check_usage(int argc, char* argv[]) {
+
+    cxxopts::Options options("loopback-compare", "Compare loopback test results and detect regressions");
+
+    options.add_options()
+        ("baseline", "Baseline results (CSV or JSON)", cxxopts::value<std::string>())
+        ("candidate", "Candidate results (CSV or JSON)", cxxopts::value<std::string>())
+        ("t,throughput-threshold", "Minimum relative throughput change to be significant (in %)", cxxopts::value<double>()->default_value("2"))
+        ("l,latency-threshold", "Minimum relative latency change to be significant (in %)", cxxopts::value<double>()->default_value("5"))
+        ("s,sigma", "Minimum change to be significant (in standard errors)", cxxopts::value<double>()->default_value("3"))
+        ("a,all", "Show all metrics (not just significant changes)")
+        ("h,help", "Show usage");
+    options.positional_help("baseline candidate").show_positional_help();
+
+    try {
+        options.parse_positional({ "baseline", "candidate" });
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") != 0) {
+            std::cout << options.help() << std::endl;
+            return 2;
+        }
+
+        if (result.count("baseline") == 0 || result.count("candidate") == 0)
+            throw cxxopts::OptionParseException("'baseline' and 'candidate' must be specified");
+
+        baseline_path = result["baseline"].as<std::string>();
+        candidate_path = result["candidate"].as<std::string>();
+        throughput_threshold = std::max(result["throughput-threshold"].as<double>(), 0.0);
+        latency_threshold = std::max(result["latency-threshold"].as<double>(), 0.0);
+        sigma_factor = std::max(result["sigma"].as<double>(), 0.0);
+        show_all = result.count("all") > 0;
+    }
+    catch (const cxxopts::OptionException& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return 3;
+    }
+
+    return 0;
+}
+
+
+std::vector<result_row> load_results(const std::string& path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Unable to open " + path);
+
+    try {
+        return read_results(file);
+    }
+    catch (const std::runtime_error& error) {
+        throw std::runtime_error(path + ": " + error.what());
+    }
+}
+
+
+sample_stats compute_stats(const std::vector<result_row>& runs, const metric& m) {
+    sample_stats stats = { 0, 0, 0 };
+
+    double sum = 0;
+    for (auto& row : runs) {
+        if (row.errors > 0 || (m.is_latency && row.rtt_count == 0))
+            continue;
+        sum += row.*m.value;
+        stats.count += 1;
+    }
+    if (stats.count == 0)
+        return stats;
+    stats.mean = sum / stats.count;
+
+    if (stats.count > 1) {
+        double sum_sq = 0;
+        for (auto& row : runs) {
+            if (row.errors > 0 || (m.is_latency && row.rtt_count == 0))
+                continue;
+            double d = row.*m.value - stats.mean;
+            sum_sq += d * d;
+        }
+        stats.stddev = sqrt(sum_sq / (stats.count - 1));
+    }
+
+    return stats;
+}
+
+
+std::string format_config(const config_key& key) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%d bps %d%c chunk %d read %d iov %d out %d",
+        std::get<0>(key), std::get<1>(key), std::get<2>(key) ? 'P' : 'N', std::get<3>(key),
+        std::get<4>(key), std::get<5>(key), std::get<6>(key));
+    return buf;
+}
@@ -0,0 +1,123 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Test engines: they send pseudo random data over the link(s), receive it and
+// compare it with the expected data.
+//
+
+#pragma once
+
+#include "link.hpp"
+#include "prng.hpp"
+#include "soak.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+/**
+ * Parameters of the loopback test
+ */
+struct loopback_params {
+    /// Number of bytes to transmit
+    int num_bytes;
+    /// Data bits (7 or 8)
+    int data_bits;
+    /// Maximum data outstanding in transit (in bytes)
+    int max_outstanding_bytes;
+    /// Size of chunks written to the serial port (in bytes)
+    int chunk_size;
+    /// Size of reads from the serial port (in bytes)
+    int read_size;
+    /// Number of chunks written or read with a single `writev` / `readv` call (threads engine only)
+    int num_iovecs;
+    /// Delay before reception starts (in s)
+    int rx_delay;
+    /// Initial value of pseudo random number generator
+    uint32_t prng_init;
+    /// Resynchronize after lost or corrupted data instead of cancelling the test (threads engine only)
+    bool is_soak;
+};
+
+/**
+ * Result of the loopback test
+ */
+struct loopback_result {
+    /// Indicates if all data has been received and verified
+    bool is_successful;
+    /// Duration from the start of the reception until all data has been received (in s)
+    double duration;
+    /// Error statistics (soak test only)
+    soak_stats soak;
+};
+
+/**
+ * Runs the loopback test with separate threads for sending and receiving.
+ *
+ * The outstanding data is limited using a mutex and a condition variable.
+ * In soak mode, the receiver resynchronizes after lost or corrupted data.
+ *
+ * @param params test parameters
+ * @param link link to test
+ * @return test result
+ */
+loopback_result run_threads_engine(const loopback_params& params, loopback_link& link);
+
+/**
+ * Runs the loopback test for several links in a single thread.
+ *
+ * The serial ports are used in non-blocking mode and driven from a shared
+ * epoll loop. The outstanding data is limited without any locking.
+ *
+ * @param params test parameters
+ * @param links links to test
+ * @return test results (one per link)
+ */
+std::vector<loopback_result> run_epoll_engine(const loopback_params& params, std::vector<loopback_link>& links);
+
+/**
+ * Runs the loopback test in a single thread using io_uring.
+ *
+ * Chains of fixed-buffer writes and reads are submitted and completed in batches.
+ * The serial port(s) remain in blocking mode.
+ *
+ * @param params test parameters
+ * @param link link to test
+ * @return test result
+ */
+loopback_result run_uring_engine(const loopback_params& params, loopback_link& link);
+
+/**
+ * Returns the mask applied to each byte of the pseudo random data.
+ * @param data_bits data bits (7 or 8)
+ * @return byte mask
+ */
+uint8_t data_mask(int data_bits);
+
+/**
+ * Verifies the received data against the pseudo random data.
+ *
+ * If the data does not match, the position of the first mismatch is
+ * printed together with a hex dump of the expected and received data.
+ *
+ * @param prandom pseudo random generator (positioned at the start of the received data)
+ * @param buf received data
+ * @param len length of the received data (in bytes)
+ * @param data_bits data bits (7 or 8)
+ * @param recv_path path of the receiving serial port (for the error message)
+ * @return `true` if the data matches
+ */
+bool verify_received_data(prng& prandom, const uint8_t* buf, size_t len, int data_bits, const std::string& recv_path);
+
+/**
+ * Prints a hex dump of the specified buffer.
+ * @param title Title to print at start of line
+ * @param buf buffer start
+ * @para buf_len buffer length
+ */
+void hex_dump(const char* title, const uint8_t* buf, size_t buf_len);
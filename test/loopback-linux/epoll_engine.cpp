@@ -0,0 +1,315 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Single-threaded test engine using non-blocking I/O and epoll.
+//
+
+#include "engine.hpp"
+#include "prng.hpp"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono;
+
+// Time without received data after which the test is cancelled
+static constexpr milliseconds RX_TIMEOUT(100);
+// Maximum number of events retrieved at once
+static constexpr int MAX_EVENTS = 64;
+
+namespace {
+
+/**
+ * Test state of a single link
+ */
+struct link_state {
+    link_state(const loopback_params& params, loopback_link& link);
+
+    void update_interest(int epoll_fd, bool is_rx_active);
+    void set_interest(int epoll_fd, int fd, uint32_t events, uint32_t& registered_events);
+    bool can_send_chunk() const;
+    void on_writable();
+    bool on_readable();
+
+    const loopback_params& params;
+    loopback_link& link;
+    int tx_fd;
+    int rx_fd;
+    uint32_t tx_events;
+    uint32_t rx_events;
+    bool is_done;
+    loopback_result result;
+
+    prng tx_prandom;
+    prng rx_prandom;
+
+    std::vector<uint8_t> tx_buf;
+    int tx_len;
+    int tx_pos;
+    int num_generated;
+    int num_sent;
+
+    std::vector<uint8_t> rx_buf;
+    int num_received;
+    steady_clock::time_point last_rx_time;
+};
+
+/**
+ * Test state of epoll engine
+ */
+class epoll_engine {
+public:
+    epoll_engine(const loopback_params& params, std::vector<loopback_link>& links);
+    ~epoll_engine();
+
+    std::vector<loopback_result> run();
+
+private:
+    void finish_link(link_state& state, bool is_successful);
+
+    const loopback_params& params;
+    std::vector<std::unique_ptr<link_state>> links;
+    int epoll_fd;
+    int num_active_links;
+    bool is_rx_active;
+    steady_clock::time_point rx_start_time;
+};
+
+}
+
+
+// --- link_state
+
+link_state::link_state(const loopback_params& params, loopback_link& link)
+: params(params), link(link), tx_fd(link.send_port.fd()), rx_fd(link.recv_port.fd()),
+    tx_events(0), rx_events(0), is_done(false), result({ false, 0 }),
+    tx_prandom(params.prng_init), rx_prandom(params.prng_init),
+    tx_buf(params.chunk_size), tx_len(0), tx_pos(0), num_generated(0), num_sent(0),
+    rx_buf(params.read_size), num_received(0) { }
+
+// Registers the events of interest (only if changed)
+void link_state::update_interest(int epoll_fd, bool is_rx_active) {
+    // transmit if data is pending or the outstanding data allows another chunk
+    bool wants_tx = !is_done && (tx_pos < tx_len || can_send_chunk());
+    bool wants_rx = !is_done && is_rx_active;
+
+    uint32_t tx = wants_tx ? (uint32_t)EPOLLOUT : 0U;
+    uint32_t rx = wants_rx ? (uint32_t)EPOLLIN : 0U;
+
+    if (tx_fd == rx_fd) {
+        set_interest(epoll_fd, tx_fd, tx | rx, tx_events);
+        rx_events = tx_events;
+    } else {
+        set_interest(epoll_fd, tx_fd, tx, tx_events);
+        set_interest(epoll_fd, rx_fd, rx, rx_events);
+    }
+}
+
+void link_state::set_interest(int epoll_fd, int fd, uint32_t events, uint32_t& registered_events) {
+    if (events == registered_events)
+        return;
+
+    struct epoll_event ev = { 0 };
+    ev.events = events;
+    ev.data.ptr = this;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1)
+        throw serial_error("Failed to modify epoll registration", errno);
+    registered_events = events;
+}
+
+// Checks if the outstanding data allows sending the next chunk (always if nothing is outstanding)
+bool link_state::can_send_chunk() const {
+    if (num_generated >= params.num_bytes)
+        return false;
+    int m = std::min(params.chunk_size, params.num_bytes - num_generated);
+    int outstanding = num_sent - num_received;
+    return outstanding + m <= params.max_outstanding_bytes || outstanding <= 0;
+}
+
+void link_state::on_writable() {
+    if (tx_pos == tx_len) {
+        // generate next chunk
+        if (!can_send_chunk())
+            return;
+
+        int m = std::min(params.chunk_size, params.num_bytes - num_generated);
+        tx_prandom.fill(tx_buf.data(), m, data_mask(params.data_bits));
+        tx_len = m;
+        tx_pos = 0;
+        num_generated += m;
+    }
+
+    ssize_t k = write(tx_fd, tx_buf.data() + tx_pos, tx_len - tx_pos);
+    if (k == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        throw serial_error("Failed to transmit data", errno);
+    }
+
+    tx_pos += (int)k;
+    num_sent += (int)k;
+    if (tx_pos == tx_len)
+        tx_pos = tx_len = 0;
+}
+
+bool link_state::on_readable() {
+    int len = std::min(params.read_size, params.num_bytes - num_received);
+    ssize_t k = read(rx_fd, rx_buf.data(), len);
+    if (k == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return true;
+        throw serial_error("Failed to receive data", errno);
+    }
+    if (k == 0) {
+        std::cerr << "No more data from " << link.recv_path << " after " << num_received << " bytes" << std::endl;
+        return false;
+    }
+
+    last_rx_time = steady_clock::now();
+
+    if (!verify_received_data(rx_prandom, rx_buf.data(), k, params.data_bits, link.recv_path))
+        return false;
+
+    num_received += (int)k;
+    return true;
+}
+
+
+// --- epoll_engine
+
+epoll_engine::epoll_engine(const loopback_params& params, std::vector<loopback_link>& links)
+: params(params), epoll_fd(-1), num_active_links(0), is_rx_active(false) {
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+        throw serial_error("Failed to create epoll instance", errno);
+
+    for (auto& link : links) {
+        this->links.push_back(std::make_unique<link_state>(params, link));
+        link_state* state = this->links.back().get();
+
+        link.send_port.set_non_blocking(true);
+        if (state->rx_fd != state->tx_fd)
+            link.recv_port.set_non_blocking(true);
+
+        struct epoll_event ev = { 0 };
+        ev.data.ptr = state;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, state->tx_fd, &ev) == -1)
+            throw serial_error("Failed to register serial port with epoll", errno);
+        if (state->rx_fd != state->tx_fd) {
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, state->rx_fd, &ev) == -1)
+                throw serial_error("Failed to register serial port with epoll", errno);
+        }
+    }
+}
+
+epoll_engine::~epoll_engine() {
+    if (epoll_fd != -1)
+        close(epoll_fd);
+
+    // restore blocking mode (for draining and closing)
+    for (auto& state : links) {
+        try {
+            state->link.send_port.set_non_blocking(false);
+            if (state->rx_fd != state->tx_fd)
+                state->link.recv_port.set_non_blocking(false);
+        } catch (serial_error&) {
+            // ignore
+        }
+    }
+}
+
+std::vector<loopback_result> epoll_engine::run() {
+    rx_start_time = steady_clock::now() + seconds(params.rx_delay);
+    num_active_links = (int)links.size();
+    epoll_event events[MAX_EVENTS];
+
+    while (num_active_links > 0) {
+        auto now = steady_clock::now();
+        if (!is_rx_active && now >= rx_start_time) {
+            is_rx_active = true;
+            for (auto& state : links)
+                state->last_rx_time = now;
+        }
+
+        // wait until the reception starts or the first link times out
+        auto timeout_time = rx_start_time;
+        if (is_rx_active) {
+            timeout_time = steady_clock::time_point::max();
+            for (auto& state : links) {
+                if (state->is_done)
+                    continue;
+                if (now >= state->last_rx_time + RX_TIMEOUT) {
+                    std::cerr << "No more data from " << state->link.recv_path << " after " << state->num_received << " bytes" << std::endl;
+                    finish_link(*state, false);
+                    continue;
+                }
+                timeout_time = std::min(timeout_time, state->last_rx_time + RX_TIMEOUT);
+            }
+            if (num_active_links == 0)
+                break;
+        }
+        int timeout = (int)duration_cast<milliseconds>(timeout_time - now).count() + 1;
+
+        for (auto& state : links)
+            state->update_interest(epoll_fd, is_rx_active);
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            throw serial_error("Failed to wait for serial port events", errno);
+        }
+
+        for (int i = 0; i < n; i++) {
+            link_state* state = (link_state*)events[i].data.ptr;
+            if (state->is_done)
+                continue;
+
+            uint32_t ev = events[i].events;
+            if ((ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0 && (state->rx_events & EPOLLIN) != 0) {
+                if (!state->on_readable()) {
+                    finish_link(*state, false);
+                    continue;
+                }
+                if (state->num_received == params.num_bytes) {
+                    finish_link(*state, true);
+                    continue;
+                }
+            }
+            if ((ev & (EPOLLOUT | EPOLLERR)) != 0 && (state->tx_events & EPOLLOUT) != 0)
+                state->on_writable();
+        }
+    }
+
+    std::vector<loopback_result> results;
+    for (auto& state : links)
+        results.push_back(state->result);
+    return results;
+}
+
+void epoll_engine::finish_link(link_state& state, bool is_successful) {
+    state.is_done = true;
+    state.result.is_successful = is_successful;
+    if (is_successful)
+        state.result.duration = duration_cast<microseconds>(steady_clock::now() - rx_start_time).count() / 1000000.0;
+    state.update_interest(epoll_fd, false);
+    num_active_links -= 1;
+}
+
+
+std::vector<loopback_result> run_epoll_engine(const loopback_params& params, std::vector<loopback_link>& links) {
+    epoll_engine engine(params, links);
+    return engine.run();
+}
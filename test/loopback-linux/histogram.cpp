@@ -0,0 +1,86 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Latency histogram with logarithmic buckets (similar to HdrHistogram).
+//
+
+#include "histogram.hpp"
+#include <algorithm>
+#include <math.h>
+
+// Number of buckets for exact values (and number of sub-buckets of
+// the first logarithmic bucket)
+static constexpr int SUB_BUCKETS = 128;
+static constexpr int SUB_BUCKET_BITS = 7;
+// Number of sub-buckets of the remaining logarithmic buckets
+static constexpr int HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+// Total number of buckets for 64-bit values
+static constexpr int NUM_BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS;
+
+
+histogram::histogram() : buckets(NUM_BUCKETS), _count(0), _min(UINT64_MAX), _max(0) { }
+
+void histogram::record(uint64_t value) {
+    buckets[index_of(value)] += 1;
+    _count += 1;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+}
+
+uint64_t histogram::value_at_percentile(double percentile) const {
+    if (_count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)ceil(std::min(std::max(percentile, 0.0), 100.0) / 100.0 * _count);
+    target = std::max(target, (uint64_t)1);
+
+    uint64_t n = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        n += buckets[i];
+        if (n >= target)
+            return std::min(upper_bound(i), _max);
+    }
+    return _max;
+}
+
+void histogram::write_csv(std::ostream& os) const {
+    os << "lower,upper,count\n";
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (buckets[i] != 0)
+            os << lower_bound(i) << ',' << upper_bound(i) << ',' << buckets[i] << '\n';
+    }
+}
+
+int histogram::index_of(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return (int)value;
+
+    // value >> shift is in the range [HALF_SUB_BUCKETS, SUB_BUCKETS)
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (SUB_BUCKET_BITS - 1);
+    int sub = (int)(value >> shift);
+    return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + (sub - HALF_SUB_BUCKETS);
+}
+
+uint64_t histogram::lower_bound(int index) {
+    if (index < SUB_BUCKETS)
+        return index;
+
+    int shift = (index - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+    uint64_t sub = (index - SUB_BUCKETS) % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+    return sub << shift;
+}
+
+uint64_t histogram::upper_bound(int index) {
+    if (index < SUB_BUCKETS)
+        return index;
+
+    int shift = (index - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+    return lower_bound(index) + (((uint64_t)1 << shift) - 1);
+}
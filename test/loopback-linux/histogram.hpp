@@ -0,0 +1,82 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Latency histogram with logarithmic buckets (similar to HdrHistogram).
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+/**
+ * Histogram with logarithmic buckets.
+ *
+ * Values below 128 are recorded exactly. Larger values are recorded
+ * in buckets with a relative width of at most 1/64 (1.6%).
+ */
+class histogram {
+public:
+    /**
+     * Creates an empty histogram.
+     */
+    histogram();
+
+    /**
+     * Records a value.
+     * @param value value to record
+     */
+    void record(uint64_t value);
+
+    /**
+     * Gets the number of recorded values.
+     * @return count
+     */
+    uint64_t count() const { return _count; }
+
+    /**
+     * Gets the minimum of the recorded values.
+     * @return minimum value (0 if no value has been recorded)
+     */
+    uint64_t min() const { return _count > 0 ? _min : 0; }
+
+    /**
+     * Gets the maximum of the recorded values.
+     * @return maximum value (0 if no value has been recorded)
+     */
+    uint64_t max() const { return _max; }
+
+    /**
+     * Gets the value at the specified percentile.
+     *
+     * The result is the upper bound of the bucket containing the percentile,
+     * limited to the maximum recorded value.
+     *
+     * @param percentile percentile (0 to 100)
+     * @return value
+     */
+    uint64_t value_at_percentile(double percentile) const;
+
+    /**
+     * Writes the non-empty buckets as CSV (lower bound, upper bound, count).
+     * @param os output stream
+     */
+    void write_csv(std::ostream& os) const;
+
+private:
+    static int index_of(uint64_t value);
+    static uint64_t lower_bound(int index);
+    static uint64_t upper_bound(int index);
+
+    std::vector<uint64_t> buckets;
+    uint64_t _count;
+    uint64_t _min;
+    uint64_t _max;
+};
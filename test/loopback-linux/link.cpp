@@ -0,0 +1,59 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Link consisting of the serial port(s) for transmission and reception.
+//
+
+#include "link.hpp"
+#include <iostream>
+
+
+loopback_link::loopback_link(const std::string& send_path, const std::string& recv_path)
+: send_path(send_path), recv_path(recv_path) { }
+
+void loopback_link::open(int bit_rate, int data_bits, bool with_parity, bool low_latency) {
+    send_port.open(send_path.c_str(), bit_rate, data_bits, with_parity);
+    if (low_latency)
+        set_low_latency(send_port, send_path);
+
+    if (send_path == recv_path) {
+        recv_port = send_port;
+
+    } else {
+        try {
+            recv_port.open(recv_path.c_str(), bit_rate, data_bits, with_parity);
+            if (low_latency)
+                set_low_latency(recv_port, recv_path);
+        } catch (serial_error&) {
+            send_port.close();
+            throw;
+        }
+    }
+
+    recv_port.drain();
+}
+
+void loopback_link::close(bool drain) {
+    if (drain)
+        recv_port.drain();
+    send_port.close();
+    if (recv_path != send_path)
+        recv_port.close();
+}
+
+void loopback_link::set_low_latency(serial_port& port, const std::string& path) {
+    if (!port.set_low_latency())
+        std::cerr << "Warning: " << path << ": driver does not support ASYNC_LOW_LATENCY" << std::endl;
+}
+
+std::string loopback_link::name() const {
+    if (send_path == recv_path)
+        return send_path;
+    return send_path + ":" + recv_path;
+}
@@ -0,0 +1,70 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Link consisting of the serial port(s) for transmission and reception.
+//
+
+#pragma once
+
+#include "serial.hpp"
+#include <string>
+
+/**
+ * Loopback link.
+ *
+ * Data transmitted on the send port is expected to arrive at the receive port.
+ * The send and receive port can be the same serial port.
+ */
+struct loopback_link {
+    /**
+     * Creates a new link instance.
+     *
+     * The serial ports are in closed state.
+     *
+     * @param send_path path of serial port for transmission
+     * @param recv_path path of serial port for reception (can be the same as `send_path`)
+     */
+    loopback_link(const std::string& send_path, const std::string& recv_path);
+
+    /**
+     * Opens the serial port(s) and drains pending data.
+     *
+     * @param bit_rate bit rate (in baud or bits/s)
+     * @param data_bits number of data bits (7 or 8)
+     * @param with_parity whether to use an additional parity bit
+     * @param low_latency `true` to configure the serial port(s) for low latency
+     */
+    void open(int bit_rate, int data_bits, bool with_parity, bool low_latency = false);
+
+    /**
+     * Closes the serial port(s).
+     *
+     * @param drain `true` to drain pending data before closing
+     */
+    void close(bool drain = true);
+
+    /**
+     * Gets the name of the link (for messages).
+     *
+     * @return name
+     */
+    std::string name() const;
+
+    /// Path of serial port for transmission
+    std::string send_path;
+    /// Path of serial port for reception
+    std::string recv_path;
+    /// Serial port for transmission
+    serial_port send_port;
+    /// Serial port for reception (same instance as `send_port` if the paths are equal)
+    serial_port recv_port;
+
+private:
+    static void set_low_latency(serial_port& port, const std::string& path);
+};
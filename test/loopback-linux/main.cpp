@@ -16,38 +16,78 @@
 // Comand line syntax: loopback-test [ OPTIONS... ] tx-port [ rx-port ]
 //
 // Specify the same port for tx-port and rx-port for single port configuration.
+// With --virtual, a virtual adapter (pty pair) is used instead of tx-port.
+// Further links can be added with `--link tx-port[:rx-port]`. All links are
+// tested at the same time.
+//
+// With --sweep, bit rate, data bits, chunk size, read size and outstanding data can be
+// lists or ranges (e.g. `-b 115200,921600 -k 16-64:16`). Each configuration
+// is tested and the results are written as CSV or JSON rows.
+//
+// With --low-latency, reads are event-driven and the driver is asked for
+// low-latency operation. Together with --pin-cpu (CPU affinity and SCHED_FIFO
+// priority), it reduces the latency added by the host.
+//
+// With --soak, the test continues after lost, inserted or corrupted data.
+// Each error event is logged and error rates per GB are reported.
 //
 
 #include "cxxopts.hpp"
+#include "engine.hpp"
+#include "link.hpp"
+#include "pingpong.hpp"
 #include "prng.hpp"
-#include "serial.hpp"
+#include "results.hpp"
+#include "virtual_adapter.hpp"
 #include <algorithm>
-#include <condition_variable>
+#include <sched.h>
+#include <string.h>
+#include <fstream>
 #include <iomanip>
-#include <mutex>
+#include <memory>
 #include <thread>
+#include <vector>
 
 using namespace std::chrono;
 
 static constexpr uint32_t PRNG_INIT = 0x7b;
 
 // parsed command line arguments
-static std::string send_port_path;
-static std::string recv_port_path;
 static int num_bytes;
 static int bit_rate;
 static int data_bits;
 static bool with_parity;
 static int rx_delay;
 static int max_outstanding_bytes;
-
-static serial_port send_port;
-static serial_port recv_port;
-static volatile bool test_cancelled = false;
-
-static int outstanding_bytes;
-std::mutex outstanding_data_mutex; // protects outstanding_bytes
-std::condition_variable outstanding_data_condition; // to be used with outstanding_data_mutex
+static int chunk_size;
+static int read_size;
+static int num_iovecs;
+static std::string engine;
+static bool is_pingpong;
+static int num_messages;
+static int message_size;
+static int message_gap;
+static std::string histogram_path;
+static bool is_sweep;
+static bool is_soak;
+static bool is_low_latency;
+static int pin_cpu;
+static int rt_priority;
+static bool is_virtual;
+static virtual_adapter_config virtual_config;
+static std::vector<int> bit_rate_values;
+static std::vector<int> data_bits_values;
+static std::vector<bool> parity_values;
+static std::vector<int> chunk_size_values;
+static std::vector<int> read_size_values;
+static std::vector<int> outstanding_values;
+static int num_repeats;
+static result_format output_format;
+static std::string output_path;
+
+// links to test (the first one is specified by tx-port and rx-port)
+static std::vector<loopback_link> links;
+static bool test_cancelled = false;
 
 /**
  * Checks the program arguments
@@ -58,41 +98,57 @@ std::condition_variable outstanding_data_condition; // to be used with outstandi
 static int check_usage(int argc, char* argv[]);
 
 /**
- * Open the serial port(s) specified on the command line
+ * Pins the process to the selected CPU and sets the real-time priority (if configured).
+ *
+ * Threads started later inherit both settings.
+ */
+static void configure_scheduling();
+
+/**
+ * Open the serial port(s) of all links
  *
  * @return 0 on success, other value on error
  */
 static int open_ports();
 
 /**
- * Close  the serial port(s)
+ * Close  the serial port(s) of all links
  */
 static void close_ports();
 
 /**
- * Sends pseudo random data to the serial port
+ * Runs the throughput test with the selected engine on all links
+ *
+ * @param results receives the results (one per link)
+ * @return `true` if the test was successful for all links
+ */
+static bool run_throughput_test(std::vector<loopback_result>& results);
+
+/**
+ * Prints the throughput test results
+ *
+ * @param results results (one per link)
  */
-static void send();
+static void print_throughput_results(const std::vector<loopback_result>& results);
 
 /**
- * Receives data from the serial port and compares it with the expected data
+ * Runs the tests for all configurations of the sweep and writes the results
+ *
+ * @return 0 if all tests were successful, 3 otherwise
  */
-static void recv();
+static int run_sweep();
 
 /**
- * Clears the high bit of each byte in the buffer.
- * @param buf buffer to be modified
- * @param buf_len length of buffer (in bytes)
+ * Runs the ping-pong test and prints the round-trip time statistics
  */
-static void clear_high_bit(uint8_t* buf, size_t buf_len);
+static void run_pingpong_test();
 
 /**
- * Prints a hex dump of the specified buffer.
- * @param title Title to print at start of line
- * @param buf buffer start
- * @para buf_len buffer length
+ * Runs the soak test (with the configured number of runs) and prints the error statistics
+ *
+ * @return 0 if no errors occurred, 3 otherwise
  */
-static void hex_dump(const char* title, const uint8_t* buf, size_t buf_len);
+static int run_soak_test();
 
 
 /**
@@ -106,36 +162,32 @@ int main(int argc, char* argv[]) {
     if (check_usage(argc, argv) != 0)
         exit(1);
 
-    try {
-        open_ports();
+    configure_scheduling();
 
-        // Run send function in separate thread
-        std::thread sender(send);
-
-        if (rx_delay != 0)
-            std::this_thread::sleep_for(seconds(rx_delay));
+    try {
+        std::unique_ptr<virtual_adapter> adapter;
+        if (is_virtual) {
+            adapter.reset(new virtual_adapter(virtual_config));
+            links.insert(links.begin(), loopback_link(adapter->path(), adapter->path()));
+        }
 
-        // start time
-        time_point<high_resolution_clock> start_time = high_resolution_clock::now();
+        if (is_sweep)
+            return run_sweep();
+        if (is_soak)
+            return run_soak_test();
 
-        // receive data
-        recv();
+        open_ports();
 
-        // end time
-        time_point<high_resolution_clock> end_time = high_resolution_clock::now();
-        double duration = static_cast<double>(duration_cast<milliseconds>(end_time - start_time).count()) / 1000.0;
+        if (is_pingpong) {
+            run_pingpong_test();
+            close_ports();
+            return test_cancelled ? 3 : 0;
+        }
 
-        sender.join();
+        std::vector<loopback_result> results;
+        run_throughput_test(results);
         close_ports();
-
-        if (!test_cancelled) {
-            int br = (int)((double)num_bytes * data_bits / duration);
-            double expected_net_rate = (double)bit_rate * data_bits / ((double)data_bits + (with_parity ? 1 : 0) + 2);
-            printf("Successfully sent %d bytes in %.1fs\n", num_bytes, duration);
-            printf("Gross bit rate: %d bps\n", bit_rate);
-            printf("Net bit rate:   %d bps\n", br);
-            printf("Overhead: %.1f%%\n", expected_net_rate * 100.0 / br - 100);
-        }
+        print_throughput_results(results);
 
     }
     catch (serial_error& error) {
@@ -155,11 +207,34 @@ int check_usage(int argc, char* argv[]) {
         ("t,tx-port", "Serial port for transmission", cxxopts::value<std::string>())
         ("r,rx-port", "Serial port for reception (default: same as tx-port)", cxxopts::value<std::string>())
         ("n,numbytes", "Number of bytes to transmit", cxxopts::value<int>()->default_value("300000"))
-        ("b,bitrate", "Bit rate (1200 .. 99,999,999 bps)", cxxopts::value<int>()->default_value("921600"))
+        ("b,bitrate", "Bit rate (1200 .. 99,999,999 bps)", cxxopts::value<std::string>()->default_value("921600"))
         ("p,parity", "Enable parity bit")
-        ("d,databits", "Data bits (7 or 8)", cxxopts::value<int>()->default_value("8"))
+        ("d,databits", "Data bits (7 or 8)", cxxopts::value<std::string>()->default_value("8"))
         ("s,rx-sleep", "Sleep before reception (in s)", cxxopts::value<int>()->default_value("0"))
-        ("o,outstanding", "Maximum data outstanding in transit (in bytes)", cxxopts::value<int>()->default_value("999999999"))
+        ("o,outstanding", "Maximum data outstanding in transit (in bytes)", cxxopts::value<std::string>()->default_value("999999999"))
+        ("k,chunk-size", "Size of chunks written to serial port (in bytes)", cxxopts::value<std::string>()->default_value("64"))
+        ("R,read-size", "Size of reads from serial port (in bytes, default: 64 for threads, 4096 for epoll, 1024 for uring)", cxxopts::value<std::string>())
+        ("iov", "Number of chunks per writev/readv call (threads engine)", cxxopts::value<int>()->default_value("1"))
+        ("e,engine", "Test engine: threads, epoll or uring", cxxopts::value<std::string>()->default_value("threads"))
+        ("L,link", "Additional link to test at the same time: tx-port[:rx-port] (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("ping-pong", "Measure round-trip time of individual messages")
+        ("c,messages", "Number of messages (ping-pong)", cxxopts::value<int>()->default_value("1000"))
+        ("m,msg-size", "Message size (ping-pong, in bytes)", cxxopts::value<int>()->default_value("16"))
+        ("g,gap", "Gap between messages (ping-pong, in us)", cxxopts::value<int>()->default_value("0"))
+        ("histogram", "Export round-trip time histogram to CSV file (ping-pong)", cxxopts::value<std::string>())
+        ("low-latency", "Event-driven reads and low-latency mode of serial driver (not with uring)")
+        ("pin-cpu", "Pin test threads to the CPU and use real-time scheduling (SCHED_FIFO)", cxxopts::value<int>())
+        ("rt-priority", "Real-time priority with --pin-cpu (1 .. 99)", cxxopts::value<int>()->default_value("50"))
+        ("virtual", "Test a virtual adapter (pty pair) instead of tx-port")
+        ("virtual-fifo", "FIFO size of virtual adapter (in bytes)", cxxopts::value<int>()->default_value("512"))
+        ("virtual-drop", "Probability that the virtual adapter drops a byte", cxxopts::value<double>()->default_value("0"))
+        ("virtual-corrupt", "Probability that the virtual adapter corrupts a byte", cxxopts::value<double>()->default_value("0"))
+        ("soak", "Soak test: resynchronize after lost or corrupted data and report error rates")
+        ("sweep", "Test all combinations of the listed bit rates, data bits, chunk sizes etc.")
+        ("sweep-parity", "Test without and with parity bit (sweep)")
+        ("repeat", "Number of runs per configuration (sweep, soak)", cxxopts::value<int>()->default_value("1"))
+        ("format", "Output format: csv or json (sweep)", cxxopts::value<std::string>()->default_value("csv"))
+        ("output", "Output file (sweep, default: standard output)", cxxopts::value<std::string>())
         ("h,help", "Show usage");
     options.positional_help("tx-port [ rx-port ]").show_positional_help();
 
@@ -167,31 +242,112 @@ int check_usage(int argc, char* argv[]) {
         options.parse_positional({ "tx-port", "rx-port" });
         auto result = options.parse(argc, argv);
 
-        if (result.count("tx-port") == 0)
+        is_virtual = result.count("virtual") > 0;
+        if (result.count("tx-port") == 0 && !is_virtual)
             throw cxxopts::OptionParseException("'tx-port' not specified");
+        if (result.count("tx-port") > 0 && is_virtual)
+            throw cxxopts::OptionParseException("'tx-port' cannot be combined with --virtual");
+        virtual_config.fifo_size = std::min(std::max(result["virtual-fifo"].as<int>(), 1), 1048576);
+        virtual_config.drop_rate = result["virtual-drop"].as<double>();
+        virtual_config.corrupt_rate = result["virtual-corrupt"].as<double>();
+        virtual_config.seed = PRNG_INIT;
 
         if (result.count("help") != 0) {
             std::cout << options.help() << std::endl;
             return 2;
         }
 
-        bit_rate = result["bitrate"].as<int>();
-        bit_rate = std::min(std::max(bit_rate, 1200), 99999999);
+        is_sweep = result.count("sweep") > 0;
+        is_soak = result.count("soak") > 0;
+        try {
+            bit_rate_values = parse_int_list(result["bitrate"].as<std::string>());
+            data_bits_values = parse_int_list(result["databits"].as<std::string>());
+            chunk_size_values = parse_int_list(result["chunk-size"].as<std::string>());
+            if (result.count("read-size") > 0)
+                read_size_values = parse_int_list(result["read-size"].as<std::string>());
+            outstanding_values = parse_int_list(result["outstanding"].as<std::string>());
+        } catch (const std::invalid_argument& e) {
+            throw cxxopts::OptionParseException(e.what());
+        }
+        if (!is_sweep && (bit_rate_values.size() > 1 || data_bits_values.size() > 1
+                || chunk_size_values.size() > 1 || read_size_values.size() > 1 || outstanding_values.size() > 1))
+            throw cxxopts::OptionParseException("lists and ranges require --sweep");
+        for (int& v : bit_rate_values)
+            v = std::min(std::max(v, 1200), 99999999);
+        for (int& v : chunk_size_values)
+            v = std::min(std::max(v, 1), 1048576);
+
+        bit_rate = bit_rate_values[0];
         num_bytes = result["numbytes"].as<int>();
         num_bytes = std::min(std::max(num_bytes, 1), 1000000000);
-        data_bits = result["databits"].as<int>();
-        send_port_path = result["tx-port"].as<std::string>();
+        data_bits = data_bits_values[0];
+        chunk_size = chunk_size_values[0];
         rx_delay = result["rx-sleep"].as<int>();
-        max_outstanding_bytes = result["outstanding"].as<int>();
+        max_outstanding_bytes = outstanding_values[0];
+        engine = result["engine"].as<std::string>();
+        if (engine != "threads" && engine != "epoll" && engine != "uring")
+            throw cxxopts::OptionParseException("invalid engine '" + engine + "'");
+        if (read_size_values.empty())
+            read_size_values = { engine == "epoll" ? 4096 : engine == "uring" ? 1024 : 64 };
+        for (int& v : read_size_values)
+            v = std::min(std::max(v, 1), 1048576);
+        read_size = read_size_values[0];
+        num_iovecs = std::min(std::max(result["iov"].as<int>(), 1), 64);
+        if (num_iovecs > 1 && engine != "threads")
+            throw cxxopts::OptionParseException("--iov requires the threads engine");
+        is_low_latency = result.count("low-latency") > 0;
+        if (is_low_latency && engine == "uring")
+            throw cxxopts::OptionParseException("--low-latency is not supported with the uring engine");
+        pin_cpu = result.count("pin-cpu") > 0 ? result["pin-cpu"].as<int>() : -1;
+        rt_priority = std::min(std::max(result["rt-priority"].as<int>(), 1), 99);
+        is_pingpong = result.count("ping-pong") > 0;
+        if (is_soak && (is_sweep || is_pingpong))
+            throw cxxopts::OptionParseException("--soak cannot be combined with --sweep or --ping-pong");
+        if (is_soak && engine != "threads")
+            throw cxxopts::OptionParseException("--soak requires the threads engine");
+        num_messages = std::max(result["messages"].as<int>(), 0);
+        message_size = std::min(std::max(result["msg-size"].as<int>(), 1), 65536);
+        message_gap = std::max(result["gap"].as<int>(), 0);
+        if (result.count("histogram") > 0)
+            histogram_path = result["histogram"].as<std::string>();
         with_parity = result.count("parity") > 0;
+        if (result.count("sweep-parity") > 0)
+            parity_values = { false, true };
+        else
+            parity_values = { with_parity };
+        num_repeats = std::max(result["repeat"].as<int>(), 1);
+        std::string format = result["format"].as<std::string>();
+        if (format == "csv")
+            output_format = result_format::csv;
+        else if (format == "json")
+            output_format = result_format::json;
+        else
+            throw cxxopts::OptionParseException("invalid format '" + format + "'");
+        if (result.count("output") > 0)
+            output_path = result["output"].as<std::string>();
         if (with_parity)
             data_bits = std::min(std::max(data_bits, 7), 8);
         else
             data_bits = 8;
-        if (result.count("rx-port") > 0)
-            recv_port_path = result["rx-port"].as<std::string>();
-        else
-            recv_port_path = send_port_path;
+        if (!is_virtual) {
+            std::string send_port_path = result["tx-port"].as<std::string>();
+            std::string recv_port_path = send_port_path;
+            if (result.count("rx-port") > 0)
+                recv_port_path = result["rx-port"].as<std::string>();
+            links.emplace_back(send_port_path, recv_port_path);
+        }
+
+        if (result.count("link") > 0) {
+            for (auto& spec : result["link"].as<std::vector<std::string>>()) {
+                size_t sep = spec.find(':');
+                if (sep == std::string::npos)
+                    links.emplace_back(spec, spec);
+                else
+                    links.emplace_back(spec.substr(0, sep), spec.substr(sep + 1));
+            }
+        }
+        if (links.size() + (is_virtual ? 1 : 0) > 1 && (is_sweep || is_pingpong))
+            throw cxxopts::OptionParseException("multiple links are not supported with --sweep and --ping-pong");
 
     }
     catch (const cxxopts::OptionException& e) {
@@ -204,119 +360,290 @@ int check_usage(int argc, char* argv[]) {
 }
 
 
-void send() {
-    prng prandom(PRNG_INIT);
-    uint8_t buf[64];
+bool run_throughput_test(std::vector<loopback_result>& results) {
+    loopback_params params = { num_bytes, data_bits, max_outstanding_bytes, chunk_size, read_size, num_iovecs, rx_delay, PRNG_INIT, is_soak };
+
+    if (engine == "epoll") {
+        // single thread for all links
+        results = run_epoll_engine(params, links);
+
+    } else {
+        // separate threads for each link
+        results.assign(links.size(), { false, 0 });
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < links.size(); i++) {
+            threads.emplace_back([&params, &results, i] {
+                try {
+                    results[i] = engine == "uring"
+                        ? run_uring_engine(params, links[i])
+                        : run_threads_engine(params, links[i]);
+                } catch (serial_error& error) {
+                    std::cerr << links[i].name() << ": " << error.what() << std::endl;
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
 
-    try {
+    test_cancelled = false;
+    for (auto& result : results)
+        test_cancelled = test_cancelled || !result.is_successful;
+    return !test_cancelled;
+}
 
-        int n = num_bytes;
-        while (n > 0 && !test_cancelled) {
-            int m = std::min((int)sizeof(buf), n);
-            prandom.fill(buf, m);
-            if (data_bits == 7)
-                clear_high_bit(buf, m);
-            
-            // wait until outstanding data is low enough to send next chunk
-            {
-                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
-                outstanding_data_condition.wait(lock, []{
-                    return outstanding_bytes + sizeof(buf) <= max_outstanding_bytes
-                        || test_cancelled;
-                });
-                if (test_cancelled)
-                    return;
-            }
-            
-            send_port.transmit(buf, m);
-            n -= m;
-            
-            // update outstanding data
-            {
-                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
-                outstanding_bytes += m;
-            }
+
+void print_throughput_results(const std::vector<loopback_result>& results) {
+    double expected_net_rate = (double)bit_rate * data_bits / ((double)data_bits + (with_parity ? 1 : 0) + 2);
+
+    if (results.size() == 1) {
+        if (!results[0].is_successful)
+            return;
+        double duration = results[0].duration;
+        int br = (int)((double)num_bytes * data_bits / duration);
+        printf("Successfully sent %d bytes in %.1fs\n", num_bytes, duration);
+        printf("Gross bit rate: %d bps\n", bit_rate);
+        printf("Net bit rate:   %d bps\n", br);
+        printf("Overhead: %.1f%%\n", expected_net_rate * 100.0 / br - 100);
+        return;
+    }
+
+    // per link and aggregate results
+    int num_successful = 0;
+    double max_duration = 0;
+    printf("Gross bit rate: %d bps per link\n", bit_rate);
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].is_successful) {
+            double duration = results[i].duration;
+            int br = (int)((double)num_bytes * data_bits / duration);
+            printf("%-40s %8.1fs %10d bps  overhead %.1f%%\n", links[i].name().c_str(), duration, br, expected_net_rate * 100.0 / br - 100);
+            num_successful += 1;
+            max_duration = std::max(max_duration, duration);
+        } else {
+            printf("%-40s failed\n", links[i].name().c_str());
         }
     }
-    catch (serial_error& error) {
-        std::cerr << error.what() << std::endl;
-        test_cancelled = true;
+
+    if (num_successful > 0) {
+        int br = (int)((double)num_bytes * num_successful * data_bits / max_duration);
+        printf("Aggregate net bit rate of %d links: %d bps\n", num_successful, br);
     }
 }
 
 
-void recv() {
-    uint8_t buf[64];
-    uint8_t expected[64];
-    prng prandom(PRNG_INIT);
-
-    try {
-
-        int n = 0;
-        while (n < num_bytes && !test_cancelled) {
-            int k = recv_port.receive(buf, sizeof(buf));
-            if (k == 0) {
-                std::cerr << "No more data from " << recv_port_path << " after " << n << " bytes" << std::endl;
-                test_cancelled = true;
-                return;
-            }
-            
-            // update outstanding data and notify sender
-            {
-                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
-                outstanding_bytes -= k;
-            }
-            outstanding_data_condition.notify_one();
-
-            prandom.fill(expected, k);
-            if (data_bits == 7)
-                clear_high_bit(expected, k);
-            if (memcmp(buf, expected, k) != 0) {
-                std::cerr << "Invalid data at pos " << n << std::endl;
-                hex_dump("Expected: ", expected, k);
-                hex_dump("Received: ", buf, k);
-                test_cancelled = true;
-                return;
+int run_sweep() {
+    std::ofstream file;
+    if (!output_path.empty()) {
+        file.open(output_path);
+        if (!file)
+            throw serial_error("Failed to open output file", errno);
+    }
+    result_writer writer(output_path.empty() ? std::cout : file, output_format);
+
+    int num_failed = 0;
+    for (int br : bit_rate_values) {
+        for (bool parity : parity_values) {
+            for (size_t db_index = 0; db_index < data_bits_values.size(); db_index++) {
+                // without parity, only 8 data bits are supported
+                if (!parity && db_index > 0)
+                    continue;
+                int db = parity ? std::min(std::max(data_bits_values[db_index], 7), 8) : 8;
+
+                for (int cs : chunk_size_values) {
+                    for (int rs : read_size_values) {
+                        for (int outstanding : outstanding_values) {
+                            for (int run = 0; run < num_repeats; run++) {
+                                bit_rate = br;
+                                with_parity = parity;
+                                data_bits = db;
+                                chunk_size = cs;
+                                read_size = rs;
+                                max_outstanding_bytes = outstanding;
+
+                                std::cerr << "Bit rate " << br << ", " << db << (parity ? " data bits with parity" : " data bits")
+                                    << ", chunk size " << cs << ", read size " << rs << ", outstanding " << outstanding << ", run " << run << std::endl;
+
+                                result_row row{};
+                                row.bit_rate = br;
+                                row.data_bits = db;
+                                row.with_parity = parity;
+                                row.chunk_size = cs;
+                                row.read_size = rs;
+                                row.num_iovecs = num_iovecs;
+                                row.max_outstanding_bytes = outstanding;
+                                row.run = run;
+                                row.num_bytes = num_bytes;
+                                try {
+                                    open_ports();
+
+                                    std::vector<loopback_result> results;
+                                    if (run_throughput_test(results)) {
+                                        double expected_net_rate = (double)br * db / ((double)db + (parity ? 1 : 0) + 2);
+                                        double duration = results[0].duration;
+                                        row.duration = duration;
+                                        row.net_bit_rate = (double)num_bytes * db / duration;
+                                        row.overhead = expected_net_rate * 100.0 / row.net_bit_rate - 100;
+                                    } else {
+                                        row.errors += 1;
+                                    }
+
+                                    if (num_messages > 0) {
+                                        links[0].recv_port.drain();
+                                        pingpong_params params = { num_messages, message_size, message_gap, db, PRNG_INIT };
+                                        histogram rtt;
+                                        histogram host_time;
+                                        if (!run_pingpong(params, links[0].send_port, links[0].recv_port, rtt, host_time))
+                                            row.errors += 1;
+                                        row.rtt_count = (int)rtt.count();
+                                        row.rtt_p50 = rtt.value_at_percentile(50) / 1000.0;
+                                        row.rtt_p90 = rtt.value_at_percentile(90) / 1000.0;
+                                        row.rtt_p99 = rtt.value_at_percentile(99) / 1000.0;
+                                        row.rtt_p999 = rtt.value_at_percentile(99.9) / 1000.0;
+                                        row.rtt_max = rtt.max() / 1000.0;
+                                    }
+
+                                    close_ports();
+                                }
+                                catch (serial_error& error) {
+                                    std::cerr << error.what() << std::endl;
+                                    row.errors += 1;
+                                    links[0].close(false);
+                                }
+
+                                if (row.errors > 0)
+                                    num_failed += 1;
+                                writer.write(row);
+                            }
+                        }
+                    }
+                }
             }
-            n += k;
         }
-
     }
-    catch (serial_error& error) {
-        std::cerr << error.what() << std::endl;
-        test_cancelled = true;
-        outstanding_data_condition.notify_one();
+
+    writer.finish();
+    return num_failed > 0 ? 3 : 0;
+}
+
+
+void run_pingpong_test() {
+    pingpong_params params = { num_messages, message_size, message_gap, data_bits, PRNG_INIT };
+    histogram rtt;
+    histogram host_time;
+    test_cancelled = !run_pingpong(params, links[0].send_port, links[0].recv_port, rtt, host_time);
+
+    printf("Sent %d messages of %d bytes\n", (int)rtt.count(), message_size);
+    if (rtt.count() == 0)
+        return;
+
+    printf("Round-trip time:\n");
+    for (double percentile : { 50.0, 90.0, 99.0, 99.9 })
+        printf("  p%-5g %10.1f us\n", percentile, rtt.value_at_percentile(percentile) / 1000.0);
+    printf("  max    %10.1f us\n", rtt.max() / 1000.0);
+
+    // latency breakdown (median): time on the wire, on the host and the rest
+    double rtt_us = rtt.value_at_percentile(50) / 1000.0;
+    double wire_us = (double)message_size * (data_bits + (with_parity ? 1 : 0) + 2) * 1e6 / bit_rate;
+    double host_us = host_time.value_at_percentile(50) / 1000.0;
+    double other_us = std::max(rtt_us - wire_us - host_us, 0.0);
+    printf("Latency breakdown (median):\n");
+    printf("  wire   %10.1f us  %5.1f%%\n", wire_us, wire_us * 100 / rtt_us);
+    printf("  host   %10.1f us  %5.1f%%  (write and read calls)\n", host_us, host_us * 100 / rtt_us);
+    printf("  other  %10.1f us  %5.1f%%  (USB, device, wake-up)\n", other_us, other_us * 100 / rtt_us);
+
+    if (!histogram_path.empty()) {
+        std::ofstream file(histogram_path);
+        rtt.write_csv(file);
+        if (!file)
+            throw serial_error("Failed to write histogram");
     }
 }
 
 
-int open_ports() {
-    send_port.open(send_port_path.c_str(), bit_rate, data_bits, with_parity);
+int run_soak_test() {
+    std::vector<soak_stats> totals(links.size(), soak_stats());
+    int num_runs = 0;
+
+    for (int run = 0; run < num_repeats && !test_cancelled; run++) {
+        if (num_repeats > 1)
+            std::cerr << "Run " << run << std::endl;
 
-    if (send_port_path == recv_port_path) {
-        recv_port = send_port;
+        open_ports();
+        std::vector<loopback_result> results;
+        run_throughput_test(results);
+        close_ports();
 
+        for (size_t i = 0; i < links.size(); i++)
+            totals[i].add(results[i].soak);
+        num_runs += 1;
     }
-    else {
-        recv_port.open(recv_port_path.c_str(), bit_rate, data_bits, with_parity);
+
+    bool has_errors = false;
+    printf("Soak test: %d run%s of %d bytes\n", num_runs, num_runs == 1 ? "" : "s", num_bytes);
+    for (size_t i = 0; i < links.size(); i++) {
+        const soak_stats& stats = totals[i];
+        double gb = stats.num_bytes / 1e9;
+        printf("%s: %llu bytes checked, %llu error events\n", links[i].name().c_str(),
+            (unsigned long long)stats.num_bytes, (unsigned long long)stats.num_events);
+        printf("  Lost:      %12llu bytes  %12.1f per GB\n", (unsigned long long)stats.num_lost, gb > 0 ? stats.num_lost / gb : 0.0);
+        printf("  Inserted:  %12llu bytes  %12.1f per GB\n", (unsigned long long)stats.num_inserted, gb > 0 ? stats.num_inserted / gb : 0.0);
+        printf("  Corrupted: %12llu bytes  %12.1f per GB\n", (unsigned long long)stats.num_corrupted, gb > 0 ? stats.num_corrupted / gb : 0.0);
+        printf("  Events:    %12llu        %12.1f per GB\n", (unsigned long long)stats.num_events, gb > 0 ? stats.num_events / gb : 0.0);
+        has_errors = has_errors || stats.num_events > 0;
     }
 
-    recv_port.drain();
+    return test_cancelled || has_errors ? 3 : 0;
+}
+
+
+void configure_scheduling() {
+    if (pin_cpu < 0)
+        return;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(pin_cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        std::cerr << "Warning: failed to pin test to CPU " << pin_cpu << ": " << strerror(errno) << std::endl;
+
+    struct sched_param param = { 0 };
+    param.sched_priority = rt_priority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+        std::cerr << "Warning: failed to set real-time priority: " << strerror(errno) << std::endl;
+}
+
+
+int open_ports() {
+    for (auto& link : links)
+        link.open(bit_rate, data_bits, with_parity, is_low_latency);
     return 0;
 }
 
 
 void close_ports() {
-    recv_port.drain();
-    send_port.close();
-    if (recv_port_path != send_port_path)
-        recv_port.close();
+    for (auto& link : links)
+        link.close();
 }
 
 
-void clear_high_bit(uint8_t* buf, size_t buf_len) {
-    for (int i = 0; i < buf_len; i++)
-        buf[i] &= 0x7f;
+uint8_t data_mask(int data_bits) {
+    return data_bits == 7 ? 0x7f : 0xff;
+}
+
+
+bool verify_received_data(prng& prandom, const uint8_t* buf, size_t len, int data_bits, const std::string& recv_path) {
+    uint64_t start = prandom.position();
+    int mismatch = prandom.verify(buf, len, data_mask(data_bits));
+    if (mismatch < 0)
+        return true;
+
+    std::vector<uint8_t> expected(len);
+    prandom.seek(start);
+    prandom.fill(expected.data(), len, data_mask(data_bits));
+    std::cerr << "Invalid data from " << recv_path << " at pos " << start + mismatch << std::endl;
+    hex_dump("Expected: ", expected.data(), len);
+    hex_dump("Received: ", buf, len);
+    return false;
 }
 
 
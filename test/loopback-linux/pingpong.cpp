@@ -0,0 +1,71 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Ping-pong test measuring the round-trip time of individual messages.
+//
+
+#include "pingpong.hpp"
+#include "engine.hpp"
+#include "prng.hpp"
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+// Time without received data after which the message is considered lost
+static constexpr int RX_TIMEOUT_MS = 100;
+
+
+bool run_pingpong(const pingpong_params& params, serial_port& send_port, serial_port& recv_port, histogram& rtt, histogram& host_time) {
+    prng prandom(params.prng_init);
+    std::vector<uint8_t> message(params.message_size);
+    std::vector<uint8_t> response(params.message_size);
+
+    for (int i = 0; i < params.num_messages; i++) {
+        prandom.fill(message.data(), params.message_size, data_mask(params.data_bits));
+
+        auto start_time = steady_clock::now();
+        send_port.transmit(message.data(), params.message_size);
+        auto host_duration = steady_clock::now() - start_time;
+
+        int n = 0;
+        while (n < params.message_size) {
+            int k = 0;
+            if (recv_port.wait_readable(RX_TIMEOUT_MS)) {
+                auto read_time = steady_clock::now();
+                k = recv_port.receive(response.data() + n, params.message_size - n);
+                host_duration += steady_clock::now() - read_time;
+            }
+            if (k == 0) {
+                std::cerr << "No response to message " << i << " after " << n << " bytes" << std::endl;
+                return false;
+            }
+            n += k;
+        }
+
+        auto end_time = steady_clock::now();
+        rtt.record(duration_cast<nanoseconds>(end_time - start_time).count());
+        host_time.record(duration_cast<nanoseconds>(host_duration).count());
+
+        if (memcmp(message.data(), response.data(), params.message_size) != 0) {
+            std::cerr << "Invalid data in message " << i << std::endl;
+            hex_dump("Expected: ", message.data(), params.message_size);
+            hex_dump("Received: ", response.data(), params.message_size);
+            return false;
+        }
+
+        if (params.gap > 0)
+            std::this_thread::sleep_for(microseconds(params.gap));
+    }
+
+    return true;
+}
@@ -0,0 +1,52 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Ping-pong test measuring the round-trip time of individual messages.
+//
+
+#pragma once
+
+#include "histogram.hpp"
+#include "serial.hpp"
+#include <stdint.h>
+
+/**
+ * Parameters of the ping-pong test
+ */
+struct pingpong_params {
+    /// Number of messages
+    int num_messages;
+    /// Message size (in bytes)
+    int message_size;
+    /// Gap between receiving a message and sending the next one (in µs)
+    int gap;
+    /// Data bits (7 or 8)
+    int data_bits;
+    /// Initial value of pseudo random number generator
+    uint32_t prng_init;
+};
+
+/**
+ * Runs the ping-pong test.
+ *
+ * Each message is sent and completely received before the next one is sent.
+ * The round-trip times (in ns) are recorded in the histogram.
+ *
+ * Additionally, the time spent on the host (in ns) is recorded for each message:
+ * the time spent in the write call and in the read calls once data is available.
+ * It excludes the time waiting for data.
+ *
+ * @param params test parameters
+ * @param send_port serial port for transmission
+ * @param recv_port serial port for reception (can be the same as `send_port`)
+ * @param rtt histogram receiving the round-trip times
+ * @param host_time histogram receiving the time spent on the host
+ * @return `true` if all messages have been received and verified
+ */
+bool run_pingpong(const pingpong_params& params, serial_port& send_port, serial_port& recv_port, histogram& rtt, histogram& host_time);
@@ -9,43 +9,251 @@
 //
 
 #include "prng.hpp"
+#include <string.h>
 
-prng::prng(uint32_t init) : state(init), nbytes(0), bits(0) { }
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRNG_HAS_X86_KERNELS 1
+#endif
 
+static constexpr uint32_t WEYL_INCREMENT = 0x9e3779b9;
+static constexpr uint32_t HASH_MUL1 = 0x7feb352d;
+static constexpr uint32_t HASH_MUL2 = 0x846ca68b;
 
-uint32_t prng::next() {
-    uint32_t x = state;
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    state = x;
+// Generates `num_words` words starting at word `index` and stores them
+// (masked, little endian) in `buf`
+typedef void (*fill_kernel)(uint32_t seed, uint32_t index, uint8_t* buf, size_t num_words, uint8_t mask);
+// Compares `num_words` words starting at word `index` with `buf` (after masking
+// the generated data). Returns the offset of the first mismatching byte,
+// or `num_words * 4` if all bytes match.
+typedef size_t (*verify_kernel)(uint32_t seed, uint32_t index, const uint8_t* buf, size_t num_words, uint8_t mask);
+
+
+static inline uint32_t hash_word(uint32_t seed, uint32_t index) {
+    // Weyl sequence followed by an integer hash (lowbias32)
+    uint32_t x = seed + index * WEYL_INCREMENT;
+    x ^= x >> 16;
+    x *= HASH_MUL1;
+    x ^= x >> 15;
+    x *= HASH_MUL2;
+    x ^= x >> 16;
     return x;
 }
 
+static inline uint32_t mask_word(uint8_t mask) {
+    return mask * 0x01010101U;
+}
 
-void prng::fill(uint8_t* buf, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        if (nbytes == 0) {
-            bits = next();
-            nbytes = 4;
-        }
-        buf[i] = bits;
-        bits >>= 8;
-        nbytes--;
+
+// --- scalar kernels
+
+static void fill_scalar(uint32_t seed, uint32_t index, uint8_t* buf, size_t num_words, uint8_t mask) {
+    uint32_t m = mask_word(mask);
+    for (size_t i = 0; i < num_words; i++) {
+        uint32_t bits = hash_word(seed, index + (uint32_t)i) & m;
+        buf[0] = bits;
+        buf[1] = bits >> 8;
+        buf[2] = bits >> 16;
+        buf[3] = bits >> 24;
+        buf += 4;
+    }
+}
+
+static size_t verify_scalar(uint32_t seed, uint32_t index, const uint8_t* buf, size_t num_words, uint8_t mask) {
+    uint32_t m = mask_word(mask);
+    for (size_t i = 0; i < num_words; i++) {
+        uint32_t bits = hash_word(seed, index + (uint32_t)i) & m;
+        const uint8_t* p = buf + 4 * i;
+        uint32_t received = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        uint32_t diff = bits ^ received;
+        if (diff != 0)
+            return 4 * i + __builtin_ctz(diff) / 8;
+    }
+    return 4 * num_words;
+}
+
+
+#if PRNG_HAS_X86_KERNELS
+
+// --- SSE4.1 kernels (4 words per iteration)
+
+__attribute__((target("sse4.1")))
+static inline __m128i hash_sse41(__m128i x) {
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = _mm_mullo_epi32(x, _mm_set1_epi32(HASH_MUL1));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = _mm_mullo_epi32(x, _mm_set1_epi32(HASH_MUL2));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i weyl_sse41(uint32_t seed, uint32_t index) {
+    __m128i idx = _mm_add_epi32(_mm_set1_epi32(index), _mm_setr_epi32(0, 1, 2, 3));
+    return _mm_add_epi32(_mm_set1_epi32(seed), _mm_mullo_epi32(idx, _mm_set1_epi32(WEYL_INCREMENT)));
+}
+
+__attribute__((target("sse4.1")))
+static void fill_sse41(uint32_t seed, uint32_t index, uint8_t* buf, size_t num_words, uint8_t mask) {
+    __m128i m = _mm_set1_epi8(mask);
+    size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+        __m128i x = _mm_and_si128(hash_sse41(weyl_sse41(seed, index + (uint32_t)i)), m);
+        _mm_storeu_si128((__m128i*)(buf + 4 * i), x);
+    }
+    fill_scalar(seed, index + (uint32_t)i, buf + 4 * i, num_words - i, mask);
+}
+
+__attribute__((target("sse4.1")))
+static size_t verify_sse41(uint32_t seed, uint32_t index, const uint8_t* buf, size_t num_words, uint8_t mask) {
+    __m128i m = _mm_set1_epi8(mask);
+    size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+        __m128i expected = _mm_and_si128(hash_sse41(weyl_sse41(seed, index + (uint32_t)i)), m);
+        __m128i received = _mm_loadu_si128((const __m128i*)(buf + 4 * i));
+        unsigned eq = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(expected, received));
+        if (eq != 0xffff)
+            return 4 * i + __builtin_ctz(~eq);
+    }
+    return 4 * i + verify_scalar(seed, index + (uint32_t)i, buf + 4 * i, num_words - i, mask);
+}
+
+
+// --- AVX2 kernels (8 words per iteration)
+
+__attribute__((target("avx2")))
+static inline __m256i hash_avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(HASH_MUL1));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(HASH_MUL2));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i weyl_avx2(uint32_t seed, uint32_t index) {
+    __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(index), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    return _mm256_add_epi32(_mm256_set1_epi32(seed), _mm256_mullo_epi32(idx, _mm256_set1_epi32(WEYL_INCREMENT)));
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint32_t seed, uint32_t index, uint8_t* buf, size_t num_words, uint8_t mask) {
+    __m256i m = _mm256_set1_epi8(mask);
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+        __m256i x = _mm256_and_si256(hash_avx2(weyl_avx2(seed, index + (uint32_t)i)), m);
+        _mm256_storeu_si256((__m256i*)(buf + 4 * i), x);
+    }
+    fill_scalar(seed, index + (uint32_t)i, buf + 4 * i, num_words - i, mask);
+}
+
+__attribute__((target("avx2")))
+static size_t verify_avx2(uint32_t seed, uint32_t index, const uint8_t* buf, size_t num_words, uint8_t mask) {
+    __m256i m = _mm256_set1_epi8(mask);
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+        __m256i expected = _mm256_and_si256(hash_avx2(weyl_avx2(seed, index + (uint32_t)i)), m);
+        __m256i received = _mm256_loadu_si256((const __m256i*)(buf + 4 * i));
+        unsigned eq = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(expected, received));
+        if (eq != 0xffffffff)
+            return 4 * i + __builtin_ctz(~eq);
+    }
+    return 4 * i + verify_scalar(seed, index + (uint32_t)i, buf + 4 * i, num_words - i, mask);
+}
+
+#endif
+
+
+// --- kernel selection
+
+struct prng_kernels {
+    fill_kernel fill;
+    verify_kernel verify;
+};
+
+static prng_kernels select_kernels() {
+#if PRNG_HAS_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { fill_avx2, verify_avx2 };
+    if (__builtin_cpu_supports("sse4.1"))
+        return { fill_sse41, verify_sse41 };
+#endif
+    return { fill_scalar, verify_scalar };
+}
+
+static const prng_kernels kernels = select_kernels();
+
+
+// --- prng
+
+prng::prng(uint32_t init) : seed(init), pos(0) { }
+
+
+uint32_t prng::word(uint64_t index) const {
+    return hash_word(seed, (uint32_t)index);
+}
+
+
+uint8_t prng::byte_at(uint64_t pos) const {
+    return (uint8_t)(word(pos / 4) >> (8 * (pos % 4)));
+}
+
+
+void prng::fill(uint8_t* buf, size_t len, uint8_t mask) {
+    size_t i = 0;
+
+    // unaligned start
+    while (i < len && pos % 4 != 0) {
+        buf[i] = byte_at(pos) & mask;
+        i++;
+        pos++;
+    }
+
+    // full words
+    size_t num_words = (len - i) / 4;
+    kernels.fill(seed, (uint32_t)(pos / 4), buf + i, num_words, mask);
+    i += 4 * num_words;
+    pos += 4 * num_words;
+
+    // remaining bytes
+    for (; i < len; i++) {
+        buf[i] = byte_at(pos) & mask;
+        pos++;
     }
 }
 
 
-int prng::verify(const uint8_t* buf, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        if (nbytes == 0) {
-            bits = next();
-            nbytes = 4;
+int prng::verify(const uint8_t* buf, size_t len, uint8_t mask) {
+    size_t i = 0;
+
+    // unaligned start
+    while (i < len && (pos + i) % 4 != 0) {
+        if (buf[i] != (byte_at(pos + i) & mask)) {
+            pos += i;
+            return (int)i;
         }
-        if (buf[i] != (uint8_t)bits)
+        i++;
+    }
+
+    // full words
+    size_t num_words = (len - i) / 4;
+    size_t offset = kernels.verify(seed, (uint32_t)((pos + i) / 4), buf + i, num_words, mask);
+    if (offset < 4 * num_words) {
+        pos += i + offset;
+        return (int)(i + offset);
+    }
+    i += 4 * num_words;
+
+    // remaining bytes
+    for (; i < len; i++) {
+        if (buf[i] != (byte_at(pos + i) & mask)) {
+            pos += i;
             return (int)i;
-        bits >>= 8;
-        nbytes--;
+        }
     }
+
+    pos += len;
     return -1;
 }
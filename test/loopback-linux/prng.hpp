@@ -15,6 +15,14 @@
 
 /**
  * Pseudo Random Number Generator
+ *
+ * Counter-based generator: the 32-bit word with index `i` is a hash of `i`
+ * and the initial value. Byte `n` of the stream is byte `n % 4` (little endian)
+ * of word `n / 4`. So any position of the stream can be computed directly.
+ * The stream repeats after 16 GiB.
+ *
+ * Filling and verifying use SIMD kernels (AVX2 or SSE4.1, selected at
+ * runtime) generating several words per instruction, with a scalar fallback.
  */
 struct prng {
     /**
@@ -23,27 +31,51 @@ struct prng {
      */
     prng(uint32_t init);
     /**
-     * Returns the next pseudo random value
+     * Returns the pseudo random word with the specified index
+     * @param index word index
      * @return pseudo random value
      */
-    uint32_t next();
+    uint32_t word(uint64_t index) const;
+    /**
+     * Returns the pseudo random byte at the specified position
+     * @param pos byte position
+     * @return pseudo random byte
+     */
+    uint8_t byte_at(uint64_t pos) const;
     /**
      * Fills the buffer with pseudo random data
      * @param buf buffer receiving the random data
      * @param len length of the buffer (in bytes)
+     * @param mask mask applied to each byte (e.g. 0x7f for 7 data bits)
      */
-    void fill(uint8_t* buf, size_t len);
-    
+    void fill(uint8_t* buf, size_t len, uint8_t mask = 0xff);
+
     /**
      * Verifies that the specified bytes match the random data generated by this instance.
-     * @param buf buffer receiving the random data
+     *
+     * If the data matches, the position is advanced by `len`. Otherwise,
+     * it is advanced to the first mismatching byte.
+     *
+     * @param buf buffer with the received data
      * @param len length of the buffer (in bytes)
-     * @return -1 if the data matches, the position of the mismatch otherwise
+     * @param mask mask applied to each generated byte before comparing (e.g. 0x7f for 7 data bits)
+     * @return -1 if the data matches, the offset of the first mismatch otherwise
+     */
+    int verify(const uint8_t* buf, size_t len, uint8_t mask = 0xff);
+
+    /**
+     * Sets the position of the next byte returned by `fill()` and checked by `verify()`
+     * @param pos byte position
+     */
+    void seek(uint64_t pos) { this->pos = pos; }
+
+    /**
+     * Returns the position of the next byte returned by `fill()` and checked by `verify()`
+     * @return byte position
      */
-    int verify(const uint8_t* buf, size_t len);
+    uint64_t position() const { return pos; }
 
 private:
-    uint32_t state;
-    int nbytes;
-    uint32_t bits;
+    uint32_t seed;
+    uint64_t pos;
 };
@@ -0,0 +1,261 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Machine-readable test results (CSV or JSON).
+//
+
+#include "results.hpp"
+#include <ctype.h>
+#include <iterator>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Column names (in CSV column order, also used as JSON keys)
+static const char* const COLUMNS[] = {
+    "bitrate", "databits", "parity", "chunk_size", "read_size", "iovecs", "outstanding", "run", "bytes", "errors",
+    "duration", "net_bitrate", "overhead",
+    "rtt_count", "rtt_p50_us", "rtt_p90_us", "rtt_p99_us", "rtt_p999_us", "rtt_max_us"
+};
+static constexpr int NUM_COLUMNS = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+
+result_writer::result_writer(std::ostream& os, result_format format)
+: os(os), format(format), num_rows(0) {
+
+    if (format == result_format::csv) {
+        for (int i = 0; i < NUM_COLUMNS; i++)
+            os << (i > 0 ? "," : "") << COLUMNS[i];
+        os << std::endl;
+    } else {
+        os << "[";
+    }
+}
+
+void result_writer::write(const result_row& row) {
+    char values[NUM_COLUMNS][32];
+    snprintf(values[0], sizeof(values[0]), "%d", row.bit_rate);
+    snprintf(values[1], sizeof(values[1]), "%d", row.data_bits);
+    snprintf(values[2], sizeof(values[2]), "%d", row.with_parity ? 1 : 0);
+    snprintf(values[3], sizeof(values[3]), "%d", row.chunk_size);
+    snprintf(values[4], sizeof(values[4]), "%d", row.read_size);
+    snprintf(values[5], sizeof(values[5]), "%d", row.num_iovecs);
+    snprintf(values[6], sizeof(values[6]), "%d", row.max_outstanding_bytes);
+    snprintf(values[7], sizeof(values[7]), "%d", row.run);
+    snprintf(values[8], sizeof(values[8]), "%d", row.num_bytes);
+    snprintf(values[9], sizeof(values[9]), "%d", row.errors);
+    snprintf(values[10], sizeof(values[10]), "%.6f", row.duration);
+    snprintf(values[11], sizeof(values[11]), "%.0f", row.net_bit_rate);
+    snprintf(values[12], sizeof(values[12]), "%.2f", row.overhead);
+    snprintf(values[13], sizeof(values[13]), "%d", row.rtt_count);
+    snprintf(values[14], sizeof(values[14]), "%.1f", row.rtt_p50);
+    snprintf(values[15], sizeof(values[15]), "%.1f", row.rtt_p90);
+    snprintf(values[16], sizeof(values[16]), "%.1f", row.rtt_p99);
+    snprintf(values[17], sizeof(values[17]), "%.1f", row.rtt_p999);
+    snprintf(values[18], sizeof(values[18]), "%.1f", row.rtt_max);
+
+    if (format == result_format::csv) {
+        for (int i = 0; i < NUM_COLUMNS; i++)
+            os << (i > 0 ? "," : "") << values[i];
+        os << std::endl;
+    } else {
+        os << (num_rows > 0 ? ",\n  {" : "\n  {");
+        for (int i = 0; i < NUM_COLUMNS; i++)
+            os << (i > 0 ? ", \"" : "\"") << COLUMNS[i] << "\": " << values[i];
+        os << "}" << std::flush;
+    }
+
+    num_rows += 1;
+}
+
+void result_writer::finish() {
+    if (format == result_format::json)
+        os << (num_rows > 0 ? "\n]" : "]") << std::endl;
+}
+
+
+// Sets the value of the column with the specified index
+static void set_value(result_row& row, int column, double value) {
+    switch (column) {
+    case 0: row.bit_rate = (int)value; break;
+    case 1: row.data_bits = (int)value; break;
+    case 2: row.with_parity = value != 0; break;
+    case 3: row.chunk_size = (int)value; break;
+    case 4: row.read_size = (int)value; break;
+    case 5: row.num_iovecs = (int)value; break;
+    case 6: row.max_outstanding_bytes = (int)value; break;
+    case 7: row.run = (int)value; break;
+    case 8: row.num_bytes = (int)value; break;
+    case 9: row.errors = (int)value; break;
+    case 10: row.duration = value; break;
+    case 11: row.net_bit_rate = value; break;
+    case 12: row.overhead = value; break;
+    case 13: row.rtt_count = (int)value; break;
+    case 14: row.rtt_p50 = value; break;
+    case 15: row.rtt_p90 = value; break;
+    case 16: row.rtt_p99 = value; break;
+    case 17: row.rtt_p999 = value; break;
+    case 18: row.rtt_max = value; break;
+    }
+}
+
+// Returns the column index for the name (-1 if unknown)
+static int column_index(const std::string& name) {
+    for (int i = 0; i < NUM_COLUMNS; i++) {
+        if (name == COLUMNS[i])
+            return i;
+    }
+    return -1;
+}
+
+static double parse_number(const std::string& text) {
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || *end != 0)
+        throw std::runtime_error("invalid number '" + text + "'");
+    return value;
+}
+
+static std::vector<result_row> read_csv(std::istream& is) {
+    std::vector<result_row> rows;
+    std::vector<int> columns;
+    std::string line;
+
+    while (std::getline(is, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+
+        std::vector<std::string> fields;
+        size_t pos = 0;
+        while (true) {
+            size_t end = line.find(',', pos);
+            fields.push_back(line.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+            if (end == std::string::npos)
+                break;
+            pos = end + 1;
+        }
+
+        if (columns.empty()) {
+            for (auto& field : fields)
+                columns.push_back(column_index(field));
+            continue;
+        }
+
+        if (fields.size() != columns.size())
+            throw std::runtime_error("invalid number of fields in line '" + line + "'");
+        result_row row{};
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (columns[i] >= 0)
+                set_value(row, columns[i], parse_number(fields[i]));
+        }
+        rows.push_back(row);
+    }
+
+    return rows;
+}
+
+// Minimal parser for the JSON output (array of objects with numeric values)
+static std::vector<result_row> read_json(std::istream& is) {
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    const char* p = text.c_str();
+
+    auto skip_space = [&p]() {
+        while (isspace((unsigned char)*p))
+            p++;
+    };
+    auto expect = [&p, &skip_space](char c) {
+        skip_space();
+        if (*p != c)
+            throw std::runtime_error(std::string("invalid JSON: expected '") + c + "'");
+        p++;
+    };
+    auto accept = [&p, &skip_space](char c) {
+        skip_space();
+        if (*p != c)
+            return false;
+        p++;
+        return true;
+    };
+
+    std::vector<result_row> rows;
+    expect('[');
+    if (accept(']'))
+        return rows;
+
+    do {
+        result_row row{};
+        expect('{');
+        if (!accept('}')) {
+            do {
+                expect('"');
+                const char* end = strchr(p, '"');
+                if (end == nullptr)
+                    throw std::runtime_error("invalid JSON: unterminated string");
+                std::string name(p, end);
+                p = end + 1;
+                expect(':');
+                skip_space();
+                char* num_end;
+                double value = strtod(p, &num_end);
+                if (num_end == p)
+                    throw std::runtime_error("invalid JSON: expected number for '" + name + "'");
+                p = num_end;
+                int column = column_index(name);
+                if (column >= 0)
+                    set_value(row, column, value);
+            } while (accept(','));
+            expect('}');
+        }
+        rows.push_back(row);
+    } while (accept(','));
+    expect(']');
+
+    return rows;
+}
+
+std::vector<result_row> read_results(std::istream& is) {
+    is >> std::ws;
+    if (is.peek() == '[')
+        return read_json(is);
+    return read_csv(is);
+}
+
+
+std::vector<int> parse_int_list(const std::string& spec) {
+    std::vector<int> values;
+
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string item = spec.substr(pos, end - pos);
+
+        int start, last, step = 1;
+        char tail;
+        if (sscanf(item.c_str(), "%d-%d:%d%c", &start, &last, &step, &tail) == 3
+                || sscanf(item.c_str(), "%d-%d%c", &start, &last, &tail) == 2) {
+            if (step <= 0 || last < start)
+                throw std::invalid_argument("invalid range '" + item + "'");
+            for (int v = start; v <= last; v += step)
+                values.push_back(v);
+        } else if (sscanf(item.c_str(), "%d%c", &start, &tail) == 1) {
+            values.push_back(start);
+        } else {
+            throw std::invalid_argument("invalid value '" + item + "'");
+        }
+
+        pos = end + 1;
+    }
+
+    return values;
+}
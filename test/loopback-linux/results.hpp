@@ -0,0 +1,118 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Machine-readable test results (CSV or JSON).
+//
+
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Result of a single test run of a sweep.
+ */
+struct result_row {
+    /// Bit rate (in bps)
+    int bit_rate;
+    /// Data bits (7 or 8)
+    int data_bits;
+    /// Parity bit enabled
+    bool with_parity;
+    /// Size of chunks written to the serial port (in bytes)
+    int chunk_size;
+    /// Size of reads from the serial port (in bytes)
+    int read_size;
+    /// Number of chunks per writev/readv call (1 for write/read)
+    int num_iovecs;
+    /// Maximum data outstanding in transit (in bytes)
+    int max_outstanding_bytes;
+    /// Repetition (0 for the first run of a configuration)
+    int run;
+    /// Number of bytes transmitted
+    int num_bytes;
+    /// Number of errors (failed tests)
+    int errors;
+    /// Duration of throughput test (in s)
+    double duration;
+    /// Net bit rate (in bps)
+    double net_bit_rate;
+    /// Overhead compared to the theoretical net bit rate (in %)
+    double overhead;
+    /// Number of round-trip time samples (0 if no latency test has been run)
+    int rtt_count;
+    /// Round-trip times (in µs): p50, p90, p99, p99.9 and max
+    double rtt_p50;
+    double rtt_p90;
+    double rtt_p99;
+    double rtt_p999;
+    double rtt_max;
+};
+
+/**
+ * Output format
+ */
+enum class result_format {
+    csv,
+    json
+};
+
+/**
+ * Writes result rows as CSV or JSON.
+ *
+ * The JSON output is an array with an object per row.
+ */
+class result_writer {
+public:
+    /**
+     * Creates a new writer.
+     * @param os output stream
+     * @param format output format
+     */
+    result_writer(std::ostream& os, result_format format);
+
+    /**
+     * Writes a result row.
+     * @param row result row
+     */
+    void write(const result_row& row);
+
+    /**
+     * Completes the output.
+     */
+    void finish();
+
+private:
+    std::ostream& os;
+    result_format format;
+    int num_rows;
+};
+
+/**
+ * Reads result rows written by `result_writer`.
+ *
+ * The format (CSV or JSON) is detected automatically. Missing columns are set to 0.
+ *
+ * @param is input stream
+ * @return result rows (throws `std::runtime_error` if the input is invalid)
+ */
+std::vector<result_row> read_results(std::istream& is);
+
+/**
+ * Parses a list of integer values.
+ *
+ * The list consists of comma-separated values or ranges. A range has the
+ * form `start-end` or `start-end:step` (default step 1), e.g. `8,16-64:16`.
+ *
+ * @param spec list specification
+ * @return values (throws `std::invalid_argument` if the specification is invalid)
+ */
+std::vector<int> parse_int_list(const std::string& spec);
@@ -12,13 +12,18 @@
 
 #include "serial.hpp"
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <string.h>
 #include <unistd.h>
 #include <asm-generic/termbits.h>
 #include <asm-generic/ioctls.h>
+#include <linux/serial.h>
 #include <sys/ioctl.h>
 
+// Timeout for reads in low-latency mode (same as VTIME in normal mode)
+static constexpr int RX_TIMEOUT_MS = 100;
+
 /**
  * Sets the specified bits in the specified flags value.
  * @param flags flags value
@@ -39,7 +44,7 @@ static inline void clear_bits(unsigned int& flags, unsigned int bits) {
 }
 
 
-serial_port::serial_port() : _fd(-1) { }
+serial_port::serial_port() : _fd(-1), _low_latency(false) { }
 
 void serial_port::open(const char* path, int bit_rate, int data_bits, bool with_parity) {
     int fd = ::open(path, O_RDWR | O_NOCTTY);
@@ -75,6 +80,7 @@ void serial_port::open(const char* path, int bit_rate, int data_bits, bool with_
     ioctl(fd, TCSETS2, &options);
     
     _fd = fd;
+    _low_latency = false;
 }
 
 void serial_port::close() {
@@ -97,23 +103,94 @@ void serial_port::transmit(const uint8_t* data, int data_len) {
         throw serial_error("Failed to transmit data");
 }
 
+void serial_port::transmit(const struct iovec* iov, int iov_count) {
+    size_t data_len = 0;
+    for (int i = 0; i < iov_count; i++)
+        data_len += iov[i].iov_len;
+
+    size_t res = ::writev(_fd, iov, iov_count);
+    if (res == -1)
+        throw serial_error("Failed to transmit data", errno);
+    if (res != data_len)
+        throw serial_error("Failed to transmit data");
+}
+
 int serial_port::receive(uint8_t* data, int data_len) {
+    if (_low_latency && !wait_readable(RX_TIMEOUT_MS))
+        return 0;
+
     size_t res = ::read(_fd, data, data_len);
     if (res == -1)
         throw serial_error("Failed to receive data", errno);
     return (int)res;
 }
 
+int serial_port::receive(const struct iovec* iov, int iov_count) {
+    if (_low_latency && !wait_readable(RX_TIMEOUT_MS))
+        return 0;
+
+    size_t res = ::readv(_fd, iov, iov_count);
+    if (res == -1)
+        throw serial_error("Failed to receive data", errno);
+    return (int)res;
+}
+
+bool serial_port::wait_readable(int timeout_ms) {
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    int res;
+    do {
+        res = ::poll(&pfd, 1, timeout_ms);
+    } while (res == -1 && errno == EINTR);
+    if (res == -1)
+        throw serial_error("Failed to wait for data", errno);
+    return res > 0;
+}
+
 void serial_port::drain() {
     uint8_t buf[16];
     ssize_t k;
     do {
+        if (_low_latency && !wait_readable(RX_TIMEOUT_MS))
+            return;
         k = ::read(_fd, buf, sizeof(buf));
     } while (k > 0);
     if (k == -1)
         throw serial_error("Failed to drain serial port", errno);
 }
 
+bool serial_port::set_low_latency() {
+    struct termios2 options;
+    if (ioctl(_fd, TCGETS2, &options) == -1)
+        throw serial_error("Failed to query serial port settings", errno);
+
+    // read returns as soon as a single character is available
+    // (receive() waits with poll() for timeouts)
+    options.c_cc[VTIME] = 0;
+    options.c_cc[VMIN]  = 1;
+    if (ioctl(_fd, TCSETS2, &options) == -1)
+        throw serial_error("Failed to set serial port settings", errno);
+    _low_latency = true;
+
+    // push received data to the tty layer immediately (if supported by driver)
+    struct serial_struct serial;
+    if (ioctl(_fd, TIOCGSERIAL, &serial) == -1)
+        return false;
+    serial.flags |= ASYNC_LOW_LATENCY;
+    return ioctl(_fd, TIOCSSERIAL, &serial) == 0;
+}
+
+void serial_port::set_non_blocking(bool non_blocking) {
+    int flags = fcntl(_fd, F_GETFL);
+    if (flags == -1)
+        throw serial_error("Failed to query serial port flags", errno);
+    if (non_blocking)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~O_NONBLOCK;
+    if (fcntl(_fd, F_SETFL, flags) == -1)
+        throw serial_error("Failed to set serial port flags", errno);
+}
+
 
 
 // --- serial_error -------------
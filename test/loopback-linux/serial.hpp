@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <sys/uio.h>
 #include <exception>
 #include <string>
 
@@ -60,6 +61,14 @@ public:
      * @param data_len length of data, in bytes
      */
     void transmit(const uint8_t* data, int data_len);
+
+    /**
+     * Transmit data from several buffers on this serial port (single `writev` call).
+     *
+     * @param iov buffers to transmit
+     * @param iov_count number of buffers
+     */
+    void transmit(const struct iovec* iov, int iov_count);
     
     /**
      * Receive data from the serial port.
@@ -69,14 +78,61 @@ public:
      * @return number of bytes received
      */
     int receive(uint8_t* data, int data_len);
+
+    /**
+     * Receive data from the serial port into several buffers (single `readv` call).
+     *
+     * @param iov buffers to receive data
+     * @param iov_count number of buffers
+     * @return number of bytes received
+     */
+    int receive(const struct iovec* iov, int iov_count);
     
+    /**
+     * Waits until data is available for reception.
+     *
+     * @param timeout_ms timeout (in ms)
+     * @return `true` if data is available, `false` if the timeout has expired
+     */
+    bool wait_readable(int timeout_ms);
+
     /**
      * Drains any pending data.
      */
     void drain();
+
+    /**
+     * Configures the serial port for low latency.
+     *
+     * Reads are event-driven: instead of the inter-character timer (`VTIME`),
+     * `receive()` waits with `poll()` and returns as soon as data is available.
+     * Additionally, the driver is asked to push received data to the tty layer
+     * immediately (`ASYNC_LOW_LATENCY`).
+     *
+     * @return `true` if the driver accepted `ASYNC_LOW_LATENCY`
+     */
+    bool set_low_latency();
+
+    /**
+     * Enables or disables non-blocking mode.
+     *
+     * In non-blocking mode, `transmit()` and `receive()` must not be used.
+     * Instead, the file descriptor is used directly.
+     *
+     * @param non_blocking `true` for non-blocking mode
+     */
+    void set_non_blocking(bool non_blocking);
+
+    /**
+     * Get the file descriptor.
+     *
+     * @return file descriptor (-1 if closed)
+     */
+    int fd() const { return _fd; }
     
 private:
     int _fd;
+    bool _low_latency;
     
 };
 
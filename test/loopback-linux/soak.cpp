@@ -0,0 +1,169 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Loss-tolerant verification of received data (for soak tests).
+//
+
+#include "soak.hpp"
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+using namespace std::chrono;
+
+// Number of bytes compared to confirm resynchronization
+static constexpr size_t MATCH_LEN = 16;
+// Minimum number of bytes compared to confirm resynchronization (at the end of the data)
+static constexpr size_t MIN_MATCH_LEN = 4;
+// Maximum number of corrupted or inserted bytes resolved in a single event
+static constexpr size_t MAX_SHIFT = 256;
+// Maximum number of lost bytes resolved in a single event
+static constexpr size_t MAX_LOST = 4096;
+// Number of bytes required after a mismatch before it is resolved
+static constexpr size_t RESYNC_LOOKAHEAD = MAX_SHIFT + MATCH_LEN;
+
+// protects the log output of concurrently tested links
+static std::mutex log_mutex;
+
+
+void soak_stats::add(const soak_stats& other) {
+    num_bytes += other.num_bytes;
+    num_lost += other.num_lost;
+    num_inserted += other.num_inserted;
+    num_corrupted += other.num_corrupted;
+    num_events += other.num_events;
+}
+
+
+soak_checker::soak_checker(uint32_t prng_init, int data_bits, const std::string& name)
+: prandom(prng_init), mask(data_bits == 7 ? 0x7f : 0xff), name(name), error_stats() { }
+
+void soak_checker::process(const uint8_t* buf, size_t len) {
+    if (pending.empty()) {
+        // fast path: verify in place
+        int mismatch = prandom.verify(buf, len, mask);
+        if (mismatch < 0)
+            return;
+        buf += mismatch;
+        len -= mismatch;
+    }
+
+    pending.insert(pending.end(), buf, buf + len);
+    check(false);
+}
+
+void soak_checker::finish(uint64_t end_pos) {
+    check(true);
+
+    uint64_t pos = prandom.position();
+    if (pos < end_pos) {
+        log_event("lost", pos, end_pos - pos);
+        error_stats.num_lost += end_pos - pos;
+        prandom.seek(end_pos);
+    }
+}
+
+soak_stats soak_checker::stats() const {
+    soak_stats result = error_stats;
+    result.num_bytes = prandom.position();
+    return result;
+}
+
+void soak_checker::check(bool is_final) {
+    size_t offset = 0;
+    while (offset < pending.size()) {
+        int mismatch = prandom.verify(pending.data() + offset, pending.size() - offset, mask);
+        if (mismatch < 0) {
+            offset = pending.size();
+            break;
+        }
+
+        offset += mismatch;
+        size_t avail = pending.size() - offset;
+        if (!is_final && avail < RESYNC_LOOKAHEAD)
+            break; // wait for more data
+
+        offset += resync(pending.data() + offset, avail);
+    }
+
+    pending.erase(pending.begin(), pending.begin() + offset);
+}
+
+// Resolves the mismatch at the start of `data`. Returns the number of received bytes consumed.
+size_t soak_checker::resync(const uint8_t* data, size_t len) {
+    uint64_t pos = prandom.position();
+
+    // find the smallest disruption that explains the received data
+    for (size_t d = 1; d <= MAX_SHIFT; d++) {
+        if (d < len && matches(data + d, len - d, pos + d)) {
+            log_event("corrupted", pos, d);
+            error_stats.num_corrupted += d;
+            prandom.seek(pos + d);
+            return d;
+        }
+        if (matches(data, len, pos + d)) {
+            log_event("lost", pos, d);
+            error_stats.num_lost += d;
+            prandom.seek(pos + d);
+            return 0;
+        }
+        if (d < len && matches(data + d, len - d, pos)) {
+            log_event("inserted", pos, d);
+            error_stats.num_inserted += d;
+            return d;
+        }
+    }
+
+    for (size_t d = MAX_SHIFT + 1; d <= MAX_LOST; d++) {
+        if (matches(data, len, pos + d)) {
+            log_event("lost", pos, d);
+            error_stats.num_lost += d;
+            prandom.seek(pos + d);
+            return 0;
+        }
+    }
+
+    // no resynchronization found: count a single corrupted byte and retry with the next one
+    log_event("corrupted", pos, 1);
+    error_stats.num_corrupted += 1;
+    prandom.seek(pos + 1);
+    return 1;
+}
+
+bool soak_checker::matches(const uint8_t* data, size_t len, uint64_t pos) const {
+    len = std::min(len, MATCH_LEN);
+    if (len < MIN_MATCH_LEN)
+        return false;
+
+    prng probe = prandom;
+    probe.seek(pos);
+    return probe.verify(data, len, mask) < 0;
+}
+
+void soak_checker::log_event(const char* type, uint64_t pos, uint64_t count) {
+    error_stats.num_events += 1;
+
+    auto now = system_clock::now();
+    time_t t = system_clock::to_time_t(now);
+    int millis = (int)(duration_cast<milliseconds>(now.time_since_epoch()).count() % 1000);
+    struct tm tm;
+    localtime_r(&t, &tm);
+
+    std::ostringstream line;
+    line << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << millis
+        << ' ' << name << ": " << count << (count == 1 ? " byte " : " bytes ") << type
+        << " at pos " << pos << '\n';
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << line.str() << std::flush;
+}
@@ -0,0 +1,109 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Loss-tolerant verification of received data (for soak tests).
+//
+
+#pragma once
+
+#include "prng.hpp"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Error statistics of a soak test
+ */
+struct soak_stats {
+    /// Number of bytes of the expected stream that have been checked
+    uint64_t num_bytes;
+    /// Number of bytes missing from the received data
+    uint64_t num_lost;
+    /// Number of extra bytes in the received data
+    uint64_t num_inserted;
+    /// Number of received bytes with a wrong value
+    uint64_t num_corrupted;
+    /// Number of error events (each covering one or more bytes)
+    uint64_t num_events;
+
+    /**
+     * Adds the statistics of another test run.
+     * @param other other statistics
+     */
+    void add(const soak_stats& other);
+};
+
+/**
+ * Loss-tolerant checker for received pseudo random data.
+ *
+ * Instead of stopping at the first mismatch, the checker resynchronizes
+ * to the expected stream. It determines if bytes have been lost, inserted
+ * or corrupted by searching for the nearest offset at which the received data
+ * matches the expected stream again. Each error event is logged with
+ * a timestamp and the stream position.
+ */
+class soak_checker {
+public:
+    /**
+     * Creates a new instance.
+     * @param prng_init initial value of pseudo random number generator
+     * @param data_bits data bits (7 or 8)
+     * @param name name used in the log (usually path of receiving serial port)
+     */
+    soak_checker(uint32_t prng_init, int data_bits, const std::string& name);
+
+    /**
+     * Checks received data.
+     *
+     * If a mismatch cannot be resolved yet, the remaining data is kept
+     * until enough data has been received.
+     *
+     * @param buf received data
+     * @param len length of received data (in bytes)
+     */
+    void process(const uint8_t* buf, size_t len);
+
+    /**
+     * Resolves all pending data and counts the expected data up to
+     * the specified position as lost.
+     *
+     * To be called if no data is expected to arrive for the expected
+     * stream up to `end_pos`.
+     *
+     * @param end_pos stream position up to which data has been transmitted
+     */
+    void finish(uint64_t end_pos);
+
+    /**
+     * Gets the position in the expected stream.
+     *
+     * All data before this position has either been received or counted as lost.
+     *
+     * @return stream position (in bytes)
+     */
+    uint64_t position() const { return prandom.position(); }
+
+    /**
+     * Gets the error statistics.
+     * @return statistics
+     */
+    soak_stats stats() const;
+
+private:
+    void check(bool is_final);
+    size_t resync(const uint8_t* data, size_t len);
+    bool matches(const uint8_t* data, size_t len, uint64_t pos) const;
+    void log_event(const char* type, uint64_t pos, uint64_t count);
+
+    prng prandom;
+    uint8_t mask;
+    std::string name;
+    std::vector<uint8_t> pending;
+    soak_stats error_stats;
+};
@@ -0,0 +1,264 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Test engine using separate threads for sending and receiving.
+//
+
+#include "engine.hpp"
+#include "prng.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+// Time without received data after which the data in transit is considered lost (soak mode)
+static constexpr milliseconds SOAK_RX_TIMEOUT(1000);
+
+namespace {
+
+/**
+ * Test state of threads engine
+ */
+class threads_engine {
+public:
+    threads_engine(const loopback_params& params, loopback_link& link);
+
+    loopback_result run();
+
+private:
+    /**
+     * Sends pseudo random data to the serial port
+     */
+    void send();
+
+    /**
+     * Receives data from the serial port and compares it with the expected data
+     */
+    void recv();
+
+    /**
+     * Receives data from the serial port and checks it, resynchronizing after errors (soak mode)
+     */
+    void recv_soak();
+
+    /**
+     * Receives data into `rx_buf` (using `read` or `readv`)
+     * @return number of bytes received
+     */
+    int receive();
+
+    const loopback_params& params;
+    loopback_link& link;
+    volatile bool test_cancelled;
+    soak_stats soak;
+
+    std::vector<uint8_t> rx_buf;
+    std::vector<iovec> rx_iov;
+
+    int outstanding_bytes;
+    std::mutex outstanding_data_mutex; // protects outstanding_bytes
+    std::condition_variable outstanding_data_condition; // to be used with outstanding_data_mutex
+};
+
+}
+
+
+threads_engine::threads_engine(const loopback_params& params, loopback_link& link)
+: params(params), link(link), test_cancelled(false), soak(),
+    rx_buf((size_t)params.read_size * params.num_iovecs), rx_iov(params.num_iovecs), outstanding_bytes(0) {
+
+    for (int i = 0; i < params.num_iovecs; i++) {
+        rx_iov[i].iov_base = rx_buf.data() + (size_t)i * params.read_size;
+        rx_iov[i].iov_len = params.read_size;
+    }
+}
+
+loopback_result threads_engine::run() {
+    // Run send function in separate thread
+    std::thread sender(&threads_engine::send, this);
+
+    if (params.rx_delay != 0)
+        std::this_thread::sleep_for(seconds(params.rx_delay));
+
+    // start time
+    time_point<high_resolution_clock> start_time = high_resolution_clock::now();
+
+    // receive data
+    if (params.is_soak)
+        recv_soak();
+    else
+        recv();
+
+    // end time
+    time_point<high_resolution_clock> end_time = high_resolution_clock::now();
+
+    // wake up sender if reception has been cancelled
+    {
+        std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+    }
+    outstanding_data_condition.notify_one();
+    sender.join();
+    double duration = static_cast<double>(duration_cast<milliseconds>(end_time - start_time).count()) / 1000.0;
+    return { !test_cancelled, duration, soak };
+}
+
+void threads_engine::send() {
+    prng prandom(params.prng_init);
+    std::vector<uint8_t> buf((size_t)params.chunk_size * params.num_iovecs);
+    std::vector<iovec> iov(params.num_iovecs);
+
+    try {
+
+        int n = params.num_bytes;
+        while (n > 0 && !test_cancelled) {
+            // prepare up to `num_iovecs` chunks
+            int m = 0;
+            int iov_count = 0;
+            while (iov_count < params.num_iovecs && m < n) {
+                int len = std::min(params.chunk_size, n - m);
+                iov[iov_count].iov_base = buf.data() + m;
+                iov[iov_count].iov_len = len;
+                iov_count += 1;
+                m += len;
+            }
+            prandom.fill(buf.data(), m, data_mask(params.data_bits));
+
+            // wait until outstanding data is low enough to send the chunks
+            // (always allow sending if nothing is outstanding)
+            {
+                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+                outstanding_data_condition.wait(lock, [this, m]{
+                    return outstanding_bytes + m <= params.max_outstanding_bytes
+                        || outstanding_bytes <= 0 || test_cancelled;
+                });
+                if (test_cancelled)
+                    return;
+            }
+
+            if (iov_count == 1)
+                link.send_port.transmit(buf.data(), m);
+            else
+                link.send_port.transmit(iov.data(), iov_count);
+            n -= m;
+
+            // update outstanding data
+            {
+                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+                outstanding_bytes += m;
+            }
+        }
+    }
+    catch (serial_error& error) {
+        std::cerr << error.what() << std::endl;
+        test_cancelled = true;
+    }
+}
+
+void threads_engine::recv() {
+    prng prandom(params.prng_init);
+
+    try {
+
+        int n = 0;
+        while (n < params.num_bytes && !test_cancelled) {
+            int k = receive();
+            if (k == 0) {
+                std::cerr << "No more data from " << link.recv_path << " after " << n << " bytes" << std::endl;
+                test_cancelled = true;
+                return;
+            }
+
+            // update outstanding data and notify sender
+            {
+                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+                outstanding_bytes -= k;
+            }
+            outstanding_data_condition.notify_one();
+
+            if (!verify_received_data(prandom, rx_buf.data(), k, params.data_bits, link.recv_path)) {
+                test_cancelled = true;
+                return;
+            }
+            n += k;
+        }
+
+    }
+    catch (serial_error& error) {
+        std::cerr << error.what() << std::endl;
+        test_cancelled = true;
+        outstanding_data_condition.notify_one();
+    }
+}
+
+void threads_engine::recv_soak() {
+    soak_checker checker(params.prng_init, params.data_bits, link.recv_path);
+    auto last_rx_time = steady_clock::now();
+
+    try {
+
+        while (checker.position() < (uint64_t)params.num_bytes && !test_cancelled) {
+            uint64_t pos = checker.position();
+            int k = receive();
+            if (k > 0) {
+                last_rx_time = steady_clock::now();
+                checker.process(rx_buf.data(), k);
+
+            } else {
+                if (steady_clock::now() - last_rx_time < SOAK_RX_TIMEOUT)
+                    continue;
+
+                // no data for a while: data in transit is lost
+                int outstanding;
+                {
+                    std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+                    outstanding = outstanding_bytes;
+                }
+                if (outstanding <= 0) {
+                    std::cerr << "No more data from " << link.recv_path << " after " << pos << " bytes" << std::endl;
+                    test_cancelled = true;
+                    break;
+                }
+                checker.finish(pos + outstanding);
+                last_rx_time = steady_clock::now();
+            }
+
+            // update outstanding data (by the progress in the expected stream) and notify sender
+            {
+                std::unique_lock<std::mutex> lock(outstanding_data_mutex);
+                outstanding_bytes -= (int)(checker.position() - pos);
+            }
+            outstanding_data_condition.notify_one();
+        }
+
+    }
+    catch (serial_error& error) {
+        std::cerr << error.what() << std::endl;
+        test_cancelled = true;
+        outstanding_data_condition.notify_one();
+    }
+
+    soak = checker.stats();
+}
+
+int threads_engine::receive() {
+    if (params.num_iovecs == 1)
+        return link.recv_port.receive(rx_buf.data(), params.read_size);
+    return link.recv_port.receive(rx_iov.data(), params.num_iovecs);
+}
+
+
+loopback_result run_threads_engine(const loopback_params& params, loopback_link& link) {
+    threads_engine engine(params, link);
+    return engine.run();
+}
@@ -0,0 +1,448 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Single-threaded test engine using io_uring (without liburing).
+//
+
+#include "engine.hpp"
+#include "prng.hpp"
+#include <errno.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace std::chrono;
+
+// Number of chunks submitted to the serial port at once
+static constexpr int TX_DEPTH = 16;
+// Number of reads submitted at once
+static constexpr int RX_DEPTH = 4;
+// Number of submission queue entries
+static constexpr unsigned RING_ENTRIES = 32;
+
+// Tags in user data of submission queue entries
+static constexpr uint64_t TAG_TX = 1ULL << 32;
+static constexpr uint64_t TAG_RX = 2ULL << 32;
+static constexpr uint64_t TAG_DELAY = 3ULL << 32;
+static constexpr uint64_t TAG_MASK = 0xffffffffULL << 32;
+
+namespace {
+
+/**
+ * Minimal io_uring instance using raw system calls.
+ */
+class io_ring {
+public:
+    io_ring(unsigned entries);
+    ~io_ring();
+
+    /**
+     * Registers the buffers for fixed buffer reads and writes.
+     * @param iovecs buffers
+     * @param num_iovecs number of buffers
+     */
+    void register_buffers(const iovec* iovecs, unsigned num_iovecs);
+
+    /**
+     * Gets the next free submission queue entry.
+     *
+     * The entry is cleared. It is submitted with the next call to `submit_and_wait()`.
+     * @return submission queue entry
+     */
+    io_uring_sqe* get_sqe();
+
+    /**
+     * Submits the queued entries and waits for at least one completion.
+     */
+    void submit_and_wait();
+
+    /**
+     * Gets the next completion queue entry.
+     * @return completion queue entry, or `nullptr` if there is none
+     */
+    io_uring_cqe* peek_cqe();
+
+    /**
+     * Marks the completion queue entry returned by `peek_cqe()` as consumed.
+     */
+    void cqe_seen();
+
+private:
+    void unmap();
+
+    int ring_fd;
+
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    unsigned sqe_tail;
+    unsigned num_queued;
+};
+
+/**
+ * Test state of io_uring engine
+ */
+class uring_engine {
+public:
+    uring_engine(const loopback_params& params, loopback_link& link);
+
+    loopback_result run();
+
+private:
+    void queue_tx();
+    void queue_rx();
+    bool on_completion(const io_uring_cqe* cqe);
+
+    const loopback_params& params;
+    loopback_link& link;
+    int tx_fd;
+    int rx_fd;
+    io_ring ring;
+
+    prng tx_prandom;
+    prng rx_prandom;
+
+    std::vector<uint8_t> tx_buf_storage;
+    uint8_t* tx_buf[TX_DEPTH];
+    int tx_len[TX_DEPTH];
+    int tx_pos[TX_DEPTH];
+    int tx_chain_len;
+    int tx_in_flight;
+    int num_generated;
+
+    std::vector<uint8_t> rx_buf_storage;
+    uint8_t* rx_buf[RX_DEPTH];
+    int rx_in_flight;
+    int num_received;
+    bool is_rx_active;
+    steady_clock::time_point rx_start_time;
+    __kernel_timespec rx_delay_ts;
+};
+
+}
+
+
+// --- io_ring
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void* map_ring(int fd, size_t size, off_t offset) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ptr == MAP_FAILED)
+        throw serial_error("Failed to map io_uring", errno);
+    return ptr;
+}
+
+io_ring::io_ring(unsigned entries)
+: sq_ptr(nullptr), cq_ptr(nullptr), sqes(nullptr), num_queued(0) {
+
+    io_uring_params p = { 0 };
+    ring_fd = io_uring_setup(entries, &p);
+    if (ring_fd == -1)
+        throw serial_error("io_uring is not available", errno);
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0)
+        sq_size = cq_size = std::max(sq_size, cq_size);
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+    try {
+        sq_ptr = map_ring(ring_fd, sq_size, IORING_OFF_SQ_RING);
+        if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0)
+            cq_ptr = sq_ptr;
+        else
+            cq_ptr = map_ring(ring_fd, cq_size, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)map_ring(ring_fd, sqes_size, IORING_OFF_SQES);
+    } catch (serial_error&) {
+        unmap();
+        close(ring_fd);
+        throw;
+    }
+
+    uint8_t* sq = (uint8_t*)sq_ptr;
+    sq_head = (unsigned*)(sq + p.sq_off.head);
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+
+    uint8_t* cq = (uint8_t*)cq_ptr;
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    sqe_tail = *sq_tail;
+}
+
+io_ring::~io_ring() {
+    unmap();
+    close(ring_fd);
+}
+
+void io_ring::unmap() {
+    if (sqes != nullptr)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != nullptr)
+        munmap(sq_ptr, sq_size);
+}
+
+void io_ring::register_buffers(const iovec* iovecs, unsigned num_iovecs) {
+    if (io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iovecs, num_iovecs) == -1)
+        throw serial_error("Failed to register io_uring buffers", errno);
+}
+
+io_uring_sqe* io_ring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= *sq_mask + 1)
+        throw serial_error("io_uring submission queue is full");
+
+    unsigned index = sqe_tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sqe_tail += 1;
+    num_queued += 1;
+    return sqe;
+}
+
+void io_ring::submit_and_wait() {
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+    while (true) {
+        int res = io_uring_enter(ring_fd, num_queued, 1, IORING_ENTER_GETEVENTS);
+        if (res >= 0) {
+            num_queued -= res;
+            if (num_queued == 0)
+                return;
+        } else if (errno != EINTR) {
+            throw serial_error("Failed to submit io_uring requests", errno);
+        }
+    }
+}
+
+io_uring_cqe* io_ring::peek_cqe() {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &cqes[head & *cq_mask];
+}
+
+void io_ring::cqe_seen() {
+    __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+// --- uring_engine
+
+uring_engine::uring_engine(const loopback_params& params, loopback_link& link)
+: params(params), link(link), tx_fd(link.send_port.fd()), rx_fd(link.recv_port.fd()), ring(RING_ENTRIES),
+    tx_prandom(params.prng_init), rx_prandom(params.prng_init),
+    tx_buf_storage(TX_DEPTH * params.chunk_size), tx_chain_len(0), tx_in_flight(0), num_generated(0),
+    rx_buf_storage(RX_DEPTH * params.read_size), rx_in_flight(0), num_received(0), is_rx_active(false) {
+
+    // buffer index 0 .. TX_DEPTH - 1: transmit buffers, TX_DEPTH .. : receive buffers
+    iovec iovecs[TX_DEPTH + RX_DEPTH];
+    for (int i = 0; i < TX_DEPTH; i++) {
+        tx_buf[i] = tx_buf_storage.data() + i * params.chunk_size;
+        iovecs[i] = { tx_buf[i], (size_t)params.chunk_size };
+    }
+    for (int i = 0; i < RX_DEPTH; i++) {
+        rx_buf[i] = rx_buf_storage.data() + i * params.read_size;
+        iovecs[TX_DEPTH + i] = { rx_buf[i], (size_t)params.read_size };
+    }
+    ring.register_buffers(iovecs, TX_DEPTH + RX_DEPTH);
+}
+
+loopback_result uring_engine::run() {
+    if (params.rx_delay > 0) {
+        rx_delay_ts = { params.rx_delay, 0 };
+        io_uring_sqe* sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t)&rx_delay_ts;
+        sqe->len = 1;
+        sqe->user_data = TAG_DELAY;
+    } else {
+        is_rx_active = true;
+        rx_start_time = steady_clock::now();
+    }
+
+    while (num_received < params.num_bytes || tx_in_flight > 0) {
+        // Linked requests are executed in order. As a new chain could
+        // overtake the previous one, only one chain per direction is in flight.
+        if (tx_in_flight == 0)
+            queue_tx();
+        if (rx_in_flight == 0 && is_rx_active && num_received < params.num_bytes)
+            queue_rx();
+
+        ring.submit_and_wait();
+
+        io_uring_cqe* cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            bool is_ok = on_completion(cqe);
+            ring.cqe_seen();
+            if (!is_ok)
+                return { false, 0 };
+        }
+    }
+
+    double duration = duration_cast<microseconds>(steady_clock::now() - rx_start_time).count() / 1000000.0;
+    return { true, duration };
+}
+
+// Queues a chain of writes (as far as the outstanding data allows)
+void uring_engine::queue_tx() {
+    // resubmit the unwritten rest of the previous chain first
+    int slot = 0;
+    while (slot < tx_chain_len && tx_pos[slot] == tx_len[slot])
+        slot += 1;
+
+    if (slot == tx_chain_len) {
+        tx_chain_len = 0;
+        while (tx_chain_len < TX_DEPTH && num_generated < params.num_bytes) {
+            // limit outstanding data (but always allow a chunk if nothing is outstanding)
+            int m = std::min(params.chunk_size, params.num_bytes - num_generated);
+            int outstanding = num_generated - num_received;
+            if (outstanding + m > params.max_outstanding_bytes && outstanding > 0)
+                break;
+            uint8_t* buf = tx_buf[tx_chain_len];
+            tx_prandom.fill(buf, m, data_mask(params.data_bits));
+
+            tx_len[tx_chain_len] = m;
+            tx_pos[tx_chain_len] = 0;
+            tx_chain_len += 1;
+            num_generated += m;
+        }
+        slot = 0;
+    }
+
+    io_uring_sqe* sqe = nullptr;
+    for (; slot < tx_chain_len; slot++) {
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = tx_fd;
+        sqe->addr = (uintptr_t)(tx_buf[slot] + tx_pos[slot]);
+        sqe->len = tx_len[slot] - tx_pos[slot];
+        sqe->off = (uint64_t)-1;
+        sqe->buf_index = slot;
+        sqe->user_data = TAG_TX | slot;
+        tx_in_flight += 1;
+    }
+
+    // end of chain
+    if (sqe != nullptr)
+        sqe->flags = 0;
+}
+
+// Queues a chain of reads (not exceeding the remaining data)
+void uring_engine::queue_rx() {
+    io_uring_sqe* sqe = nullptr;
+    int remaining = params.num_bytes - num_received;
+    while (rx_in_flight < RX_DEPTH && remaining > 0) {
+        int m = std::min(params.read_size, remaining);
+
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = rx_fd;
+        sqe->addr = (uintptr_t)rx_buf[rx_in_flight];
+        sqe->len = m;
+        sqe->off = (uint64_t)-1;
+        sqe->buf_index = TX_DEPTH + rx_in_flight;
+        sqe->user_data = TAG_RX | rx_in_flight;
+
+        rx_in_flight += 1;
+        remaining -= m;
+    }
+
+    // end of chain
+    if (sqe != nullptr)
+        sqe->flags = 0;
+}
+
+bool uring_engine::on_completion(const io_uring_cqe* cqe) {
+    uint64_t tag = cqe->user_data & TAG_MASK;
+    int res = cqe->res;
+
+    if (tag == TAG_DELAY) {
+        is_rx_active = true;
+        rx_start_time = steady_clock::now();
+        return true;
+    }
+
+    // A short or interrupted request cancels the remaining requests
+    // of the chain. They are resubmitted.
+    if (tag == TAG_TX) {
+        tx_in_flight -= 1;
+        if (res == -ECANCELED || res == -EINTR)
+            return true;
+        if (res < 0)
+            throw serial_error("Failed to transmit data", -res);
+        tx_pos[cqe->user_data & ~TAG_MASK] += res;
+        return true;
+    }
+
+    rx_in_flight -= 1;
+    if (res == -ECANCELED || res == -EINTR)
+        return true;
+    if (res < 0)
+        throw serial_error("Failed to receive data", -res);
+    if (res == 0) {
+        std::cerr << "No more data from " << link.recv_path << " after " << num_received << " bytes" << std::endl;
+        return false;
+    }
+
+    const uint8_t* buf = rx_buf[cqe->user_data & ~TAG_MASK];
+    if (!verify_received_data(rx_prandom, buf, res, params.data_bits, link.recv_path))
+        return false;
+
+    num_received += res;
+    return true;
+}
+
+
+loopback_result run_uring_engine(const loopback_params& params, loopback_link& link) {
+    uring_engine engine(params, link);
+    return engine.run();
+}
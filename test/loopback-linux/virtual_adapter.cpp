@@ -0,0 +1,191 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Virtual USB serial adapter with TX wired to RX (based on a pty pair).
+//
+
+#include "virtual_adapter.hpp"
+#include "serial.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <asm-generic/termbits.h>
+#include <asm-generic/ioctls.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std::chrono;
+
+// Maximum number of bytes read from the host at once
+static constexpr int RX_CHUNK_SIZE = 256;
+// Maximum time between checks of the line settings
+static constexpr milliseconds SETTINGS_INTERVAL(50);
+
+
+virtual_adapter::virtual_adapter(const virtual_adapter_config& config)
+: config(config), master_fd(-1), slave_fd(-1), stop_fd(-1), rng(config.seed), probability(0.0, 1.0),
+    char_time(0) {
+
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (master_fd == -1)
+        throw serial_error("Failed to create pty", errno);
+
+    if (grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        int err = errno;
+        close(master_fd);
+        throw serial_error("Failed to unlock pty", err);
+    }
+    pty_path = ptsname(master_fd);
+
+    // Keep the slave side open so the master side does not report a hangup
+    // while the host tools have closed the serial port. Start in raw mode.
+    slave_fd = open(pty_path.c_str(), O_RDWR | O_NOCTTY);
+    stop_fd = eventfd(0, EFD_NONBLOCK);
+    struct termios2 options;
+    if (slave_fd == -1 || stop_fd == -1 || ioctl(slave_fd, TCGETS2, &options) == -1) {
+        int err = errno;
+        if (slave_fd != -1)
+            close(slave_fd);
+        if (stop_fd != -1)
+            close(stop_fd);
+        close(master_fd);
+        throw serial_error("Failed to set up pty", err);
+    }
+    options.c_iflag = 0;
+    options.c_oflag = 0;
+    options.c_lflag = 0;
+    ioctl(slave_fd, TCSETS2, &options);
+
+    update_line_settings();
+    thread = std::thread(&virtual_adapter::run, this);
+}
+
+virtual_adapter::~virtual_adapter() {
+    uint64_t value = 1;
+    if (write(stop_fd, &value, sizeof(value)) != sizeof(value))
+        std::cerr << "Failed to stop virtual adapter" << std::endl;
+    thread.join();
+
+    close(stop_fd);
+    close(slave_fd);
+    close(master_fd);
+}
+
+void virtual_adapter::run() {
+    try {
+        auto settings_time = steady_clock::now();
+
+        while (true) {
+            auto now = steady_clock::now();
+            if (now >= settings_time + SETTINGS_INTERVAL) {
+                update_line_settings();
+                settings_time = now;
+            }
+
+            transmit_to_host(now);
+
+            // wait for data from the host (if there is space in the FIFO),
+            // for the next character to complete or for the stop request
+            struct pollfd fds[2] = {
+                { stop_fd, POLLIN, 0 },
+                { master_fd, (short)((int)fifo.size() < config.fifo_size ? POLLIN : 0), 0 }
+            };
+            auto timeout_time = settings_time + SETTINGS_INTERVAL;
+            if (!fifo.empty())
+                timeout_time = std::min(timeout_time, next_char_time);
+            auto timeout_ns = std::max(duration_cast<nanoseconds>(timeout_time - now).count(), (int64_t)0);
+            struct timespec timeout = { (time_t)(timeout_ns / 1000000000), (long)(timeout_ns % 1000000000) };
+
+            int n = ppoll(fds, 2, &timeout, nullptr);
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw serial_error("Failed to wait for pty", errno);
+            }
+
+            if ((fds[0].revents & POLLIN) != 0)
+                break;
+            if ((fds[1].revents & POLLIN) != 0)
+                receive_from_host();
+        }
+
+    } catch (serial_error& error) {
+        std::cerr << "Virtual adapter: " << error.what() << std::endl;
+    }
+}
+
+// Derives the character time from the settings of the serial port
+void virtual_adapter::update_line_settings() {
+    struct termios2 options;
+    if (ioctl(slave_fd, TCGETS2, &options) == -1)
+        throw serial_error("Failed to query pty settings", errno);
+
+    int data_bits = 8;
+    switch (options.c_cflag & CSIZE) {
+    case CS5: data_bits = 5; break;
+    case CS6: data_bits = 6; break;
+    case CS7: data_bits = 7; break;
+    }
+    int bits = 1 + data_bits + ((options.c_cflag & PARENB) != 0 ? 1 : 0) + ((options.c_cflag & CSTOPB) != 0 ? 2 : 1);
+    unsigned int bit_rate = std::max(options.c_ospeed, 50U);
+    char_time = (int64_t)bits * 1000000000 / bit_rate;
+}
+
+// Reads data written by the host into the FIFO (with random drops and corruptions)
+void virtual_adapter::receive_from_host() {
+    uint8_t buf[RX_CHUNK_SIZE];
+    int len = std::min(RX_CHUNK_SIZE, config.fifo_size - (int)fifo.size());
+    ssize_t k = read(master_fd, buf, len);
+    if (k == -1) {
+        if (errno == EAGAIN || errno == EINTR || errno == EIO)
+            return;
+        throw serial_error("Failed to read from pty", errno);
+    }
+
+    if (fifo.empty())
+        next_char_time = steady_clock::now() + nanoseconds(char_time);
+
+    for (ssize_t i = 0; i < k; i++) {
+        uint8_t b = buf[i];
+        if (config.drop_rate > 0 && probability(rng) < config.drop_rate)
+            continue;
+        if (config.corrupt_rate > 0 && probability(rng) < config.corrupt_rate)
+            b ^= 1 << (rng() % 8);
+        fifo.push_back(b);
+    }
+}
+
+// Writes the characters completely transmitted by now back to the host
+void virtual_adapter::transmit_to_host(steady_clock::time_point now) {
+    uint8_t buf[RX_CHUNK_SIZE];
+    int n = 0;
+    while (n < RX_CHUNK_SIZE && n < (int)fifo.size() && next_char_time <= now) {
+        buf[n] = fifo[n];
+        n += 1;
+        next_char_time += nanoseconds(char_time);
+    }
+    if (n == 0)
+        return;
+
+    ssize_t k = write(master_fd, buf, n);
+    if (k == -1) {
+        if (errno != EAGAIN && errno != EINTR && errno != EIO)
+            throw serial_error("Failed to write to pty", errno);
+        k = 0;
+    }
+
+    // characters not accepted by the host remain in the FIFO
+    fifo.erase(fifo.begin(), fifo.begin() + k);
+    if (k < n)
+        next_char_time = now + nanoseconds(char_time);
+}
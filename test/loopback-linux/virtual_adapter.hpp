@@ -0,0 +1,91 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Loopback test
+//
+// Virtual USB serial adapter with TX wired to RX (based on a pty pair).
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+
+/**
+ * Configuration of the virtual adapter
+ */
+struct virtual_adapter_config {
+    /// Size of the adapter's FIFO (in bytes)
+    int fifo_size;
+    /// Probability that a byte is dropped
+    double drop_rate;
+    /// Probability that a byte is corrupted
+    double corrupt_rate;
+    /// Seed for the random drops and corruptions
+    uint32_t seed;
+};
+
+/**
+ * Virtual serial adapter.
+ *
+ * The adapter creates a pty pair. The host tools use the pty (slave side) like
+ * the serial port of a real adapter with TX wired to RX. A helper thread
+ * emulates the adapter on the master side:
+ *
+ * - The data is paced according to the bit rate and the data format set with `termios2`.
+ * - The data passes through a FIFO of configurable size. If it is full,
+ *   the adapter stops reading from the host (similar to RTS/CTS flow control).
+ * - Bytes can be randomly dropped or corrupted.
+ */
+class virtual_adapter {
+public:
+    /**
+     * Creates a new instance and starts the emulation.
+     * @param config adapter configuration
+     */
+    virtual_adapter(const virtual_adapter_config& config);
+
+    /**
+     * Stops the emulation and closes the pty pair.
+     */
+    ~virtual_adapter();
+
+    virtual_adapter(const virtual_adapter&) = delete;
+    virtual_adapter& operator=(const virtual_adapter&) = delete;
+
+    /**
+     * Gets the path of the serial port to be used by the host tools.
+     * @return path (e.g. `/dev/pts/5`)
+     */
+    const std::string& path() const { return pty_path; }
+
+private:
+    void run();
+    void update_line_settings();
+    void receive_from_host();
+    void transmit_to_host(std::chrono::steady_clock::time_point now);
+
+    virtual_adapter_config config;
+    std::string pty_path;
+    int master_fd;
+    int slave_fd;
+    int stop_fd;
+    std::thread thread;
+
+    std::deque<uint8_t> fifo;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> probability;
+
+    // duration of a single character on the wire (in ns)
+    int64_t char_time;
+    // time at which the next character has been transmitted completely
+    std::chrono::steady_clock::time_point next_char_time;
+};
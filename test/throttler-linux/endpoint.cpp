@@ -0,0 +1,91 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Endpoint of the throttler: serial port or pty.
+//
+
+#include "endpoint.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <asm-generic/termbits.h>
+#include <asm-generic/ioctls.h>
+
+
+endpoint::endpoint(const std::string& spec)
+: is_pty(false), master_fd(-1), slave_fd(-1) {
+    if (spec == "pty" || spec.compare(0, 4, "pty:") == 0) {
+        is_pty = true;
+        if (spec.size() > 4)
+            link_path = spec.substr(4);
+    } else {
+        port_path = spec;
+    }
+}
+
+void endpoint::open(int bit_rate) {
+    if (is_pty) {
+        open_pty();
+        return;
+    }
+
+    port.open(port_path.c_str(), bit_rate);
+    port.drain();
+    port.set_non_blocking(true);
+}
+
+void endpoint::open_pty() {
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (master_fd == -1)
+        throw serial_error("Failed to create pty", errno);
+    if (grantpt(master_fd) != 0 || unlockpt(master_fd) != 0)
+        throw serial_error("Failed to unlock pty", errno);
+    port_path = ptsname(master_fd);
+
+    // Keep the other side open so the master side does not report a hangup
+    // while the tools under test have closed it. Start in raw mode.
+    slave_fd = ::open(port_path.c_str(), O_RDWR | O_NOCTTY);
+    if (slave_fd == -1)
+        throw serial_error("Failed to open pty", errno);
+    struct termios2 options;
+    if (ioctl(slave_fd, TCGETS2, &options) == -1)
+        throw serial_error("Failed to query pty settings", errno);
+    options.c_iflag = 0;
+    options.c_oflag = 0;
+    options.c_lflag = 0;
+    if (ioctl(slave_fd, TCSETS2, &options) == -1)
+        throw serial_error("Failed to configure pty", errno);
+
+    if (!link_path.empty()) {
+        unlink(link_path.c_str());
+        if (symlink(port_path.c_str(), link_path.c_str()) != 0)
+            throw serial_error("Failed to create symbolic link", errno);
+    }
+}
+
+void endpoint::close() {
+    if (!is_pty) {
+        port.close();
+        return;
+    }
+
+    if (!link_path.empty())
+        unlink(link_path.c_str());
+    if (slave_fd != -1)
+        ::close(slave_fd);
+    if (master_fd != -1)
+        ::close(master_fd);
+    slave_fd = master_fd = -1;
+}
+
+int endpoint::fd() const {
+    return is_pty ? master_fd : port.fd();
+}
@@ -0,0 +1,69 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Endpoint of the throttler: serial port or pty.
+//
+
+#pragma once
+
+#include "serial.hpp"
+#include <string>
+
+/**
+ * Endpoint of the throttler.
+ *
+ * The endpoint is either a serial port (specified by its path) or a newly
+ * created pty (specified as `pty` or `pty:link-path`). For a pty, the other
+ * side is used by the tools under test, optionally via a symbolic link.
+ */
+class endpoint {
+public:
+    /**
+     * Creates a new endpoint instance.
+     *
+     * The endpoint is in closed state.
+     *
+     * @param spec serial port path, `pty` or `pty:link-path`
+     */
+    endpoint(const std::string& spec);
+
+    /**
+     * Opens the endpoint in non-blocking mode.
+     *
+     * @param bit_rate bit rate (for serial ports only)
+     */
+    void open(int bit_rate);
+
+    /**
+     * Closes the endpoint.
+     */
+    void close();
+
+    /**
+     * Gets the file descriptor.
+     * @return file descriptor (-1 if closed)
+     */
+    int fd() const;
+
+    /**
+     * Gets the path of the serial port (or of the pty to be used by the tools under test).
+     * @return path
+     */
+    const std::string& path() const { return port_path; }
+
+private:
+    void open_pty();
+
+    std::string port_path;
+    bool is_pty;
+    std::string link_path;
+    serial_port port;
+    int master_fd;
+    int slave_fd;
+};
@@ -0,0 +1,310 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Host-side equivalent of the throttler firmware for testing flow control.
+//
+// Data received on port A is passed to port B and vice versa. Each direction
+// is throttled by a token bucket with configurable rate and burst capacity.
+// If the buffer of a direction is full or no tokens are available, the
+// throttler stops reading from the source port. The resulting backpressure
+// makes the serial driver assert RTS (or blocks the writer of a pty).
+//
+// The token bucket can be shaped by the same traffic profiles as in the
+// throttler firmware (constant, stall, burst, sawtooth, hwm). For the "hwm"
+// profile, the throttler stops writing for the stall duration as soon as the
+// buffer is full so the backpressure is held exactly at the limit.
+//
+// Each port is either a serial port or a newly created pty (`pty` or
+// `pty:link-path`). The throttler runs until it is interrupted (Ctrl-C).
+//
+// Comand line syntax: throttler-linux [ OPTIONS... ] port-a port-b
+//
+
+#include "cxxopts.hpp"
+#include "endpoint.hpp"
+#include "token_bucket.hpp"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+
+using namespace std::chrono;
+
+// Maximum number of bytes read or written at once
+static constexpr int CHUNK_SIZE = 256;
+
+// parsed command line arguments
+static std::string port_a_spec;
+static std::string port_b_spec;
+static int bit_rate;
+static double rate;
+static double capacity;
+static int buffer_size;
+static traffic_profile profile;
+static milliseconds period;
+static milliseconds stall;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+namespace {
+
+/**
+ * Single direction of the throttler
+ */
+struct channel {
+    channel(const char* name, endpoint& src, endpoint& dst);
+
+    bool wants_read() const { return (int)buf.size() < buffer_size && bucket.available() > 0; }
+    bool wants_write() const { return !buf.empty() && !is_stalled; }
+    bool is_waiting_for_tokens() const { return (int)buf.size() < buffer_size && bucket.available() == 0; }
+
+    void update_stall(steady_clock::time_point now);
+
+    void on_readable();
+    void on_writable();
+
+    const char* name;
+    endpoint& src;
+    endpoint& dst;
+    token_bucket bucket;
+    std::deque<uint8_t> buf;
+    uint64_t num_bytes;
+
+    // "hwm" profile
+    bool is_stalled;
+    bool is_hwm_armed;
+    steady_clock::time_point stall_end;
+};
+
+}
+
+/**
+ * Checks the program arguments
+ * @param argc number of arguments
+ * @param argv argument array
+ * @return 0 on success, other value on error
+ */
+static int check_usage(int argc, char* argv[]);
+
+/**
+ * Passes the data between the two ports until the throttler is interrupted
+ * @param port_a port A
+ * @param port_b port B
+ */
+static void run_throttler(endpoint& port_a, endpoint& port_b);
+
+
+/**
+ * Main function
+ * @param argc number of arguments
+ * @param argv argument array
+ */
+int main(int argc, char* argv[]) {
+    if (check_usage(argc, argv) != 0)
+        exit(1);
+
+    struct sigaction action = { };
+    action.sa_handler = [](int) { stop_requested = 1; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    endpoint port_a(port_a_spec);
+    endpoint port_b(port_b_spec);
+
+    try {
+        port_a.open(bit_rate);
+        port_b.open(bit_rate);
+        run_throttler(port_a, port_b);
+    }
+    catch (serial_error& error) {
+        std::cerr << error.what() << std::endl;
+        port_a.close();
+        port_b.close();
+        return 2;
+    }
+
+    port_a.close();
+    port_b.close();
+    return 0;
+}
+
+
+int check_usage(int argc, char* argv[]) {
+
+    cxxopts::Options options("throttler", "Throttles the data passed between two serial ports");
+
+    options.add_options()
+        ("a,port-a", "Port A: serial port path, 'pty' or 'pty:link-path'", cxxopts::value<std::string>())
+        ("b,port-b", "Port B: serial port path, 'pty' or 'pty:link-path'", cxxopts::value<std::string>())
+        ("bitrate", "Bit rate of serial ports (1200 .. 99,999,999 bps)", cxxopts::value<int>()->default_value("115200"))
+        ("r,rate", "Throttled data rate (in bytes/s)", cxxopts::value<double>()->default_value("2000"))
+        ("c,capacity", "Burst capacity of token bucket (in bytes)", cxxopts::value<double>()->default_value("16"))
+        ("s,buffer-size", "Buffer size per direction (in bytes)", cxxopts::value<int>()->default_value("512"))
+        ("p,profile", "Traffic profile: constant, stall, burst, sawtooth, hwm", cxxopts::value<std::string>()->default_value("constant"))
+        ("period", "Period of 'stall' and 'sawtooth' profile (in ms)", cxxopts::value<int>()->default_value("1000"))
+        ("stall", "Stall duration of 'stall' and 'hwm' profile (in ms)", cxxopts::value<int>()->default_value("100"))
+        ("h,help", "Show usage");
+    options.positional_help("port-a port-b").show_positional_help();
+
+    try {
+        options.parse_positional({ "port-a", "port-b" });
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") != 0) {
+            std::cout << options.help() << std::endl;
+            return 2;
+        }
+
+        if (result.count("port-a") == 0 || result.count("port-b") == 0)
+            throw cxxopts::OptionParseException("'port-a' and 'port-b' must be specified");
+
+        port_a_spec = result["port-a"].as<std::string>();
+        port_b_spec = result["port-b"].as<std::string>();
+        bit_rate = std::min(std::max(result["bitrate"].as<int>(), 1200), 99999999);
+        rate = result["rate"].as<double>();
+        if (rate <= 0)
+            throw cxxopts::OptionParseException("rate must be positive");
+        capacity = std::max(result["capacity"].as<double>(), 1.0);
+        buffer_size = std::min(std::max(result["buffer-size"].as<int>(), 1), 1048576);
+        if (!parse_traffic_profile(result["profile"].as<std::string>(), profile))
+            throw cxxopts::OptionParseException("invalid profile '" + result["profile"].as<std::string>() + "'");
+        period = milliseconds(std::max(result["period"].as<int>(), 1));
+        stall = milliseconds(std::max(result["stall"].as<int>(), 0));
+
+    }
+    catch (const cxxopts::OptionException& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return 3;
+    }
+
+    return 0;
+}
+
+
+void run_throttler(endpoint& port_a, endpoint& port_b) {
+    channel a_to_b("A to B", port_a, port_b);
+    channel b_to_a("B to A", port_b, port_a);
+
+    printf("Port A: %s\n", port_a.path().c_str());
+    printf("Port B: %s\n", port_b.path().c_str());
+    printf("Throttling to %.0f bytes/s (burst %.0f bytes, buffer %d bytes, profile %s)\n",
+           rate, capacity, buffer_size, profile_name(profile));
+    fflush(stdout);
+
+    auto start_time = steady_clock::now();
+
+    while (!stop_requested) {
+        auto now = steady_clock::now();
+        for (auto ch : { &a_to_b, &b_to_a }) {
+            ch->bucket.refill(now);
+            ch->update_stall(now);
+        }
+
+        struct pollfd fds[2] = {
+            { port_a.fd(), (short)((a_to_b.wants_read() ? POLLIN : 0) | (b_to_a.wants_write() ? POLLOUT : 0)), 0 },
+            { port_b.fd(), (short)((b_to_a.wants_read() ? POLLIN : 0) | (a_to_b.wants_write() ? POLLOUT : 0)), 0 }
+        };
+
+        // wake up when the next token becomes available
+        struct timespec timeout = { 1, 0 };
+        auto timeout_time = now + seconds(1);
+        for (auto ch : { &a_to_b, &b_to_a }) {
+            if (ch->is_waiting_for_tokens())
+                timeout_time = std::min(timeout_time, ch->bucket.next_token_time());
+            if (ch->is_stalled)
+                timeout_time = std::min(timeout_time, ch->stall_end);
+        }
+        auto timeout_ns = std::max(duration_cast<nanoseconds>(timeout_time - now).count(), (int64_t)0);
+        timeout.tv_sec = timeout_ns / 1000000000;
+        timeout.tv_nsec = timeout_ns % 1000000000;
+
+        int n = ppoll(fds, 2, &timeout, nullptr);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            throw serial_error("Failed to wait for serial port events", errno);
+        }
+
+        if ((fds[0].revents & POLLIN) != 0)
+            a_to_b.on_readable();
+        if ((fds[0].revents & POLLOUT) != 0)
+            b_to_a.on_writable();
+        if ((fds[1].revents & POLLIN) != 0)
+            b_to_a.on_readable();
+        if ((fds[1].revents & POLLOUT) != 0)
+            a_to_b.on_writable();
+        if (((fds[0].revents | fds[1].revents) & (POLLERR | POLLHUP)) != 0)
+            throw serial_error("Serial port has been disconnected");
+    }
+
+    double duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count() / 1000.0;
+    printf("\nPassed data in %.1fs:\n", duration);
+    for (auto ch : { &a_to_b, &b_to_a })
+        printf("  %s: %10llu bytes  %10.0f bytes/s\n", ch->name, (unsigned long long)ch->num_bytes, ch->num_bytes / duration);
+}
+
+
+// --- channel
+
+channel::channel(const char* name, endpoint& src, endpoint& dst)
+: name(name), src(src), dst(dst), bucket(rate, capacity), num_bytes(0), is_stalled(false), is_hwm_armed(true) {
+    bucket.set_profile(profile, period, stall);
+}
+
+void channel::update_stall(steady_clock::time_point now) {
+    if (profile != traffic_profile::hwm)
+        return;
+
+    if (is_stalled && now >= stall_end)
+        is_stalled = false;
+
+    if ((int)buf.size() < buffer_size) {
+        is_hwm_armed = true;
+    } else if (is_hwm_armed) {
+        // stall exactly when the buffer becomes full (once per crossing)
+        is_hwm_armed = false;
+        is_stalled = true;
+        stall_end = now + stall;
+    }
+}
+
+void channel::on_readable() {
+    uint8_t chunk[CHUNK_SIZE];
+    int len = std::min({ CHUNK_SIZE, buffer_size - (int)buf.size(), bucket.available() });
+    ssize_t k = read(src.fd(), chunk, len);
+    if (k == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        throw serial_error("Failed to receive data", errno);
+    }
+
+    bucket.consume((int)k);
+    buf.insert(buf.end(), chunk, chunk + k);
+}
+
+void channel::on_writable() {
+    uint8_t chunk[CHUNK_SIZE];
+    int len = std::min(CHUNK_SIZE, (int)buf.size());
+    std::copy(buf.begin(), buf.begin() + len, chunk);
+    ssize_t k = write(dst.fd(), chunk, len);
+    if (k == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
+        throw serial_error("Failed to transmit data", errno);
+    }
+
+    buf.erase(buf.begin(), buf.begin() + k);
+    num_bytes += k;
+}
@@ -0,0 +1,105 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Token bucket limiting the data rate.
+//
+
+#include "token_bucket.hpp"
+#include <algorithm>
+
+using namespace std::chrono;
+
+static const char* const profile_names[] = { "constant", "stall", "burst", "sawtooth", "hwm" };
+
+
+bool parse_traffic_profile(const std::string& name, traffic_profile& profile) {
+    for (size_t i = 0; i < sizeof(profile_names) / sizeof(profile_names[0]); i++) {
+        if (name == profile_names[i]) {
+            profile = (traffic_profile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* profile_name(traffic_profile profile) {
+    return profile_names[(int)profile];
+}
+
+token_bucket::token_bucket(double rate, double capacity, time_point start)
+: rate(rate), capacity(capacity), tokens(0), last_refill(start), start_time(start),
+  profile(traffic_profile::constant), period(seconds(1)), stall(0), is_stalled(false), burst_target(0) { }
+
+void token_bucket::set_profile(traffic_profile profile, milliseconds period, milliseconds stall) {
+    this->profile = profile;
+    this->period = period;
+    this->stall = stall;
+    burst_target = 0;
+}
+
+void token_bucket::refill(time_point now) {
+    double elapsed = (shaped_time(now) - shaped_time(last_refill)) / 1e9;
+    double added = elapsed * rate;
+
+    is_stalled = profile == traffic_profile::stall && (now - start_time) % period < stall;
+
+    tokens = std::min(tokens + added, capacity);
+    last_refill = now;
+}
+
+double token_bucket::shaped_time(time_point t) const {
+    auto since_start = t - start_time;
+    double num_periods = (double)(since_start / period);
+    auto phase = since_start % period;
+
+    switch (profile) {
+    case traffic_profile::stall:
+        // no tokens are added during the stall at the start of each period
+        return num_periods * (period - stall).count() + std::max(phase - stall, nanoseconds(0)).count();
+
+    case traffic_profile::sawtooth:
+        // integral of the rate ramping from 0 to the full rate within each period
+        return num_periods * period.count() / 2
+            + (double)phase.count() * phase.count() / (2.0 * period.count());
+
+    default:
+        return (double)duration_cast<nanoseconds>(since_start).count();
+    }
+}
+
+int token_bucket::available() const {
+    if (is_stalled)
+        return 0;
+    if (profile == traffic_profile::burst && tokens < std::min(burst_target, capacity))
+        return 0;
+    return (int)tokens;
+}
+
+void token_bucket::consume(int n) {
+    tokens -= n;
+    if (profile == traffic_profile::burst)
+        burst_target = std::uniform_int_distribution<int>(1, std::max((int)capacity, 1))(random);
+}
+
+token_bucket::time_point token_bucket::next_token_time() const {
+    if (is_stalled)
+        return last_refill + (stall - (last_refill - start_time) % period);
+
+    double target = 1;
+    if (profile == traffic_profile::burst)
+        target = std::max(std::min(burst_target, capacity), 1.0);
+    if (tokens >= target)
+        return last_refill;
+
+    // for the sawtooth profile, the current rate is used as an estimate (at least 1% of the rate)
+    double current_rate = rate;
+    if (profile == traffic_profile::sawtooth)
+        current_rate *= std::max((double)((last_refill - start_time) % period).count() / period.count(), 0.01);
+    return last_refill + nanoseconds((int64_t)((target - tokens) / current_rate * 1e9) + 1);
+}
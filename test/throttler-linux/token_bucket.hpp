@@ -0,0 +1,124 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Token bucket limiting the data rate.
+//
+
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <string>
+
+/**
+ * Traffic profile shaping the token bucket (same as in throttler firmware).
+ */
+enum class traffic_profile {
+    /// Constant rate
+    constant,
+    /// No tokens for the stall duration at the start of each period
+    stall,
+    /// Tokens are released when a random number of them (up to the capacity) has accumulated
+    burst,
+    /// Rate ramps from 0 to the full rate within each period
+    sawtooth,
+    /// Stall when the buffer reaches the high water mark (handled by the throttler)
+    hwm
+};
+
+/**
+ * Parses the traffic profile name.
+ * @param name profile name
+ * @param profile receives the profile
+ * @return `true` if the name is valid
+ */
+bool parse_traffic_profile(const std::string& name, traffic_profile& profile);
+
+/**
+ * Gets the name of the traffic profile.
+ * @param profile traffic profile
+ * @return name
+ */
+const char* profile_name(traffic_profile profile);
+
+/**
+ * Token bucket.
+ *
+ * Tokens are added at a constant rate up to the bucket capacity, optionally
+ * shaped by a traffic profile. Each byte passed through the throttler
+ * consumes a token. The bucket starts empty (like the throttler firmware).
+ */
+class token_bucket {
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    /**
+     * Creates a new token bucket.
+     * @param rate rate at which tokens are added (in tokens per second)
+     * @param capacity maximum number of tokens (burst size)
+     * @param start start time (start of the first period of the traffic profile)
+     */
+    token_bucket(double rate, double capacity, time_point start = std::chrono::steady_clock::now());
+
+    /**
+     * Sets the traffic profile.
+     * @param profile traffic profile
+     * @param period period of the `stall` and `sawtooth` profile
+     * @param stall stall duration of the `stall` profile
+     */
+    void set_profile(traffic_profile profile, std::chrono::milliseconds period, std::chrono::milliseconds stall);
+
+    /**
+     * Adds the tokens accumulated since the last refill.
+     * @param now current time
+     */
+    void refill(time_point now);
+
+    /**
+     * Gets the number of available tokens.
+     * @return whole tokens
+     */
+    int available() const;
+
+    /**
+     * Consumes tokens.
+     * @param n number of tokens
+     */
+    void consume(int n);
+
+    /**
+     * Gets the time at which at least one token will be available.
+     * @return time
+     */
+    time_point next_token_time() const;
+
+private:
+    /**
+     * Gets the time since the start weighted by the traffic profile's share of the rate.
+     *
+     * The tokens added between two points in time are the difference of their shaped times
+     * multiplied by the rate.
+     *
+     * @param t point in time
+     * @return shaped time (in nanoseconds)
+     */
+    double shaped_time(time_point t) const;
+
+    double rate;
+    double capacity;
+    double tokens;
+    time_point last_refill;
+    time_point start_time;
+    traffic_profile profile;
+    std::chrono::nanoseconds period;
+    std::chrono::nanoseconds stall;
+    bool is_stalled;
+    double burst_target;
+    std::minstd_rand random;
+};
@@ -0,0 +1,286 @@
+//
+//  USB Serial
+//
+// Copyright (c) 2026 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Throttler (for Linux)
+//
+// Tests of the token bucket and its traffic profiles. The bucket is driven with
+// synthetic time points so the tests don't depend on the speed of the machine.
+//
+// Comand line syntax: token-bucket-test [ TEST_NAME... ]
+//
+
+#include "check.hpp"
+#include "token_bucket.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+// Start time of all buckets (arbitrary)
+static const token_bucket::time_point start = token_bucket::time_point(seconds(1000));
+
+// Refills the bucket every millisecond (1 ms to `duration_ms` after the start)
+// and consumes all available tokens (like the throttler, only if tokens are available).
+// Returns the tokens consumed per millisecond.
+static std::vector<int> drain(token_bucket& bucket, int duration_ms)
+{
+    std::vector<int> consumed;
+    for (int ms = 1; ms <= duration_ms; ms++) {
+        bucket.refill(start + milliseconds(ms));
+        int n = bucket.available();
+        if (n > 0)
+            bucket.consume(n);
+        consumed.push_back(n);
+    }
+    return consumed;
+}
+
+// Sum of tokens consumed from index `begin` to `end` (exclusive)
+static int sum(const std::vector<int>& consumed, int begin, int end)
+{
+    int n = 0;
+    for (int i = begin; i < end; i++)
+        n += consumed[i];
+    return n;
+}
+
+
+static void test_initially_empty()
+{
+    token_bucket bucket(1000, 100, start);
+    bucket.refill(start);
+    CHECK_EQ(bucket.available(), 0);
+    CHECK(bucket.next_token_time() == start + milliseconds(1) + nanoseconds(1));
+}
+
+static void test_constant_rate()
+{
+    token_bucket bucket(1000, 100, start);
+
+    bucket.refill(start + milliseconds(10));
+    CHECK_EQ(bucket.available(), 10);
+    CHECK(bucket.next_token_time() == start + milliseconds(10));
+
+    bucket.consume(4);
+    CHECK_EQ(bucket.available(), 6);
+    bucket.consume(6);
+    CHECK_EQ(bucket.available(), 0);
+
+    // fractions of tokens accumulate
+    bucket.refill(start + microseconds(10500));
+    CHECK_EQ(bucket.available(), 0);
+    auto next = bucket.next_token_time();
+    CHECK(next > start + microseconds(10999) && next <= start + microseconds(11001));
+    bucket.refill(next);
+    CHECK_EQ(bucket.available(), 1);
+
+    // frequent refills add up to the rate
+    for (int ms = 12; ms <= 1011; ms++)
+        bucket.refill(start + milliseconds(ms));
+    CHECK_EQ(bucket.available(), 100); // clamped to capacity
+}
+
+static void test_frequent_refills()
+{
+    token_bucket bucket(1000, 1000, start);
+    int consumed = 0;
+    for (int ms = 1; ms <= 500; ms++) {
+        bucket.refill(start + milliseconds(ms));
+        consumed += bucket.available();
+        bucket.consume(bucket.available());
+    }
+    CHECK(consumed >= 499 && consumed <= 500);
+}
+
+static void test_capacity()
+{
+    token_bucket bucket(1000, 16, start);
+
+    bucket.refill(start + seconds(1));
+    CHECK_EQ(bucket.available(), 16);
+
+    // tokens lost while the bucket was full aren't added later
+    bucket.consume(16);
+    bucket.refill(start + seconds(1) + milliseconds(5));
+    CHECK_EQ(bucket.available(), 5);
+
+    // partial consumption
+    bucket.consume(3);
+    bucket.refill(start + seconds(2));
+    CHECK_EQ(bucket.available(), 16);
+}
+
+static void test_profile_names()
+{
+    for (auto profile : { traffic_profile::constant, traffic_profile::stall, traffic_profile::burst,
+            traffic_profile::sawtooth, traffic_profile::hwm }) {
+        traffic_profile parsed;
+        CHECK(parse_traffic_profile(profile_name(profile), parsed));
+        CHECK(parsed == profile);
+    }
+    traffic_profile parsed;
+    CHECK(!parse_traffic_profile("ramp", parsed));
+}
+
+static void test_stall_profile()
+{
+    token_bucket bucket(1000, 1000, start);
+    bucket.set_profile(traffic_profile::stall, milliseconds(100), milliseconds(20));
+
+    // no tokens during the stall, the next token is expected at its end
+    bucket.refill(start + milliseconds(5));
+    CHECK_EQ(bucket.available(), 0);
+    CHECK(bucket.next_token_time() == start + milliseconds(20));
+
+    // no tokens are credited for the stall when it ends (like the firmware)
+    bucket.refill(start + milliseconds(20));
+    CHECK_EQ(bucket.available(), 0);
+
+    // rate applies for the rest of the period, stall repeats in each period
+    auto consumed = drain(bucket, 300);
+    for (int period = 0; period < 3; period++) {
+        test_context = "period " + std::to_string(period);
+        int offset = period * 100;
+        if (period > 0)
+            CHECK_EQ(sum(consumed, offset, offset + 19), 0);
+        CHECK_EQ(sum(consumed, offset + 20, offset + 99), 79);
+    }
+    test_context.clear();
+}
+
+static void test_stall_profile_sleeping()
+{
+    // like the throttler: refill only when the next token is expected
+    token_bucket bucket(1000, 1000, start);
+    bucket.set_profile(traffic_profile::stall, milliseconds(100), milliseconds(20));
+
+    auto now = start;
+    auto end = start + milliseconds(300);
+    int consumed_in_stall = 0;
+    int consumed_after_stall = 0;
+    while (now < end) {
+        bucket.refill(now);
+        int n = bucket.available();
+        if (n > 0) {
+            bucket.consume(n);
+            if ((now - start) % milliseconds(100) <= milliseconds(20))
+                consumed_in_stall += n;
+            else
+                consumed_after_stall += n;
+        }
+        auto next = bucket.next_token_time();
+        CHECK(next > now);
+        now = next;
+    }
+
+    // no tokens until after the stall (not even at its end), 80 tokens per period
+    CHECK_EQ(consumed_in_stall, 0);
+    CHECK(consumed_after_stall >= 239 && consumed_after_stall <= 240);
+}
+
+static void test_burst_profile()
+{
+    token_bucket bucket(1000, 50, start);
+    bucket.set_profile(traffic_profile::burst, milliseconds(1000), milliseconds(0));
+
+    auto consumed = drain(bucket, 2000);
+    int total = 0;
+    int num_bursts = 0;
+    int max_burst = 0;
+    for (int n : consumed) {
+        total += n;
+        if (n > 0)
+            num_bursts += 1;
+        max_burst = std::max(max_burst, n);
+    }
+
+    // tokens are released in bursts of random size, the average rate is kept
+    CHECK(total >= 2000 - 50 && total <= 2000);
+    CHECK(max_burst <= 50);
+    CHECK(max_burst > 25);
+    CHECK(num_bursts < total / 10);
+
+    // while waiting for a burst, the next token time is when the burst is complete
+    token_bucket waiting(1000, 50, start);
+    waiting.set_profile(traffic_profile::burst, milliseconds(1000), milliseconds(0));
+    bool has_waited = false;
+    for (int ms = 1; ms <= 100 && !has_waited; ms++) {
+        auto now = start + milliseconds(ms);
+        waiting.refill(now);
+        if (waiting.available() > 0) {
+            waiting.consume(waiting.available());
+            continue;
+        }
+
+        has_waited = true;
+        auto next = waiting.next_token_time();
+        CHECK(next > now && next <= now + milliseconds(50));
+        waiting.refill(next);
+        CHECK(waiting.available() > 1);
+    }
+    CHECK(has_waited);
+}
+
+static void test_sawtooth_profile()
+{
+    token_bucket bucket(1000, 1000, start);
+    bucket.set_profile(traffic_profile::sawtooth, milliseconds(100), milliseconds(0));
+
+    // rate ramps up within each period: half the tokens on average
+    auto consumed = drain(bucket, 200);
+    for (int period = 0; period < 2; period++) {
+        test_context = "period " + std::to_string(period);
+        int offset = period * 100;
+        int first_half = sum(consumed, offset, offset + 50);
+        int second_half = sum(consumed, offset + 50, offset + 100);
+        CHECK(first_half + second_half >= 48 && first_half + second_half <= 50);
+        CHECK(first_half >= 10 && first_half <= 13);
+        CHECK(second_half >= 36 && second_half <= 38);
+    }
+    test_context.clear();
+
+    // tokens follow the ramp: 1000/s * (15 ms)^2 / (2 * 100 ms) = 1.125 tokens at 15 ms
+    token_bucket early(1000, 1000, start);
+    early.set_profile(traffic_profile::sawtooth, milliseconds(100), milliseconds(0));
+    early.refill(start + milliseconds(10));
+    CHECK_EQ(early.available(), 0);
+    early.refill(start + milliseconds(15));
+    CHECK_EQ(early.available(), 1);
+    early.consume(1);
+
+    // next token time is estimated from the current rate (15% at 15 ms), the ramp is faster
+    auto next = early.next_token_time();
+    CHECK(next > start + milliseconds(20) && next <= start + milliseconds(21));
+    early.refill(next);
+    CHECK_EQ(early.available(), 1);
+}
+
+static void test_hwm_profile()
+{
+    // the stall at the high water mark is handled by the throttler: constant rate
+    token_bucket bucket(1000, 1000, start);
+    bucket.set_profile(traffic_profile::hwm, milliseconds(1000), milliseconds(100));
+
+    auto consumed = drain(bucket, 300);
+    CHECK(sum(consumed, 0, 300) >= 299);
+    CHECK(bucket.next_token_time() <= start + milliseconds(301) + nanoseconds(1));
+}
+
+
+const std::vector<test_case> test_cases = {
+    { "initially_empty", test_initially_empty },
+    { "constant_rate", test_constant_rate },
+    { "frequent_refills", test_frequent_refills },
+    { "capacity", test_capacity },
+    { "profile_names", test_profile_names },
+    { "stall_profile", test_stall_profile },
+    { "stall_profile_sleeping", test_stall_profile_sleeping },
+    { "burst_profile", test_burst_profile },
+    { "sawtooth_profile", test_sawtooth_profile },
+    { "hwm_profile", test_hwm_profile },
+};
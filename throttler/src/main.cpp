@@ -1,58 +1,143 @@
 /*
  * USB Serial - Throttler firmware
- * 
+ *
  * Copyright (c) 2020 Manuel Bleichenbacher
  * Licensed under MIT License
  * https://opensource.org/licenses/MIT
- * 
+ *
  * Test fixture for testing hardware flow control (CTS/RTS).
- * 
- * This firmware passes data received on UART1 RX to UART2 TX and vice versa 
- * (UART2 RX to UART1 TX). At the interface, it works with 115,200 bps.
- * Internally, it throttles the speed to 2 bytes/ms (about about 20,000 bps).
+ *
+ * This firmware passes data received on UART1 RX to UART2 TX and vice versa
+ * (UART2 RX to UART1 TX). Received data is written to a circular buffer by DMA.
+ * The data is transmitted in chunks by DMA, paced by a timer implementing a
+ * token bucket (by default 2,000 bytes/s with a burst of 16 bytes).
+ * RTS is deasserted if the buffer reaches the high water mark.
+ *
+ * The token bucket can be shaped by a traffic profile:
+ *
+ *     constant             constant rate
+ *     stall                periodic stalls (no transmission for <stall> ms every <period> ms)
+ *     burst                random bursts (transmission starts when a random number of tokens is available)
+ *     sawtooth             rate ramps from 0 to <rate> within <period> ms
+ *     hwm                  stall for <stall> ms as soon as the buffer reaches the high water mark
+ *
+ * The interface speed (default 115,200 bps), the rate, the burst size, the
+ * profile and the high water margin can be changed at runtime using commands
+ * on UART3 (115,200 bps):
+ *
+ *     baud <bps>           sets the bit rate of UART1 and UART2
+ *     rate <bytes/s>       sets the throttled rate (of each direction)
+ *     burst <bytes>        sets the burst size
+ *     profile <name>       sets the traffic profile
+ *     period <ms>          sets the period of the "stall" and "sawtooth" profiles
+ *     stall <ms>           sets the stall duration of the "stall" and "hwm" profiles
+ *     margin <bytes>       sets the margin between high water mark and buffer size (0 = 2ms of data)
+ *     status               shows the current settings and the maximum buffer fill level
+ *                          since the last status command
+ *
+ * Each command is terminated with CR or LF. The firmware replies with
+ * "OK" or "ERR" (after the settings for "status").
  */
 
 #include <libopencmsis/core_cm3.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/usart.h>
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 
-#define BUF_SIZE 512
-#define MAX_CAPACITY 16
-#define SPEED 2 // bytes per ms
+#define BUF_SIZE 4096
+#define TICK_FREQ 10000 // timer ticks per second
+#define RX_HIGH_WATER_MARGIN_MS 2
+#define RX_HIGH_WATER_MIN_MARGIN 32
+#define MIN_BAUDRATE 1200
+#define MAX_BAUDRATE 2250000 // limit of USART2 (APB1 clock / 16)
+#define MAX_RATE 1000000 // bytes per s
+#define MAX_PERIOD 60000 // ms
+#define CMD_BAUDRATE 115200
+#define CMD_LINE_LEN 32
+#define CMD_OUT_LEN 256
 
-static volatile bool tick_occurred;
+enum class traffic_profile
+{
+	constant,
+	stall,
+	burst,
+	sawtooth,
+	hwm
+};
 
-static int32_t capacity_ch_a;
-static int32_t capacity_ch_b;
+static const char *const profile_names[] = { "constant", "stall", "burst", "sawtooth", "hwm" };
 
-static int32_t size_ch_a;
-static int32_t head_ch_a;
-static int32_t tail_ch_a;
-static int32_t size_ch_b;
-static int32_t head_ch_b;
-static int32_t tail_ch_b;
+/**
+ * Single direction of the throttler.
+ *
+ * The RX DMA writes to the circular buffer (head) and the TX DMA reads
+ * from the same buffer (tail). No data is copied.
+ */
+struct channel
+{
+	uint32_t rx_usart;
+	uint8_t rx_dma_chan;
+	uint32_t tx_usart;
+	uint8_t tx_dma_chan;
+	uint32_t rts_port;
+	uint16_t rts_pin;
 
-uint8_t buffer_ch_a[BUF_SIZE];
-uint8_t buffer_ch_b[BUF_SIZE];
+	// modified by timer interrupt only
+	volatile int tail;
+	int tx_size;
+	bool is_transmitting;
+	uint32_t tokens; // in units of 1 / TICK_FREQ bytes
+	uint32_t burst_target; // tokens required to start transmission ("burst" profile)
+	uint32_t stall_end; // tick at which current stall ends ("hwm" profile)
+	bool is_stalled; // "hwm" profile
+	bool is_hwm_armed; // "hwm" profile
 
-extern "C" void sys_tick_handler()
-{
-	tick_occurred = true;
-}
+	// modified by main loop only
+	volatile int max_fill;
+
+	uint8_t buffer[BUF_SIZE];
+};
+
+// Channel A: USART 1 to USART 2
+static channel ch_a = { USART1, DMA_CHANNEL5, USART2, DMA_CHANNEL7, GPIOA, GPIO12, 0, 0, false, 0, 0, 0, false, false, 0, { } };
+// Channel B: USART 2 to USART 1
+static channel ch_b = { USART2, DMA_CHANNEL6, USART1, DMA_CHANNEL4, GPIOA, GPIO1, 0, 0, false, 0, 0, 0, false, false, 0, { } };
+
+static volatile uint32_t baudrate = 115200;
+static volatile uint32_t rate = 2000; // bytes per s
+static volatile uint32_t burst = 16; // bytes
+static volatile traffic_profile profile = traffic_profile::constant;
+static volatile uint32_t period = 1000; // ms
+static volatile uint32_t stall = 100; // ms
+static uint32_t rx_high_water_margin; // bytes (0 = automatic)
+static volatile int rx_high_water_mark;
+
+static uint32_t tick_count;
+static uint32_t random_state = 0x12345678;
+
+static char cmd_line[CMD_LINE_LEN];
+static int cmd_line_len;
+static char cmd_out[CMD_OUT_LEN];
+static int cmd_out_head;
+static int cmd_out_tail;
 
 static void clock_setup()
 {
 	rcc_clock_setup_in_hse_8mhz_out_72mhz();
+	rcc_periph_clock_enable(RCC_DMA1);
 
-	// Interrupt every 1ms
-	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB_DIV8);
-	systick_set_reload(rcc_ahb_frequency / 8 / 1000 - 1);
-
-	// Enable and start
-	systick_interrupt_enable();
-	systick_counter_enable();
+	// Timer interrupt with TICK_FREQ (timer clock is 72 MHz)
+	rcc_periph_clock_enable(RCC_TIM2);
+	rcc_periph_reset_pulse(RST_TIM2);
+	timer_set_prescaler(TIM2, rcc_apb1_frequency * 2 / 1000000 - 1);
+	timer_set_period(TIM2, 1000000 / TICK_FREQ - 1);
+	timer_enable_irq(TIM2, TIM_DIER_UIE);
 }
 
 static void uart_setup()
@@ -60,9 +145,11 @@ static void uart_setup()
 	// Enable USART interface clock
 	rcc_periph_clock_enable(RCC_USART1);
 	rcc_periph_clock_enable(RCC_USART2);
+	rcc_periph_clock_enable(RCC_USART3);
 
 	// Enable pin clock
 	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_GPIOB);
 
 	// Enable AFIO clock for remapping
 	rcc_periph_clock_enable(RCC_AFIO);
@@ -70,104 +157,430 @@ static void uart_setup()
 	// Remap CAN1 (conflict with USART1 RTS, see errata)
 	AFIO_MAPR |= AFIO_MAPR_CAN1_REMAP_PORTB;
 
-	// Configure pins for USART1
+	// Configure pins for USART1 (RTS is controlled by software as RX uses DMA)
 	gpio_set(GPIOA, GPIO9);
 	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO9); // TX
 	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO10);				  // RX
-	gpio_clear(GPIOA, GPIO12);
-	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO12); // RTS
-	gpio_clear(GPIOA, GPIO11);															   // CTS pull down
-	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, GPIO11);			   // CTS
-
-	// Configure USART1
-	usart_set_baudrate(USART1, 115200);
-	usart_set_databits(USART1, 8);
-	usart_set_stopbits(USART1, USART_STOPBITS_1);
-	usart_set_parity(USART1, USART_PARITY_NONE);
-	usart_set_mode(USART1, USART_MODE_TX_RX);
-	usart_set_flow_control(USART1, USART_FLOWCONTROL_RTS_CTS);
-	usart_enable(USART1);
-
-	// Configure pins for USART2
+	gpio_set(GPIOA, GPIO12);
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);	  // RTS
+	gpio_clear(GPIOA, GPIO11);															  // CTS pull down
+	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, GPIO11);			  // CTS
+
+	// Configure pins for USART2 (RTS is controlled by software as RX uses DMA)
 	gpio_set(GPIOA, GPIO2);
 	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO2); // TX
 	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO3);					  // RX
-	gpio_clear(GPIOA, GPIO1);
-	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO1); // RTS
+	gpio_set(GPIOA, GPIO1);
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, GPIO1);		  // RTS
 	gpio_clear(GPIOA, GPIO0);															  // CTS pull down
 	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, GPIO0);			  // CTS
 
-	// Configure USART2
-	usart_set_baudrate(USART2, 115200);
-	usart_set_databits(USART2, 8);
-	usart_set_stopbits(USART2, USART_STOPBITS_1);
-	usart_set_parity(USART2, USART_PARITY_NONE);
-	usart_set_mode(USART2, USART_MODE_TX_RX);
-	usart_set_flow_control(USART2, USART_FLOWCONTROL_RTS_CTS);
-	usart_enable(USART2);
+	// Configure USART1 and USART2
+	for (uint32_t usart : { USART1, USART2 })
+	{
+		usart_set_databits(usart, 8);
+		usart_set_stopbits(usart, USART_STOPBITS_1);
+		usart_set_parity(usart, USART_PARITY_NONE);
+		usart_set_mode(usart, USART_MODE_TX_RX);
+		usart_set_flow_control(usart, USART_FLOWCONTROL_CTS);
+		usart_enable_rx_dma(usart);
+		usart_enable_tx_dma(usart);
+		usart_enable(usart);
+	}
+
+	// Configure pins for USART3 (command interface, no flow control)
+	gpio_set(GPIOB, GPIO10);
+	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO10); // TX
+	gpio_set_mode(GPIOB, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO11);				   // RX
+
+	// Configure USART3
+	usart_set_baudrate(USART3, CMD_BAUDRATE);
+	usart_set_databits(USART3, 8);
+	usart_set_stopbits(USART3, USART_STOPBITS_1);
+	usart_set_parity(USART3, USART_PARITY_NONE);
+	usart_set_mode(USART3, USART_MODE_TX_RX);
+	usart_set_flow_control(USART3, USART_FLOWCONTROL_NONE);
+	usart_enable(USART3);
 }
 
-int main()
+static void channel_start(channel &ch)
 {
-	clock_setup();
-	uart_setup();
+	ch.tail = 0;
+	ch.tx_size = 0;
+	ch.is_transmitting = false;
+	ch.tokens = 0;
+	ch.burst_target = 0;
+	ch.is_stalled = false;
+	ch.is_hwm_armed = true;
+	ch.max_fill = 0;
 
-	while (1)
+	// configure TX DMA
+	dma_channel_reset(DMA1, ch.tx_dma_chan);
+	dma_set_peripheral_address(DMA1, ch.tx_dma_chan, (uint32_t)(uintptr_t)&USART_DR(ch.tx_usart));
+	dma_set_read_from_memory(DMA1, ch.tx_dma_chan);
+	dma_enable_memory_increment_mode(DMA1, ch.tx_dma_chan);
+	dma_set_memory_size(DMA1, ch.tx_dma_chan, DMA_CCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, ch.tx_dma_chan, DMA_CCR_PSIZE_8BIT);
+	dma_set_priority(DMA1, ch.tx_dma_chan, DMA_CCR_PL_MEDIUM);
+
+	// configure RX DMA (as circular buffer)
+	dma_channel_reset(DMA1, ch.rx_dma_chan);
+	dma_set_peripheral_address(DMA1, ch.rx_dma_chan, (uint32_t)(uintptr_t)&USART_DR(ch.rx_usart));
+	dma_set_read_from_peripheral(DMA1, ch.rx_dma_chan);
+	dma_enable_memory_increment_mode(DMA1, ch.rx_dma_chan);
+	dma_enable_circular_mode(DMA1, ch.rx_dma_chan);
+	dma_set_memory_size(DMA1, ch.rx_dma_chan, DMA_CCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, ch.rx_dma_chan, DMA_CCR_PSIZE_8BIT);
+	dma_set_priority(DMA1, ch.rx_dma_chan, DMA_CCR_PL_HIGH);
+	dma_set_memory_address(DMA1, ch.rx_dma_chan, (uint32_t)(uintptr_t)ch.buffer);
+	dma_set_number_of_data(DMA1, ch.rx_dma_chan, BUF_SIZE);
+	dma_enable_channel(DMA1, ch.rx_dma_chan);
+
+	// ready to receive
+	gpio_clear(ch.rts_port, ch.rts_pin);
+}
+
+static void channel_stop(channel &ch)
+{
+	gpio_set(ch.rts_port, ch.rts_pin);
+	dma_disable_channel(DMA1, ch.rx_dma_chan);
+	dma_disable_channel(DMA1, ch.tx_dma_chan);
+}
+
+static int channel_head(channel &ch)
+{
+	int head = BUF_SIZE - dma_get_number_of_data(DMA1, ch.rx_dma_chan);
+	if (head == BUF_SIZE)
+		head = 0;
+	return head;
+}
+
+static int channel_fill(channel &ch)
+{
+	int len = channel_head(ch) - ch.tail;
+	if (len < 0)
+		len += BUF_SIZE;
+	return len;
+}
+
+static void update_rts(channel &ch)
+{
+	int len = channel_fill(ch);
+	if (len > ch.max_fill)
+		ch.max_fill = len;
+
+	// RTS is active low
+	if (len < rx_high_water_mark)
+		gpio_clear(ch.rts_port, ch.rts_pin);
+	else
+		gpio_set(ch.rts_port, ch.rts_pin);
+}
+
+static uint32_t next_random()
+{
+	// xorshift32
+	uint32_t x = random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	random_state = x;
+	return x;
+}
+
+// Refills the token bucket according to the traffic profile.
+// Returns false if the channel is stalled.
+static bool refill_tokens(channel &ch)
+{
+	uint32_t ticks_per_period = period * (TICK_FREQ / 1000);
+	uint32_t stall_ticks = stall * (TICK_FREQ / 1000);
+	uint32_t added = rate;
+
+	switch (profile)
 	{
-		// --- Channel A: USART 1 to USART 2 ---
+	case traffic_profile::stall:
+		if (tick_count % ticks_per_period < stall_ticks)
+			return false;
+		break;
+
+	case traffic_profile::sawtooth:
+		added = (uint32_t)((uint64_t)rate * (tick_count % ticks_per_period) / ticks_per_period);
+		break;
 
-		if (size_ch_a > 0 && (USART_SR(USART2) & USART_SR_TXE) != 0)
+	case traffic_profile::hwm:
+		if (ch.is_stalled)
 		{
-			// send byte
-			USART_DR(USART2) = buffer_ch_a[tail_ch_a];
-			tail_ch_a++;
-			if (tail_ch_a >= BUF_SIZE)
-				tail_ch_a = 0;
-			size_ch_a--;
+			if ((int32_t)(tick_count - ch.stall_end) < 0)
+				return false;
+			ch.is_stalled = false;
 		}
-
-		if (capacity_ch_a > 0 && size_ch_a < BUF_SIZE && (USART_SR(USART1) & USART_SR_RXNE) != 0)
+		if (channel_fill(ch) < rx_high_water_mark)
 		{
-			// receive byte
-			capacity_ch_a--;
-			buffer_ch_a[head_ch_a] = (uint8_t)USART_DR(USART1);
-			head_ch_a++;
-			if (head_ch_a >= BUF_SIZE)
-				head_ch_a = 0;
-			size_ch_a++;
+			ch.is_hwm_armed = true;
 		}
-
-		// --- Channel B: USART 2 to USART 1 ---
-
-		if (size_ch_b > 0 && (USART_SR(USART1) & USART_SR_TXE) != 0)
+		else if (ch.is_hwm_armed)
 		{
-			// send byte
-			USART_DR(USART1) = buffer_ch_b[tail_ch_b];
-			tail_ch_b++;
-			if (tail_ch_b >= BUF_SIZE)
-				tail_ch_b = 0;
-			size_ch_b--;
+			// stall exactly when the high water mark is reached (once per crossing)
+			ch.is_hwm_armed = false;
+			ch.is_stalled = true;
+			ch.stall_end = tick_count + stall_ticks;
+			return false;
 		}
+		break;
+
+	default:
+		break;
+	}
+
+	ch.tokens = std::min(ch.tokens + added, burst * TICK_FREQ);
+	return true;
+}
+
+// Called on each timer tick: refill token bucket and transmit next chunk
+static void pace_transmission(channel &ch)
+{
+	if (ch.is_transmitting && dma_get_interrupt_flag(DMA1, ch.tx_dma_chan, DMA_TCIF | DMA_TEIF))
+	{
+		dma_clear_interrupt_flags(DMA1, ch.tx_dma_chan, DMA_TCIF | DMA_TEIF);
+		dma_disable_channel(DMA1, ch.tx_dma_chan);
+
+		int tail = ch.tail + ch.tx_size;
+		if (tail >= BUF_SIZE)
+			tail = 0;
+		ch.tail = tail;
+		ch.is_transmitting = false;
+	}
+
+	if (!refill_tokens(ch) || ch.is_transmitting)
+		return;
+
+	if (profile == traffic_profile::burst && ch.tokens < std::min(ch.burst_target, burst * TICK_FREQ))
+		return;
+
+	// Determine TX chunk size (limited by available tokens)
+	int head = channel_head(ch);
+	int end = head >= ch.tail ? head : BUF_SIZE;
+	int size = std::min(end - ch.tail, (int)(ch.tokens / TICK_FREQ));
+	if (size == 0)
+		return;
+
+	ch.tokens -= size * TICK_FREQ;
+	if (profile == traffic_profile::burst)
+		ch.burst_target = (next_random() % burst + 1) * TICK_FREQ;
+	ch.tx_size = size;
+	ch.is_transmitting = true;
+
+	dma_set_memory_address(DMA1, ch.tx_dma_chan, (uint32_t)(uintptr_t)(ch.buffer + ch.tail));
+	dma_set_number_of_data(DMA1, ch.tx_dma_chan, size);
+	dma_enable_channel(DMA1, ch.tx_dma_chan);
+}
+
+extern "C" void tim2_isr()
+{
+	timer_clear_flag(TIM2, TIM_SR_UIF);
+	tick_count++;
+	pace_transmission(ch_a);
+	pace_transmission(ch_b);
+}
+
+static void update_high_water_mark()
+{
+	// By default, high water mark is buffer size - 2ms worth of data (10 bits per byte)
+	int margin = rx_high_water_margin;
+	if (margin == 0)
+		margin = std::max((int)(baudrate * RX_HIGH_WATER_MARGIN_MS / 10000), RX_HIGH_WATER_MIN_MARGIN);
+	rx_high_water_mark = BUF_SIZE - margin;
+}
+
+static void set_baudrate(uint32_t baud)
+{
+	// stop both channels (data in transit is discarded)
+	nvic_disable_irq(NVIC_TIM2_IRQ);
+	timer_disable_counter(TIM2);
+	channel_stop(ch_a);
+	channel_stop(ch_b);
+
+	baudrate = baud;
+	for (uint32_t usart : { USART1, USART2 })
+	{
+		usart_disable(usart);
+		usart_set_baudrate(usart, baud);
+		usart_enable(usart);
+	}
+
+	update_high_water_mark();
+
+	channel_start(ch_a);
+	channel_start(ch_b);
+	timer_set_counter(TIM2, 0);
+	timer_enable_counter(TIM2);
+	nvic_enable_irq(NVIC_TIM2_IRQ);
+}
+
+// --- Command interface
+
+static void cmd_write(const char *str)
+{
+	for (; *str != 0; str++)
+	{
+		int head = (cmd_out_head + 1) % CMD_OUT_LEN;
+		if (head == cmd_out_tail)
+			return; // buffer full - discard output
+		cmd_out[cmd_out_head] = *str;
+		cmd_out_head = head;
+	}
+}
+
+static void cmd_write_setting(const char *name, uint32_t value)
+{
+	char digits[12];
+	int p = sizeof(digits) - 1;
+	digits[p] = 0;
+	do
+	{
+		p--;
+		digits[p] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+
+	cmd_write(name);
+	cmd_write(" ");
+	cmd_write(digits + p);
+	cmd_write("\r\n");
+}
 
-		if (capacity_ch_b > 0 && size_ch_b < BUF_SIZE && (USART_SR(USART2) & USART_SR_RXNE) != 0)
+static bool parse_value(const char *arg, uint32_t min_value, uint32_t max_value, uint32_t *value)
+{
+	if (arg == nullptr || *arg == 0)
+		return false;
+	char *end;
+	unsigned long v = strtoul(arg, &end, 10);
+	if (*end != 0 || v < min_value || v > max_value)
+		return false;
+	*value = v;
+	return true;
+}
+
+static bool parse_profile(const char *arg, uint32_t *value)
+{
+	if (arg == nullptr)
+		return false;
+	for (uint32_t i = 0; i < sizeof(profile_names) / sizeof(profile_names[0]); i++)
+	{
+		if (strcmp(arg, profile_names[i]) == 0)
 		{
-			// receive byte
-			capacity_ch_b--;
-			buffer_ch_b[head_ch_b] = (uint8_t)USART_DR(USART2);
-			head_ch_b++;
-			if (head_ch_b >= BUF_SIZE)
-				head_ch_b = 0;
-			size_ch_b++;
+			*value = i;
+			return true;
 		}
+	}
+	return false;
+}
+
+static void execute_command(char *line)
+{
+	char *arg = strchr(line, ' ');
+	if (arg != nullptr)
+		*arg++ = 0;
+
+	uint32_t value;
+	bool ok = true;
+
+	if (strcmp(line, "baud") == 0 && parse_value(arg, MIN_BAUDRATE, MAX_BAUDRATE, &value))
+	{
+		set_baudrate(value);
+	}
+	else if (strcmp(line, "rate") == 0 && parse_value(arg, 1, MAX_RATE, &value))
+	{
+		rate = value;
+	}
+	else if (strcmp(line, "burst") == 0 && parse_value(arg, 1, BUF_SIZE, &value))
+	{
+		burst = value;
+	}
+	else if (strcmp(line, "profile") == 0 && parse_profile(arg, &value))
+	{
+		profile = (traffic_profile)value;
+	}
+	else if (strcmp(line, "period") == 0 && parse_value(arg, 1, MAX_PERIOD, &value))
+	{
+		period = value;
+	}
+	else if (strcmp(line, "stall") == 0 && parse_value(arg, 0, MAX_PERIOD, &value))
+	{
+		stall = value;
+	}
+	else if (strcmp(line, "margin") == 0 && parse_value(arg, 0, BUF_SIZE - 1, &value))
+	{
+		rx_high_water_margin = value;
+		update_high_water_mark();
+	}
+	else if (strcmp(line, "status") == 0 && arg == nullptr)
+	{
+		cmd_write_setting("baud", baudrate);
+		cmd_write_setting("rate", rate);
+		cmd_write_setting("burst", burst);
+		cmd_write("profile ");
+		cmd_write(profile_names[(int)profile]);
+		cmd_write("\r\n");
+		cmd_write_setting("period", period);
+		cmd_write_setting("stall", stall);
+		cmd_write_setting("hwm", rx_high_water_mark);
+		cmd_write_setting("max_fill_a", ch_a.max_fill);
+		cmd_write_setting("max_fill_b", ch_b.max_fill);
+		ch_a.max_fill = 0;
+		ch_b.max_fill = 0;
+	}
+	else
+	{
+		ok = false;
+	}
+
+	cmd_write(ok ? "OK\r\n" : "ERR\r\n");
+}
+
+static void poll_command()
+{
+	// transmit pending output
+	if (cmd_out_tail != cmd_out_head && (USART_SR(USART3) & USART_SR_TXE) != 0)
+	{
+		USART_DR(USART3) = cmd_out[cmd_out_tail];
+		cmd_out_tail = (cmd_out_tail + 1) % CMD_OUT_LEN;
+	}
 
-		// Increase capacity on each systick
+	if ((USART_SR(USART3) & USART_SR_RXNE) == 0)
+		return;
 
-		if (tick_occurred)
+	char c = (char)USART_DR(USART3);
+	if (c == '\r' || c == '\n')
+	{
+		if (cmd_line_len > 0 && cmd_line_len < CMD_LINE_LEN)
+		{
+			cmd_line[cmd_line_len] = 0;
+			execute_command(cmd_line);
+		}
+		else if (cmd_line_len > 0)
 		{
-			capacity_ch_a = std::min(capacity_ch_a + SPEED, (int32_t)MAX_CAPACITY);
-			capacity_ch_b = std::min(capacity_ch_b + SPEED, (int32_t)MAX_CAPACITY);
-			tick_occurred = false;
+			cmd_write("ERR\r\n"); // line too long
 		}
+		cmd_line_len = 0;
+	}
+	else if (cmd_line_len < CMD_LINE_LEN)
+	{
+		cmd_line[cmd_line_len] = c;
+		cmd_line_len++;
+	}
+}
+
+int main()
+{
+	clock_setup();
+	uart_setup();
+	set_baudrate(baudrate);
+
+	while (1)
+	{
+		update_rts(ch_a);
+		update_rts(ch_b);
+		poll_command();
 	}
 
 	return 0;